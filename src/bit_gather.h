@@ -0,0 +1,93 @@
+#ifndef BIT_GATHER_H_
+#define BIT_GATHER_H_
+
+#include <stdint.h>
+#if defined(__BMI2__) && !defined(BIT_GATHER_LUT)
+#include <immintrin.h>
+#endif
+
+/* Gathers the bits of a word selected by a fixed mask into the low bits of the
+ * result, in order (extract, x86 PEXT), and scatters low bits back to the mask
+ * positions (deposit, PDEP). The mask is compiled once: with BMI2 both are
+ * single instructions, otherwise (or with BIT_GATHER_LUT defined) lookups in
+ * per-byte tables, one per non-zero byte of the mask.
+ */
+class BitGather {
+    private:
+        uint64_t _mask;
+        uint32_t _width;            // bits in the mask
+        uint32_t _num_bytes;        // non-zero bytes of the mask
+        uint8_t _byte[8];           // their positions, low to high
+        uint8_t _shift[8];          // mask bits below each of them
+        uint8_t _extract[8][256];   // byte value -> its mask bits, packed
+        uint8_t _deposit[8][256];   // packed bits -> byte value
+
+    public:
+        BitGather() { init(0); }
+        explicit BitGather(uint64_t mask) { init(mask); }
+
+        void init(uint64_t mask) {
+            _mask = mask;
+            _width = __builtin_popcountl(mask);
+            _num_bytes = 0;
+            uint32_t shift = 0;
+            for (uint32_t b = 0; b < 8; b++) {
+                uint32_t m = (mask >> (8 * b)) & 0xff;
+                if (!m) continue;
+                uint32_t i = _num_bytes++;
+                _byte[i] = b;
+                _shift[i] = shift;
+                for (uint32_t v = 0; v < 256; v++) {
+                    uint32_t packed = 0, spread = 0, pos = 0;
+                    for (uint32_t bit = 0; bit < 8; bit++) {
+                        if (!(m & (1 << bit))) continue;
+                        packed |= ((v >> bit) & 1) << pos;  // v as a byte of the word
+                        spread |= ((v >> pos) & 1) << bit;  // v as packed bits
+                        pos++;
+                    }
+                    _extract[i][v] = packed;
+                    _deposit[i][v] = spread;
+                }
+                shift += __builtin_popcount(m);
+            }
+        }
+
+        uint64_t mask() const { return _mask; }
+        uint32_t width() const { return _width; }
+
+        inline uint64_t extract(uint64_t x) const {
+#if defined(__BMI2__) && !defined(BIT_GATHER_LUT)
+            return _pext_u64(x, _mask);
+#else
+            return extractLUT(x);
+#endif
+        }
+
+        inline uint64_t deposit(uint64_t x) const {
+#if defined(__BMI2__) && !defined(BIT_GATHER_LUT)
+            return _pdep_u64(x, _mask);
+#else
+            return depositLUT(x);
+#endif
+        }
+
+        // Table versions, always available (e.g., to compare against BMI2)
+        inline uint64_t extractLUT(uint64_t x) const {
+            uint64_t res = 0;
+            for (uint32_t i = 0; i < _num_bytes; i++) {
+                res |= (uint64_t)_extract[i][(x >> (8 * _byte[i])) & 0xff] << _shift[i];
+            }
+            return res;
+        }
+
+        inline uint64_t depositLUT(uint64_t x) const {
+            uint64_t res = 0;
+            for (uint32_t i = 0; i < _num_bytes; i++) {
+                // Entries ignore the index bits past this byte's width (they belong to later bytes)
+                res |= (uint64_t)_deposit[i][(x >> _shift[i]) & 0xff] << (8 * _byte[i]);
+            }
+            return res;
+        }
+};
+
+#endif  // BIT_GATHER_H_
@@ -6,8 +6,8 @@ uint64_t AlloyCacheScheme::access(MemReq& req) {
     ReqType type = (req.type == GETS || req.type == GETX) ? LOAD : STORE;
 	// // Address address = req.lineAddr % (_ext_size / 64);
     Address address = req.lineAddr;
-	uint32_t mcdram_select = (address / 64) % _mc->_mcdram_per_mc;
-	Address mc_address = (address / 64 / _mc->_mcdram_per_mc * 64) | (address % 64); 
+	uint32_t mcdram_select = (address / 64) % _mcdram_per_mc;
+	Address mc_address = (address / 64 / _mcdram_per_mc * 64) | (address % 64); 
 	Address tag = address / (_granularity / 64);
     uint64_t set_num = tag % _num_sets;
     uint32_t hit_way = _num_ways;
@@ -15,18 +15,15 @@ uint64_t AlloyCacheScheme::access(MemReq& req) {
     MESIState state;
     bool counter_access = false;
 
-    _accessed_ext_lines_set.insert(address);
-    _accessed_ext_lines = _accessed_ext_lines_set.size();
-    _accessed_ext_pages_set.insert(address / (_page_size / 64));
-    _accessed_ext_pages = _accessed_ext_pages_set.size();
+    recordExtAccess(address);
 
     // info("access: address = %ld, mc_address = %ld, tag = %ld, set_num = %ld", address, mc_address, tag, set_num);
     // Check for hit
-    if (_cache[set_num].ways[0].valid &&
-        _cache[set_num].ways[0].tag == tag &&
+    if (_cache[set_num].isValid(0) &&
+        _cache[set_num].getTag(0) == tag &&
         set_num >= _ds_index) {
         hit_way = 0;
-        // info("!!!!!hit:  _cache[set_num].ways[0].tag = %ld",  _cache[set_num].ways[0].tag);
+        // info("!!!!!hit:  _cache[set_num].getTag(0) = %ld",  _cache[set_num].getTag(0));
     }
 
     // N.B. Banshee's code, but not considering the tag access for store
@@ -35,9 +32,9 @@ uint64_t AlloyCacheScheme::access(MemReq& req) {
             req.cycle += _llc_latency;
         } else {
             req.lineAddr = mc_address;
-            req.cycle = _mc->_mcdram[mcdram_select]->access(req, 0, 6);
-            _mc_bw_per_step += 6;
-            _numTagLoad.inc();
+            req.cycle = _mcdram[mcdram_select]->access(req, 0, 6);
+            _mc_bw_per_step.inc(req.srcId, 6);
+            _numTagLoad.inc(req.srcId);
             req.lineAddr = address;
         }
     } */
@@ -47,9 +44,9 @@ uint64_t AlloyCacheScheme::access(MemReq& req) {
             req.cycle += _llc_latency;
         } else {
             req.lineAddr = mc_address;
-            req.cycle = _mc->_mcdram[mcdram_select]->access(req, 0, 6);
-            _mc_bw_per_step += 6;
-            _numTagLoad.inc();
+            req.cycle = _mcdram[mcdram_select]->access(req, 0, 6);
+            _mc_bw_per_step.inc(req.srcId, 6);
+            _numTagLoad.inc(req.srcId);
             req.lineAddr = address;
         }
     }
@@ -57,179 +54,119 @@ uint64_t AlloyCacheScheme::access(MemReq& req) {
     if (hit_way != _num_ways) {
         // Cache hit
         updateUtilizationStats(set_num, hit_way);
-        _num_hit_per_step++;
+        _num_hit_per_step.inc(req.srcId);
         if (type == LOAD && _sram_tag) {
             MemReq read_req = {mc_address, GETX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-            req.cycle = _mc->_mcdram[mcdram_select]->access(read_req, 0, 4);
-            _mc_bw_per_step += 4;
+            req.cycle = _mcdram[mcdram_select]->access(read_req, 0, 4);
+            _mc_bw_per_step.inc(req.srcId, 4);
         }
         if (type == STORE) {
             MemReq write_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-            req.cycle = _mc->_mcdram[mcdram_select]->access(write_req, 1, 4);
-            _mc_bw_per_step += 4;
-            _cache[set_num].ways[hit_way].dirty = true;
-            _numStoreHit.inc();
+            req.cycle = _mcdram[mcdram_select]->access(write_req, 1, 4);
+            _mc_bw_per_step.inc(req.srcId, 4);
+            _cache[set_num].setDirty(hit_way);
+            _numStoreHit.inc(req.srcId);
         } else {
-            _numLoadHit.inc();
+            _numLoadHit.inc(req.srcId);
         }
         data_ready_cycle = req.cycle;
     } else {
         // Cache miss
-        _num_miss_per_step++;
+        _num_miss_per_step.inc(req.srcId);
         if (type == LOAD)
-            _numLoadMiss.inc();
+            _numLoadMiss.inc(req.srcId);
         else
-            _numStoreMiss.inc();
+            _numStoreMiss.inc(req.srcId);
 
         // Handle placement
         uint32_t replace_way = _num_ways;
         bool place = false;
         if (set_num >= _ds_index) {
-            place = _line_placement_policy->handleCacheMiss(&_cache[set_num].ways[0]);
+            place = _line_placement_policy->handleCacheMiss(_cache[set_num].isValid(0));
         }
         replace_way = place ? 0 : 1;
 
         // Handle data access
         if (type == LOAD) {
             if (!_sram_tag && set_num >= _ds_index) {
-                req.cycle = _mc->_ext_dram->access(req, 1, 4);
+                req.cycle = _ext_dram->access(req, 1, 4);
             } else {
-                req.cycle = _mc->_ext_dram->access(req, 0, 4);
+                req.cycle = _ext_dram->access(req, 0, 4);
             }
-            _ext_bw_per_step += 4;
+            _ext_bw_per_step.inc(req.srcId, 4);
         } else if (type == STORE && replace_way >= _num_ways) {
-            req.cycle = _mc->_ext_dram->access(req, 0, 4);
-            _ext_bw_per_step += 4;
+            req.cycle = _ext_dram->access(req, 0, 4);
+            _ext_bw_per_step.inc(req.srcId, 4);
         } else if (type == STORE) {
             // N.B. Banshee's code, but we don't need to load data from the external DRAM for store with cacheline granularity
             /* MemReq load_req = {address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-            req.cycle = _mc->_ext_dram->access(load_req, 0, 4);
-            _ext_bw_per_step += 4; */
+            req.cycle = _ext_dram->access(load_req, 0, 4);
+            _ext_bw_per_step.inc(req.srcId, 4); */
         }
         data_ready_cycle = req.cycle;
         // Handle replacement
         if (replace_way < _num_ways) {
             MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
             uint32_t size = _sram_tag ? 4 : 6;
-            _mc->_mcdram[mcdram_select]->access(insert_req, 2, size);
-            _mc_bw_per_step += size;
-            _numTagStore.inc();
-            _numPlacement.inc();
-
-            if (_cache[set_num].ways[replace_way].valid) {
-                if (_cache[set_num].ways[replace_way].dirty) {
-                    _numDirtyEviction.inc();
+            _mcdram[mcdram_select]->access(insert_req, 2, size);
+            _mc_bw_per_step.inc(req.srcId, size);
+            _numTagStore.inc(req.srcId);
+            _numPlacement.inc(req.srcId);
+
+            if (_cache[set_num].isValid(replace_way)) {
+                if (_cache[set_num].isDirty(replace_way)) {
+                    _numDirtyEviction.inc(req.srcId);
                     if (type == STORE && _sram_tag) {
                         MemReq load_req = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                        _mc->_mcdram[mcdram_select]->access(load_req, 2, 4);
-                        _mc_bw_per_step += 4;
+                        _mcdram[mcdram_select]->access(load_req, 2, 4);
+                        _mc_bw_per_step.inc(req.srcId, 4);
                     }
-                    MemReq wb_req = {_cache[set_num].ways[replace_way].tag, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                    _mc->_ext_dram->access(wb_req, 2, 4);
-                    _ext_bw_per_step += 4;
+                    MemReq wb_req = {_cache[set_num].getTag(replace_way), PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+                    _ext_dram->access(wb_req, 2, 4);
+                    _ext_bw_per_step.inc(req.srcId, 4);
                 } else {
-                    _numCleanEviction.inc();
+                    _numCleanEviction.inc(req.srcId);
                 }
             }
-            _cache[set_num].ways[replace_way].valid = true;
-            _cache[set_num].ways[replace_way].tag = tag;
-            _cache[set_num].ways[replace_way].dirty = (req.type == PUTX);
+            _cache[set_num].fill(replace_way, tag, req.type == PUTX);
             updateUtilizationStats(set_num, replace_way);
         }
     }
 
     if (counter_access && !_sram_tag) {
-        _numCounterAccess.inc();
+        _numCounterAccess.inc(req.srcId);
         MemReq counter_req = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-        _mc->_mcdram[mcdram_select]->access(counter_req, 2, 2);
+        _mcdram[mcdram_select]->access(counter_req, 2, 2);
         counter_req.type = PUTX;
-        _mc->_mcdram[mcdram_select]->access(counter_req, 2, 2);
-        _mc_bw_per_step += 4;
+        _mcdram[mcdram_select]->access(counter_req, 2, 2);
+        _mc_bw_per_step.inc(req.srcId, 4);
     }
 
     return data_ready_cycle;
 }
 
-void AlloyCacheScheme::period(MemReq& req) {
-    // Log utilization stats periodically
-    if (_stats_period && _num_requests % _stats_period == 0) {
-        logUtilizationStats();
-        // Reset access counts after logging
-        for (uint64_t i = 0; i < _total_lines; i++) {
-            _line_access_count[i] &= ((1ULL << 32) - 1);
-        }
-    }
-    // Handle bandwidth balance if needed
-    if (_bw_balance && _num_requests % _step_length == 0) {
-        _num_hit_per_step /= 2;
-        _num_miss_per_step /= 2;
-        _mc_bw_per_step /= 2;
-        _ext_bw_per_step /= 2;
-
-        if (_bw_balance && _mc_bw_per_step + _ext_bw_per_step > 0) {
-            // Calculate current bandwidth ratio
-            double ratio = 1.0 * _mc_bw_per_step / (_mc_bw_per_step + _ext_bw_per_step);
-            double target_ratio = 0.8;  // Target ratio (mc_bw = 4 * ext_bw)
-
-            // Adjust _ds_index based on bandwidth difference
-            uint64_t index_step = _num_sets / 1000;
-            int64_t delta_index = (ratio - target_ratio > -0.02 && ratio - target_ratio < 0.02) ? 0 : index_step * (ratio - target_ratio) / 0.01;
-
-            printf("ratio = %f\n", ratio);
-
-            if (delta_index > 0) {
-                // Handle increasing _ds_index
-                for (uint32_t mc = 0; mc < _mc->_mcdram_per_mc; mc++) {
-                    for (uint64_t set = _ds_index; set < (uint64_t)(_ds_index + delta_index); set++) {
-                        if (set >= _num_sets) break;
-
-                        for (uint32_t way = 0; way < _num_ways; way++) {
-                            Way& meta = _cache[set].ways[way];
-                            if (meta.valid && meta.dirty) {
-                                // Write back to external DRAM
-                                MESIState state;
-                                MemReq load_req = {meta.tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                                _mc->_mcdram[mc]->access(load_req, 2, (_granularity / 64) * 4);
-                                MemReq wb_req = {meta.tag * 64, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                                _mc->_ext_dram->access(wb_req, 2, (_granularity / 64) * 4);
-                                _ext_bw_per_step += (_granularity / 64) * 4;
-                                _mc_bw_per_step += (_granularity / 64) * 4;
-                            }
-
-                            meta.valid = false;
-                            meta.dirty = false;
-                        }
-                    }
-                }
-            }
-            _ds_index = ((int64_t)_ds_index + delta_index <= 0) ? 0 : _ds_index + delta_index;
-            printf("_ds_index = %ld/%ld\n", _ds_index, _num_sets);
-        }
-    }
-}
-
 void AlloyCacheScheme::initStats(AggregateStat* parentStat) {
     AggregateStat* stats = new AggregateStat();
     stats->init("alloyCache", "AlloyCache stats");
-    _numPlacement.init("placement", "Number of Placement");
+    _numPlacement.init("placement", "Number of Placement", zinfo->numCores);
     stats->append(&_numPlacement);
-    _numCleanEviction.init("cleanEvict", "Clean Eviction");
+    _numCleanEviction.init("cleanEvict", "Clean Eviction", zinfo->numCores);
     stats->append(&_numCleanEviction);
-    _numDirtyEviction.init("dirtyEvict", "Dirty Eviction");
+    _numDirtyEviction.init("dirtyEvict", "Dirty Eviction", zinfo->numCores);
     stats->append(&_numDirtyEviction);
-    _numLoadHit.init("loadHit", "Load Hit");
+    _numLoadHit.init("loadHit", "Load Hit", zinfo->numCores);
     stats->append(&_numLoadHit);
-    _numLoadMiss.init("loadMiss", "Load Miss");
+    _numLoadMiss.init("loadMiss", "Load Miss", zinfo->numCores);
     stats->append(&_numLoadMiss);
-    _numStoreHit.init("storeHit", "Store Hit");
+    _numStoreHit.init("storeHit", "Store Hit", zinfo->numCores);
     stats->append(&_numStoreHit);
-    _numStoreMiss.init("storeMiss", "Store Miss");
+    _numStoreMiss.init("storeMiss", "Store Miss", zinfo->numCores);
     stats->append(&_numStoreMiss);
-    _numTagLoad.init("tagLoad", "Number of tag loads");
+    _numTagLoad.init("tagLoad", "Number of tag loads", zinfo->numCores);
     stats->append(&_numTagLoad);
-    _numTagStore.init("tagStore", "Number of tag stores");
+    _numTagStore.init("tagStore", "Number of tag stores", zinfo->numCores);
     stats->append(&_numTagStore);
-    _numCounterAccess.init("counterAccess", "Counter Access");
+    _numCounterAccess.init("counterAccess", "Counter Access", zinfo->numCores);
     stats->append(&_numCounterAccess);
     
     stats->append(_numReaccessedLines);
@@ -239,6 +176,7 @@ void AlloyCacheScheme::initStats(AggregateStat* parentStat) {
     stats->append(_numTotalExtLines);
     stats->append(_numAccessedExtPages);
     stats->append(_numTotalExtPages);
+    appendBalanceStats(stats);
     
     parentStat->append(stats);
 }
\ No newline at end of file
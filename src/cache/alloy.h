@@ -8,16 +8,16 @@
 class AlloyCacheScheme : public CacheScheme {
    private:
     LinePlacementPolicy* _line_placement_policy;
-    Counter _numPlacement;
-    Counter _numCleanEviction;
-    Counter _numDirtyEviction;
-    Counter _numLoadHit;
-    Counter _numLoadMiss;
-    Counter _numStoreHit;
-    Counter _numStoreMiss;
-    Counter _numTagLoad;
-    Counter _numTagStore;
-    Counter _numCounterAccess;
+    ShardedCounter _numPlacement;
+    ShardedCounter _numCleanEviction;
+    ShardedCounter _numDirtyEviction;
+    ShardedCounter _numLoadHit;
+    ShardedCounter _numLoadMiss;
+    ShardedCounter _numStoreHit;
+    ShardedCounter _numStoreMiss;
+    ShardedCounter _numTagLoad;
+    ShardedCounter _numTagStore;
+    ShardedCounter _numCounterAccess;
 
    public:
     AlloyCacheScheme(Config& config, MemoryController* mc)
@@ -32,7 +32,6 @@ class AlloyCacheScheme : public CacheScheme {
     }
 
     uint64_t access(MemReq& req) override;
-    void period(MemReq& req) override;
     void initStats(AggregateStat* parentStat) override;
 };
 
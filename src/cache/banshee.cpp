@@ -2,12 +2,18 @@
 
 #include "mc.h"
 
+// Cross-checks the whole tag buffer on every canInsert() and insert(). The
+// occupancy recount scans all entries, which dominated replay time, so it is
+// off unless debugging the tag buffer.
+#define CHECK_TAG_BUFFER 0
+//#define CHECK_TAG_BUFFER 1
+
 uint64_t BansheeCacheScheme::access(MemReq& req) {
     ReqType type = (req.type == GETS || req.type == GETX) ? LOAD : STORE;
     // Address address = req.lineAddr % (_ext_size / 64);
     Address address = req.lineAddr;
-    uint32_t mcdram_select = (address / 64) % _mc->_mcdram_per_mc;
-    Address mc_address = (address / 64 / _mc->_mcdram_per_mc * 64) | (address % 64);
+    uint32_t mcdram_select = (address / 64) % _mcdram_per_mc;
+    Address mc_address = (address / 64 / _mcdram_per_mc * 64) | (address % 64);
     Address tag = address / (_granularity / 64);
     uint64_t set_num = tag % _num_sets;
     uint32_t hit_way = _num_ways;
@@ -16,32 +22,26 @@ uint64_t BansheeCacheScheme::access(MemReq& req) {
     bool hybrid_tag_probe = false;
     bool counter_access = false;
 
-    _accessed_ext_lines_set.insert(address);
-    _accessed_ext_lines = _accessed_ext_lines_set.size();
-    _accessed_ext_pages_set.insert(address / (_page_size / 64));
-    _accessed_ext_pages = _accessed_ext_pages_set.size();
+    recordExtAccess(address);
 
     // Check TLB for hit
-    if (_tlb.find(tag) == _tlb.end()) {
-        _tlb[tag] = TLBEntry{tag, _num_ways, 0, 0, 0};
-    }
-
-    if (_tlb[tag].way != _num_ways) {
-        hit_way = _tlb[tag].way;
-        assert(_cache[set_num].ways[hit_way].valid &&
-               _cache[set_num].ways[hit_way].tag == tag);
+    TLBEntry& tlb_entry = (*_tlb)[tag];
+    if (tlb_entry.way != _num_ways) {
+        hit_way = tlb_entry.way;
+        assert(_cache[set_num].isValid(hit_way) &&
+               _cache[set_num].getTag(hit_way) == tag);
     } else {
         for (uint32_t i = 0; i < _num_ways; i++)
-            assert(_cache[set_num].ways[i].tag != tag || !_cache[set_num].ways[i].valid);  // @chunk: can TLB hold all tags? maybe it is actually the page table?
+            assert(_cache[set_num].getTag(i) != tag || !_cache[set_num].isValid(i));  // @chunk: can TLB hold all tags? maybe it is actually the page table?
     }
 
     // Check if we need to probe tag
     if (type == STORE) {
         if (_tag_buffer->existInTB(tag) == _tag_buffer->getNumWays() && set_num >= _ds_index) {
-            _numTBDirtyMiss.inc();
+            _numTBDirtyMiss.inc(req.srcId);
             if (!_sram_tag) hybrid_tag_probe = true;
         } else {
-            _numTBDirtyHit.inc();
+            _numTBDirtyHit.inc(req.srcId);
         }
     }
 
@@ -50,19 +50,19 @@ uint64_t BansheeCacheScheme::access(MemReq& req) {
     if (hit_way != _num_ways) {
         // Cache hit
         updateUtilizationStats(set_num, hit_way);
-        _num_hit_per_step++;
+        _num_hit_per_step.inc(req.srcId);
         _page_placement_policy->handleCacheHit(tag, type, set_num, &_cache[set_num], counter_access, hit_way);
         if (type == STORE) {
-            _cache[set_num].ways[hit_way].dirty = true;
-            _numStoreHit.inc();
+            _cache[set_num].setDirty(hit_way);
+            _numStoreHit.inc(req.srcId);
         } else {
-            _numLoadHit.inc();
+            _numLoadHit.inc(req.srcId);
         }
 
         if (!hybrid_tag_probe) {
             req.lineAddr = mc_address;
-            req.cycle = _mc->_mcdram[mcdram_select]->access(req, 0, 4);
-            _mc_bw_per_step += 4;
+            req.cycle = _mcdram[mcdram_select]->access(req, 0, 4);
+            _mc_bw_per_step.inc(req.srcId, 4);
             req.lineAddr = address;
             data_ready_cycle = req.cycle;
             if (type == LOAD && _tag_buffer->canInsert(tag)) {
@@ -71,65 +71,65 @@ uint64_t BansheeCacheScheme::access(MemReq& req) {
         } else {
             assert(!_sram_tag);
             MemReq tag_probe = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-            req.cycle = _mc->_mcdram[mcdram_select]->access(tag_probe, 0, 2);
-            _mc_bw_per_step += 2;
-            _numTagLoad.inc();
+            req.cycle = _mcdram[mcdram_select]->access(tag_probe, 0, 2);
+            _mc_bw_per_step.inc(req.srcId, 2);
+            _numTagLoad.inc(req.srcId);
             req.lineAddr = mc_address;
-            req.cycle = _mc->_mcdram[mcdram_select]->access(req, 1, 4);
-            _mc_bw_per_step += 4;
+            req.cycle = _mcdram[mcdram_select]->access(req, 1, 4);
+            _mc_bw_per_step.inc(req.srcId, 4);
             req.lineAddr = address;
             data_ready_cycle = req.cycle;
         }
     } else {
         // Cache miss
-        _num_miss_per_step++;
+        _num_miss_per_step.inc(req.srcId);
         if (type == LOAD)
-            _numLoadMiss.inc();
+            _numLoadMiss.inc(req.srcId);
         else
-            _numStoreMiss.inc();
+            _numStoreMiss.inc(req.srcId);
 
         // Handle placement
         uint32_t replace_way = _page_placement_policy->handleCacheMiss(tag, type, set_num, &_cache[set_num], counter_access);
 
         if (hybrid_tag_probe) {
             MemReq tag_probe = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-            req.cycle = _mc->_mcdram[mcdram_select]->access(tag_probe, 0, 2);
-            _mc_bw_per_step += 2;
-            req.cycle = _mc->_ext_dram->access(req, 1, 4);
-            _ext_bw_per_step += 4;
-            _numTagLoad.inc();
+            req.cycle = _mcdram[mcdram_select]->access(tag_probe, 0, 2);
+            _mc_bw_per_step.inc(req.srcId, 2);
+            req.cycle = _ext_dram->access(req, 1, 4);
+            _ext_bw_per_step.inc(req.srcId, 4);
+            _numTagLoad.inc(req.srcId);
             data_ready_cycle = req.cycle;
         } else {
-            req.cycle = _mc->_ext_dram->access(req, 0, 4);
-            _ext_bw_per_step += 4;
+            req.cycle = _ext_dram->access(req, 0, 4);
+            _ext_bw_per_step.inc(req.srcId, 4);
             data_ready_cycle = req.cycle;
         }
 
         if (replace_way < _num_ways) {
             // Handle eviction
-            if (_cache[set_num].ways[replace_way].valid) {
-                Address replaced_tag = _cache[set_num].ways[replace_way].tag;
-                _tlb[replaced_tag].way = _num_ways;
+            if (_cache[set_num].isValid(replace_way)) {
+                Address replaced_tag = _cache[set_num].getTag(replace_way);
+                (*_tlb)[replaced_tag].way = _num_ways;
 
-                if (_cache[set_num].ways[replace_way].dirty) {
-                    _numDirtyEviction.inc();
+                if (_cache[set_num].isDirty(replace_way)) {
+                    _numDirtyEviction.inc(req.srcId);
                     // Load page from MCDRAM
                     MemReq load_req = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                    _mc->_mcdram[mcdram_select]->access(load_req, 2, (_granularity / 64) * 4);
-                    _mc_bw_per_step += (_granularity / 64) * 4;
+                    _mcdram[mcdram_select]->access(load_req, 2, (_granularity / 64) * 4);
+                    _mc_bw_per_step.inc(req.srcId, (_granularity / 64) * 4);
                     // Store to ext DRAM
                     MemReq wb_req = {replaced_tag * 64, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                    _mc->_ext_dram->access(wb_req, 2, (_granularity / 64) * 4);
-                    _ext_bw_per_step += (_granularity / 64) * 4;
+                    _ext_dram->access(wb_req, 2, (_granularity / 64) * 4);
+                    _ext_bw_per_step.inc(req.srcId, (_granularity / 64) * 4);
                 } else {
-                    _numCleanEviction.inc();
+                    _numCleanEviction.inc(req.srcId);
                 }
 
                 // Update tag buffer
                 if (!_tag_buffer->canInsert(tag, replaced_tag)) {
                     _tag_buffer->clearTagBuffer();
                     _tag_buffer->setClearTime(req.cycle);
-                    _numTagBufferFlush.inc();
+                    _numTagBufferFlush.inc(req.srcId);
                 }
                 assert(_tag_buffer->canInsert(tag, replaced_tag));
                 _tag_buffer->insert(tag, true);
@@ -138,25 +138,23 @@ uint64_t BansheeCacheScheme::access(MemReq& req) {
 
             // Load new page from ext DRAM
             MemReq load_req = {tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-            _mc->_ext_dram->access(load_req, 2, (_granularity / 64) * 4);
-            _ext_bw_per_step += (_granularity / 64) * 4;
+            _ext_dram->access(load_req, 2, (_granularity / 64) * 4);
+            _ext_bw_per_step.inc(req.srcId, (_granularity / 64) * 4);
 
             // Store to MCDRAM
             MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-            _mc->_mcdram[mcdram_select]->access(insert_req, 2, (_granularity / 64) * 4);
+            _mcdram[mcdram_select]->access(insert_req, 2, (_granularity / 64) * 4);
             if (!_sram_tag) {
-                _mc->_mcdram[mcdram_select]->access(insert_req, 2, 2);
-                _mc_bw_per_step += 2;
+                _mcdram[mcdram_select]->access(insert_req, 2, 2);
+                _mc_bw_per_step.inc(req.srcId, 2);
             }
-            _mc_bw_per_step += (_granularity / 64) * 4;
-            _numTagStore.inc();
-            _numPlacement.inc();
+            _mc_bw_per_step.inc(req.srcId, (_granularity / 64) * 4);
+            _numTagStore.inc(req.srcId);
+            _numPlacement.inc(req.srcId);
 
             // Update cache entry
-            _cache[set_num].ways[replace_way].valid = true;
-            _cache[set_num].ways[replace_way].tag = tag;
-            _cache[set_num].ways[replace_way].dirty = (type == STORE);
-            _tlb[tag].way = replace_way;
+            _cache[set_num].fill(replace_way, tag, type == STORE);
+            tlb_entry.way = replace_way;
             updateUtilizationStats(set_num, replace_way);
         } else if (type == LOAD && _tag_buffer->canInsert(tag)) {
             _tag_buffer->insert(tag, false);
@@ -169,12 +167,12 @@ uint64_t BansheeCacheScheme::access(MemReq& req) {
         /////// model counter access in mcdram
         // One counter read and one coutner write
         assert(set_num >= _ds_index);
-        _numCounterAccess.inc();
+        _numCounterAccess.inc(req.srcId);
         MemReq counter_req = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-        _mc->_mcdram[mcdram_select]->access(counter_req, 2, 2);
+        _mcdram[mcdram_select]->access(counter_req, 2, 2);
         counter_req.type = PUTX;
-        _mc->_mcdram[mcdram_select]->access(counter_req, 2, 2);
-        _mc_bw_per_step += 4;
+        _mcdram[mcdram_select]->access(counter_req, 2, 2);
+        _mc_bw_per_step.inc(req.srcId, 4);
     }
 
     // Check tag buffer occupancy
@@ -182,113 +180,62 @@ uint64_t BansheeCacheScheme::access(MemReq& req) {
         printf("[Tag Buffer FLUSH] occupancy = %f\n", _tag_buffer->getOccupancy());
         _tag_buffer->clearTagBuffer();
         _tag_buffer->setClearTime(req.cycle);
-        _numTagBufferFlush.inc();
+        _numTagBufferFlush.inc(req.srcId);
     }
 
     return data_ready_cycle;
 }
 
-void BansheeCacheScheme::period(MemReq& req) {
-    if (_stats_period && _num_requests % _stats_period == 0) {
-        logUtilizationStats();
-        // Reset access counts after logging
-        for (uint64_t i = 0; i < _total_lines; i++) {
-             _line_access_count[i] &= ((1ULL << 32) - 1);
-        }
-    }
-    // Handle bandwidth balance if needed
-    if (_bw_balance && _num_requests % _step_length == 0) {
-        _num_hit_per_step /= 2;
-        _num_miss_per_step /= 2;
-        _mc_bw_per_step /= 2;
-        _ext_bw_per_step /= 2;
-
-        if (_bw_balance && _mc_bw_per_step + _ext_bw_per_step > 0) {
-            // Calculate current bandwidth ratio
-            double ratio = 1.0 * _mc_bw_per_step / (_mc_bw_per_step + _ext_bw_per_step);
-            double target_ratio = 0.8;  // Target ratio (mc_bw = 4 * ext_bw)
-
-            // Adjust _ds_index based on bandwidth difference
-            uint64_t index_step = _num_sets / 1000;
-            int64_t delta_index = (ratio - target_ratio > -0.02 && ratio - target_ratio < 0.02) ? 0 : index_step * (ratio - target_ratio) / 0.01;
-
-            printf("ratio = %f\n", ratio);
-
-            if (delta_index > 0) {
-                // Handle increasing _ds_index
-                for (uint32_t mc = 0; mc < _mc->_mcdram_per_mc; mc++) {
-                    for (uint64_t set = _ds_index; set < (uint64_t)(_ds_index + delta_index); set++) {
-                        if (set >= _num_sets) break;
-
-                        for (uint32_t way = 0; way < _num_ways; way++) {
-                            Way& meta = _cache[set].ways[way];
-                            if (meta.valid && meta.dirty) {
-                                // Write back to external DRAM
-                                MESIState state;
-                                MemReq load_req = {meta.tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                                _mc->_mcdram[mc]->access(load_req, 2, (_granularity / 64) * 4);
-                                MemReq wb_req = {meta.tag * 64, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                                _mc->_ext_dram->access(wb_req, 2, (_granularity / 64) * 4);
-                                _ext_bw_per_step += (_granularity / 64) * 4;
-                                _mc_bw_per_step += (_granularity / 64) * 4;
-                            }
-
-                            if (_scheme == BansheeCache && meta.valid) {
-                                _tlb[meta.tag].way = _num_ways;
-                                if (!_tag_buffer->canInsert(meta.tag)) {
-                                    printf("Rebalance. [Tag Buffer FLUSH] occupancy = %f\n", _tag_buffer->getOccupancy());
-                                    _tag_buffer->clearTagBuffer();
-                                    _tag_buffer->setClearTime(req.cycle);
-                                    _numTagBufferFlush.inc();
-                                }
-                                assert(_tag_buffer->canInsert(meta.tag));
-                                _tag_buffer->insert(meta.tag, true);
-                            }
-
-                            meta.valid = false;
-                            meta.dirty = false;
-                        }
-                        if (_scheme == BansheeCache) {
-                            _page_placement_policy->flushChunk(set);
-                        }
-                    }
-                }
-            }
-            _ds_index = ((int64_t)_ds_index + delta_index <= 0) ? 0 : _ds_index + delta_index;
-            printf("_ds_index = %ld/%ld\n", _ds_index, _num_sets);
+void BansheeCacheScheme::onBalanceFlush(MemReq& req, uint64_t set) {
+    // Bypassed pages must be remapped to external memory through the tag buffer
+    for (uint32_t way = 0; way < _num_ways; way++) {
+        if (!_cache[set].isValid(way)) continue;
+        Address tag = _cache[set].getTag(way);
+        (*_tlb)[tag].way = _num_ways;
+        if (!_tag_buffer->canInsert(tag)) {
+            printf("Rebalance. [Tag Buffer FLUSH] occupancy = %f\n", _tag_buffer->getOccupancy());
+            _tag_buffer->clearTagBuffer();
+            _tag_buffer->setClearTime(req.cycle);
+            _numTagBufferFlush.inc(req.srcId);
         }
+        assert(_tag_buffer->canInsert(tag));
+        _tag_buffer->insert(tag, true);
     }
+    _page_placement_policy->flushChunk(set);
 }
 
 void BansheeCacheScheme::initStats(AggregateStat* parentStat) {
     AggregateStat* stats = new AggregateStat();
     stats->init("bansheeCache", "BansheeCache stats");
-    _numPlacement.init("placement", "Number of Placement");
+    _numPlacement.init("placement", "Number of Placement", zinfo->numCores);
     stats->append(&_numPlacement);
-    _numCleanEviction.init("cleanEvict", "Clean Eviction");
+    _numCleanEviction.init("cleanEvict", "Clean Eviction", zinfo->numCores);
     stats->append(&_numCleanEviction);
-    _numDirtyEviction.init("dirtyEvict", "Dirty Eviction");
+    _numDirtyEviction.init("dirtyEvict", "Dirty Eviction", zinfo->numCores);
     stats->append(&_numDirtyEviction);
-    _numLoadHit.init("loadHit", "Load Hit");
+    _numLoadHit.init("loadHit", "Load Hit", zinfo->numCores);
     stats->append(&_numLoadHit);
-    _numLoadMiss.init("loadMiss", "Load Miss");
+    _numLoadMiss.init("loadMiss", "Load Miss", zinfo->numCores);
     stats->append(&_numLoadMiss);
-    _numStoreHit.init("storeHit", "Store Hit");
+    _numStoreHit.init("storeHit", "Store Hit", zinfo->numCores);
     stats->append(&_numStoreHit);
-    _numStoreMiss.init("storeMiss", "Store Miss");
+    _numStoreMiss.init("storeMiss", "Store Miss", zinfo->numCores);
     stats->append(&_numStoreMiss);
-    _numTagLoad.init("tagLoad", "Number of tag loads");
+    _numTagLoad.init("tagLoad", "Number of tag loads", zinfo->numCores);
     stats->append(&_numTagLoad);
-    _numTagStore.init("tagStore", "Number of tag stores");
+    _numTagStore.init("tagStore", "Number of tag stores", zinfo->numCores);
     stats->append(&_numTagStore);
-    _numTagBufferFlush.init("tagBufferFlush", "Number of tag buffer flushes");
+    _numTagBufferFlush.init("tagBufferFlush", "Number of tag buffer flushes", zinfo->numCores);
     stats->append(&_numTagBufferFlush);
-    _numTBDirtyHit.init("TBDirtyHit", "Tag buffer hits (LLC dirty evict)");
+    _numTBDirtyHit.init("TBDirtyHit", "Tag buffer hits (LLC dirty evict)", zinfo->numCores);
     stats->append(&_numTBDirtyHit);
-    _numTBDirtyMiss.init("TBDirtyMiss", "Tag buffer misses (LLC dirty evict)");
+    _numTBDirtyMiss.init("TBDirtyMiss", "Tag buffer misses (LLC dirty evict)", zinfo->numCores);
     stats->append(&_numTBDirtyMiss);
-    _numCounterAccess.init("counterAccess", "Counter Access");
+    _numCounterAccess.init("counterAccess", "Counter Access", zinfo->numCores);
     stats->append(&_numCounterAccess);
+    auto tlbBytes = makeLambdaStat([this]() { return _tlb->bytes(); });
+    tlbBytes->init("tlbBytes", "Bytes allocated for the page TLB");
+    stats->append(tlbBytes);
     
     stats->append(_numReaccessedLines);
     stats->append(_numAccessedLines);
@@ -297,6 +244,7 @@ void BansheeCacheScheme::initStats(AggregateStat* parentStat) {
     stats->append(_numTotalExtLines);
     stats->append(_numAccessedExtPages);
     stats->append(_numTotalExtPages);
+    appendBalanceStats(stats);
     
     parentStat->append(stats);
 }
@@ -330,7 +278,7 @@ uint32_t TagBuffer::existInTB(Address tag) {
 }
 
 bool TagBuffer::canInsert(Address tag) {
-#if 1
+#if CHECK_TAG_BUFFER
     uint32_t num = 0;
     for (uint32_t i = 0; i < _num_sets; i++)
         for (uint32_t j = 0; j < _num_ways; j++)
@@ -365,7 +313,7 @@ bool TagBuffer::canInsert(Address tag1, Address tag2) {
 void TagBuffer::insert(Address tag, bool remap) {
     uint32_t set_num = tag % _num_sets;
     uint32_t exist_way = existInTB(tag);
-#if 1
+#if CHECK_TAG_BUFFER
     for (uint32_t i = 0; i < _num_ways; i++)
         for (uint32_t j = i + 1; j < _num_ways; j++) {
             // if (_tag_buffer[set_num][i].tag != 0 && _tag_buffer[set_num][i].tag == _tag_buffer[set_num][j].tag) {
@@ -2,6 +2,7 @@
 #define _BANSHEE_CACHE_SCHEME_H_
 
 #include "cache/cache_scheme.h"
+#include "cache/page_tlb.h"
 #include "g_std/g_string.h"
 #include "g_std/g_unordered_map.h"
 #include "mc.h"  // For TagBuffer
@@ -12,20 +13,20 @@ class BansheeCacheScheme : public CacheScheme {
    private:
     PagePlacementPolicy* _page_placement_policy;
     TagBuffer* _tag_buffer;
-    g_unordered_map<Address, TLBEntry> _tlb;
-    Counter _numPlacement;
-    Counter _numCleanEviction;
-    Counter _numDirtyEviction;
-    Counter _numLoadHit;
-    Counter _numLoadMiss;
-    Counter _numStoreHit;
-    Counter _numStoreMiss;
-    Counter _numTagLoad;
-    Counter _numTagStore;
-    Counter _numTagBufferFlush;
-    Counter _numTBDirtyHit;
-    Counter _numTBDirtyMiss;
-    Counter _numCounterAccess;
+    PageTLB* _tlb;
+    ShardedCounter _numPlacement;
+    ShardedCounter _numCleanEviction;
+    ShardedCounter _numDirtyEviction;
+    ShardedCounter _numLoadHit;
+    ShardedCounter _numLoadMiss;
+    ShardedCounter _numStoreHit;
+    ShardedCounter _numStoreMiss;
+    ShardedCounter _numTagLoad;
+    ShardedCounter _numTagStore;
+    ShardedCounter _numTagBufferFlush;
+    ShardedCounter _numTBDirtyHit;
+    ShardedCounter _numTBDirtyMiss;
+    ShardedCounter _numCounterAccess;
 
    public:
     BansheeCacheScheme(Config& config, MemoryController* mc)
@@ -36,6 +37,7 @@ class BansheeCacheScheme : public CacheScheme {
         _page_placement_policy = (PagePlacementPolicy*)gm_malloc(sizeof(PagePlacementPolicy));
         new (_page_placement_policy) PagePlacementPolicy(this);
         _page_placement_policy->initialize(config);
+        _tlb = new PageTLB((_ext_bits < 64) ? _ext_size / _granularity : 0, _num_ways);
 
         // Use gm_malloc for tag buffer
         _tag_buffer = (TagBuffer*)gm_malloc(sizeof(TagBuffer));
@@ -43,10 +45,12 @@ class BansheeCacheScheme : public CacheScheme {
     }
 
     uint64_t access(MemReq& req) override;
-    void period(MemReq& req) override;
     void initStats(AggregateStat* parentStat) override;
 
     TagBuffer* getTagBuffer() override { return _tag_buffer; }
+
+   protected:
+    void onBalanceFlush(MemReq& req, uint64_t set) override;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "cache/cache_scheme.h"
+
+#include "bithacks.h"
+
+void CacheScheme::period(MemReq& req) {
+    // _num_requests grows by one per call, so deadlines replace the per-request modulos
+    if (_num_requests == _next_stats_request) {
+        logUtilizationStats();
+        _next_stats_request += _stats_period;
+    }
+    if (_bw_balance && _num_requests == _next_step_request) {
+        balanceStep(req);
+        _next_step_request += _step_length;
+    }
+}
+
+void CacheScheme::balanceStep(MemReq& req) {
+    // Sums the shards and folds them back into one
+    _num_hit_per_step.set(_num_hit_per_step.get() / 2);
+    _num_miss_per_step.set(_num_miss_per_step.get() / 2);
+    uint64_t mc_bw = _mc_bw_per_step.get() / 2;
+    uint64_t ext_bw = _ext_bw_per_step.get() / 2;
+    _mc_bw_per_step.set(mc_bw);
+    _ext_bw_per_step.set(ext_bw);
+    if (mc_bw + ext_bw == 0) return;
+
+    // Steer the cache towards serving 80% of the traffic (mc_bw = 4 * ext_bw)
+    double ratio = 1.0 * mc_bw / (mc_bw + ext_bw);
+    double target_ratio = 0.8;
+    _bw_ratio = (uint64_t)(ratio * 1000 + 0.5);
+
+    uint64_t index_step = _num_sets / 1000;
+    int64_t delta_index = (ratio - target_ratio > -0.02 && ratio - target_ratio < 0.02) ? 0 : index_step * (ratio - target_ratio) / 0.01;
+    if (delta_index > 0) {
+        flushBalanceSets(req, _ds_index, MIN(_ds_index + delta_index, _num_sets));
+    }
+    _ds_index = ((int64_t)_ds_index + delta_index <= 0) ? 0 : _ds_index + delta_index;
+}
+
+void CacheScheme::flushBalanceSets(MemReq& req, uint64_t begin, uint64_t end) {
+    _balance_wb_tags.clear();
+    for (uint64_t set = begin; set < end; set++) {
+        Set& s = _cache[set];
+        for (uint32_t way = 0; way < _num_ways; way++) {
+            if (s.isValid(way) && s.isDirty(way)) _balance_wb_tags.push_back(s.getTag(way));
+        }
+        onBalanceFlush(req, set);
+        for (uint32_t way = 0; way < _num_ways; way++) s.invalidate(way);
+    }
+
+    // Write back runs of consecutive dirty granules. Each run is split at
+    // 64-line blocks, which is how Alloy and Banshee interleave lines across
+    // MCDRAM channels, so every transfer reads the lines from the channel and
+    // cache address that hold them, and writes them back to their own address
+    uint64_t granule_lines = _granularity / 64;
+    uint64_t num_tags = _balance_wb_tags.size();
+    for (uint64_t i = 0; i < num_tags;) {
+        Address first = _balance_wb_tags[i];
+        uint64_t run = 1;
+        while (i + run < num_tags && _balance_wb_tags[i + run] == first + run) run++;
+
+        Address line = first * granule_lines;
+        Address run_end = (first + run) * granule_lines;
+        while (line < run_end) {
+            uint64_t lines = MIN(run_end, (line / 64 + 1) * 64) - line;
+            uint32_t size = lines * 4;
+            uint32_t mcdram_select = (line / 64) % _mcdram_per_mc;
+            Address mc_address = (line / 64 / _mcdram_per_mc * 64) | (line % 64);
+            MESIState state;
+            MemReq load_req = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+            _mcdram[mcdram_select]->access(load_req, 2, size);
+            MemReq wb_req = {line, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+            _ext_dram->access(wb_req, 2, size);
+            _mc_bw_per_step.inc(req.srcId, size);
+            _ext_bw_per_step.inc(req.srcId, size);
+            line += lines;
+        }
+        _balance_wb_granules += run;
+        i += run;
+    }
+}
+
+void CacheScheme::appendBalanceStats(AggregateStat* stats) {
+    if (!_bw_balance) return;
+    stats->append(_bwRatioStat);
+    stats->append(_dsIndexStat);
+    stats->append(_balanceWbStat);
+}
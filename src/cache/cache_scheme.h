@@ -2,10 +2,14 @@
 #define _CACHE_SCHEME_H_
 
 #include <cmath>
+#include "bithacks.h"
 #include "cache/cache_utils.h"
+#include "cache/footprint.h"
+#include "cache/shadow.h"
 #include "memory_hierarchy.h"
 #include "g_std/g_unordered_map.h"
 #include "g_std/g_unordered_set.h"
+#include "g_std/g_vector.h"
 #include <unordered_map>
 #include <unordered_set>
 #include "stats.h"
@@ -21,6 +25,10 @@ class CacheScheme {
    protected:
     Scheme _scheme;         // Cache scheme type
     MemoryController* _mc;  // Pointer to access MemoryController components
+    MemObject* _ext_dram;     // External DRAM (or this shard's port to it)
+    MemObject** _mcdram;      // MCDRAM array (or this shard's ports to it)
+    uint32_t _mcdram_per_mc;  // MCDRAM instances per controller
+    uint32_t _num_shards;     // Front-end shards the cache is split across
     uint64_t _granularity;  // Cache line size
     uint64_t _num_ways;     // Associativity
     uint64_t _cache_size;   // Total cache size in bytes
@@ -36,23 +44,26 @@ class CacheScheme {
     bool _sram_tag;         // SRAM tag flag
     uint32_t _llc_latency;  // Last-level cache latency
     bool _bw_balance;       // Bandwidth balancing flag
-    uint64_t _ds_index;     // Data structure index
+    uint64_t _ds_index;     // Sets below this index are bypassed (bandwidth balancing)
     uint64_t _step_length;
+    uint64_t _next_step_request;   // _num_requests at which the next balance step runs
+    uint64_t _next_stats_request;  // _num_requests at which utilization stats are next logged
+    uint64_t _bw_ratio;            // Cache share of the traffic at the last balance step, in per mille
+    uint64_t _balance_wb_granules;  // Dirty granules written back by balance flushes
+    g_vector<Address> _balance_wb_tags;  // Scratch: dirty tags of the sets being flushed
 
-    // Common counters for statistics
+    // Common counters for statistics (per-step ones are sharded by srcId)
     uint64_t _num_requests;
-    uint64_t _num_hit_per_step;
-    uint64_t _num_miss_per_step;
-    uint64_t _mc_bw_per_step;
-    uint64_t _ext_bw_per_step;
+    ShardedCounter _num_hit_per_step;
+    ShardedCounter _num_miss_per_step;
+    ShardedCounter _mc_bw_per_step;
+    ShardedCounter _ext_bw_per_step;
     double _miss_rate_trace[MAX_STEPS];
     
     // Add utilization statistics
-    g_unordered_set <uint64_t> _accessed_ext_lines_set;
-    g_unordered_set <uint64_t> _accessed_ext_pages_set;
-    uint64_t _accessed_ext_lines;
-    uint64_t _accessed_ext_pages;
-    uint64_t* _line_access_count;
+    FootprintTracker* _ext_lines_footprint;  // Distinct external lines accessed
+    FootprintTracker* _ext_pages_footprint;  // Distinct external pages accessed
+    uint8_t* _line_access_count;  // Per cache line, saturating at 2; nullptr if disabled
     uint64_t _accessed_lines;
     uint64_t _reaccessed_lines;
     uint64_t _total_lines;
@@ -64,11 +75,24 @@ class CacheScheme {
     ProxyStat* _numTotalExtPages;
     ProxyStat* _numAccessedLines;
     ProxyStat* _numReaccessedLines;
-    ProxyStat* _numAccessedExtLines;
-    ProxyStat* _numAccessedExtPages;
+    ScalarStat* _numAccessedExtLines;
+    ScalarStat* _numAccessedExtPages;
+    ProxyStat* _bwRatioStat;
+    ProxyStat* _dsIndexStat;
+    ProxyStat* _balanceWbStat;
+    ShadowCaches* _shadows;  // Other cache sizes simulated alongside, nullptr if none
+
+    // Bandwidth balancing: moves _ds_index and flushes the sets it skips over
+    void balanceStep(MemReq& req);
+    void flushBalanceSets(MemReq& req, uint64_t begin, uint64_t end);
+    // Called for each set flushed by balancing, before its ways are invalidated
+    virtual void onBalanceFlush(MemReq& req, uint64_t set) {}
+    // Appends the balancing stats if sys.mem.bwBalance is set
+    void appendBalanceStats(AggregateStat* stats);
+
    public:
     CacheScheme(Config& config, MemoryController* mc)
-        : _mc(mc) {
+        : _mc(mc), _ext_dram(nullptr), _mcdram(nullptr), _mcdram_per_mc(0) {
         // Cache configuration
         _scheme = UNKNOWN;
         _sram_tag = config.get<bool>("sys.mem.sram_tag", false);
@@ -82,6 +106,24 @@ class CacheScheme {
         _page_size = config.get<uint32_t>("sys.mem.page_size", 4096); // 4096, 2097152
         _cache_size = (uint64_t)config.get<uint32_t>("sys.mem.mcdram.size", 128) * 1024 * 1024; // Bytes
         _ext_size = (uint64_t)config.get<uint32_t>("sys.mem.ext_dram.size", 0) * 1024 * 1024; // Bytes
+        // Each shard of a sharded controller models 1/N of the sets over 1/N of the
+        // sharding granules (the larger of a page and _granularity, see MemoryController)
+        _num_shards = config.get<uint32_t>("sys.mem.shards", 1);
+        if (_num_shards == 0) panic("sys.mem.shards must be >= 1");
+        if (_num_shards > 1) {
+            uint64_t shard_granule = MAX(_granularity, _page_size);
+            uint64_t set_bytes = _granularity * MAX(_num_ways, (uint64_t)1);
+            if (_cache_size % (_num_shards * MAX(shard_granule, set_bytes)) != 0) {
+                panic("sys.mem.mcdram.size (%ld bytes) does not split evenly into %d shards of whole %ld-byte granules and sets",
+                      _cache_size, _num_shards, MAX(shard_granule, set_bytes));
+            }
+            if (_ext_size % (_num_shards * shard_granule) != 0) {
+                panic("sys.mem.ext_dram.size (%ld bytes) does not split evenly into %d shards of whole %ld-byte granules",
+                      _ext_size, _num_shards, shard_granule);
+            }
+        }
+        _cache_size /= _num_shards;
+        _ext_size /= _num_shards;
         _page_bits = log2(_page_size);
         if (_page_bits < 12) {
             panic("Page size %d is too small, must be at least 64 bytes", _page_size);
@@ -106,38 +148,50 @@ class CacheScheme {
         info("cache_size = %ld, num_ways = %ld, num_sets = %ld, granularity = %ld, step_length: %lu", _cache_size, _num_ways, _num_sets, _granularity, _step_length);
         info("page_size = %ld, page_bits = %ld, cache_bits = %ld, ext_bits = %ld", _page_size, _page_bits, _cache_bits, _ext_bits);
 
-        // _cache = new Set[_num_sets];
+        // Tags and valid/dirty bitmasks of all sets live in three flat arrays (see Set)
         _cache = (Set*)gm_malloc(sizeof(Set) * _num_sets);
+        uint64_t mask_words = (_num_ways + 63) / 64;
+        Address* tags = gm_calloc<Address>(_num_sets * _num_ways);
+        uint64_t* valid = gm_calloc<uint64_t>(_num_sets * mask_words);
+        uint64_t* dirty = gm_calloc<uint64_t>(_num_sets * mask_words);
         for (uint64_t i = 0; i < _num_sets; i++) {
-            // _cache[i].ways = new Way[_num_ways];
-            _cache[i].ways = (Way*)gm_malloc(sizeof(Way) * _num_ways);
+            _cache[i].tags = tags + i * _num_ways;
+            _cache[i].valid = valid + i * mask_words;
+            _cache[i].dirty = dirty + i * mask_words;
             _cache[i].num_ways = _num_ways;
-            for (uint32_t j = 0; j < _num_ways; j++) {
-                _cache[i].ways[j].valid = false;
-                _cache[i].ways[j].dirty = false;
-                _cache[i].ways[j].tag = 0;
-            }
         }
 
         // Stats initialization
-        _num_hit_per_step = 0;
-        _num_miss_per_step = 0;
-        _mc_bw_per_step = 0;
-        _ext_bw_per_step = 0;
+        _num_hit_per_step.init("hitsPerStep", "Hits in the current balance step", zinfo->numCores);
+        _num_miss_per_step.init("missesPerStep", "Misses in the current balance step", zinfo->numCores);
+        _mc_bw_per_step.init("mcBwPerStep", "MCDRAM traffic in the current balance step", zinfo->numCores);
+        _ext_bw_per_step.init("extBwPerStep", "External traffic in the current balance step", zinfo->numCores);
         for (uint32_t i = 0; i < MAX_STEPS; i++)
             _miss_rate_trace[i] = 0;
         _num_requests = 0;
+        _next_step_request = _step_length;
+        _bw_ratio = 0;
+        _balance_wb_granules = 0;
 
         // Initialize utilization statistics
         _accessed_lines = 0;
         _total_lines = _num_sets * _num_ways;
         _total_ext_lines = _ext_size / 64;
         _total_ext_pages = _ext_size / _page_size;
-        _line_access_count = (uint64_t*)gm_malloc(sizeof(uint64_t) * _total_lines);
-        for (uint64_t i = 0; i < _total_lines; i++) {
-            _line_access_count[i] = 0;
+        _reaccessed_lines = 0;
+        // Per-line access counts only feed numAccessedLines/numReaccessedLines
+        if (config.get<bool>("sys.mem.mcdram.lineUtilStats", true)) {
+            _line_access_count = gm_calloc<uint8_t>(_total_lines);
+        } else {
+            _line_access_count = nullptr;
         }
-        _stats_period = config.get<uint32_t>("sys.mem.mcdram.utilstats_period", 0);  // Default: log every 1M accesses
+        // Footprint trackers: Bitmap (exact), HLL (approximate) or None
+        g_string footprint = config.get<const char*>("sys.mem.mcdram.footprintTracker", "Bitmap");
+        uint64_t ext_universe = (_ext_bits < 64) ? _total_ext_lines : 0;
+        _ext_lines_footprint = BuildFootprintTracker(footprint, ext_universe);
+        _ext_pages_footprint = BuildFootprintTracker(footprint, ext_universe ? _total_ext_pages : 0);
+        _stats_period = config.get<uint32_t>("sys.mem.mcdram.utilstats_period", 0);  // 0 disables logging
+        _next_stats_request = _stats_period ? _stats_period : UINT64_MAX;
         _numTotalLines = new ProxyStat();
         _numTotalLines->init("numTotalLines", "Total number of cache lines", &_total_lines);
         _numTotalExtLines = new ProxyStat();
@@ -148,43 +202,84 @@ class CacheScheme {
         _numAccessedLines->init("numAccessedLines", "Number of cache lines accessed", &_accessed_lines);
         _numReaccessedLines = new ProxyStat();
         _numReaccessedLines->init("numReaccessedLines", "Number of cache lines re-accessed", &_reaccessed_lines);
-        _numAccessedExtLines = new ProxyStat();
-        _numAccessedExtLines->init("numAccessedExtLines", "Number of external lines accessed", &_accessed_ext_lines);
-        _numAccessedExtPages = new ProxyStat();
-        _numAccessedExtPages->init("numAccessedExtPages", "Number of external pages accessed", &_accessed_ext_pages);
+        _numAccessedExtLines = makeLambdaStat([this]() { return _ext_lines_footprint->count(); });
+        _numAccessedExtLines->init("numAccessedExtLines", "Number of external lines accessed");
+        _numAccessedExtPages = makeLambdaStat([this]() { return _ext_pages_footprint->count(); });
+        _numAccessedExtPages->init("numAccessedExtPages", "Number of external pages accessed");
+        _bwRatioStat = new ProxyStat();
+        _bwRatioStat->init("bwRatio", "Cache share of memory traffic at the last balance step (per mille)", &_bw_ratio);
+        _dsIndexStat = new ProxyStat();
+        _dsIndexStat->init("dsIndex", "Number of sets bypassed by bandwidth balancing", &_ds_index);
+        _balanceWbStat = new ProxyStat();
+        _balanceWbStat->init("balanceWb", "Dirty granules written back by bandwidth balancing", &_balance_wb_granules);
+
+        _shadows = BuildShadowCaches(config, _granularity, _num_ways, _num_sets, _num_shards);
     }
 
     virtual uint64_t access(MemReq& req) = 0;  // Pure virtual method for cache access
-    virtual void period(MemReq& req) = 0;
+    // Called after every access: periodic utilization logging and bandwidth balancing
+    virtual void period(MemReq& req);
     virtual void initStats(AggregateStat* parentStat) = 0;  // Stats initialization
 
+    // The controller binds the memories after construction; sharded controllers pass per-shard ports
+    void setMemories(MemObject* ext_dram, MemObject** mcdram, uint32_t mcdram_per_mc) {
+        _ext_dram = ext_dram;
+        _mcdram = mcdram;
+        _mcdram_per_mc = mcdram_per_mc;
+    }
+
+    // Feeds an access (by line address, as passed to access()) to the shadow capacities, if any
+    inline void accessShadows(Address lineAddr, bool isWrite) {
+        if (_shadows) _shadows->access(lineAddr / (_granularity / 64), isWrite);
+    }
+    void initShadowStats(AggregateStat* parentStat) {
+        if (_shadows) _shadows->initStats(parentStat);
+    }
+
     virtual TagBuffer* getTagBuffer() { return nullptr; }
     uint64_t getNumRequests() { return _num_requests; };
     void incNumRequests() { _num_requests++; };
     uint64_t getNumSets() { return _num_sets; };
     uint32_t getNumWays() { return _num_ways; };
-    double getRecentMissRate() { return (double)_num_miss_per_step / (_num_miss_per_step + _num_hit_per_step); };
+    double getRecentMissRate() {
+        uint64_t misses = _num_miss_per_step.get();
+        return (double)misses / (misses + _num_hit_per_step.get());
+    };
+    // Hits/misses of the current balance step; their change across an access gives its outcome
+    // Of one core only, which is enough to tell the outcome of its access
+    uint64_t getStepHits(uint32_t srcId) const { return _num_hit_per_step.getShard(srcId); }
+    uint64_t getStepMisses(uint32_t srcId) const { return _num_miss_per_step.getShard(srcId); }
     Set* getSets() { return _cache; };
     uint64_t getGranularity() const { return _granularity; }
     Scheme getScheme() { return _scheme; };
 
+    inline void recordExtAccess(Address lineAddr) {
+        _ext_lines_footprint->insert(lineAddr);
+        _ext_pages_footprint->insert(lineAddr / (_page_size / 64));
+    }
+
     virtual inline void updateUtilizationStats(uint32_t hit_set, uint32_t hit_way) {
+        if (!_line_access_count) return;
         uint64_t line_index = hit_set * _num_ways + hit_way;
-        if (_line_access_count[line_index] == 0) {
+        uint8_t& count = _line_access_count[line_index];
+        if (count == 0) {
             _accessed_lines++;
-        } else if (_line_access_count[line_index] == 1) {
+            count = 1;
+        } else if (count == 1) {
             _reaccessed_lines++;
+            count = 2;
         }
-        _line_access_count[line_index]++;
     }
     // Add method to log utilization statistics
     virtual void logUtilizationStats() {
         double utilization = (double)_accessed_lines / _total_lines * 100;
         double reaccess_rate = (double)_reaccessed_lines / _total_lines * 100;
-        double ext_utilization = (double)_accessed_ext_lines / _total_ext_lines * 100;
-        double ext_page_utilization = (double)_accessed_ext_pages / _total_ext_pages * 100;
+        uint64_t accessed_ext_lines = _ext_lines_footprint->count();
+        uint64_t accessed_ext_pages = _ext_pages_footprint->count();
+        double ext_utilization = (double)accessed_ext_lines / _total_ext_lines * 100;
+        double ext_page_utilization = (double)accessed_ext_pages / _total_ext_pages * 100;
         info("Cache utilization: %.2f%% (%ld/%ld lines accessed); %.2f%% (%ld/%ld re-accessed lines)", utilization, _accessed_lines, _total_lines, reaccess_rate, _reaccessed_lines, _total_lines);
-        info("Ext memory utilization: %.2f%% (%ld/%ld lines accessed); %.2f%% (%ld/%ld pages accessed)", ext_utilization, _accessed_ext_lines, _total_ext_lines, ext_page_utilization, _accessed_ext_pages, _total_ext_pages);
+        info("Ext memory utilization: %.2f%% (%ld/%ld lines accessed); %.2f%% (%ld/%ld pages accessed)", ext_utilization, accessed_ext_lines, _total_ext_lines, ext_page_utilization, accessed_ext_pages, _total_ext_pages);
     }
 };
 
@@ -5,6 +5,10 @@
 #include "g_std/g_string.h"
 #include "memory_hierarchy.h"
 
+#if !defined(CACHE_TAGS_SCALAR) && defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 enum Scheme {
     AlloyCache,
     UnisonCache,
@@ -26,38 +30,119 @@ enum ReqType {
     STORE
 };
 
-class Way {
-   public:
-    Address tag;
-    bool valid;
-    bool dirty;
-};
-
+/* One set of a scheme's tag store, in struct-of-arrays layout: the tags of all
+ * ways are contiguous, and valid/dirty state are bitmasks with one bit per way
+ * (bit w % 64 of word w / 64), so a lookup compares several tags per
+ * instruction and empty, clean or dirty ways come from masks instead of scans.
+ * The tag of an invalid way is meaningless. The arrays are carved out of flat
+ * per-scheme allocations (see CacheScheme).
+ *
+ * Sets of 16+ ways compare four tags at a time with AVX2 when the build
+ * targets it (e.g., march=native in SConstruct) unless CACHE_TAGS_SCALAR is
+ * defined; smaller sets, and other builds, use an early-exit loop. (SSE4.1
+ * compares, two tags at a time, lose to that loop at every size.)
+ * tagbench measures both against the former array-of-structs layout.
+ */
 class Set {
    public:
-    Way* ways;
+    Address* tags;
+    uint64_t* valid;
+    uint64_t* dirty;
     uint32_t num_ways;
 
-    uint32_t getEmptyWay() {
-        for (uint32_t i = 0; i < num_ways; i++)
-            if (!ways[i].valid)
-                return i;
+    enum WayState { EMPTY, CLEAN, DIRTY };
+
+    inline bool isValid(uint32_t way) const { return (valid[way >> 6] >> (way & 63)) & 1; }
+    inline bool isDirty(uint32_t way) const { return (dirty[way >> 6] >> (way & 63)) & 1; }
+    inline Address getTag(uint32_t way) const { return tags[way]; }
+
+    inline void fill(uint32_t way, Address tag, bool isDirty) {
+        tags[way] = tag;
+        valid[way >> 6] |= 1ul << (way & 63);
+        setDirty(way, isDirty);
+    }
+    inline void setDirty(uint32_t way, bool isDirty = true) {
+        uint64_t bit = 1ul << (way & 63);
+        dirty[way >> 6] = isDirty ? (dirty[way >> 6] | bit) : (dirty[way >> 6] & ~bit);
+    }
+    inline void invalidate(uint32_t way) {
+        valid[way >> 6] &= ~(1ul << (way & 63));
+        dirty[way >> 6] &= ~(1ul << (way & 63));
+    }
+
+    // Valid way holding tag, or num_ways if none
+    inline uint32_t lookup(Address tag) const {
+#if !defined(CACHE_TAGS_SCALAR) && defined(__AVX2__)
+        // Below 16 ways, an early-exit scan beats comparing every tag
+        if (num_ways >= 16) {
+            for (uint32_t base = 0; base < num_ways; base += 64) {
+                uint32_t n = (num_ways - base < 64) ? num_ways - base : 64;
+                uint64_t hit = matchTags(tags + base, n, tag) & valid[base >> 6];
+                if (hit) return base + __builtin_ctzl(hit);
+            }
+            return num_ways;
+        }
+#endif
+        for (uint32_t way = 0; way < num_ways; way++) {
+            if (tags[way] == tag && isValid(way)) return way;
+        }
         return num_ways;
-    };
-    bool hasEmptyWay() { return getEmptyWay() < num_ways; };
-};
+    }
 
-class TLBEntry {
-   public:
-    uint64_t tag;
-    uint64_t way;
-    uint64_t count;  // for OS based placement policy
+    inline uint32_t getEmptyWay() const {
+        for (uint32_t word = 0; word < numWords(); word++) {
+            uint64_t empty = stateWord(EMPTY, word);
+            if (empty) return word * 64 + __builtin_ctzl(empty);
+        }
+        return num_ways;
+    }
+    inline bool hasEmptyWay() const { return getEmptyWay() < num_ways; };
+
+    // Number of ways in a state, and the n-th of them (0-based, in way order)
+    inline uint32_t countWays(WayState state) const {
+        uint32_t count = 0;
+        for (uint32_t word = 0; word < numWords(); word++) count += __builtin_popcountl(stateWord(state, word));
+        return count;
+    }
+    inline uint32_t nthWay(WayState state, uint32_t n) const {
+        for (uint32_t word = 0; word < numWords(); word++) {
+            uint64_t bits = stateWord(state, word);
+            uint32_t count = __builtin_popcountl(bits);
+            if (n >= count) {
+                n -= count;
+                continue;
+            }
+            while (n--) bits &= bits - 1;  // drop the lowest set bits
+            return word * 64 + __builtin_ctzl(bits);
+        }
+        return num_ways;
+    }
+
+   private:
+    inline uint32_t numWords() const { return (num_ways + 63) / 64; }
+    inline uint64_t stateWord(WayState state, uint32_t word) const {
+        uint64_t inSet = (word == numWords() - 1 && (num_ways & 63)) ? (1ul << (num_ways & 63)) - 1 : ~0ul;
+        switch (state) {
+            case EMPTY: return ~valid[word] & inSet;
+            case CLEAN: return valid[word] & ~dirty[word];
+            default: return valid[word] & dirty[word];
+        }
+    }
 
-    // the following two are only for UnisonCache
-    // due to space cosntraint, it is not feasible to keep one bit for each line,
-    // so we use 1 bit for 4 lines.
-    uint64_t touch_bitvec;  // whether a line is touched in a page
-    uint64_t dirty_bitvec;  // whether a line is dirty in page
+#if !defined(CACHE_TAGS_SCALAR) && defined(__AVX2__)
+    // Bit i set iff tags[i] == tag, for n <= 64 tags
+    static inline uint64_t matchTags(const Address* tags, uint32_t n, Address tag) {
+        uint64_t match = 0;
+        uint32_t i = 0;
+        __m256i key = _mm256_set1_epi64x(tag);
+        for (; i + 4 <= n; i += 4) {
+            __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(tags + i)), key);
+            match |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << i;
+        }
+        for (; i < n; i++) match |= (uint64_t)(tags[i] == tag) << i;
+        return match;
+    }
+#endif
 };
 
 class LineEntry {
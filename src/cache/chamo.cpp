@@ -8,30 +8,16 @@
 #include "mc.h"
 
 uint64_t CHAMOScheme::_GetBaseRank(uint64_t dram_cache_idx, uint64_t target_level_idx) {
-    // assert(target_level_idx < dram_ratio_);
+    assert(target_level_idx < dram_ratio_);
+    assert(_TestBit(access_bit_map_, dram_cache_idx, target_level_idx));
 
-    // assert(target_level_idx < dram_base_rank_.size());
-    // assert(dram_cache_idx < dram_base_rank_[target_level_idx].size());
-    // uint64_t base_rank = dram_base_rank_[target_level_idx][dram_cache_idx];
-
-    // 先计算基础的base_rank
+    // base_rank = 1 + 该列中低于target_level的被访问level个数
+    const uint64_t* col_bits = &access_bit_map_[dram_cache_idx * words_per_col_];
     uint64_t base_rank = 1;
-    uint64_t cxl_level;
-    for (cxl_level = 0; cxl_level < dram_ratio_; cxl_level += 1) {
-        assert(cxl_level < access_bit_map_.size());
-
-        if (cxl_level == target_level_idx) {
-            assert(access_bit_map_[cxl_level][dram_cache_idx]);
-            break;
-        }
-
-        if (access_bit_map_[cxl_level][dram_cache_idx]) {
-            base_rank += 1;
-        }
+    for (uint64_t w = 0; w < target_level_idx / 64; w++) {
+        base_rank += __builtin_popcountll(col_bits[w]);
     }
-
-    assert(cxl_level < dram_ratio_);
-    assert(base_rank <= dram_ratio_);
+    base_rank += __builtin_popcountll(col_bits[target_level_idx / 64] & ((1ULL << (target_level_idx % 64)) - 1));
 
     assert(base_rank > 0);
     assert(base_rank <= dram_ratio_);
@@ -40,20 +26,6 @@ uint64_t CHAMOScheme::_GetBaseRank(uint64_t dram_cache_idx, uint64_t target_leve
     return base_rank;
 }
 
-uint64_t CHAMOScheme::_GetColCap(uint64_t dram_cache_idx) {
-    uint64_t cap = 0;
-    for (uint64_t level_idx = 0; level_idx < dram_ratio_; level_idx += 1) {
-        assert(level_idx < access_bit_map_.size());
-        assert(dram_cache_idx < access_bit_map_[level_idx].size());
-
-        if (access_bit_map_[level_idx][dram_cache_idx]) {
-            cap += 1;
-        }
-    }
-
-    return cap;
-}
-
 bool CHAMOScheme::CheckCuckooPath(uint64_t dram_cache_idx, uint64_t& cuckoo_path_len) {
     cuckoo_path_len = 0;
 
@@ -62,13 +34,14 @@ bool CHAMOScheme::CheckCuckooPath(uint64_t dram_cache_idx, uint64_t& cuckoo_path
     for (uint64_t idx = 0; idx < cuckoo_window_len_; idx += 1) {
         uint64_t col_idx = (dram_cache_idx + idx) % nr_dram_cache_;
         assert(col_idx < dram_overflow_rank_.size());
+        uint64_t col_load = _GetColCap(col_idx) + dram_overflow_rank_[col_idx];
 
         // 已经有col无法容忍新的元素了，退出循环
-        if (_GetColCap(col_idx) + dram_overflow_rank_[col_idx] >= 2 * nr_map_limit_) {
+        if (col_load >= 2 * nr_map_limit_) {
             break;
         }
 
-        if (_GetColCap(col_idx) + dram_overflow_rank_[col_idx] < nr_map_limit_) {
+        if (col_load < nr_map_limit_) {
             cuckoo_path_len = idx;
             return true;
         }
@@ -112,15 +85,15 @@ void CHAMOScheme::_UpdateMapLimit(void) {
 
 uint64_t CHAMOScheme::_HashIdxToAddr(uint64_t line_addr_in_level, uint64_t level_idx, uint64_t hash_idx) {
     uint64_t target_addr = 0;
-    assert(level_idx < is_cuckoo_hash_.size());
-    assert(line_addr_in_level < is_cuckoo_hash_[level_idx].size());
+    assert(level_idx < dram_ratio_);
+    assert(line_addr_in_level < nr_dram_cache_);
     if (hash_idx == 0 || hash_idx == 1) {
         // 使用cuckoo hash
-        // assert(is_cuckoo_hash_[level_idx][line_addr_in_level]);
+        // assert(_TestBit(is_cuckoo_hash_, line_addr_in_level, level_idx));
 
         // 更新cuckoo成功映射的函数 (这里主要是更新nr_map_limit更新后没计入的cuckoo_cnt)
-        if (!is_cuckoo_hash_[level_idx][line_addr_in_level]) {
-            is_cuckoo_hash_[level_idx][line_addr_in_level] = true;
+        if (!_TestBit(is_cuckoo_hash_, line_addr_in_level, level_idx)) {
+            _SetBit(is_cuckoo_hash_, line_addr_in_level, level_idx, true);
 
             hash_metric_.nr_cuckoo_cnt_ += 1;
         }
@@ -132,8 +105,8 @@ uint64_t CHAMOScheme::_HashIdxToAddr(uint64_t line_addr_in_level, uint64_t level
         assert(hash_idx == 2);
 
         // 更新cuckoo映射失败的函数
-        if (is_cuckoo_hash_[level_idx][line_addr_in_level]) {
-            is_cuckoo_hash_[level_idx][line_addr_in_level] = false;
+        if (_TestBit(is_cuckoo_hash_, line_addr_in_level, level_idx)) {
+            _SetBit(is_cuckoo_hash_, line_addr_in_level, level_idx, false);
 
             hash_metric_.nr_cuckoo_cnt_ -= 1;
         }
@@ -145,12 +118,10 @@ uint64_t CHAMOScheme::_HashIdxToAddr(uint64_t line_addr_in_level, uint64_t level
     assert(hash_metric_.nr_cuckoo_cnt_ <= hash_metric_.nr_touched_cnt_);
 
     // 更新hash_idx变化情况
-    assert(level_idx < hash_idx_.size());
-    assert(line_addr_in_level < hash_idx_[level_idx].size());
-    if (hash_idx_[level_idx][line_addr_in_level] != hash_idx) {
+    if (_GetHashIdx(line_addr_in_level, level_idx) != hash_idx) {
         hash_metric_.nr_period_hash_change_cnt_ += 1;
 
-        hash_idx_[level_idx][line_addr_in_level] = hash_idx;
+        _SetHashIdx(line_addr_in_level, level_idx, hash_idx);
     }
 
     return target_addr;
@@ -161,8 +132,7 @@ uint64_t CHAMOScheme::_RankToAddr(uint64_t base_rank, uint64_t overflow_rank,
     uint8_t target_hash_idx = (uint8_t)-1;
     uint64_t target_addr = 0;
     uint64_t next_col_idx = (line_addr_in_level + 1) % nr_dram_cache_;
-    assert(level_idx < is_cuckoo_hash_.size());
-    assert(line_addr_in_level < is_cuckoo_hash_[level_idx].size());
+    assert(level_idx < dram_ratio_);
     assert(line_addr_in_level < dram_self_contain_rank_.size());
     assert(line_addr_in_level < dram_overflow_rank_.size());
     assert(next_col_idx < dram_self_contain_rank_.size());
@@ -213,23 +183,20 @@ uint64_t CHAMOScheme::GetAlterCxlLineAddr(uint64_t phy_cache_addr) {
 }
 
 void CHAMOScheme::UpdateMappingInfo(uint64_t dram_cache_idx, uint64_t level_idx) {
-    assert(level_idx < is_cuckoo_hash_.size());
-    assert(dram_cache_idx < is_cuckoo_hash_[level_idx].size());
-    assert(!is_cuckoo_hash_[level_idx][dram_cache_idx]);
+    assert(level_idx < dram_ratio_);
+    assert(!_TestBit(is_cuckoo_hash_, dram_cache_idx, level_idx));
 
     // 先判断能否抢夺右侧列的资源
     uint64_t next_col_idx = (dram_cache_idx + 1) % nr_dram_cache_;
     assert(dram_cache_idx < dram_self_contain_rank_.size());
     assert(dram_cache_idx < dram_overflow_rank_.size());
-    assert(level_idx < is_cuckoo_hash_.size());
-    assert(dram_cache_idx < is_cuckoo_hash_[level_idx].size());
     assert(next_col_idx < dram_overflow_rank_.size());
     assert(next_col_idx < dram_self_contain_rank_.size());
     if (dram_self_contain_rank_[next_col_idx] + dram_overflow_rank_[next_col_idx] < nr_map_limit_) {
         dram_overflow_rank_[next_col_idx] += 1;
         assert(dram_self_contain_rank_[next_col_idx] + dram_overflow_rank_[next_col_idx] <= nr_map_limit_);
 
-        is_cuckoo_hash_[level_idx][dram_cache_idx] = true;
+        _SetBit(is_cuckoo_hash_, dram_cache_idx, level_idx, true);
         hash_metric_.nr_cuckoo_cnt_ += 1;
 
         return;
@@ -240,7 +207,7 @@ void CHAMOScheme::UpdateMappingInfo(uint64_t dram_cache_idx, uint64_t level_idx)
         dram_self_contain_rank_[dram_cache_idx] += 1;
         assert(dram_self_contain_rank_[dram_cache_idx] + dram_overflow_rank_[dram_cache_idx] <= nr_map_limit_);
 
-        is_cuckoo_hash_[level_idx][dram_cache_idx] = true;
+        _SetBit(is_cuckoo_hash_, dram_cache_idx, level_idx, true);
         hash_metric_.nr_cuckoo_cnt_ += 1;
 
         return;
@@ -258,25 +225,17 @@ uint64_t CHAMOScheme::Index(uint64_t cache_addr) {
 
     // 我们提出cxl_level的概念, e.g., DRAM:CXL = 1:4情况下，CXL_level = 4
     uint64_t cxl_level = phy_line_addr / nr_dram_cache_;
-    assert(cxl_level < access_bit_map_.size());
+    assert(cxl_level < dram_ratio_);
 
     uint64_t line_offset_in_level = phy_line_addr % nr_dram_cache_;
-    assert(line_offset_in_level < access_bit_map_[cxl_level].size());
 
-    if (!access_bit_map_[cxl_level][line_offset_in_level]) {
-        assert(cxl_level < dram_base_rank_.size());
-        assert(line_offset_in_level < dram_base_rank_[cxl_level].size());
-        assert(dram_base_rank_[cxl_level][line_offset_in_level] == 0);
-        dram_base_rank_[cxl_level][line_offset_in_level] = _GetColCap(line_offset_in_level) + 1;
-        assert(dram_base_rank_[cxl_level][line_offset_in_level] > 0 &&
-               dram_base_rank_[cxl_level][line_offset_in_level] <= dram_ratio_);
-
-        access_bit_map_[cxl_level][line_offset_in_level] = true;
+    if (!_TestBit(access_bit_map_, line_offset_in_level, cxl_level)) {
+        _SetBit(access_bit_map_, line_offset_in_level, cxl_level, true);
+        col_cap_[line_offset_in_level] += 1;
+        assert(col_cap_[line_offset_in_level] <= dram_ratio_);
         hash_metric_.nr_touched_cnt_ += 1;
         hash_metric_.nr_period_newly_cache_cnt_ += 1;
 
-        assert(dram_base_rank_[cxl_level][line_offset_in_level] == _GetColCap(line_offset_in_level));
-
         UpdateMappingInfo(line_offset_in_level, cxl_level);
     }
 
@@ -298,16 +257,13 @@ uint64_t CHAMOScheme::access(MemReq& req) {
     assert(mc_address < _cache_size / 64);
     assert(address < _ext_size / 64);
 
-    _accessed_ext_lines_set.insert(address);
-    _accessed_ext_lines = _accessed_ext_lines_set.size();
-    _accessed_ext_pages_set.insert(address / (_page_size / 64));
-    _accessed_ext_pages = _accessed_ext_pages_set.size();
+    recordExtAccess(address);
 
     // info("RW:%d, lineAddr = 0x%lx, phy_addr = 0x%lx, cache_addr = 0x%lx, set_num = %ld, tag = 0x%lx\n", type, req.lineAddr, address, mc_address, set_num, tag);
 
     // Check for cache hit
     uint32_t hit_way = 0;
-    if (!(_cache[set_num].ways[hit_way].valid && _cache[set_num].ways[hit_way].tag == tag)) {
+    if (!(_cache[set_num].isValid(hit_way) && _cache[set_num].getTag(hit_way) == tag)) {
         hit_way = _num_ways;
     }
 
@@ -319,86 +275,82 @@ uint64_t CHAMOScheme::access(MemReq& req) {
     if (type == LOAD) {
         // Simulate cache access (in-subarray tag matching)
         MemReq read_req = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-        req.cycle = _mc->_mcdram[mcdram_select]->access(read_req, 0, 4);
-        _mc_bw_per_step += 4;
+        req.cycle = _mcdram[mcdram_select]->access(read_req, 0, 4);
+        _mc_bw_per_step.inc(req.srcId, 4);
 
         if (hit_way < _num_ways) {
             // Cache hit
             updateUtilizationStats(set_num, hit_way);
-            _num_hit_per_step++;
-            _numLoadHit.inc();
+            _num_hit_per_step.inc(req.srcId);
+            _numLoadHit.inc(req.srcId);
             data_ready_cycle = req.cycle;  // Data available after cache latency
         } else {
             // Cache miss: Fetch from main memory and fill the cache
-            _num_miss_per_step++;
-            _numLoadMiss.inc();
+            _num_miss_per_step.inc(req.srcId);
+            _numLoadMiss.inc(req.srcId);
 
             // Fetch data from main memory
             MemReq main_memory_req = {address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-            data_ready_cycle = _mc->_ext_dram->access(main_memory_req, 1, 4);
-            _ext_bw_per_step += 4;
+            data_ready_cycle = _ext_dram->access(main_memory_req, 1, 4);
+            _ext_bw_per_step.inc(req.srcId, 4);
 
             // Handle eviction if victim is dirty
-            if (_cache[set_num].ways[victim_way].valid && _cache[set_num].ways[victim_way].dirty) {
+            if (_cache[set_num].isValid(victim_way) && _cache[set_num].isDirty(victim_way)) {
                 // N.B. Load line from dram cache before write-back.
                 Address victim_address = mc_address; // pseudo-address
                 MemReq read_req = {victim_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                _mc->_mcdram[mcdram_select]->access(read_req, 2, 4);
-                _mc_bw_per_step += 4;
+                _mcdram[mcdram_select]->access(read_req, 2, 4);
+                _mc_bw_per_step.inc(req.srcId, 4);
 
-                Address wb_address = _cache[set_num].ways[victim_way].tag;
+                Address wb_address = _cache[set_num].getTag(victim_way);
                 MemReq wb_req = {wb_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                _mc->_ext_dram->access(wb_req, 2, 4);  // Write-back to main memory
-                _ext_bw_per_step += 4;
-                _numDirtyEviction.inc();
-            } else if (_cache[set_num].ways[victim_way].valid) {
-                _numCleanEviction.inc();
+                _ext_dram->access(wb_req, 2, 4);  // Write-back to main memory
+                _ext_bw_per_step.inc(req.srcId, 4);
+                _numDirtyEviction.inc(req.srcId);
+            } else if (_cache[set_num].isValid(victim_way)) {
+                _numCleanEviction.inc(req.srcId);
             }
 
             // Insert new line (fill operation)
-            _cache[set_num].ways[victim_way].tag = tag;
-            _cache[set_num].ways[victim_way].valid = true;
-            _cache[set_num].ways[victim_way].dirty = false;  // LOAD: line is clean
+            _cache[set_num].fill(victim_way, tag, false);  // LOAD: line is clean
             updateUtilizationStats(set_num, victim_way);
         }
     } else {  // STORE
         // Simulate cache write access
         MemReq write_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-        req.cycle = _mc->_mcdram[mcdram_select]->access(write_req, 0, 4);
-        _mc_bw_per_step += 4;
+        req.cycle = _mcdram[mcdram_select]->access(write_req, 0, 4);
+        _mc_bw_per_step.inc(req.srcId, 4);
 
         if (hit_way < _num_ways) {
             // Write hit
             updateUtilizationStats(set_num, hit_way);
-            _num_hit_per_step++;
-            _numStoreHit.inc();
-            _cache[set_num].ways[hit_way].dirty = true;
+            _num_hit_per_step.inc(req.srcId);
+            _numStoreHit.inc(req.srcId);
+            _cache[set_num].setDirty(hit_way);
             data_ready_cycle = req.cycle;
         } else {
             // Write miss
-            _num_miss_per_step++;
-            _numStoreMiss.inc();
+            _num_miss_per_step.inc(req.srcId);
+            _numStoreMiss.inc(req.srcId);
 
             // Handle eviction if victim is dirty
-            if (_cache[set_num].ways[victim_way].valid && _cache[set_num].ways[victim_way].dirty) {
+            if (_cache[set_num].isValid(victim_way) && _cache[set_num].isDirty(victim_way)) {
                 // N.B. Load line from dram cache before write-back.
                 Address victim_address = mc_address; // pseudo-address
                 MemReq read_req = {victim_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                _mc->_mcdram[mcdram_select]->access(read_req, 2, 4);
-                _mc_bw_per_step += 4;
+                _mcdram[mcdram_select]->access(read_req, 2, 4);
+                _mc_bw_per_step.inc(req.srcId, 4);
 
-                Address wb_address = _cache[set_num].ways[victim_way].tag;
+                Address wb_address = _cache[set_num].getTag(victim_way);
                 MemReq wb_req = {wb_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                _mc->_ext_dram->access(wb_req, 2, 4);  // Write-back to main memory, non-critical
-                _ext_bw_per_step += 4;
-                _numDirtyEviction.inc();
-            } else if (_cache[set_num].ways[victim_way].valid) {
-                _numCleanEviction.inc();
+                _ext_dram->access(wb_req, 2, 4);  // Write-back to main memory, non-critical
+                _ext_bw_per_step.inc(req.srcId, 4);
+                _numDirtyEviction.inc(req.srcId);
+            } else if (_cache[set_num].isValid(victim_way)) {
+                _numCleanEviction.inc(req.srcId);
             }
             // Insert new line
-            _cache[set_num].ways[victim_way].tag = tag;
-            _cache[set_num].ways[victim_way].valid = true;
-            _cache[set_num].ways[victim_way].dirty = true;  // STORE: mark as dirty
+            _cache[set_num].fill(victim_way, tag, true);  // STORE: mark as dirty
             data_ready_cycle = req.cycle;
             updateUtilizationStats(set_num, victim_way);
         }
@@ -407,77 +359,20 @@ uint64_t CHAMOScheme::access(MemReq& req) {
     return data_ready_cycle;
 }
 
-void CHAMOScheme::period(MemReq& req) {
-    if (_stats_period && _num_requests % _stats_period == 0) {
-        logUtilizationStats();
-        // Reset access counts after logging
-        for (uint64_t i = 0; i < _total_lines; i++) {
-             _line_access_count[i] &= ((1ULL << 32) - 1);
-        }
-    }
-    // Handle bandwidth balance if needed
-    if (_bw_balance && _num_requests % _step_length == 0) {
-        _num_hit_per_step /= 2;
-        _num_miss_per_step /= 2;
-        _mc_bw_per_step /= 2;
-        _ext_bw_per_step /= 2;
-
-        if (_bw_balance && _mc_bw_per_step + _ext_bw_per_step > 0) {
-            // Calculate current bandwidth ratio
-            double ratio = 1.0 * _mc_bw_per_step / (_mc_bw_per_step + _ext_bw_per_step);
-            double target_ratio = 0.8;  // Target ratio (mc_bw = 4 * ext_bw)
-
-            // Adjust _ds_index based on bandwidth difference
-            uint64_t index_step = _num_sets / 1000;
-            int64_t delta_index = (ratio - target_ratio > -0.02 && ratio - target_ratio < 0.02) ? 0 : index_step * (ratio - target_ratio) / 0.01;
-
-            printf("ratio = %f\n", ratio);
-
-            if (delta_index > 0) {
-                // Handle increasing _ds_index
-                for (uint32_t mc = 0; mc < _mc->_mcdram_per_mc; mc++) {
-                    for (uint64_t set = _ds_index; set < (uint64_t)(_ds_index + delta_index); set++) {
-                        if (set >= _num_sets) break;
-
-                        for (uint32_t way = 0; way < _num_ways; way++) {
-                            Way& meta = _cache[set].ways[way];
-                            if (meta.valid && meta.dirty) {
-                                // Write back to external DRAM
-                                MESIState state;
-                                MemReq load_req = {meta.tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                                _mc->_mcdram[mc]->access(load_req, 2, (_granularity / 64) * 4);
-                                MemReq wb_req = {meta.tag * 64, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                                _mc->_ext_dram->access(wb_req, 2, (_granularity / 64) * 4);
-                                _ext_bw_per_step += (_granularity / 64) * 4;
-                                _mc_bw_per_step += (_granularity / 64) * 4;
-                            }
-
-                            meta.valid = false;
-                            meta.dirty = false;
-                        }
-                    }
-                }
-            }
-            _ds_index = ((int64_t)_ds_index + delta_index <= 0) ? 0 : _ds_index + delta_index;
-            printf("_ds_index = %ld/%ld\n", _ds_index, _num_sets);
-        }
-    }
-}
-
 void CHAMOScheme::initStats(AggregateStat* parentStat) {
     AggregateStat* stats = new AggregateStat();
     stats->init("chamoCache", "CHAMO Cache stats");
-    _numCleanEviction.init("cleanEvict", "Clean Eviction");
+    _numCleanEviction.init("cleanEvict", "Clean Eviction", zinfo->numCores);
     stats->append(&_numCleanEviction);
-    _numDirtyEviction.init("dirtyEvict", "Dirty Eviction");
+    _numDirtyEviction.init("dirtyEvict", "Dirty Eviction", zinfo->numCores);
     stats->append(&_numDirtyEviction);
-    _numLoadHit.init("loadHit", "Load Hit");
+    _numLoadHit.init("loadHit", "Load Hit", zinfo->numCores);
     stats->append(&_numLoadHit);
-    _numLoadMiss.init("loadMiss", "Load Miss");
+    _numLoadMiss.init("loadMiss", "Load Miss", zinfo->numCores);
     stats->append(&_numLoadMiss);
-    _numStoreHit.init("storeHit", "Store Hit");
+    _numStoreHit.init("storeHit", "Store Hit", zinfo->numCores);
     stats->append(&_numStoreHit);
-    _numStoreMiss.init("storeMiss", "Store Miss");
+    _numStoreMiss.init("storeMiss", "Store Miss", zinfo->numCores);
     stats->append(&_numStoreMiss);
     
     stats->append(_numReaccessedLines);
@@ -487,6 +382,7 @@ void CHAMOScheme::initStats(AggregateStat* parentStat) {
     stats->append(_numTotalExtLines);
     stats->append(_numAccessedExtPages);
     stats->append(_numTotalExtPages);
+    appendBalanceStats(stats);
     
     parentStat->append(stats);
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
@@ -39,20 +40,24 @@ class CHAMOScheme : public CacheScheme  {
             nr_dram_cache_(_cache_size / 64),
             nr_cxl_cache_(_ext_size / 64),
             dram_ratio_(nr_cxl_cache_ / nr_dram_cache_ ),
+            words_per_col_((dram_ratio_ + 63) / 64),
+            hash_words_per_col_((dram_ratio_ + 31) / 32),
             nr_map_limit_(1),
             load_ratio_(95),
             cuckoo_window_len_(4),
             hash_metric_{0, 0, 0, 0, 0},
             dram_overflow_rank_(nr_dram_cache_, 0),
-            dram_base_rank_(dram_ratio_, std::vector<uint64_t>(nr_dram_cache_, 0)),
             dram_self_contain_rank_(nr_dram_cache_, 0),
-            access_bit_map_(dram_ratio_, std::vector<bool>(nr_dram_cache_, false)),
-            is_cuckoo_hash_(dram_ratio_, std::vector<bool>(nr_dram_cache_, false)),
-            hash_idx_(dram_ratio_, std::vector<uint8_t>(nr_dram_cache_, (uint8_t)-1)),
             lcg_(nr_cxl_cache_),
             next_line_(nr_dram_cache_)
             {
                 _scheme = CHAMO;
+                // 按列(column-major)存放的位图，每列的所有level在连续的words中
+                access_bit_map_ = gm_calloc<uint64_t>(nr_dram_cache_ * words_per_col_);
+                is_cuckoo_hash_ = gm_calloc<uint64_t>(nr_dram_cache_ * words_per_col_);
+                col_cap_ = gm_calloc<uint32_t>(nr_dram_cache_);
+                hash_idx_ = gm_calloc<uint64_t>(nr_dram_cache_ * hash_words_per_col_);
+                memset(hash_idx_, 0xff, sizeof(uint64_t) * nr_dram_cache_ * hash_words_per_col_);  // 全部为kHashIdxNone
             };
 
     protected:
@@ -61,13 +66,14 @@ class CHAMOScheme : public CacheScheme  {
         uint64_t access(MemReq& req) override;
         uint64_t Index(uint64_t phy_line_addr);
 
-        void period(MemReq& req) override;
         void initStats(AggregateStat* parentStat) override;
 
     private:
         uint64_t nr_dram_cache_;
         uint64_t nr_cxl_cache_;
         uint64_t dram_ratio_;
+        uint64_t words_per_col_;        // 每列access/cuckoo位图占用的64-bit words数
+        uint64_t hash_words_per_col_;   // 每列hash_idx占用的words数 (每个level 2 bits)
         uint64_t nr_map_limit_; // 1->n
         uint64_t load_ratio_;
         uint64_t cuckoo_window_len_;
@@ -75,21 +81,40 @@ class CHAMOScheme : public CacheScheme  {
         std::ofstream cuckoo_metric_stream_;
 
         std::vector<uint64_t> dram_overflow_rank_;
-        std::vector<std::vector<uint64_t>> dram_base_rank_;
         std::vector<uint64_t> dram_self_contain_rank_;    // 映射到自己对应的这一列，和overflow_rank相互抢同一列的资源
-        std::vector<std::vector<bool>> access_bit_map_;
-        std::vector<std::vector<bool>> is_cuckoo_hash_;
-        std::vector<std::vector<uint8_t>> hash_idx_;    // -1代表默认值
+        uint64_t* access_bit_map_;  // [col][level/64]: level被访问过则置位
+        uint64_t* is_cuckoo_hash_;  // [col][level/64]: level使用cuckoo hash则置位
+        uint32_t* col_cap_;         // 每列被访问的cache block个数, 即access_bit_map_该列的popcount
+        uint64_t* hash_idx_;        // [col][level/32]: 每个level 2 bits, kHashIdxNone代表默认值
+
+        static const uint64_t kHashIdxNone = 3;
+
+        inline bool _TestBit(const uint64_t* bit_map, uint64_t col_idx, uint64_t level_idx) const {
+            return (bit_map[col_idx * words_per_col_ + level_idx / 64] >> (level_idx % 64)) & 1;
+        }
+        inline void _SetBit(uint64_t* bit_map, uint64_t col_idx, uint64_t level_idx, bool value) {
+            uint64_t& word = bit_map[col_idx * words_per_col_ + level_idx / 64];
+            uint64_t mask = 1ULL << (level_idx % 64);
+            word = value ? (word | mask) : (word & ~mask);
+        }
+        inline uint64_t _GetHashIdx(uint64_t col_idx, uint64_t level_idx) const {
+            return (hash_idx_[col_idx * hash_words_per_col_ + level_idx / 32] >> (2 * (level_idx % 32))) & 3;
+        }
+        inline void _SetHashIdx(uint64_t col_idx, uint64_t level_idx, uint64_t hash_idx) {
+            uint64_t& word = hash_idx_[col_idx * hash_words_per_col_ + level_idx / 32];
+            uint64_t shift = 2 * (level_idx % 32);
+            word = (word & ~(3ULL << shift)) | (hash_idx << shift);
+        }
         LCGHash lcg_;
         NextLineHash next_line_;
 
         // Statistics counters
-        Counter _numCleanEviction;
-        Counter _numDirtyEviction;
-        Counter _numLoadHit;
-        Counter _numLoadMiss;
-        Counter _numStoreHit;
-        Counter _numStoreMiss;
+        ShardedCounter _numCleanEviction;
+        ShardedCounter _numDirtyEviction;
+        ShardedCounter _numLoadHit;
+        ShardedCounter _numLoadMiss;
+        ShardedCounter _numStoreHit;
+        ShardedCounter _numStoreMiss;
 
         // CheckCuckooPath
         // 判断在cuckoo_path length内是否能成功插入,cuckoo_path_len为成功插入的路径长度:0->cuckoo_window_len-1
@@ -97,7 +122,10 @@ class CHAMOScheme : public CacheScheme  {
         void UpdateCUckooPath(uint64_t dram_cache_idx, uint64_t cuckoo_path_len);
 
         // 计算每个cache block的等效rank
-        uint64_t _GetColCap(uint64_t dram_cache_idx);   // 获取某列中被访问的cache block个数  
+        inline uint64_t _GetColCap(uint64_t dram_cache_idx) {   // 获取某列中被访问的cache block个数
+            assert(dram_cache_idx < nr_dram_cache_);
+            return col_cap_[dram_cache_idx];
+        }
         uint64_t _GetBaseRank(uint64_t dram_cache_idx, uint64_t target_level_idx);
         uint64_t _GetOverflowRank(uint64_t dram_cache_idx, uint64_t target_level_idx);
         uint64_t _GetSelfContainRank(uint64_t dram_cache_idx);
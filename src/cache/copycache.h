@@ -6,14 +6,13 @@
 
 class CopyCacheScheme : public CacheScheme {
    private:
-    Counter _numLoadHit;  // Counter for load hits
+    ShardedCounter _numLoadHit;  // Counter for load hits
    public:
     CopyCacheScheme(Config& config, MemoryController* mc)
         : CacheScheme(config, mc) {
         _scheme = CopyCache;
     }
     uint64_t access(MemReq& req) override;
-    void period(MemReq& req) override;
     void initStats(AggregateStat* parentStat) override;
 };
 
@@ -0,0 +1,55 @@
+#include "cache/footprint.h"
+
+#include <math.h>
+#include <string.h>
+#include "log.h"
+
+SparseBitmapTracker::SparseBitmapTracker(uint64_t universe) : _leaves(nullptr), _num_leaves(0), _count(0) {
+    uint64_t numLeaves = (universe + (1ul << LEAF_BITS) - 1) >> LEAF_BITS;
+    if (universe && numLeaves <= MAX_FLAT_LEAVES) {
+        _num_leaves = numLeaves;
+        _leaves = gm_calloc<uint64_t*>(_num_leaves);
+    }
+}
+
+uint64_t* SparseBitmapTracker::getLeaf(uint64_t leafIdx) {
+    uint64_t** slot;
+    if (_leaves && leafIdx < _num_leaves) {
+        slot = &_leaves[leafIdx];
+    } else {
+        // Unbounded universe, or a key outside the declared one
+        slot = &_leaf_map[leafIdx];
+    }
+    if (unlikely(!*slot)) *slot = gm_calloc<uint64_t>(LEAF_WORDS);
+    return *slot;
+}
+
+HyperLogLogTracker::HyperLogLogTracker() {
+    _regs = gm_calloc<uint8_t>(NUM_REGS);
+}
+
+uint64_t HyperLogLogTracker::count() const {
+    double sum = 0.0;
+    uint32_t zeros = 0;
+    for (uint32_t i = 0; i < NUM_REGS; i++) {
+        sum += ldexp(1.0, -_regs[i]);
+        if (_regs[i] == 0) zeros++;
+    }
+    double m = NUM_REGS;
+    double estimate = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+    // Small-range correction (linear counting); 64-bit hashes need no large-range one
+    if (estimate <= 2.5 * m && zeros) estimate = m * log(m / zeros);
+    return (uint64_t)(estimate + 0.5);
+}
+
+FootprintTracker* BuildFootprintTracker(const g_string& type, uint64_t universe) {
+    if (type == "Bitmap") {
+        return new SparseBitmapTracker(universe);
+    } else if (type == "HLL") {
+        return new HyperLogLogTracker();
+    } else if (type == "None") {
+        return new NullFootprintTracker();
+    } else {
+        panic("Invalid footprint tracker %s (Bitmap, HLL or None)", type.c_str());
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef _FOOTPRINT_H_
+#define _FOOTPRINT_H_
+
+#include <stdint.h>
+#include "g_std/g_string.h"
+#include "g_std/g_unordered_map.h"
+#include "galloc.h"
+
+/* Counts the distinct keys (e.g., external lines or pages) a scheme has touched.
+ * Replaces per-key hash sets, which grow to hundreds of millions of nodes in the
+ * shared heap on large external memories. */
+class FootprintTracker : public GlobAlloc {
+   public:
+    virtual ~FootprintTracker() {}
+    virtual void insert(uint64_t key) = 0;
+    virtual uint64_t count() const = 0;
+};
+
+/* Exact tracker: a two-level bitmap whose 4KB leaves are only allocated once a
+ * key in their range is touched. The top level is a flat array when the key
+ * universe is known and small enough, and a hash map of leaves otherwise. */
+class SparseBitmapTracker : public FootprintTracker {
+   private:
+    static const uint32_t LEAF_BITS = 15;  // 32K keys per leaf
+    static const uint64_t LEAF_WORDS = (1ul << LEAF_BITS) / 64;
+    static const uint64_t MAX_FLAT_LEAVES = 1ul << 24;
+
+    uint64_t** _leaves;  // flat top level, or nullptr
+    g_unordered_map<uint64_t, uint64_t*> _leaf_map;  // sparse top level
+    uint64_t _num_leaves;
+    uint64_t _count;
+
+    uint64_t* getLeaf(uint64_t leafIdx);
+
+   public:
+    explicit SparseBitmapTracker(uint64_t universe);
+
+    inline void insert(uint64_t key) {
+        uint64_t* leaf = getLeaf(key >> LEAF_BITS);
+        uint64_t bit = key & ((1ul << LEAF_BITS) - 1);
+        uint64_t mask = 1ul << (bit % 64);
+        if (!(leaf[bit / 64] & mask)) {
+            leaf[bit / 64] |= mask;
+            _count++;
+        }
+    }
+
+    uint64_t count() const { return _count; }
+};
+
+/* Approximate tracker: a HyperLogLog sketch with 2^14 one-byte registers
+ * (16KB, ~0.8% standard error), for runs where exact footprints are too costly. */
+class HyperLogLogTracker : public FootprintTracker {
+   private:
+    static const uint32_t PRECISION = 14;
+    static const uint32_t NUM_REGS = 1 << PRECISION;
+    uint8_t* _regs;
+
+   public:
+    HyperLogLogTracker();
+
+    inline void insert(uint64_t key) {
+        // splitmix64 finalizer, so that sequential keys spread over registers
+        uint64_t h = key + 0x9e3779b97f4a7c15ul;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ul;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebul;
+        h = h ^ (h >> 31);
+        uint32_t reg = h >> (64 - PRECISION);
+        uint8_t rho = __builtin_clzll((h << PRECISION) | (1ul << (PRECISION - 1))) + 1;
+        if (rho > _regs[reg]) _regs[reg] = rho;
+    }
+
+    uint64_t count() const;
+};
+
+/* Disabled tracking: footprint stats read as 0 */
+class NullFootprintTracker : public FootprintTracker {
+   public:
+    inline void insert(uint64_t key) {}
+    uint64_t count() const { return 0; }
+};
+
+// type is "Bitmap", "HLL" or "None"; universe is the number of possible keys (0 if unbounded)
+FootprintTracker* BuildFootprintTracker(const g_string& type, uint64_t universe);
+
+#endif
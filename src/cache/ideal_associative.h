@@ -11,12 +11,12 @@
 class IdealAssociativeScheme : public CacheScheme {
    private:
     // Statistics counters
-    Counter _numCleanEviction;
-    Counter _numDirtyEviction;
-    Counter _numLoadHit;
-    Counter _numLoadMiss;
-    Counter _numStoreHit;
-    Counter _numStoreMiss;
+    ShardedCounter _numCleanEviction;
+    ShardedCounter _numDirtyEviction;
+    ShardedCounter _numLoadHit;
+    ShardedCounter _numLoadMiss;
+    ShardedCounter _numStoreHit;
+    ShardedCounter _numStoreMiss;
 
     static const uint32_t MAX_ADDR_BITS = 58;  // 64 - 6 bits for cache line offset
 
@@ -30,7 +30,6 @@ class IdealAssociativeScheme : public CacheScheme {
     }
 
     uint64_t access(MemReq& req) override;
-    void period(MemReq& req) override;
     void initStats(AggregateStat* parentStat) override;
 };
 
@@ -11,12 +11,12 @@
 class IdealBalancedScheme : public CacheScheme {
    private:
     // Statistics counters
-    Counter _numCleanEviction;
-    Counter _numDirtyEviction;
-    Counter _numLoadHit;
-    Counter _numLoadMiss;
-    Counter _numStoreHit;
-    Counter _numStoreMiss;
+    ShardedCounter _numCleanEviction;
+    ShardedCounter _numDirtyEviction;
+    ShardedCounter _numLoadHit;
+    ShardedCounter _numLoadMiss;
+    ShardedCounter _numStoreHit;
+    ShardedCounter _numStoreMiss;
 
     uint64_t _num_line_entries, _current_way;
     LineEntry* _line_entries;
@@ -42,7 +42,6 @@ class IdealBalancedScheme : public CacheScheme {
     }
 
     uint64_t access(MemReq& req) override;
-    void period(MemReq& req) override;
     void initStats(AggregateStat* parentStat) override;
 };
 
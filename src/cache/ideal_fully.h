@@ -12,12 +12,12 @@
 class IdealFullyScheme : public CacheScheme {
    private:
     // Statistics counters
-    Counter _numCleanEviction;
-    Counter _numDirtyEviction;
-    Counter _numLoadHit;
-    Counter _numLoadMiss;
-    Counter _numStoreHit;
-    Counter _numStoreMiss;
+    ShardedCounter _numCleanEviction;
+    ShardedCounter _numDirtyEviction;
+    ShardedCounter _numLoadHit;
+    ShardedCounter _numLoadMiss;
+    ShardedCounter _numStoreHit;
+    ShardedCounter _numStoreMiss;
 
     uint64_t _num_line_entries;
     LineEntry* _line_entries;
@@ -60,7 +60,6 @@ class IdealFullyScheme : public CacheScheme {
     }
 
     uint64_t access(MemReq& req) override;
-    void period(MemReq& req) override;
     void initStats(AggregateStat* parentStat) override;
     
     // Helper method to update LRU state
@@ -102,21 +102,21 @@ uint64_t IdealHotnessScheme::access(MemReq& req) {
         incrementFrequency(page_index);
 
         if (is_write) {
-            _numStoreHit.inc();
+            _numStoreHit.inc(req.srcId);
             _page_table[page_index].dirty = true;
         } else {
-            _numLoadHit.inc();
+            _numLoadHit.inc(req.srcId);
         }
-        _num_hit_per_step++;
+        _num_hit_per_step.inc(req.srcId);
 
     } else {
         // Page miss
         if (is_write) {
-            _numStoreMiss.inc();
+            _numStoreMiss.inc(req.srcId);
         } else {
-            _numLoadMiss.inc();
+            _numLoadMiss.inc(req.srcId);
         }
-        _num_miss_per_step++;
+        _num_miss_per_step.inc(req.srcId);
 
         // Find victim page
         uint32_t victim_index = findVictimPage();
@@ -124,16 +124,16 @@ uint64_t IdealHotnessScheme::access(MemReq& req) {
         // Handle eviction if necessary
         if (_page_table[victim_index].valid) {
             if (_page_table[victim_index].dirty) {
-                _numDirtyEviction.inc();
+                _numDirtyEviction.inc(req.srcId);
                 // Write back entire page
                 for (uint32_t i = 0; i < _lines_per_page; i++) {
                     Address wb_addr = (_page_table[victim_index].tag * _lines_per_page + i) * _granularity;
                     MemReq wb_req = {wb_addr, PUTX, req.childId, &state, data_ready_cycle,
                                      req.childLock, req.initialState, req.srcId, req.flags};
-                    data_ready_cycle = _mc->_ext_dram->access(wb_req, 2, 4);
+                    data_ready_cycle = _ext_dram->access(wb_req, 2, 4);
                 }
             } else {
-                _numCleanEviction.inc();
+                _numCleanEviction.inc(req.srcId);
             }
             // Remove old page mapping
             _page_location.erase(_page_table[victim_index].tag);
@@ -144,7 +144,7 @@ uint64_t IdealHotnessScheme::access(MemReq& req) {
             Address load_addr = (page_number * _lines_per_page + i) * _granularity;
             MemReq load_req = {load_addr, GETS, req.childId, &state, data_ready_cycle,
                                req.childLock, req.initialState, req.srcId, req.flags};
-            data_ready_cycle = _mc->_ext_dram->access(load_req, 1, 4);
+            data_ready_cycle = _ext_dram->access(load_req, 1, 4);
         }
 
         // Update page table and mapping
@@ -166,77 +166,20 @@ uint64_t IdealHotnessScheme::access(MemReq& req) {
     return data_ready_cycle;
 }
 
-void IdealHotnessScheme::period(MemReq& req) {
-    if (_stats_period && _num_requests % _stats_period == 0) {
-        logUtilizationStats();
-        // Reset access counts after logging
-        for (uint64_t i = 0; i < _total_lines; i++) {
-             _line_access_count[i] &= ((1ULL << 32) - 1);
-        }
-    }
-    // Handle bandwidth balance if needed
-    if (_bw_balance && _num_requests % _step_length == 0) {
-        _num_hit_per_step /= 2;
-        _num_miss_per_step /= 2;
-        _mc_bw_per_step /= 2;
-        _ext_bw_per_step /= 2;
-
-        if (_bw_balance && _mc_bw_per_step + _ext_bw_per_step > 0) {
-            // Calculate current bandwidth ratio
-            double ratio = 1.0 * _mc_bw_per_step / (_mc_bw_per_step + _ext_bw_per_step);
-            double target_ratio = 0.8;  // Target ratio (mc_bw = 4 * ext_bw)
-
-            // Adjust _ds_index based on bandwidth difference
-            uint64_t index_step = _num_sets / 1000;
-            int64_t delta_index = (ratio - target_ratio > -0.02 && ratio - target_ratio < 0.02) ? 0 : index_step * (ratio - target_ratio) / 0.01;
-
-            printf("ratio = %f\n", ratio);
-
-            if (delta_index > 0) {
-                // Handle increasing _ds_index
-                for (uint32_t mc = 0; mc < _mc->_mcdram_per_mc; mc++) {
-                    for (uint64_t set = _ds_index; set < (uint64_t)(_ds_index + delta_index); set++) {
-                        if (set >= _num_sets) break;
-
-                        for (uint32_t way = 0; way < _num_ways; way++) {
-                            Way& meta = _cache[set].ways[way];
-                            if (meta.valid && meta.dirty) {
-                                // Write back to external DRAM
-                                MESIState state;
-                                MemReq load_req = {meta.tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                                _mc->_mcdram[mc]->access(load_req, 2, (_granularity / 64) * 4);
-                                MemReq wb_req = {meta.tag * 64, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                                _mc->_ext_dram->access(wb_req, 2, (_granularity / 64) * 4);
-                                _ext_bw_per_step += (_granularity / 64) * 4;
-                                _mc_bw_per_step += (_granularity / 64) * 4;
-                            }
-
-                            meta.valid = false;
-                            meta.dirty = false;
-                        }
-                    }
-                }
-            }
-            _ds_index = ((int64_t)_ds_index + delta_index <= 0) ? 0 : _ds_index + delta_index;
-            printf("_ds_index = %ld/%ld\n", _ds_index, _num_sets);
-        }
-    }
-}
-
 void IdealHotnessScheme::initStats(AggregateStat* parentStat) {
     AggregateStat* stats = new AggregateStat();
     stats->init("idealBalancedCache", "IdealBalanced Cache stats");
-    _numCleanEviction.init("cleanEvict", "Clean Eviction");
+    _numCleanEviction.init("cleanEvict", "Clean Eviction", zinfo->numCores);
     stats->append(&_numCleanEviction);
-    _numDirtyEviction.init("dirtyEvict", "Dirty Eviction");
+    _numDirtyEviction.init("dirtyEvict", "Dirty Eviction", zinfo->numCores);
     stats->append(&_numDirtyEviction);
-    _numLoadHit.init("loadHit", "Load Hit");
+    _numLoadHit.init("loadHit", "Load Hit", zinfo->numCores);
     stats->append(&_numLoadHit);
-    _numLoadMiss.init("loadMiss", "Load Miss");
+    _numLoadMiss.init("loadMiss", "Load Miss", zinfo->numCores);
     stats->append(&_numLoadMiss);
-    _numStoreHit.init("storeHit", "Store Hit");
+    _numStoreHit.init("storeHit", "Store Hit", zinfo->numCores);
     stats->append(&_numStoreHit);
-    _numStoreMiss.init("storeMiss", "Store Miss");
+    _numStoreMiss.init("storeMiss", "Store Miss", zinfo->numCores);
     stats->append(&_numStoreMiss);
     
     stats->append(_numReaccessedLines);
@@ -246,6 +189,7 @@ void IdealHotnessScheme::initStats(AggregateStat* parentStat) {
     stats->append(_numTotalExtLines);
     stats->append(_numAccessedExtPages);
     stats->append(_numTotalExtPages);
+    appendBalanceStats(stats);
     
     parentStat->append(stats);
 }
@@ -13,12 +13,12 @@
 class IdealHotnessScheme : public CacheScheme {
    private:
     // Statistics counters
-    Counter _numCleanEviction;
-    Counter _numDirtyEviction;
-    Counter _numLoadHit;
-    Counter _numLoadMiss;
-    Counter _numStoreHit;
-    Counter _numStoreMiss;
+    ShardedCounter _numCleanEviction;
+    ShardedCounter _numDirtyEviction;
+    ShardedCounter _numLoadHit;
+    ShardedCounter _numLoadMiss;
+    ShardedCounter _numStoreHit;
+    ShardedCounter _numStoreMiss;
 
     uint32_t _num_pages;       // Number of pages that can fit in cache
     uint32_t _lines_per_page;  // Number of cache lines per page
@@ -39,7 +39,6 @@ class IdealHotnessScheme : public CacheScheme {
    public:
     IdealHotnessScheme(Config& config, MemoryController* mc);
     uint64_t access(MemReq& req) override;
-    void period(MemReq& req) override;
     void initStats(AggregateStat* parentStat) override;
 };
 
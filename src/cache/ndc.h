@@ -5,18 +5,19 @@
 #include <string>
 
 #include "cache/cache_scheme.h"
+#include "cache/ndc_addr_map.h"
 #include "mc.h"
 #include "stats.h"
 
 class NDCScheme : public CacheScheme {
    private:
     // Statistics counters
-    Counter _numCleanEviction;
-    Counter _numDirtyEviction;
-    Counter _numLoadHit;
-    Counter _numLoadMiss;
-    Counter _numStoreHit;
-    Counter _numStoreMiss;
+    ShardedCounter _numCleanEviction;
+    ShardedCounter _numDirtyEviction;
+    ShardedCounter _numLoadHit;
+    ShardedCounter _numLoadMiss;
+    ShardedCounter _numStoreHit;
+    ShardedCounter _numStoreMiss;
 
     uint32_t _ch_pos, _ra_pos, _bg_pos, _ba_pos, _ro_pos, _co_pos;
     uint32_t _ch_mask, _ra_mask, _bg_mask, _ba_mask, _ro_mask, _co_mask;
@@ -24,6 +25,7 @@ class NDCScheme : public CacheScheme {
     // Mask parameters for address translation
     uint64_t _index_mask, _cache_tag_mask, _pred_tag_mask;
     uint32_t _index_bits, _cache_tag_bits, _pred_tag_bits, _cache_lines_bits;
+    NDCAddrMap _addr_map;  // the masks above, compiled
 
     // Maximum possible address bits after removing cacheline offset bits
     static const uint32_t MAX_ADDR_BITS = 58;  // 64 - 6 bits for cache line offset
@@ -79,7 +81,10 @@ class NDCScheme : public CacheScheme {
                 if (temp_mask & 1) bits_set++;
                 temp_mask >>= 1;
             }
-            assert(bits_set == _index_bits);
+            if (bits_set != (int)_index_bits) {
+                panic("sys.mem.mcdram.index_mask_upper/lower = 0x%lx has %d bits set, but %ld sets need %d index bits",
+                      _index_mask, bits_set, _num_sets, _index_bits);
+            }
         }
 
         // Calculate tag mask as the inverse of index mask (within valid address bits)
@@ -103,6 +108,8 @@ class NDCScheme : public CacheScheme {
 
         // Output both hexadecimal values and binary strings
         info("index_mask = 0x%lx (%s); tag_mask = 0x%lx (%s)\n", _index_mask, index_mask_str.c_str(), _cache_tag_mask, tag_mask_str.c_str());
+
+        _addr_map.init(_index_mask, _cache_tag_mask, _index_bits, _cache_tag_bits, _cache_lines_bits, _co_pos, _pred_tag_mask);
     }
 
     DramAddress mapAddress(Address address) const {
@@ -117,93 +124,13 @@ class NDCScheme : public CacheScheme {
         return DramAddress(channel, rank, bg, ba, ro, co);
     }
 
-    // Ultra-optimized physical address to cache address conversion
-    inline Address phyAddr2cacheAddr(Address phy_addr) {
-        // uint64_t hex_addr = phy_addr >> _num_shift_bits;
-        uint64_t hex_addr = phy_addr; // line address is already shifted
-
-        // Initialize the cache address
-        uint64_t cache_addr = 0;
-
-        // 1. EXTRACT TAG BITS
-        // Rather than checking each bit individually, extract and compress tag bits in one go
-        uint64_t tag_value = 0;
-        uint64_t bit_pos = 0;
-        uint64_t mask = 1;
-
-        // Find first tag bit position
-        int first_tag_bit = 0;
-        while (first_tag_bit < 64 && !(_cache_tag_mask & (1ULL << first_tag_bit))) {
-            first_tag_bit++;
-        }
-
-        // Extract tag bits using direct bit manipulation
-        for (int i = first_tag_bit; i < _cache_lines_bits && bit_pos < _cache_tag_bits; i++) {
-            if (_cache_tag_mask & (1ULL << i)) {
-                // Extract this bit directly - no conditional
-                tag_value |= ((hex_addr >> i) & 1) << bit_pos;
-                bit_pos++;
-            }
-        }
-
-        // Place tag bits directly at column position
-        cache_addr |= (tag_value << _co_pos);
-
-        // 2. EXTRACT AND PLACE INDEX BITS
-        // Extract index bits directly
-        uint64_t index_value = 0;
-        bit_pos = 0;
-
-        // Find first index bit position
-        int first_index_bit = 0;
-        while (first_index_bit < 64 && !(_index_mask & (1ULL << first_index_bit))) {
-            first_index_bit++;
-        }
-
-        // Extract index bits using direct bit manipulation
-        for (int i = first_index_bit; i < _cache_lines_bits && bit_pos < _index_bits; i++) {
-            if (_index_mask & (1ULL << i)) {
-                // Extract this bit directly
-                index_value |= ((hex_addr >> i) & 1) << bit_pos;
-                bit_pos++;
-            }
-        }
-
-        // Place index bits in non-tag positions
-        bit_pos = 0;
-        for (int i = 0; i < _cache_lines_bits && bit_pos < _index_bits; i++) {
-            // Skip the tag positions
-            if (i >= _co_pos && i < (_co_pos + _cache_tag_bits)) {
-                continue;
-            }
-
-            // Place next index bit directly - no conditional
-            cache_addr |= ((index_value >> bit_pos) & 1) << i;
-            bit_pos++;
-        }
-
-        cache_addr = cache_addr | (phy_addr & _pred_tag_mask);
-        return cache_addr;
+    // Physical address to cache address conversion
+    inline Address phyAddr2cacheAddr(Address phy_addr) const {
+        return _addr_map.phyAddr2cacheAddr(phy_addr);  // line address is already shifted
     }
 
-    inline uint64_t getSetNum(Address cache_addr) {
-        uint64_t hex_addr = cache_addr;
-        uint64_t index = 0;
-        uint64_t bit_pos = 0;
-
-        // Place bits directly using shifts and masks
-        for (int i = 0; i < _cache_lines_bits && bit_pos < _index_bits; i++) {
-            // Skip tag positions
-            if (i >= _co_pos && i < (_co_pos + _cache_tag_bits)) {
-                continue;
-            }
-
-            // Extract and place bit directly - no conditional
-            index |= ((hex_addr >> i) & 1) << bit_pos;
-            bit_pos++;
-        }
-
-        return index;
+    inline uint64_t getSetNum(Address cache_addr) const {
+        return _addr_map.getSetNum(cache_addr);
     }
 
     // Get tag from cache address - optimized version
@@ -213,7 +140,6 @@ class NDCScheme : public CacheScheme {
     }
 
     uint64_t access(MemReq& req) override;
-    void period(MemReq& req) override;
     void initStats(AggregateStat* parentStat) override;
 };
 
@@ -0,0 +1,54 @@
+#ifndef _NDC_ADDR_MAP_H_
+#define _NDC_ADDR_MAP_H_
+
+#include "bit_gather.h"
+#include "memory_hierarchy.h"
+
+/* Physical line address -> NDC cache address translation. The cache address
+ * packs the tag bits of the line (the lowest tagBits bits of tagMask) at the
+ * column position coPos, and its index bits (the lowest indexBits bits of
+ * indexMask) in order in the remaining positions, keeping the bits of
+ * predTagMask in place. The set number is the index bits read back.
+ *
+ * All bit selections are compiled into BitGathers once, at init.
+ */
+class NDCAddrMap {
+    private:
+        BitGather _tag;         // tag bits of the physical address
+        BitGather _index;       // index bits of the physical address
+        BitGather _slots;       // positions of the index bits in the cache address
+        uint32_t _co_pos;
+        uint64_t _pred_tag_mask;
+
+        // The n lowest set bits of mask
+        static uint64_t lowestBits(uint64_t mask, uint32_t n) {
+            uint64_t res = 0;
+            for (uint32_t i = 0; i < n && mask; i++) {
+                res |= mask & -mask;
+                mask &= mask - 1;
+            }
+            return res;
+        }
+
+    public:
+        void init(uint64_t indexMask, uint64_t tagMask, uint32_t indexBits, uint32_t tagBits,
+                  uint32_t linesBits, uint32_t coPos, uint64_t predTagMask) {
+            uint64_t linesMask = (linesBits < 64)? (1ULL << linesBits) - 1 : ~0ULL;
+            uint64_t tagSlots = ((tagBits < 64)? (1ULL << tagBits) - 1 : ~0ULL) << coPos;
+            _tag.init(lowestBits(tagMask & linesMask, tagBits));
+            _index.init(lowestBits(indexMask & linesMask, indexBits));
+            _slots.init(lowestBits(linesMask & ~tagSlots, indexBits));
+            _co_pos = coPos;
+            _pred_tag_mask = predTagMask;
+        }
+
+        inline Address phyAddr2cacheAddr(Address phyAddr) const {
+            return (_tag.extract(phyAddr) << _co_pos) | _slots.deposit(_index.extract(phyAddr)) | (phyAddr & _pred_tag_mask);
+        }
+
+        inline uint64_t getSetNum(Address cacheAddr) const {
+            return _slots.extract(cacheAddr);
+        }
+};
+
+#endif
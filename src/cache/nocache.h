@@ -5,14 +5,13 @@
 
 class NoCacheScheme : public CacheScheme {
    private:
-    Counter _numLoadHit;  // Scheme-specific counter
+    ShardedCounter _numLoadHit;  // Scheme-specific counter
    public:
     NoCacheScheme(Config& config, MemoryController* mc)
         : CacheScheme(config, mc) {
         _scheme = NoCache;
     }
     uint64_t access(MemReq& req) override;
-    void period(MemReq& req) override;
     void initStats(AggregateStat* parentStat) override;
 };
 
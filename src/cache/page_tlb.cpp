@@ -0,0 +1,33 @@
+#include "cache/page_tlb.h"
+
+PageTLB::PageTLB(uint64_t numPages, uint32_t noWay)
+    : _leaves(nullptr), _num_leaves(0), _no_way(noWay), _num_alloc_leaves(0) {
+    uint64_t numLeaves = (numPages + (1ul << LEAF_BITS) - 1) >> LEAF_BITS;
+    if (numPages && numLeaves <= MAX_FLAT_LEAVES) {
+        _num_leaves = numLeaves;
+        _leaves = gm_calloc<TLBEntry*>(_num_leaves);
+    }
+}
+
+TLBEntry* PageTLB::getLeaf(uint64_t leafIdx) {
+    TLBEntry** slot;
+    if (_leaves && leafIdx < _num_leaves) {
+        slot = &_leaves[leafIdx];
+    } else {
+        // Unbounded tags, or a tag outside the external memory
+        slot = &_leaf_map[leafIdx];
+    }
+    if (!*slot) {
+        TLBEntry* leaf = gm_calloc<TLBEntry>(1ul << LEAF_BITS);
+        for (uint64_t i = 0; i < (1ul << LEAF_BITS); i++) leaf[i].way = _no_way;
+        *slot = leaf;
+        _num_alloc_leaves++;
+    }
+    return *slot;
+}
+
+uint64_t PageTLB::bytes() const {
+    // Map nodes hold the key, the leaf pointer and a next pointer, plus a bucket pointer
+    uint64_t mapBytes = _leaf_map.size() * 4 * sizeof(uint64_t);
+    return _num_leaves * sizeof(TLBEntry*) + mapBytes + _num_alloc_leaves * (sizeof(TLBEntry) << LEAF_BITS);
+}
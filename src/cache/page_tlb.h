@@ -0,0 +1,55 @@
+#ifndef _PAGE_TLB_H_
+#define _PAGE_TLB_H_
+
+#include <stdint.h>
+#include "g_std/g_unordered_map.h"
+#include "galloc.h"
+#include "log.h"
+#include "memory_hierarchy.h"
+
+// Per-page state of the page-granularity caches (Banshee, Unison), 8 bytes
+struct TLBEntry {
+    uint32_t way;  // way caching the page, or num_ways if not cached
+
+    // the following two are only for UnisonCache
+    // due to space cosntraint, it is not feasible to keep one bit for each line,
+    // so we use 1 bit for 4 lines.
+    uint16_t touch_bitvec;  // whether a line is touched in a page
+    uint16_t dirty_bitvec;  // whether a line is dirty in page
+};
+
+/* TLBEntries indexed by page tag. Two-level table whose leaves of 4K entries
+ * are allocated (as uncached pages) on first touch; the top level is a flat
+ * array sized to the external memory, and a hash map of leaves for tags
+ * beyond it or if the external memory size is unknown. Entries never move, so
+ * references to them stay valid. Replaces a hash map with a 40-byte entry per
+ * page ever touched. */
+class PageTLB : public GlobAlloc {
+   private:
+    static const uint32_t LEAF_BITS = 12;
+    static const uint64_t MAX_FLAT_LEAVES = 1ul << 24;
+
+    TLBEntry** _leaves;  // flat top level, or nullptr
+    g_unordered_map<uint64_t, TLBEntry*> _leaf_map;  // sparse top level
+    uint64_t _num_leaves;
+    uint32_t _no_way;
+    uint64_t _num_alloc_leaves;
+
+    TLBEntry* getLeaf(uint64_t leafIdx);
+
+   public:
+    // numPages bounds the tags (0 if unknown); noWay marks uncached pages
+    PageTLB(uint64_t numPages, uint32_t noWay);
+
+    inline TLBEntry& operator[](Address tag) {
+        uint64_t leafIdx = tag >> LEAF_BITS;
+        TLBEntry* leaf = (_leaves && leafIdx < _num_leaves) ? _leaves[leafIdx] : nullptr;
+        if (unlikely(!leaf)) leaf = getLeaf(leafIdx);
+        return leaf[tag & ((1ul << LEAF_BITS) - 1)];
+    }
+
+    // Bytes allocated for the table (the sparse top level, approximately)
+    uint64_t bytes() const;
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "cache/shadow.h"
+
+#include <algorithm>
+#include "config.h"
+#include "log.h"
+#include "str.h"
+
+ShadowCaches::ShadowCaches(const g_vector<uint64_t>& sizesMB, uint64_t granularity) : _sizes_mb(sizesMB), _granularity(granularity) {
+    for (uint32_t i = 0; i < _sizes_mb.size(); i++) _stats.push_back(new ShadowStats());
+}
+
+void ShadowCaches::initStats(AggregateStat* parentStat) {
+    AggregateStat* shadowStats = new AggregateStat();
+    shadowStats->init("shadow", "Shadow capacity stats (no timing)");
+    for (uint32_t i = 0; i < _sizes_mb.size(); i++) {
+        AggregateStat* sizeStats = new AggregateStat();
+        sizeStats->init(gm_strdup(("size-" + Str(_sizes_mb[i]) + "MB").c_str()), "Shadow capacity stats");
+        ShadowStats* s = _stats[i];
+        s->hits.init("hit", "Hits");
+        s->loadMisses.init("loadMiss", "Load misses");
+        s->storeMisses.init("storeMiss", "Store misses");
+        s->cleanEvictions.init("cleanEvict", "Clean evictions");
+        s->dirtyEvictions.init("dirtyEvict", "Dirty evictions (write-backs)");
+        s->fillBytes.init("fillBytes", "Bytes filled from external memory (the granule on load misses, the rest of it on store misses)");
+        s->wbBytes.init("wbBytes", "Bytes written back to external memory (a granule per dirty eviction)");
+        sizeStats->append(&s->hits);
+        sizeStats->append(&s->loadMisses);
+        sizeStats->append(&s->storeMisses);
+        sizeStats->append(&s->cleanEvictions);
+        sizeStats->append(&s->dirtyEvictions);
+        sizeStats->append(&s->fillBytes);
+        sizeStats->append(&s->wbBytes);
+        shadowStats->append(sizeStats);
+    }
+    parentStat->append(shadowStats);
+}
+
+SetAssocShadows::SetAssocShadows(const g_vector<uint64_t>& sizesMB, uint64_t granularity, uint32_t numWays, uint32_t numShards)
+    : ShadowCaches(sizesMB, granularity), _num_ways(numWays) {
+    for (uint64_t mb : _sizes_mb) {
+        Shadow s;
+        s.numSets = (mb << 20) / numShards / numWays / granularity;
+        if (s.numSets == 0) panic("Shadow capacity of %ld MB is smaller than one set", mb);
+        s.tags = gm_calloc<uint64_t>(s.numSets * numWays);
+        _shadows.push_back(s);
+    }
+}
+
+void SetAssocShadows::access(Address granule, bool isWrite) {
+    uint64_t key = (granule + 1) << 1;
+    for (uint32_t i = 0; i < _shadows.size(); i++) {
+        uint64_t* ways = _shadows[i].tags + (granule % _shadows[i].numSets) * _num_ways;
+        ShadowStats* s = _stats[i];
+        uint32_t pos = 0;
+        while (pos < _num_ways && (ways[pos] & ~1ul) != key) pos++;
+        uint64_t entry;
+        if (pos < _num_ways) {
+            s->hits.inc();
+            entry = ways[pos] | isWrite;
+        } else {
+            miss(s, isWrite);
+            pos = _num_ways - 1;
+            if (ways[pos] & 1) dirtyEviction(s);
+            else if (ways[pos]) s->cleanEvictions.inc();
+            entry = key | isWrite;
+        }
+        // Move to MRU
+        for (; pos > 0; pos--) ways[pos] = ways[pos - 1];
+        ways[0] = entry;
+    }
+}
+
+StackShadows::StackShadows(const g_vector<uint64_t>& sizesMB, uint64_t granularity, uint32_t numShards)
+    : ShadowCaches(sizesMB, granularity) {
+    if (_sizes_mb.size() > 32) panic("At most 32 shadow capacities are supported, got %ld", _sizes_mb.size());
+    for (uint64_t mb : _sizes_mb) {
+        uint64_t capacity = (mb << 20) / numShards / granularity;
+        if (capacity == 0) panic("Shadow capacity of %ld MB is smaller than one granule", mb);
+        _capacities.push_back(capacity);
+    }
+    _stack = new StackDistance(*std::max_element(_capacities.begin(), _capacities.end()));
+}
+
+void StackShadows::access(Address granule, bool isWrite) {
+    StackDistance::Entry* e = _stack->find(granule);
+    uint64_t depth = e ? _stack->depth(e) : UINT64_MAX;
+    for (uint32_t i = 0; i < _capacities.size(); i++) {
+        ShadowStats* s = _stats[i];
+        uint64_t capacity = _capacities[i];
+        if (depth <= capacity) {
+            s->hits.inc();
+            continue;
+        }
+        miss(s, isWrite);
+        // The granule at depth capacity, if the shadow is full, is pushed out
+        if (_stack->size() >= capacity) {
+            StackDistance::Entry* victim = _stack->atDepth(capacity);
+            if (victim->flags & (1u << i)) {
+                dirtyEviction(s);
+                victim->flags &= ~(1u << i);
+            } else {
+                s->cleanEvictions.inc();
+            }
+        }
+    }
+
+    e = _stack->touch(granule, e);
+    if (isWrite) e->flags = (_capacities.size() == 32) ? ~0u : (1u << _capacities.size()) - 1;
+}
+
+ShadowCaches* BuildShadowCaches(Config& config, uint64_t granularity, uint64_t numWays, uint64_t numSets, uint32_t numShards) {
+    g_vector<uint64_t> sizesMB(ParseList<uint64_t>(config.get<const char*>("sys.mem.mcdram.shadowSizes", "")));
+    if (sizesMB.empty()) return nullptr;
+    for (uint64_t mb : sizesMB) {
+        if (mb == 0) panic("sys.mem.mcdram.shadowSizes: sizes must be > 0 MB");
+    }
+    ShadowCaches* shadows;
+    if (numSets == 1) {
+        shadows = new StackShadows(sizesMB, granularity, numShards);
+    } else {
+        shadows = new SetAssocShadows(sizesMB, granularity, numWays, numShards);
+    }
+    info("Simulating %ld shadow capacities (%s)", sizesMB.size(), (numSets == 1) ? "fully associative LRU stack" : "set-indexed LRU");
+    return shadows;
+}
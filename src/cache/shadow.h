@@ -0,0 +1,98 @@
+#ifndef _SHADOW_H_
+#define _SHADOW_H_
+
+#include <stdint.h>
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "memory_hierarchy.h"
+#include "stack_distance.h"
+#include "stats.h"
+
+class Config;
+
+/* Shadow capacities (sys.mem.mcdram.shadowSizes, a list of sizes in MB): tag-only
+ * models of the DRAM cache at other sizes, fed the same granule stream as the
+ * primary scheme, so one run yields hit/miss/eviction counts, and the fill and
+ * write-back traffic to external memory they imply, for every size.
+ * They have no timing and do not touch the memories; only the primary
+ * configuration drives the simulation.
+ *
+ * Shadows model demand-filled LRU caches with the scheme's granularity and
+ * associativity. That is exact for direct-mapped AlloyCache and LRU IdealFully;
+ * for schemes with other replacement or placement policies, shadows give the
+ * LRU baseline at each size rather than the scheme's own behavior.
+ */
+
+// Hit/miss/eviction and external memory traffic counters of one shadow capacity
+struct ShadowStats {
+    Counter hits;
+    Counter loadMisses;
+    Counter storeMisses;
+    Counter cleanEvictions;
+    Counter dirtyEvictions;  // each one is a granule written back to external memory
+    Counter fillBytes;       // read from external memory on misses (a store brings its own line)
+    Counter wbBytes;         // granules written back to external memory on dirty evictions
+};
+
+class ShadowCaches : public GlobAlloc {
+   public:
+    virtual ~ShadowCaches() {}
+    // Every access of the primary scheme, by granule (line address / granularity)
+    virtual void access(Address granule, bool isWrite) = 0;
+    void initStats(AggregateStat* parentStat);
+
+   protected:
+    g_vector<uint64_t> _sizes_mb;
+    g_vector<ShadowStats*> _stats;  // one per size
+    uint64_t _granularity;          // bytes per granule
+
+    ShadowCaches(const g_vector<uint64_t>& sizesMB, uint64_t granularity);
+
+    void miss(ShadowStats* s, bool isWrite) {
+        if (isWrite) s->storeMisses.inc();
+        else s->loadMisses.inc();
+        s->fillBytes.inc(isWrite ? _granularity - 64 : _granularity);
+    }
+    void dirtyEviction(ShadowStats* s) {
+        s->dirtyEvictions.inc();
+        s->wbBytes.inc(_granularity);
+    }
+};
+
+/* Set-indexed shadows: a tag array per capacity, with each set kept in recency
+ * order (MRU first), so a hit or fill is a shift of at most numWays tags. */
+class SetAssocShadows : public ShadowCaches {
+   private:
+    struct Shadow {
+        uint64_t numSets;
+        uint64_t* tags;  // numSets * numWays entries of (granule + 1) << 1 | dirty, 0 if invalid
+    };
+    g_vector<Shadow> _shadows;
+    uint32_t _num_ways;
+
+   public:
+    SetAssocShadows(const g_vector<uint64_t>& sizesMB, uint64_t granularity, uint32_t numWays, uint32_t numShards);
+    void access(Address granule, bool isWrite);
+};
+
+/* Fully associative LRU at every capacity at once: one LRU stack, where an
+ * access at depth d hits in every capacity >= d, and in each smaller one
+ * evicts the granule at the depth of its capacity. Dirtiness depends on the
+ * capacity, so the flags of each granule are a bitmask of the shadows it is
+ * dirty in (at most 32 sizes). The stack only holds as many granules as the
+ * largest capacity: deeper ones miss in every shadow, as if never seen. */
+class StackShadows : public ShadowCaches {
+   private:
+    StackDistance* _stack;
+    g_vector<uint64_t> _capacities;  // in granules, one per size
+
+   public:
+    StackShadows(const g_vector<uint64_t>& sizesMB, uint64_t granularity, uint32_t numShards);
+    void access(Address granule, bool isWrite);
+};
+
+// Builds the shadows of a scheme from sys.mem.mcdram.shadowSizes, or returns
+// nullptr if the list is empty. numSets == 1 selects the stack model.
+ShadowCaches* BuildShadowCaches(Config& config, uint64_t granularity, uint64_t numWays, uint64_t numSets, uint32_t numShards);
+
+#endif
@@ -6,8 +6,8 @@ uint64_t UnisonCacheScheme::access(MemReq& req) {
     ReqType type = (req.type == GETS || req.type == GETX) ? LOAD : STORE;
     // Address address = req.lineAddr % (_ext_size / 64);
     Address address = req.lineAddr;
-    uint32_t mcdram_select = (address / 64) % _mc->_mcdram_per_mc;
-    Address mc_address = (address / 64 / _mc->_mcdram_per_mc * 64) | (address % 64);
+    uint32_t mcdram_select = (address / 64) % _mcdram_per_mc;
+    Address mc_address = (address / 64 / _mcdram_per_mc * 64) | (address % 64);
     Address tag = address / (_granularity / 64);
     uint64_t set_num = tag % _num_sets;
     uint32_t hit_way = _num_ways;
@@ -15,246 +15,185 @@ uint64_t UnisonCacheScheme::access(MemReq& req) {
     MESIState state;
     bool counter_access = false;
 
-    _accessed_ext_lines_set.insert(address);
-    _accessed_ext_lines = _accessed_ext_lines_set.size();
-    _accessed_ext_pages_set.insert(address / (_page_size / 64));
-    _accessed_ext_pages = _accessed_ext_pages_set.size();
+    recordExtAccess(address);
 
     // Check TLB for hit
-    if (_tlb.find(tag) == _tlb.end()) {
-        _tlb[tag] = TLBEntry{tag, _num_ways, 0, 0, 0};
-    }
-
-    if (_tlb[tag].way != _num_ways) {
-        hit_way = _tlb[tag].way;
-        assert(_cache[set_num].ways[hit_way].valid &&
-               _cache[set_num].ways[hit_way].tag == tag);
+    TLBEntry& tlb_entry = (*_tlb)[tag];
+    if (tlb_entry.way != _num_ways) {
+        hit_way = tlb_entry.way;
+        assert(_cache[set_num].isValid(hit_way) &&
+               _cache[set_num].getTag(hit_way) == tag);
     } else {
         for (uint32_t i = 0; i < _num_ways; i++)
-            assert(_cache[set_num].ways[i].tag != tag || !_cache[set_num].ways[i].valid);  // @chunk: can TLB hold all tags? maybe it is actually the page table?
+            assert(_cache[set_num].getTag(i) != tag || !_cache[set_num].isValid(i));  // @chunk: can TLB hold all tags? maybe it is actually the page table?
     }
 
     // Tag and data access
     if (type == LOAD) {
         req.lineAddr = mc_address;
-        req.cycle = _mc->_mcdram[mcdram_select]->access(req, 0, 6);
-        _mc_bw_per_step += 6;
-        _numTagLoad.inc();
+        req.cycle = _mcdram[mcdram_select]->access(req, 0, 6);
+        _mc_bw_per_step.inc(req.srcId, 6);
+        _numTagLoad.inc(req.srcId);
         req.lineAddr = address;
     } else {
         MemReq tag_probe = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-        req.cycle = _mc->_mcdram[mcdram_select]->access(tag_probe, 0, 2);
-        _mc_bw_per_step += 2;
-        _numTagLoad.inc();
+        req.cycle = _mcdram[mcdram_select]->access(tag_probe, 0, 2);
+        _mc_bw_per_step.inc(req.srcId, 2);
+        _numTagLoad.inc(req.srcId);
     }
 
     if (hit_way != _num_ways) {
         // Cache hit
         updateUtilizationStats(set_num, hit_way);
-        _num_hit_per_step++;
+        _num_hit_per_step.inc(req.srcId);
         if (type == STORE) {
             MemReq write_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-            req.cycle = _mc->_mcdram[mcdram_select]->access(write_req, 1, 4);
-            _mc_bw_per_step += 4;
-            _numStoreHit.inc();
+            req.cycle = _mcdram[mcdram_select]->access(write_req, 1, 4);
+            _mc_bw_per_step.inc(req.srcId, 4);
+            _numStoreHit.inc(req.srcId);
         } else {
-            _numLoadHit.inc();
+            _numLoadHit.inc(req.srcId);
         }
         data_ready_cycle = req.cycle;
         _page_placement_policy->handleCacheHit(tag, type, set_num, &_cache[set_num], counter_access, hit_way);
 
         // Update LRU information
         MemReq tag_update_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-        _mc->_mcdram[mcdram_select]->access(tag_update_req, 2, 2);
-        _mc_bw_per_step += 2;
-        _numTagStore.inc();
+        _mcdram[mcdram_select]->access(tag_update_req, 2, 2);
+        _mc_bw_per_step.inc(req.srcId, 2);
+        _numTagStore.inc(req.srcId);
 
         // Update touch/dirty bitvectors
         uint64_t bit = (address - tag * 64) / 4;
         assert(bit < 16 && bit >= 0);
         bit = ((uint64_t)1UL) << bit;
-        _tlb[tag].touch_bitvec |= bit;
+        tlb_entry.touch_bitvec |= bit;
         if (type == STORE) {
-            _tlb[tag].dirty_bitvec |= bit;
+            tlb_entry.dirty_bitvec |= bit;
         }
     } else {
         // Cache miss
-        _num_miss_per_step++;
+        _num_miss_per_step.inc(req.srcId);
         if (type == LOAD)
-            _numLoadMiss.inc();
+            _numLoadMiss.inc(req.srcId);
         else
-            _numStoreMiss.inc();
+            _numStoreMiss.inc(req.srcId);
 
         // Handle placement
         uint32_t replace_way = _page_placement_policy->handleCacheMiss(tag, type, set_num, &_cache[set_num], counter_access);
 
         if (type == LOAD) {
-            req.cycle = _mc->_ext_dram->access(req, 1, 4);
-            _ext_bw_per_step += 4;
+            req.cycle = _ext_dram->access(req, 1, 4);
+            _ext_bw_per_step.inc(req.srcId, 4);
         } else if (type == STORE && replace_way >= _num_ways) {
-            req.cycle = _mc->_ext_dram->access(req, 1, 4);
-            _ext_bw_per_step += 4;
+            req.cycle = _ext_dram->access(req, 1, 4);
+            _ext_bw_per_step.inc(req.srcId, 4);
         }
         data_ready_cycle = req.cycle;
 
         if (replace_way < _num_ways) {
             // Handle eviction if needed
-            if (_cache[set_num].ways[replace_way].valid) {
-                Address replaced_tag = _cache[set_num].ways[replace_way].tag;
-                _tlb[replaced_tag].way = _num_ways;
+            if (_cache[set_num].isValid(replace_way)) {
+                Address replaced_tag = _cache[set_num].getTag(replace_way);
+                TLBEntry& replaced_entry = (*_tlb)[replaced_tag];
+                replaced_entry.way = _num_ways;
 
-                uint32_t dirty_lines = __builtin_popcountll(_tlb[replaced_tag].dirty_bitvec) * 4;
-                uint32_t touch_lines = __builtin_popcountll(_tlb[replaced_tag].touch_bitvec) * 4;
+                uint32_t dirty_lines = __builtin_popcount(replaced_entry.dirty_bitvec) * 4;
+                uint32_t touch_lines = __builtin_popcount(replaced_entry.touch_bitvec) * 4;
 
                 assert(touch_lines > 0 && touch_lines <= 64);
                 assert(dirty_lines <= 64);
 
-                _numTouchedLines.inc(touch_lines);
-                _numEvictedLines.inc(dirty_lines);
+                _numTouchedLines.inc(req.srcId, touch_lines);
+                _numEvictedLines.inc(req.srcId, dirty_lines);
 
                 if (dirty_lines > 0) {
-                    _numDirtyEviction.inc();
+                    _numDirtyEviction.inc(req.srcId);
                     // Load dirty lines from MCDRAM
                     MemReq load_req = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                    _mc->_mcdram[mcdram_select]->access(load_req, 2, dirty_lines * 4);
-                    _mc_bw_per_step += dirty_lines * 4;
+                    _mcdram[mcdram_select]->access(load_req, 2, dirty_lines * 4);
+                    _mc_bw_per_step.inc(req.srcId, dirty_lines * 4);
 
                     // Store dirty lines to ext DRAM
                     MemReq wb_req = {replaced_tag * 64, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                    _mc->_ext_dram->access(wb_req, 2, dirty_lines * 4);
-                    _ext_bw_per_step += dirty_lines * 4;
+                    _ext_dram->access(wb_req, 2, dirty_lines * 4);
+                    _ext_bw_per_step.inc(req.srcId, dirty_lines * 4);
                 } else {
-                    _numCleanEviction.inc();
+                    _numCleanEviction.inc(req.srcId);
                 }
             }
 
             // Load new page from ext DRAM
             MemReq load_req = {tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-            _mc->_ext_dram->access(load_req, 2, _footprint_size * 4);
-            _ext_bw_per_step += _footprint_size * 4;
+            _ext_dram->access(load_req, 2, _footprint_size * 4);
+            _ext_bw_per_step.inc(req.srcId, _footprint_size * 4);
 
             // Store new page to MCDRAM
             MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-            _mc->_mcdram[mcdram_select]->access(insert_req, 2, _footprint_size * 4);
+            _mcdram[mcdram_select]->access(insert_req, 2, _footprint_size * 4);
             if (!_sram_tag) {
-                _mc->_mcdram[mcdram_select]->access(insert_req, 2, 2);  // store tag
-                _mc_bw_per_step += 2;
+                _mcdram[mcdram_select]->access(insert_req, 2, 2);  // store tag
+                _mc_bw_per_step.inc(req.srcId, 2);
             }
-            _mc_bw_per_step += _footprint_size * 4;
-            _numTagStore.inc();
-            _numPlacement.inc();
+            _mc_bw_per_step.inc(req.srcId, _footprint_size * 4);
+            _numTagStore.inc(req.srcId);
+            _numPlacement.inc(req.srcId);
 
             // Update cache entry
-            _cache[set_num].ways[replace_way].valid = true;
-            _cache[set_num].ways[replace_way].tag = tag;
-            _cache[set_num].ways[replace_way].dirty = (type == STORE);
-            _tlb[tag].way = replace_way;
+            _cache[set_num].fill(replace_way, tag, type == STORE);
+            tlb_entry.way = replace_way;
             updateUtilizationStats(set_num, replace_way);
             // Initialize bitvectors
             uint64_t bit = (address - tag * 64) / 4;
             assert(bit < 16 && bit >= 0);
             bit = ((uint64_t)1UL) << bit;
-            _tlb[tag].touch_bitvec = bit;
-            _tlb[tag].dirty_bitvec = (type == STORE) ? bit : 0;
+            tlb_entry.touch_bitvec = bit;
+            tlb_entry.dirty_bitvec = (type == STORE) ? bit : 0;
         }
     }
 
     if (counter_access && !_sram_tag) {
-        _numCounterAccess.inc();
+        _numCounterAccess.inc(req.srcId);
         MemReq counter_req = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-        _mc->_mcdram[mcdram_select]->access(counter_req, 2, 2);
+        _mcdram[mcdram_select]->access(counter_req, 2, 2);
         counter_req.type = PUTX;
-        _mc->_mcdram[mcdram_select]->access(counter_req, 2, 2);
-        _mc_bw_per_step += 4;
+        _mcdram[mcdram_select]->access(counter_req, 2, 2);
+        _mc_bw_per_step.inc(req.srcId, 4);
     }
 
     return data_ready_cycle;
 }
 
-void UnisonCacheScheme::period(MemReq& req) {
-    if (_stats_period && _num_requests % _stats_period == 0) {
-        logUtilizationStats();
-        // Reset access counts after logging
-        for (uint64_t i = 0; i < _total_lines; i++) {
-             _line_access_count[i] &= ((1ULL << 32) - 1);
-        }
-    }
-    // Handle bandwidth balance if needed
-    if (_bw_balance && _num_requests % _step_length == 0) {
-        _num_hit_per_step /= 2;
-        _num_miss_per_step /= 2;
-        _mc_bw_per_step /= 2;
-        _ext_bw_per_step /= 2;
-
-        if (_bw_balance && _mc_bw_per_step + _ext_bw_per_step > 0) {
-            // Calculate current bandwidth ratio
-            double ratio = 1.0 * _mc_bw_per_step / (_mc_bw_per_step + _ext_bw_per_step);
-            double target_ratio = 0.8;  // Target ratio (mc_bw = 4 * ext_bw)
-
-            // Adjust _ds_index based on bandwidth difference
-            uint64_t index_step = _num_sets / 1000;
-            int64_t delta_index = (ratio - target_ratio > -0.02 && ratio - target_ratio < 0.02) ? 0 : index_step * (ratio - target_ratio) / 0.01;
-
-            printf("ratio = %f\n", ratio);
-
-            if (delta_index > 0) {
-                // Handle increasing _ds_index
-                for (uint32_t mc = 0; mc < _mc->_mcdram_per_mc; mc++) {
-                    for (uint64_t set = _ds_index; set < (uint64_t)(_ds_index + delta_index); set++) {
-                        if (set >= _num_sets) break;
-
-                        for (uint32_t way = 0; way < _num_ways; way++) {
-                            Way& meta = _cache[set].ways[way];
-                            if (meta.valid && meta.dirty) {
-                                // Write back to external DRAM
-                                MESIState state;
-                                MemReq load_req = {meta.tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                                _mc->_mcdram[mc]->access(load_req, 2, (_granularity / 64) * 4);
-                                MemReq wb_req = {meta.tag * 64, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-                                _mc->_ext_dram->access(wb_req, 2, (_granularity / 64) * 4);
-                                _ext_bw_per_step += (_granularity / 64) * 4;
-                                _mc_bw_per_step += (_granularity / 64) * 4;
-                            }
-
-                            meta.valid = false;
-                            meta.dirty = false;
-                        }
-                    }
-                }
-            }
-            _ds_index = ((int64_t)_ds_index + delta_index <= 0) ? 0 : _ds_index + delta_index;
-            printf("_ds_index = %ld/%ld\n", _ds_index, _num_sets);
-        }
-    }
-}
-
 void UnisonCacheScheme::initStats(AggregateStat* parentStat) {
     AggregateStat* stats = new AggregateStat();
     stats->init("unisonCache", "UnisonCache stats");
-    _numPlacement.init("placement", "Number of Placement");
+    _numPlacement.init("placement", "Number of Placement", zinfo->numCores);
     stats->append(&_numPlacement);
-    _numCleanEviction.init("cleanEvict", "Clean Eviction");
+    _numCleanEviction.init("cleanEvict", "Clean Eviction", zinfo->numCores);
     stats->append(&_numCleanEviction);
-    _numDirtyEviction.init("dirtyEvict", "Dirty Eviction");
+    _numDirtyEviction.init("dirtyEvict", "Dirty Eviction", zinfo->numCores);
     stats->append(&_numDirtyEviction);
-    _numLoadHit.init("loadHit", "Load Hit");
+    _numLoadHit.init("loadHit", "Load Hit", zinfo->numCores);
     stats->append(&_numLoadHit);
-    _numLoadMiss.init("loadMiss", "Load Miss");
+    _numLoadMiss.init("loadMiss", "Load Miss", zinfo->numCores);
     stats->append(&_numLoadMiss);
-    _numStoreHit.init("storeHit", "Store Hit");
+    _numStoreHit.init("storeHit", "Store Hit", zinfo->numCores);
     stats->append(&_numStoreHit);
-    _numStoreMiss.init("storeMiss", "Store Miss");
+    _numStoreMiss.init("storeMiss", "Store Miss", zinfo->numCores);
     stats->append(&_numStoreMiss);
-    _numTagLoad.init("tagLoad", "Number of tag loads");
+    _numTagLoad.init("tagLoad", "Number of tag loads", zinfo->numCores);
     stats->append(&_numTagLoad);
-    _numTagStore.init("tagStore", "Number of tag stores");
+    _numTagStore.init("tagStore", "Number of tag stores", zinfo->numCores);
     stats->append(&_numTagStore);
-    _numTouchedLines.init("totalTouchLines", "Total # of touched lines");
+    _numTouchedLines.init("totalTouchLines", "Total # of touched lines", zinfo->numCores);
     stats->append(&_numTouchedLines);
-    _numEvictedLines.init("totalEvictLines", "Total # of evicted lines");
+    _numEvictedLines.init("totalEvictLines", "Total # of evicted lines", zinfo->numCores);
     stats->append(&_numEvictedLines);
-    _numCounterAccess.init("counterAccess", "Counter Access");
+    _numCounterAccess.init("counterAccess", "Counter Access", zinfo->numCores);
     stats->append(&_numCounterAccess);
+    auto tlbBytes = makeLambdaStat([this]() { return _tlb->bytes(); });
+    tlbBytes->init("tlbBytes", "Bytes allocated for the page TLB");
+    stats->append(tlbBytes);
     
     stats->append(_numReaccessedLines);
     stats->append(_numAccessedLines);
@@ -263,6 +202,7 @@ void UnisonCacheScheme::initStats(AggregateStat* parentStat) {
     stats->append(_numTotalExtLines);
     stats->append(_numAccessedExtPages);
     stats->append(_numTotalExtPages);
+    appendBalanceStats(stats);
     
     parentStat->append(stats);
 }
\ No newline at end of file
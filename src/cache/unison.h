@@ -3,6 +3,7 @@
 
 #include "cache/cache_utils.h"
 #include "cache/cache_scheme.h"
+#include "cache/page_tlb.h"
 #include "g_std/g_string.h"
 #include "g_std/g_unordered_map.h"
 #include "placement/page_placement.h"
@@ -11,20 +12,20 @@
 class UnisonCacheScheme : public CacheScheme {
    private:
     PagePlacementPolicy* _page_placement_policy;
-    g_unordered_map<Address, TLBEntry> _tlb;
+    PageTLB* _tlb;
     uint32_t _footprint_size;
-    Counter _numPlacement;
-    Counter _numCleanEviction;
-    Counter _numDirtyEviction;
-    Counter _numLoadHit;
-    Counter _numLoadMiss;
-    Counter _numStoreHit;
-    Counter _numStoreMiss;
-    Counter _numTagLoad;
-    Counter _numTagStore;
-    Counter _numTouchedLines;
-    Counter _numEvictedLines;
-    Counter _numCounterAccess;
+    ShardedCounter _numPlacement;
+    ShardedCounter _numCleanEviction;
+    ShardedCounter _numDirtyEviction;
+    ShardedCounter _numLoadHit;
+    ShardedCounter _numLoadMiss;
+    ShardedCounter _numStoreHit;
+    ShardedCounter _numStoreMiss;
+    ShardedCounter _numTagLoad;
+    ShardedCounter _numTagStore;
+    ShardedCounter _numTouchedLines;
+    ShardedCounter _numEvictedLines;
+    ShardedCounter _numCounterAccess;
 
    public:
     UnisonCacheScheme(Config& config, MemoryController* mc)
@@ -35,11 +36,11 @@ class UnisonCacheScheme : public CacheScheme {
         _page_placement_policy = (PagePlacementPolicy*)gm_malloc(sizeof(PagePlacementPolicy));
         new (_page_placement_policy) PagePlacementPolicy(this);
         _page_placement_policy->initialize(config);
+        _tlb = new PageTLB((_ext_bits < 64) ? _ext_size / _granularity : 0, _num_ways);
         _footprint_size = config.get<uint32_t>("sys.mem.mcdram.footprint_size");
     }
 
     uint64_t access(MemReq& req) override;
-    void period(MemReq& req) override;
     void initStats(AggregateStat* parentStat) override;
 };
 
@@ -0,0 +1,144 @@
+/* Microbenchmark of CHAMOScheme's per-access metadata work (first-touch
+ * marking, column capacities over the cuckoo window, and the base rank of the
+ * accessed level) for 1:16 and 1:64 DRAM:CXL ratios. It compares the packed,
+ * column-major bitmaps with cached capacities that CHAMOScheme uses against
+ * the [level][col] vector<bool> maps it used to walk on every request, and
+ * checks that both give the same capacities and ranks.
+ *
+ * Usage: chamobench [<accesses per ratio>] [<CXL memory MB>] */
+
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include "log.h"
+
+static const uint64_t CUCKOO_WINDOW = 4;  // CHAMOScheme::cuckoo_window_len_
+
+// The former layout: one vector<bool> per level, capacities and ranks walk all levels
+struct LevelMajorMap {
+    uint64_t cols, ratio;
+    std::vector<std::vector<bool>> accessed;  // [level][col]
+
+    LevelMajorMap(uint64_t c, uint64_t r) : cols(c), ratio(r), accessed(r, std::vector<bool>(c, false)) {}
+
+    uint64_t colCap(uint64_t col) const {
+        uint64_t cap = 0;
+        for (uint64_t l = 0; l < ratio; l++) {
+            if (accessed[l][col]) cap++;
+        }
+        return cap;
+    }
+
+    uint64_t baseRank(uint64_t col, uint64_t level) const {
+        uint64_t rank = 1;
+        for (uint64_t l = 0; l < level; l++) {
+            if (accessed[l][col]) rank++;
+        }
+        return rank;
+    }
+
+    // Same work per access as CHAMOScheme::Index: mark on first touch, then
+    // capacities over the cuckoo window (twice per slot, as CheckCuckooPath did) and the base rank
+    uint64_t access(uint64_t col, uint64_t level) {
+        uint64_t res = 0;
+        if (!accessed[level][col]) {
+            accessed[level][col] = true;
+            for (uint64_t i = 0; i < CUCKOO_WINDOW; i++) {
+                uint64_t c = (col + i) % cols;
+                res += colCap(c);
+                res += colCap(c);
+            }
+        }
+        return res + baseRank(col, level);
+    }
+};
+
+// CHAMOScheme's layout: words_per_col words per column, plus cached capacities
+struct ColumnMajorMap {
+    uint64_t cols, ratio, wordsPerCol;
+    uint64_t* bits;
+    uint32_t* caps;
+
+    ColumnMajorMap(uint64_t c, uint64_t r) : cols(c), ratio(r), wordsPerCol((r + 63) / 64) {
+        bits = (uint64_t*)calloc(cols * wordsPerCol, sizeof(uint64_t));
+        caps = (uint32_t*)calloc(cols, sizeof(uint32_t));
+    }
+    ~ColumnMajorMap() { free(bits); free(caps); }
+
+    uint64_t baseRank(uint64_t col, uint64_t level) const {
+        const uint64_t* colBits = &bits[col * wordsPerCol];
+        uint64_t rank = 1;
+        for (uint64_t w = 0; w < level / 64; w++) rank += __builtin_popcountll(colBits[w]);
+        return rank + __builtin_popcountll(colBits[level / 64] & ((1ULL << (level % 64)) - 1));
+    }
+
+    uint64_t access(uint64_t col, uint64_t level) {
+        uint64_t res = 0;
+        uint64_t& word = bits[col * wordsPerCol + level / 64];
+        uint64_t mask = 1ULL << (level % 64);
+        if (!(word & mask)) {
+            word |= mask;
+            caps[col]++;
+            for (uint64_t i = 0; i < CUCKOO_WINDOW; i++) {
+                uint64_t cap = caps[(col + i) % cols];
+                res += 2 * cap;
+            }
+        }
+        return res + baseRank(col, level);
+    }
+};
+
+static volatile uint64_t sink;  // keeps the timed loops from being optimized away
+
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+int main(int argc, char* argv[]) {
+    InitLog("[B] ");
+    uint64_t accesses = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 4000000;
+    uint64_t cxlMB = (argc > 2) ? strtoul(argv[2], nullptr, 0) : 1024;
+    uint64_t cxlLines = cxlMB << 14;  // 64-byte lines
+
+    info("%ld accesses per ratio, %ld MB of CXL memory, uniform random lines", accesses, cxlMB);
+    info("ratio  cache MB   vector<bool> (ns)   packed (ns)   speedup");
+    for (uint64_t ratio : {16ul, 64ul}) {
+        uint64_t cols = cxlLines / ratio;
+
+        // Lines come from a fixed sequence so both layouts see the same accesses
+        uint64_t* lines = (uint64_t*)calloc(accesses, sizeof(uint64_t));
+        uint64_t x = 0x9e3779b97f4a7c15ul;
+        for (uint64_t i = 0; i < accesses; i++) {
+            x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+            lines[i] = x % cxlLines;
+        }
+
+        LevelMajorMap* old = new LevelMajorMap(cols, ratio);
+        uint64_t oldSum = 0;
+        uint64_t start = nowNs();
+        for (uint64_t i = 0; i < accesses; i++) oldSum += old->access(lines[i] % cols, lines[i] / cols);
+        uint64_t oldNs = nowNs() - start;
+
+        ColumnMajorMap* packed = new ColumnMajorMap(cols, ratio);
+        uint64_t packedSum = 0;
+        start = nowNs();
+        for (uint64_t i = 0; i < accesses; i++) packedSum += packed->access(lines[i] % cols, lines[i] / cols);
+        uint64_t packedNs = nowNs() - start;
+
+        if (oldSum != packedSum) panic("Layouts disagree at 1:%ld: %ld vs %ld", ratio, oldSum, packedSum);
+        for (uint64_t c = 0; c < cols; c += 4099) {
+            if (old->colCap(c) != packed->caps[c]) panic("Capacity of column %ld differs at 1:%ld", c, ratio);
+        }
+        sink = packedSum;
+
+        info(" 1:%-3ld  %7ld   %17.2f   %11.2f   %6.2fx", ratio, (cols * 64) >> 20,
+             1.0 * oldNs / accesses, 1.0 * packedNs / accesses, 1.0 * oldNs / packedNs);
+
+        delete old;
+        delete packed;
+        free(lines);
+    }
+    return 0;
+}
@@ -0,0 +1,238 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "columnar_stats.h"
+#include "log.h"
+
+#ifdef _WITH_ZSTD_
+#include <zstd.h>
+#endif
+
+template <typename T>
+static T load(const uint8_t* p) {
+    T res;
+    memcpy(&res, p, sizeof(T));
+    return res;
+}
+
+ColumnarStatsReader::ColumnarStatsReader(const char* _filename) : filename(_filename), data(nullptr), size(0), numRows(0), indexed(false) {
+    fd = open(_filename, O_RDONLY);
+    if (fd < 0) panic("Could not open %s: %s", _filename, strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0) panic("Could not stat %s: %s", _filename, strerror(errno));
+    size = st.st_size;
+    if (size < sizeof(ZcsHeader)) panic("%s is not a columnar stats file (too small)", _filename);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) panic("Could not map %s: %s", _filename, strerror(errno));
+    data = (const uint8_t*)map;
+
+    ZcsHeader header = load<ZcsHeader>(data);
+    if (strncmp(header.magic, ZCS_MAGIC, sizeof(header.magic)) != 0) panic("%s is not a columnar stats file (bad magic)", _filename);
+    if (header.version != ZCS_VERSION) panic("%s has version %d, this reader supports version %d", _filename, header.version, ZCS_VERSION);
+    if (sizeof(ZcsHeader) + header.schemaBytes > size) panic("%s: truncated schema", _filename);
+    numColumns = header.numColumns;
+    parseSchema(data + sizeof(ZcsHeader), header.schemaBytes, header.numNodes);
+
+    if (!readIndex()) scanBlocks(sizeof(ZcsHeader) + header.schemaBytes);
+    for (const Block& b : blocks) numRows = b.firstRow + b.numRows;
+}
+
+ColumnarStatsReader::~ColumnarStatsReader() {
+    munmap((void*)data, size);
+    close(fd);
+}
+
+void ColumnarStatsReader::parseSchema(const uint8_t* schema, uint32_t schemaBytes, uint32_t numNodes) {
+    const uint8_t* p = schema;
+    const uint8_t* end = schema + schemaBytes;
+    auto getString = [&]() {
+        const uint8_t* s = p;
+        while (p < end && *p) p++;
+        if (p == end) panic("%s: truncated schema", filename.c_str());
+        p++;
+        return std::string((const char*)s);
+    };
+
+    std::vector<std::string> path;  // names of the current node's ancestors
+    uint32_t col = 0;
+    for (uint32_t n = 0; n < numNodes; n++) {
+        if (p + sizeof(ZcsNode) > end) panic("%s: truncated schema", filename.c_str());
+        ZcsNode zn = load<ZcsNode>(p);
+        p += sizeof(ZcsNode);
+        Node node;
+        node.kind = (ZcsNodeKind)zn.kind;
+        node.level = zn.level;
+        node.name = getString();
+        node.desc = getString();
+        node.firstColumn = col;
+        node.size = zn.size;
+        if (zn.hasCounterNames) {
+            for (uint32_t i = 0; i < zn.size; i++) node.counterNames.push_back(getString());
+        }
+        if (node.level > path.size()) panic("%s: malformed schema, node %d skips levels", filename.c_str(), n);
+        path.resize(node.level);
+
+        std::string prefix;
+        for (const std::string& a : path) prefix += a + ".";
+        prefix += node.name;
+        if (node.kind == ZCS_SCALAR) {
+            columnNames.push_back(prefix);
+        } else if (node.kind == ZCS_VECTOR) {
+            for (uint32_t i = 0; i < node.size; i++) {
+                columnNames.push_back(prefix + "." + (node.counterNames.empty()? std::to_string(i) : node.counterNames[i]));
+            }
+        }
+        col += node.size;
+        path.push_back(node.name);
+        nodes.push_back(node);
+    }
+    if (col != numColumns) panic("%s: schema has %d columns, header says %d", filename.c_str(), col, numColumns);
+}
+
+bool ColumnarStatsReader::readIndex() {
+    if (size < sizeof(ZcsTrailer)) return false;
+    ZcsTrailer trailer = load<ZcsTrailer>(data + size - sizeof(ZcsTrailer));
+    if (trailer.magic != ZCS_TRAILER_MAGIC) return false;
+    uint64_t entriesOffset = trailer.indexOffset + sizeof(ZcsIndexHeader);
+    if (entriesOffset + trailer.numBlocks*sizeof(ZcsIndexEntry) + sizeof(ZcsTrailer) != size) return false;
+    ZcsIndexHeader ih = load<ZcsIndexHeader>(data + trailer.indexOffset);
+    if (ih.magic != ZCS_INDEX_MAGIC || ih.numBlocks != trailer.numBlocks) return false;
+
+    for (uint32_t i = 0; i < trailer.numBlocks; i++) {
+        ZcsIndexEntry e = load<ZcsIndexEntry>(data + entriesOffset + i*sizeof(ZcsIndexEntry));
+        if (e.offset + sizeof(ZcsBlockHeader) > trailer.indexOffset) panic("%s: index entry %d points past the blocks", filename.c_str(), i);
+        blocks.push_back({(const ZcsBlockHeader*)(data + e.offset), e.firstRow, e.numRows});
+    }
+    indexed = true;
+    return true;
+}
+
+void ColumnarStatsReader::scanBlocks(uint64_t offset) {
+    while (offset + sizeof(uint32_t) <= size) {
+        uint32_t magic = load<uint32_t>(data + offset);
+        if (magic == ZCS_BLOCK_MAGIC) {
+            if (offset + sizeof(ZcsBlockHeader) > size) break;
+            ZcsBlockHeader h = load<ZcsBlockHeader>(data + offset);
+            uint64_t next = offset + sizeof(ZcsBlockHeader) + h.storedBytes;
+            if (next > size) break;  // still being written
+            blocks.push_back({(const ZcsBlockHeader*)(data + offset), h.firstRow, h.numRows});
+            offset = next;
+        } else if (magic == ZCS_INDEX_MAGIC) {
+            // Stale index, written by an earlier flush; more blocks were appended after it
+            if (offset + sizeof(ZcsIndexHeader) > size) break;
+            ZcsIndexHeader ih = load<ZcsIndexHeader>(data + offset);
+            offset += sizeof(ZcsIndexHeader) + ih.numBlocks*sizeof(ZcsIndexEntry) + sizeof(ZcsTrailer);
+        } else {
+            warn("%s: unexpected data at offset %ld, ignoring the rest of the file", filename.c_str(), offset);
+            break;
+        }
+    }
+}
+
+const uint8_t* ColumnarStatsReader::payload(const Block& b, std::vector<uint8_t>& buf) const {
+    ZcsBlockHeader h = load<ZcsBlockHeader>((const uint8_t*)b.header);
+    const uint8_t* stored = (const uint8_t*)b.header + sizeof(ZcsBlockHeader);
+    if (h.codec == ZCS_RAW) return stored;
+#ifdef _WITH_ZSTD_
+    if (h.codec == ZCS_ZSTD) {
+        buf.resize(h.rawBytes);
+        size_t res = ZSTD_decompress(buf.data(), h.rawBytes, stored, h.storedBytes);
+        if (ZSTD_isError(res) || res != h.rawBytes) panic("%s: corrupt block at row %ld", filename.c_str(), b.firstRow);
+        return buf.data();
+    }
+#endif
+    panic("%s: block at row %ld has codec %d, which this build does not support", filename.c_str(), b.firstRow, h.codec);
+}
+
+int32_t ColumnarStatsReader::findColumn(const std::string& name) const {
+    for (uint32_t c = 0; c < numColumns; c++) {
+        if (columnNames[c] == name) return c;
+    }
+    return -1;
+}
+
+void ColumnarStatsReader::readColumn(uint32_t col, std::vector<uint64_t>& vals, uint64_t firstRow, uint64_t rows) const {
+    assert(col < numColumns);
+    uint64_t supRow = (rows > numRows - firstRow || firstRow > numRows)? numRows : firstRow + rows;
+    std::vector<uint8_t> buf;
+    for (const Block& b : blocks) {
+        if (b.firstRow + b.numRows <= firstRow || b.firstRow >= supRow) continue;
+        ZcsBlockHeader h = load<ZcsBlockHeader>((const uint8_t*)b.header);
+        const uint8_t* p = payload(b, buf);
+        const uint8_t* colBase = p + numColumns*sizeof(uint32_t);
+        const uint8_t* cur = colBase + load<uint32_t>(p + col*sizeof(uint32_t));
+        const uint8_t* end = (col + 1 < numColumns)? colBase + load<uint32_t>(p + (col+1)*sizeof(uint32_t)) : p + h.rawBytes;
+        uint64_t val = 0;
+        for (uint32_t r = 0; r < b.numRows; r++) {
+            uint64_t v;
+            cur = zcsGetVarint(cur, end, &v);
+            if (!cur) panic("%s: corrupt column %d in block at row %ld", filename.c_str(), col, b.firstRow);
+            val += zcsUnzigzag(v);
+            uint64_t row = b.firstRow + r;
+            if (row >= firstRow && row < supRow) vals.push_back(val);
+        }
+    }
+}
+
+void ColumnarStatsReader::readRow(uint64_t row, std::vector<uint64_t>& vals) const {
+    for (uint32_t i = 0; i < blocks.size(); i++) {
+        const Block& b = blocks[i];
+        if (row < b.firstRow || row >= b.firstRow + b.numRows) continue;
+        std::vector<uint64_t> blockVals;
+        readBlock(i, blockVals);
+        const uint64_t* rowVals = &blockVals[(row - b.firstRow)*numColumns];
+        vals.assign(rowVals, rowVals + numColumns);
+        return;
+    }
+    panic("%s: row %ld out of range (%ld rows)", filename.c_str(), row, numRows);
+}
+
+void ColumnarStatsReader::readBlock(uint32_t block, std::vector<uint64_t>& vals) const {
+    assert(block < blocks.size());
+    const Block& b = blocks[block];
+    std::vector<uint8_t> buf;
+    ZcsBlockHeader h = load<ZcsBlockHeader>((const uint8_t*)b.header);
+    const uint8_t* p = payload(b, buf);
+    const uint8_t* colBase = p + numColumns*sizeof(uint32_t);
+    vals.resize((uint64_t)b.numRows*numColumns);
+    for (uint32_t c = 0; c < numColumns; c++) {
+        const uint8_t* cur = colBase + load<uint32_t>(p + c*sizeof(uint32_t));
+        const uint8_t* end = (c + 1 < numColumns)? colBase + load<uint32_t>(p + (c+1)*sizeof(uint32_t)) : p + h.rawBytes;
+        uint64_t val = 0;
+        for (uint32_t r = 0; r < b.numRows; r++) {
+            uint64_t v;
+            cur = zcsGetVarint(cur, end, &v);
+            if (!cur) panic("%s: corrupt column %d in block at row %ld", filename.c_str(), c, b.firstRow);
+            val += zcsUnzigzag(v);
+            vals[(uint64_t)r*numColumns + c] = val;
+        }
+    }
+}
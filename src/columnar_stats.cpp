@@ -0,0 +1,282 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "columnar_stats.h"
+#include "galloc.h"
+#include "log.h"
+#include "stats.h"
+#include "stats_snapshot.h"
+#include "stats_writer.h"
+
+#ifdef _WITH_ZSTD_
+#include <zstd.h>
+#endif
+
+/* Buffers rows (snapshot records) until it has a block's worth, then encodes
+ * them column by column and appends the block to the file. As with the text
+ * backend, without a StatsWriter the file is opened and closed on every
+ * write (dumps may come from any process); with a writer, the writer thread
+ * does the encoding and keeps the file open. Either way, only unbuffered
+ * dumps and close() write out partial blocks: the writer's periodic flushes
+ * only flush whole blocks already written, so they do not fragment the file
+ * into small, poorly compressed blocks.
+ */
+class ColumnarBackendImpl : public GlobAlloc, public StatsWriter::Sink {
+    private:
+        const char* filename;
+        StatsSnapshot* snapshot;
+        uint32_t numColumns;
+        uint32_t blockRows;
+        bool compress;
+
+        StatsWriter* writer;  // nullptr to write from dump()
+        // numColumns values, then a flag that ends the block after this row (unbuffered
+        // dumps); the second one is only used with a writer
+        uint64_t* records[2];
+        uint32_t curRecord;
+        lock_t freeSem;  // held while a record is with the writer
+
+        uint64_t* rows;  // pending rows, blockRows x numColumns
+        uint32_t numPending;
+        uint64_t numRows;  // rows written out in blocks
+        uint8_t* rawBuf;  // encoded block
+        uint64_t rawCap;
+        uint8_t* zBuf;  // compressed block
+        uint64_t zCap;
+
+        FILE* file;  // only kept open with a writer
+        uint64_t fileSize;
+        g_vector<ZcsIndexEntry> index;
+        bool indexWritten;  // the file ends with an index of all its blocks
+
+        void appendSchema(Stat* s, uint32_t level, g_vector<uint8_t>& schema, uint32_t& numNodes) {
+            ZcsNode node;
+            memset(&node, 0, sizeof(node));
+            node.level = level;
+            AggregateStat* as = dynamic_cast<AggregateStat*>(s);
+            VectorStat* vs = dynamic_cast<VectorStat*>(s);
+            if (as) {
+                node.kind = ZCS_AGGREGATE;
+            } else if (vs) {
+                node.kind = ZCS_VECTOR;
+                node.size = vs->size();
+                node.hasCounterNames = vs->hasCounterNames();
+            } else if (dynamic_cast<ScalarStat*>(s)) {
+                node.kind = ZCS_SCALAR;
+                node.size = 1;
+            } else {
+                panic("Unrecognized stat type");
+            }
+            if (level > UINT16_MAX) panic("Stats tree too deep for %s", filename);
+            const uint8_t* np = (const uint8_t*)&node;
+            schema.insert(schema.end(), np, np + sizeof(node));
+            auto putString = [&schema](const char* str) {
+                schema.insert(schema.end(), (const uint8_t*)str, (const uint8_t*)str + strlen(str) + 1);
+            };
+            putString(s->name());
+            putString(s->desc());
+            if (vs && vs->hasCounterNames()) {
+                for (uint32_t i = 0; i < vs->size(); i++) putString(vs->counterName(i));
+            }
+            numNodes++;
+            if (as) {
+                for (uint32_t i = 0; i < as->size(); i++) appendSchema(as->get(i), level+1, schema, numNodes);
+            }
+        }
+
+        void append(const void* buf, uint64_t bytes) {
+            if (!file) {
+                file = fopen(filename, "ab");
+                if (!file) panic("Could not open %s: %s", filename, strerror(errno));
+            }
+            if (fwrite(buf, 1, bytes, file) != bytes) panic("Could not write %s: %s", filename, strerror(errno));
+            fileSize += bytes;
+            indexWritten = false;
+            if (!writer) {
+                fclose(file);
+                file = nullptr;
+            }
+        }
+
+        void writeBlock() {
+            if (!numPending) return;
+
+            // Column-major: for each column, the deltas of its values, from 0
+            uint32_t* offsets = (uint32_t*)rawBuf;
+            uint8_t* colBase = rawBuf + numColumns*sizeof(uint32_t);
+            uint8_t* p = colBase;
+            for (uint32_t c = 0; c < numColumns; c++) {
+                offsets[c] = p - colBase;
+                uint64_t prev = 0;
+                for (uint32_t r = 0; r < numPending; r++) {
+                    uint64_t v = rows[r*numColumns + c];
+                    p = zcsPutVarint(p, zcsZigzag(v - prev));
+                    prev = v;
+                }
+            }
+            assert(p <= rawBuf + rawCap);
+
+            ZcsBlockHeader header;
+            memset(&header, 0, sizeof(header));
+            header.magic = ZCS_BLOCK_MAGIC;
+            header.codec = ZCS_RAW;
+            header.numRows = numPending;
+            header.rawBytes = p - rawBuf;
+            header.storedBytes = header.rawBytes;
+            header.firstRow = numRows;
+            const uint8_t* stored = rawBuf;
+#ifdef _WITH_ZSTD_
+            if (compress) {
+                size_t res = ZSTD_compress(zBuf, zCap, rawBuf, header.rawBytes, 3 /*level*/);
+                if (!ZSTD_isError(res) && res < header.rawBytes) {
+                    header.codec = ZCS_ZSTD;
+                    header.storedBytes = res;
+                    stored = zBuf;
+                }
+            }
+#endif
+
+            ZcsIndexEntry entry;
+            memset(&entry, 0, sizeof(entry));
+            entry.offset = fileSize;
+            entry.firstRow = numRows;
+            entry.numRows = numPending;
+            index.push_back(entry);
+
+            append(&header, sizeof(header));
+            append(stored, header.storedBytes);
+            numRows += numPending;
+            numPending = 0;
+        }
+
+        void writeIndex() {
+            if (indexWritten) return;
+            ZcsIndexHeader ih = {ZCS_INDEX_MAGIC, (uint32_t)index.size()};
+            ZcsTrailer trailer;
+            memset(&trailer, 0, sizeof(trailer));
+            trailer.indexOffset = fileSize;
+            trailer.numBlocks = index.size();
+            trailer.magic = ZCS_TRAILER_MAGIC;
+            append(&ih, sizeof(ih));
+            if (index.size()) append(&index[0], index.size()*sizeof(ZcsIndexEntry));
+            append(&trailer, sizeof(trailer));
+            indexWritten = true;
+        }
+
+    public:
+        ColumnarBackendImpl(const char* _filename, AggregateStat* rootStat, uint32_t _blockRows, bool _compress, StatsWriter* _writer) :
+            filename(_filename), blockRows(_blockRows), compress(_compress), writer(_writer), file(nullptr), fileSize(0)
+        {
+            assert(blockRows > 0);
+#ifndef _WITH_ZSTD_
+            if (compress) {
+                warn("Columnar stats (%s): zsim was built without zstd, blocks will not be compressed", filename);
+                compress = false;
+            }
+#endif
+            snapshot = new StatsSnapshot(rootStat, false /*skipVectors*/, false /*sumRegularAggregates*/);
+            numColumns = snapshot->size();
+            records[0] = gm_calloc<uint64_t>(numColumns + 1);
+            records[1] = writer? gm_calloc<uint64_t>(numColumns + 1) : nullptr;
+            curRecord = 0;
+            futex_init(&freeSem);
+
+            rows = gm_calloc<uint64_t>((uint64_t)blockRows*numColumns + 1);
+            numPending = 0;
+            numRows = 0;
+            rawCap = numColumns*sizeof(uint32_t) + (uint64_t)blockRows*numColumns*10 /*max varint bytes*/;
+            rawBuf = gm_calloc<uint8_t>(rawCap);
+#ifdef _WITH_ZSTD_
+            zCap = compress? ZSTD_compressBound(rawCap) : 0;
+#else
+            zCap = 0;
+#endif
+            zBuf = zCap? gm_calloc<uint8_t>(zCap) : nullptr;
+
+            g_vector<uint8_t> schema;
+            uint32_t numNodes = 0;
+            appendSchema(rootStat, 0, schema, numNodes);
+            ZcsHeader header;
+            memset(&header, 0, sizeof(header));
+            strncpy(header.magic, ZCS_MAGIC, sizeof(header.magic));
+            header.version = ZCS_VERSION;
+            header.numColumns = numColumns;
+            header.numNodes = numNodes;
+            header.schemaBytes = schema.size();
+
+            FILE* f = fopen(filename, "wb");  // truncate
+            if (!f) panic("Could not open %s: %s", filename, strerror(errno));
+            fclose(f);
+            append(&header, sizeof(header));
+            append(&schema[0], schema.size());
+            info("Columnar stats (%s): %d columns, %d rows/block%s%s", filename, numColumns, blockRows,
+                 compress? ", zstd" : "", writer? ", async" : "");
+        }
+
+        void dump(bool buffered) {
+            snapshot->read(records[curRecord]);
+            records[curRecord][numColumns] = !buffered;
+            if (writer) {
+                futex_lock(&freeSem);  // the writer is done with the other record
+                uint64_t ticket = writer->enqueue(this, records[curRecord], 1, &freeSem);
+                curRecord ^= 1;
+                if (!buffered) writer->wait(ticket);
+            } else {
+                write(records[curRecord], 1);
+            }
+        }
+
+        // StatsWriter::Sink; also called by dump() without a writer
+        void write(const uint64_t* recs, uint32_t numRecords) {
+            for (uint32_t r = 0; r < numRecords; r++) {
+                const uint64_t* rec = &recs[(uint64_t)r*(numColumns + 1)];
+                memcpy(&rows[(uint64_t)numPending*numColumns], rec, numColumns*sizeof(uint64_t));
+                if (++numPending == blockRows || rec[numColumns]) writeBlock();
+                if (rec[numColumns]) writeIndex();
+            }
+        }
+
+        void flush() {
+            if (file) fflush(file);
+        }
+
+        void close() {
+            writeBlock();
+            writeIndex();
+            if (file) fclose(file);
+            file = nullptr;
+        }
+};
+
+ColumnarBackend::ColumnarBackend(const char* filename, AggregateStat* rootStat, uint32_t blockRows, bool compress, StatsWriter* writer) {
+    backend = new ColumnarBackendImpl(filename, rootStat, blockRows, compress, writer);
+}
+
+void ColumnarBackend::dump(bool buffered) {
+    backend->dump(buffered);
+}
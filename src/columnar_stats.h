@@ -0,0 +1,201 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COLUMNAR_STATS_H_
+#define COLUMNAR_STATS_H_
+
+/* Columnar stats files (.zcs), written by ColumnarBackend for periodic output.
+ * One column per counter of the stats tree (scalars, and each element of
+ * vectors), one row per dump. Layout, all little-endian:
+ *
+ *   ZcsHeader, then the schema: one node per stat, in preorder
+ *     (ZcsNode, name, desc, and for named vectors, size counter names;
+ *      strings are NUL-terminated). Columns follow the order of the nodes.
+ *   Blocks of rows: ZcsBlockHeader, then storedBytes of payload, compressed
+ *     with zstd if codec == ZCS_ZSTD. Decompressed, a payload is
+ *     uint32_t colOffsets[numColumns], then the data of each column at its
+ *     offset (relative to the end of colOffsets): numRows zigzag varints,
+ *     the deltas of the column's values, starting from 0 at each block. So
+ *     blocks decode independently, and uncompressed blocks can be read one
+ *     column at a time.
+ *   When the file is closed, an index of the blocks (ZcsIndexHeader, then
+ *     ZcsIndexEntry per block), and a ZcsTrailer as the last 16 bytes of the
+ *     file. Readers of files without a trailer (e.g., mid-run) scan the
+ *     blocks instead, skipping any index that is not at the end.
+ *
+ * ColumnarStatsReader reads these files through mmap, without loading them;
+ * zcsread is its command-line interface.
+ */
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define ZCS_MAGIC "ZSIMCOL"
+#define ZCS_VERSION 1
+
+enum ZcsCodec : uint8_t {ZCS_RAW = 0, ZCS_ZSTD = 1};
+enum ZcsNodeKind : uint8_t {ZCS_AGGREGATE = 0, ZCS_SCALAR = 1, ZCS_VECTOR = 2};
+
+static const uint32_t ZCS_BLOCK_MAGIC = 0x4b42435a;  // "ZCBK"
+static const uint32_t ZCS_INDEX_MAGIC = 0x5849435a;  // "ZCIX"
+static const uint32_t ZCS_TRAILER_MAGIC = 0x5254435a;  // "ZCTR"
+
+struct ZcsHeader {
+    char magic[8];  // ZCS_MAGIC, NUL-terminated
+    uint32_t version;
+    uint32_t numColumns;
+    uint32_t numNodes;
+    uint32_t schemaBytes;  // right after the header
+};
+
+struct ZcsNode {
+    uint8_t kind;  // ZcsNodeKind
+    uint8_t hasCounterNames;
+    uint16_t level;  // depth in the tree, the root is 0
+    uint32_t size;  // columns, 0 for aggregates
+};
+
+struct ZcsBlockHeader {
+    uint32_t magic;  // ZCS_BLOCK_MAGIC
+    uint8_t codec;   // ZcsCodec
+    uint8_t pad[3];
+    uint32_t numRows;
+    uint32_t rawBytes;
+    uint32_t storedBytes;
+    uint32_t pad2;
+    uint64_t firstRow;
+};
+
+struct ZcsIndexHeader {
+    uint32_t magic;  // ZCS_INDEX_MAGIC
+    uint32_t numBlocks;
+};
+
+struct ZcsIndexEntry {
+    uint64_t offset;  // of the block header
+    uint64_t firstRow;
+    uint32_t numRows;
+    uint32_t pad;
+};
+
+struct ZcsTrailer {
+    uint64_t indexOffset;  // of the ZcsIndexHeader
+    uint32_t numBlocks;
+    uint32_t magic;  // ZCS_TRAILER_MAGIC
+};
+
+static inline uint64_t zcsZigzag(uint64_t delta) {
+    return (delta << 1) ^ (uint64_t)((int64_t)delta >> 63);
+}
+
+static inline uint64_t zcsUnzigzag(uint64_t v) {
+    return (v >> 1) ^ -(v & 1);
+}
+
+// Appends v as a LEB128 varint; buf needs room for 10 bytes
+static inline uint8_t* zcsPutVarint(uint8_t* buf, uint64_t v) {
+    while (v >= 0x80) {
+        *(buf++) = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    *(buf++) = (uint8_t)v;
+    return buf;
+}
+
+static inline const uint8_t* zcsGetVarint(const uint8_t* buf, const uint8_t* end, uint64_t* v) {
+    uint64_t res = 0;
+    for (uint32_t shift = 0; buf < end && shift < 64; shift += 7) {
+        uint8_t b = *(buf++);
+        res |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = res;
+            return buf;
+        }
+    }
+    return nullptr;  // truncated or malformed
+}
+
+class ColumnarStatsReader {
+    public:
+        struct Node {
+            ZcsNodeKind kind;
+            uint32_t level;
+            std::string name;
+            std::string desc;
+            std::vector<std::string> counterNames;  // empty if the vector has none
+            uint32_t firstColumn;
+            uint32_t size;
+        };
+
+    private:
+        struct Block {
+            const ZcsBlockHeader* header;
+            uint64_t firstRow;
+            uint32_t numRows;
+        };
+
+        std::string filename;
+        int fd;
+        const uint8_t* data;
+        uint64_t size;
+        uint32_t numColumns;
+        std::vector<Node> nodes;
+        std::vector<std::string> columnNames;  // dot-separated paths, as in the HDF5 files
+        std::vector<Block> blocks;
+        uint64_t numRows;
+        bool indexed;  // blocks come from the trailer's index, not a scan
+
+        void parseSchema(const uint8_t* schema, uint32_t schemaBytes, uint32_t numNodes);
+        bool readIndex();
+        void scanBlocks(uint64_t offset);
+        // Decompressed payload of a block; points into the file if it is raw
+        const uint8_t* payload(const Block& b, std::vector<uint8_t>& buf) const;
+
+    public:
+        explicit ColumnarStatsReader(const char* filename);  // panics on malformed files
+        ~ColumnarStatsReader();
+
+        uint32_t getNumColumns() const { return numColumns; }
+        uint64_t getNumRows() const { return numRows; }
+        uint32_t getNumBlocks() const { return blocks.size(); }
+        bool isIndexed() const { return indexed; }
+        const std::vector<Node>& getNodes() const { return nodes; }
+        const std::string& columnName(uint32_t col) const { return columnNames[col]; }
+        int32_t findColumn(const std::string& name) const;  // -1 if not found
+
+        // Appends the values of a column for rows [firstRow, firstRow + rows), clamped to the file, to vals
+        void readColumn(uint32_t col, std::vector<uint64_t>& vals, uint64_t firstRow = 0, uint64_t rows = UINT64_MAX) const;
+        // Reads a whole row (numColumns values)
+        void readRow(uint64_t row, std::vector<uint64_t>& vals) const;
+
+        // Blocks hold consecutive rows; decoding a whole block at once decompresses it only once
+        uint64_t getBlockFirstRow(uint32_t block) const { return blocks[block].firstRow; }
+        uint32_t getBlockRows(uint32_t block) const { return blocks[block].numRows; }
+        // Reads all the rows of a block, row after row (getBlockRows() x numColumns values)
+        void readBlock(uint32_t block, std::vector<uint64_t>& vals) const;
+};
+
+#endif  // COLUMNAR_STATS_H_
@@ -26,6 +26,7 @@
 #include "contention_sim.h"
 #include <algorithm>
 #include <queue>
+#include <sched.h>
 #include <sstream>
 #include <string>
 #include <typeinfo>
@@ -58,9 +59,11 @@ void ContentionSim::SimThreadTrampoline(void* arg) {
     csim->simThreadLoop(thid);
 }
 
-ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
+ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _balance, bool _stealing) {
     numDomains = _numDomains;
     numSimThreads = _numSimThreads;
+    balance = _balance;
+    stealing = _stealing;
     threadsDone = 0;
     limit = 0;
     lastLimit = 0;
@@ -73,16 +76,22 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
         new (&domains[i].pq) PrioQueue<TimingEvent, PQ_BLOCKS>();
         domains[i].curCycle = 0;
         futex_init(&domains[i].pqLock);
+        domains[i].phaseEvents = 0;
+        domains[i].cost = 0;
     }
 
-    if ((numDomains % numSimThreads) != 0) panic("numDomains(%d) must be a multiple of numSimThreads(%d) for now", numDomains, numSimThreads);
-
+    //Domains start in contiguous ranges; with balance, they are reassigned by cost every phase
     for (uint32_t i = 0; i < numSimThreads; i++) {
+        new (&simThreads[i]) SimThreadData();
         futex_init(&simThreads[i].wakeLock);
         futex_lock(&simThreads[i].wakeLock); //starts locked, so first actual call to lock blocks
-        simThreads[i].firstDomain = i*numDomains/numSimThreads;
-        simThreads[i].supDomain = (i+1)*numDomains/numSimThreads;
+        simThreads[i].doms.reserve(numDomains);
+        for (uint32_t d = i*numDomains/numSimThreads; d < (i+1)*numDomains/numSimThreads; d++) {
+            simThreads[i].doms.push_back(&domains[d]);
+        }
+        simThreads[i].thief = -1;
     }
+    domOrder.resize(numDomains);
 
     futex_init(&waitLock);
     futex_lock(&waitLock); //wait lock must also start locked
@@ -94,7 +103,7 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
     threadTicket = 0;
     __sync_synchronize();
     for (uint32_t i = 0; i < numSimThreads; i++) {
-        PIN_SpawnInternalThread(SimThreadTrampoline, this, 1024*1024, nullptr);
+        SpawnInternalThread(SimThreadTrampoline, this, 1024*1024);
     }
 
     lastCrossing = gm_calloc<CrossingEventInfo>(numDomains*numDomains*MAX_THREADS); //TODO: refine... this allocs too much
@@ -140,6 +149,19 @@ void ContentionSim::initStats(AggregateStat* parentStat) {
         domStat->append(&domains[i].profTime);
         objStat->append(domStat);
     }
+    for (uint32_t i = 0; i < numSimThreads; i++) {
+        std::stringstream ss;
+        ss << "thread-" << i;
+        AggregateStat* thStat = new AggregateStat();
+        thStat->init(gm_strdup(ss.str().c_str()), "Weave thread stats");
+        simThreads[i].profBusy.init("busy", "Time simulating or stealing domains");
+        simThreads[i].profIdle.init("idle", "Time waiting for the other threads to finish the phase");
+        simThreads[i].profSteals.init("steals", "Domains stolen from other threads");
+        thStat->append(&simThreads[i].profBusy);
+        thStat->append(&simThreads[i].profIdle);
+        thStat->append(&simThreads[i].profSteals);
+        objStat->append(thStat);
+    }
     parentStat->append(objStat);
 }
 
@@ -157,6 +179,14 @@ void ContentionSim::simulatePhase(uint64_t limit) {
         if (ocore) ocore->cSimStart();
     }
 
+    if (balance) assignDomains();
+    for (uint32_t i = 0; i < numSimThreads; i++) {
+        simThreads[i].numActive = simThreads[i].doms.size();
+        simThreads[i].retired = false;
+        simThreads[i].handoffReady = false;
+        assert(simThreads[i].thief == -1);
+    }
+
     inCSim = true;
     __sync_synchronize();
 
@@ -279,138 +309,270 @@ void ContentionSim::simThreadLoop(uint32_t thid) {
         simulatePhaseThread(thid);
         //info("%d --- phase end", domain);
 
+        simThreads[thid].profIdle.start();
         uint32_t val = __sync_add_and_fetch(&threadsDone, 1);
         if (val == numSimThreads) {
             threadsDone = 0;
+            for (uint32_t i = 0; i < numSimThreads; i++) simThreads[i].profIdle.end();
             futex_unlock(&waitLock); //unblock caller
         }
     }
     info("Finished contention simulation thread %d", thid);
 }
 
+void ContentionSim::assignDomains() {
+    //Longest-processing-time first: costliest domains first, each to the least loaded thread
+    for (uint32_t i = 0; i < numDomains; i++) {
+        domains[i].cost = (domains[i].cost + domains[i].phaseEvents)/2;
+        domains[i].phaseEvents = 0;
+        domOrder[i] = i;
+    }
+    std::sort(domOrder.begin(), domOrder.end(), [this](uint32_t a, uint32_t b) {
+        return (domains[a].cost != domains[b].cost)? domains[a].cost > domains[b].cost : a < b;
+    });
+    for (uint32_t i = 0; i < numSimThreads; i++) {
+        simThreads[i].doms.clear();
+        simThreads[i].load = 0;
+    }
+    for (uint32_t d : domOrder) {
+        uint32_t minThread = 0;
+        for (uint32_t i = 1; i < numSimThreads; i++) {
+            if (simThreads[i].load < simThreads[minThread].load) minThread = i;
+        }
+        simThreads[minThread].doms.push_back(&domains[d]);
+        simThreads[minThread].load += domains[d].cost + 1; //+1 spreads domains without history
+    }
+}
+
 void ContentionSim::simulatePhaseThread(uint32_t thid) {
-    uint32_t thDomains = simThreads[thid].supDomain - simThreads[thid].firstDomain;
-    uint32_t numFinished = 0;
+    SimThreadData& st = simThreads[thid];
+    st.profBusy.start();
+    uint32_t thDomains = st.doms.size();
 	//printf("thDomains = %d\n", thDomains);
     if (thDomains == 1) {
-        DomainData& domain = domains[simThreads[thid].firstDomain];
-        domain.profTime.start();
-        PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain.pq;
-        while (pq.size() && pq.firstCycle() < limit) {
-            uint64_t domCycle = domain.curCycle;
-            uint64_t cycle;
-            TimingEvent* te = pq.dequeue(cycle);
+        simulateDomain(thid, *st.doms[0]);
+    } else if (thDomains > 1) {
+        //info("XXX %d / %d", thid, thDomains);
+        simulateDomains(thid, &st.doms[0], thDomains);
+    }
+
+    //Out of domains: help threads that still hold several
+    while (stealing) {
+        DomainData* domain = steal(thid);
+        if (!domain) break;
+        st.profSteals.inc();
+        simulateDomain(thid, *domain);
+    }
+    retire(thid);
+    st.profBusy.end();
+
+    //info("Phase done");
+    __sync_synchronize();
+}
+
+void ContentionSim::simulateDomain(uint32_t thid, DomainData& domain) {
+    domain.profTime.start();
+    PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain.pq;
+    while (pq.size() && pq.firstCycle() < limit) {
+        uint64_t domCycle = domain.curCycle;
+        uint64_t cycle;
+        TimingEvent* te = pq.dequeue(cycle);
 			//printf("cycle=%ld, domain=%d, numChild=%d, preDelay=%d, postDelay=%d, minStart=%ld\n",
 			//	cycle, te->getDomain(), te->getNumChildren(), te->getPreDelay(), te->getPostDelay(),
 			//	te->getMinStartCycle());
-            assert(cycle >= domCycle);
-            if (cycle != domCycle) {
-                domCycle = cycle;
-                domain.curCycle = cycle;
-            }
-            te->run(cycle);
-            uint64_t newCycle = pq.size()? pq.firstCycle() : limit;
-            assert(newCycle >= domCycle);
-            if (newCycle != domCycle) domain.curCycle = newCycle;
+        assert(cycle >= domCycle);
+        if (cycle != domCycle) {
+            domCycle = cycle;
+            domain.curCycle = cycle;
+        }
+        te->run(cycle);
+        domain.phaseEvents++;
+        uint64_t newCycle = pq.size()? pq.firstCycle() : limit;
+        assert(newCycle >= domCycle);
+        if (newCycle != domCycle) domain.curCycle = newCycle;
 #if POST_MORTEM
-            simThreads[thid].logVec.push_back(std::make_pair(cycle, te));
+        simThreads[thid].logVec.push_back(std::make_pair(cycle, te));
 #endif
-        }
-        domain.curCycle = limit;
-        domain.profTime.end();
+    }
+    domain.curCycle = limit;
+    domain.profTime.end();
 
 #if POST_MORTEM
-        //Post-mortem
-        if (limit % 10000000 == 0)  {
-            futex_lock(&postMortemLock); //serialize output
-            uint32_t uniqueEvs = 0;
-            std::unordered_map<TimingEvent*, std::string> evsSeen;
-            for (std::pair<uint64_t, TimingEvent*> p : simThreads[thid].logVec) {
-                uint64_t cycle = p.first;
-                TimingEvent* te = p.second;
-                std::string desc = evsSeen[te];
-                if (desc == "") { //non-existnt
-                    std::stringstream ss;
-                    ss << uniqueEvs << " " << typeid(*te).name();
-                    CrossingEvent* ce = dynamic_cast<CrossingEvent*>(te);
-                    if (ce) {
-                        ss << " slack " << (ce->preSlack + ce->postSlack) << " osc " << ce->origStartCycle << " cnt " << ce->simCount;
-                    }
-
-                    evsSeen[te] = ss.str();
-                    uniqueEvs++;
-                    desc = ss.str();
+    //Post-mortem
+    if (limit % 10000000 == 0)  {
+        futex_lock(&postMortemLock); //serialize output
+        uint32_t uniqueEvs = 0;
+        std::unordered_map<TimingEvent*, std::string> evsSeen;
+        for (std::pair<uint64_t, TimingEvent*> p : simThreads[thid].logVec) {
+            uint64_t cycle = p.first;
+            TimingEvent* te = p.second;
+            std::string desc = evsSeen[te];
+            if (desc == "") { //non-existnt
+                std::stringstream ss;
+                ss << uniqueEvs << " " << typeid(*te).name();
+                CrossingEvent* ce = dynamic_cast<CrossingEvent*>(te);
+                if (ce) {
+                    ss << " slack " << (ce->preSlack + ce->postSlack) << " osc " << ce->origStartCycle << " cnt " << ce->simCount;
                 }
-                info("[%d] %ld %s", thid, cycle, desc.c_str());
+
+                evsSeen[te] = ss.str();
+                uniqueEvs++;
+                desc = ss.str();
             }
-            futex_unlock(&postMortemLock);
+            info("[%d] %ld %s", thid, cycle, desc.c_str());
         }
-        simThreads[thid].logVec.clear();
+        futex_unlock(&postMortemLock);
+    }
+    simThreads[thid].logVec.clear();
 #endif
+}
 
-    } else {
-        //info("XXX %d / %d %d %d", thid, thDomains, simThreads[thid].supDomain, simThreads[thid].firstDomain);
+void ContentionSim::simulateDomains(uint32_t thid, DomainData** doms, uint32_t numDoms) {
+    SimThreadData& st = simThreads[thid];
+    uint32_t thDomains = numDoms;
+    uint32_t numFinished = 0;
+
+    std::priority_queue<DomainData*, std::vector<DomainData*>, CompareDomains> domPq;
+    for (uint32_t i = 0; i < numDoms; i++) {
+        domPq.push(doms[i]);
+    }
 
-        std::priority_queue<DomainData*, std::vector<DomainData*>, CompareDomains> domPq;
-        for (uint32_t i = simThreads[thid].firstDomain; i < simThreads[thid].supDomain; i++) {
-            domPq.push(&domains[i]);
+    std::vector<DomainData*> sq1;
+    std::vector<DomainData*> sq2;
+
+    std::vector<DomainData*>& stalledQueue = sq1;
+    std::vector<DomainData*>& nextStalledQueue = sq2;
+
+    //Between events, every unfinished domain is in one of the queues. A thief
+    //gets the one that would run next (furthest behind), or else a stalled one.
+    auto pick = [&]() -> DomainData* {
+        if (thDomains - numFinished < 2) return nullptr;
+        DomainData* domain;
+        if (domPq.size()) {
+            domain = domPq.top();
+            domPq.pop();
+        } else if (stalledQueue.size()) {
+            domain = stalledQueue.back();
+            stalledQueue.pop_back();
+        } else {
+            assert(nextStalledQueue.size());
+            domain = nextStalledQueue.back();
+            nextStalledQueue.pop_back();
+        }
+        thDomains--;
+        st.numActive = thDomains - numFinished;
+        return domain;
+    };
+
+    while (numFinished < thDomains) {
+        while (domPq.size()) {
+            DomainData* domain = domPq.top();
+            domPq.pop();
+            PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
+            if (!pq.size() || pq.firstCycle() > limit) {
+                numFinished++;
+                st.numActive = thDomains - numFinished;
+                domain->curCycle = limit;
+            } else {
+                //info("YYY %d %ld %ld %d", numFinished, domPq.size(), domain->curCycle, domain->prio);
+                uint64_t cycle;
+                TimingEvent* te = pq.dequeue(cycle);
+                //uint64_t nextCycle = pq.size()? pq.firstCycle() : cycle;
+                if (cycle != domain->curCycle) domain->curCycle = cycle;
+                te->run(cycle);
+                domain->phaseEvents++;
+                domain->curCycle = pq.size()? pq.firstCycle() : limit;
+                domain->queuePrio = domain->curCycle;
+                if (domain->prio == 0) domPq.push(domain);
+                else stalledQueue.push_back(domain);
+            }
+            if (st.thief != -1) serveThief(thid, pick);
         }
 
-        std::vector<DomainData*> sq1;
-        std::vector<DomainData*> sq2;
+        while (stalledQueue.size()) {
+            DomainData* domain = stalledQueue.back();
+            stalledQueue.pop_back();
+            PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
+            if (!pq.size() || pq.firstCycle() > limit) {
+                numFinished++;
+                st.numActive = thDomains - numFinished;
+                domain->curCycle = limit;
+            } else {
+                //info("SSS %d %ld %ld", numFinished, stalledQueue.size(), domain->curCycle);
+                uint64_t cycle;
+                TimingEvent* te = pq.dequeue(cycle);
+                if (cycle != domain->curCycle) domain->curCycle = cycle;
+                te->state = EV_RUNNING;
+                te->simulate(cycle);
+                domain->phaseEvents++;
+                domain->curCycle = pq.size()? pq.firstCycle() : limit;
+                domain->queuePrio = domain->curCycle;
+                if (domain->prio == 0) domPq.push(domain);
+                else nextStalledQueue.push_back(domain);
+            }
+            if (st.thief != -1) serveThief(thid, pick);
+            if (domPq.size()) break;
+        }
+        if (!stalledQueue.size()) std::swap(stalledQueue, nextStalledQueue);
+    }
+}
 
-        std::vector<DomainData*>& stalledQueue = sq1;
-        std::vector<DomainData*>& nextStalledQueue = sq2;
+template <typename PickFn>
+void ContentionSim::serveThief(uint32_t thid, PickFn pick) {
+    int32_t t = simThreads[thid].thief;
+    //The thief may withdraw its request if we retire, so whoever clears thief answers it
+    if (t == -1 || !__sync_bool_compare_and_swap(&simThreads[thid].thief, t, -1)) return;
+    SimThreadData& th = simThreads[t];
+    th.handoff = pick();
+    __sync_synchronize();
+    th.handoffReady = true;
+}
 
-        while (numFinished < thDomains) {
-            while (domPq.size()) {
-                DomainData* domain = domPq.top();
-                domPq.pop();
-                PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
-                if (!pq.size() || pq.firstCycle() > limit) {
-                    numFinished++;
-                    domain->curCycle = limit;
+ContentionSim::DomainData* ContentionSim::steal(uint32_t thid) {
+    SimThreadData& st = simThreads[thid];
+    st.numActive = 0;
+    auto refuse = []() -> DomainData* { return nullptr; };
+    while (true) {
+        bool victims = false;
+        for (uint32_t i = 1; i < numSimThreads; i++) {
+            uint32_t v = (thid + i) % numSimThreads;
+            SimThreadData& victim = simThreads[v];
+            if (victim.retired || victim.numActive < 2) continue;
+            victims = true;
+            if (!__sync_bool_compare_and_swap(&victim.thief, -1, (int32_t)thid)) continue;
+
+            //Wait for the victim to answer between two events, refusing our own thieves meanwhile
+            bool answered = false;
+            for (uint32_t spins = 1; !answered; spins++) {
+                if (st.handoffReady) {
+                    answered = true;
+                } else if (victim.retired && __sync_bool_compare_and_swap(&victim.thief, (int32_t)thid, -1)) {
+                    break;  //withdrawn, the victim will not answer
                 } else {
-                    //info("YYY %d %ld %ld %d", numFinished, domPq.size(), domain->curCycle, domain->prio);
-                    uint64_t cycle;
-                    TimingEvent* te = pq.dequeue(cycle);
-                    //uint64_t nextCycle = pq.size()? pq.firstCycle() : cycle;
-                    if (cycle != domain->curCycle) domain->curCycle = cycle;
-                    te->run(cycle);
-                    domain->curCycle = pq.size()? pq.firstCycle() : limit;
-                    domain->queuePrio = domain->curCycle;
-                    if (domain->prio == 0) domPq.push(domain);
-                    else stalledQueue.push_back(domain);
+                    if (st.thief != -1) serveThief(thid, refuse);
+                    if (spins % 64 == 0) sched_yield();
+                    else _mm_pause();
                 }
             }
-
-            while (stalledQueue.size()) {
-                DomainData* domain = stalledQueue.back();
-                stalledQueue.pop_back();
-                PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
-                if (!pq.size() || pq.firstCycle() > limit) {
-                    numFinished++;
-                    domain->curCycle = limit;
-                } else {
-                    //info("SSS %d %ld %ld", numFinished, stalledQueue.size(), domain->curCycle);
-                    uint64_t cycle;
-                    TimingEvent* te = pq.dequeue(cycle);
-                    if (cycle != domain->curCycle) domain->curCycle = cycle;
-                    te->state = EV_RUNNING;
-                    te->simulate(cycle);
-                    domain->curCycle = pq.size()? pq.firstCycle() : limit;
-                    domain->queuePrio = domain->curCycle;
-                    if (domain->prio == 0) domPq.push(domain);
-                    else nextStalledQueue.push_back(domain);
-                }
-                if (domPq.size()) break;
+            if (!answered) continue;
+            st.handoffReady = false;
+            DomainData* domain = st.handoff;
+            if (domain) {
+                st.numActive = 1;
+                return domain;
             }
-            if (!stalledQueue.size()) std::swap(stalledQueue, nextStalledQueue);
         }
+        if (!victims) return nullptr;
+        sched_yield();
     }
+}
 
-    //info("Phase done");
+void ContentionSim::retire(uint32_t thid) {
+    SimThreadData& st = simThreads[thid];
+    st.numActive = 0;
+    st.retired = true;
     __sync_synchronize();
+    serveThief(thid, []() -> DomainData* { return nullptr; });
 }
 
 void ContentionSim::finish() {
@@ -74,6 +74,9 @@ class ContentionSim : public GlobAlloc {
             uint32_t prio;
             uint64_t queuePrio;
 
+            uint64_t phaseEvents;  // events run in the current phase
+            uint64_t cost;         // smoothed events per phase, to balance domains across threads
+
             PAD();
 
             ClockStat profTime;
@@ -91,21 +94,43 @@ class ContentionSim : public GlobAlloc {
 
         struct SimThreadData {
             lock_t wakeLock; //used to sleep/wake up simulation thread
-            uint32_t firstDomain;
-            uint32_t supDomain; //supreme, ie first not included
+            g_vector<DomainData*> doms; //domains assigned to this thread at the start of the phase
+            uint64_t load; //their total cost, used only while assigning
 
             std::vector<std::pair<uint64_t, TimingEvent*> > logVec;
+
+            PAD();
+
+            // Work stealing: a thief thread claims this thread by setting thief, and
+            // this thread answers through the thief's handoff between two events
+            volatile int32_t thief; //-1 if none
+            volatile uint32_t numActive; //domains held and not finished this phase
+            volatile bool retired; //done with its domains this phase, answers no more thieves
+
+            PAD();
+
+            DomainData* volatile handoff; //stolen domain, nullptr if refused
+            volatile bool handoffReady;
+
+            PAD();
+
+            ClockStat profBusy;
+            ClockStat profIdle;
+            Counter profSteals;
         };
 
         //RO
         DomainData* domains;
         SimThreadData* simThreads;
+        g_vector<uint32_t> domOrder; //scratch, used to assign domains
 
         PAD();
 
         uint32_t numDomains;
         uint32_t numSimThreads;
         bool skipContention;
+        bool balance; //assign domains by their cost in the last phases instead of in fixed ranges
+        bool stealing; //threads that run out of domains take them from busier threads
 
         PAD();
 
@@ -126,7 +151,7 @@ class ContentionSim : public GlobAlloc {
         lock_t postMortemLock;
 
     public:
-        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads);
+        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _balance = false, bool _stealing = false);
 
         void initStats(AggregateStat* parentStat);
 
@@ -162,6 +187,14 @@ class ContentionSim : public GlobAlloc {
     private:
         void simThreadLoop(uint32_t thid);
         void simulatePhaseThread(uint32_t thid);
+        void assignDomains();
+        void simulateDomain(uint32_t thid, DomainData& domain);
+        void simulateDomains(uint32_t thid, DomainData** doms, uint32_t numDoms);
+
+        // Work stealing
+        template <typename PickFn> void serveThief(uint32_t thid, PickFn pick);
+        DomainData* steal(uint32_t thid);
+        void retire(uint32_t thid);
 
         static void SimThreadTrampoline(void* arg);
 };
@@ -43,14 +43,16 @@ class DDRMemoryAccEvent : public TimingEvent {
         DDRMemory* mem;
         Address addr;
 		uint32_t data_size;
+        uint32_t srcId;
         bool write;
     public:
-        DDRMemoryAccEvent(DDRMemory* _mem, bool _isWrite, Address _addr, uint32_t _data_size, int32_t domain, uint32_t preDelay, uint32_t postDelay)
-            : TimingEvent(preDelay, postDelay, domain), mem(_mem), addr(_addr), data_size(_data_size), write(_isWrite) {}
+        DDRMemoryAccEvent(DDRMemory* _mem, bool _isWrite, Address _addr, uint32_t _data_size, uint32_t _srcId, int32_t domain, uint32_t preDelay, uint32_t postDelay)
+            : TimingEvent(preDelay, postDelay, domain), mem(_mem), addr(_addr), data_size(_data_size), srcId(_srcId), write(_isWrite) {}
 
         Address getAddr() const {return addr;}
         bool isWrite() const {return write;}
 		uint32_t getDataSize() const {return data_size;}
+        uint32_t getSrcId() const {return srcId;}
         void simulate(uint64_t startCycle) {
             mem->enqueue(this, startCycle);
         }
@@ -231,15 +233,15 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
 void DDRMemory::initStats(AggregateStat* parentStat) {
     AggregateStat* memStats = new AggregateStat();
     memStats->init(name.c_str(), "Memory controller stats");
-    profReads.init("rd", "Read requests"); memStats->append(&profReads);
-    profWrites.init("wr", "Write requests"); memStats->append(&profWrites);
-    bytesReads.init("tot_rd", "Total Bytes Read"); memStats->append(&bytesReads);
-    bytesWrites.init("tot_wr", "Total Bytes Write"); memStats->append(&bytesWrites);
-    profTotalRdLat.init("rdlat", "Total latency experienced by read requests"); memStats->append(&profTotalRdLat);
-    profTotalWrLat.init("wrlat", "Total latency experienced by write requests"); memStats->append(&profTotalWrLat);
-    profReadHits.init("rdhits", "Read row hits"); memStats->append(&profReadHits);
-    profWriteHits.init("wrhits", "Write row hits"); memStats->append(&profWriteHits);
-    latencyHist.init("mlh", "latency histogram for memory requests", NUMBINS); 
+    profReads.init("rd", "Read requests", zinfo->numCores); memStats->append(&profReads);
+    profWrites.init("wr", "Write requests", zinfo->numCores); memStats->append(&profWrites);
+    bytesReads.init("tot_rd", "Total Bytes Read", zinfo->numCores); memStats->append(&bytesReads);
+    bytesWrites.init("tot_wr", "Total Bytes Write", zinfo->numCores); memStats->append(&bytesWrites);
+    profTotalRdLat.init("rdlat", "Total latency experienced by read requests", zinfo->numCores); memStats->append(&profTotalRdLat);
+    profTotalWrLat.init("wrlat", "Total latency experienced by write requests", zinfo->numCores); memStats->append(&profTotalWrLat);
+    profReadHits.init("rdhits", "Read row hits", zinfo->numCores); memStats->append(&profReadHits);
+    profWriteHits.init("wrhits", "Write row hits", zinfo->numCores); memStats->append(&profWriteHits);
+    latencyHist.init("mlh", "latency histogram for memory requests", NUMBINS, zinfo->numCores); 
 	// XXX //memStats->append(&latencyHist);
     parentStat->append(memStats);
 }
@@ -277,7 +279,7 @@ uint64_t DDRMemory::access(MemReq& req, int type, uint32_t data_size) {
 			// All the requests can be processed in parallel.
 			//  
             DDRMemoryAccEvent* memEv = new (zinfo->eventRecorders[req.srcId]) DDRMemoryAccEvent(this,
-                    isWrite, req.lineAddr, data_size, domain, preDelay, isWrite? postDelayWr : postDelayRd);
+                    isWrite, req.lineAddr, data_size, req.srcId, domain, preDelay, isWrite? postDelayWr : postDelayRd);
 			if (type == 0) // default. The only record. 
             {
             	memEv->setMinStartCycle(req.cycle);
@@ -344,6 +346,7 @@ void DDRMemory::enqueue(DDRMemoryAccEvent* ev, uint64_t sysCycle) {
     req->addr = ev->getAddr();
     req->loc = mapLineAddr(ev->getAddr());
 	req->data_size = ev->getDataSize();
+    req->srcId = ev->getSrcId();
     req->write = ev->isWrite();
     req->arrivalCycle = memCycle;
     req->startSysCycle = sysCycle;
@@ -652,22 +655,22 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
         ev->done(doneSysCycle - preDelay - postDelayRd);
 
         uint32_t scDelay = doneSysCycle - r->startSysCycle;
-        profReads.inc();
+        profReads.inc(r->srcId);
 		//if (tBL == 4)
 	    //    bytesReads.inc(64 * r->data_size);
 		//else if (tBL == 1)
 	    //    bytesReads.inc(32 * r->data_size);
 		//else 
 		//	assert(false);
-        bytesReads.inc(16 * r->data_size);
-        profTotalRdLat.inc(scDelay);
-        if (rowHit) profReadHits.inc();
+        bytesReads.inc(r->srcId, 16 * r->data_size);
+        profTotalRdLat.inc(r->srcId, scDelay);
+        if (rowHit) profReadHits.inc(r->srcId);
         uint32_t bucket = std::min(NUMBINS-1, scDelay/BINSIZE);
-        latencyHist.inc(bucket, 1);
+        latencyHist.inc(r->srcId, bucket, 1);
     } else {
         uint32_t scDelay = memToSysCycle(minRespCycle) + controllerSysLatency - r->startSysCycle;
-        profWrites.inc();
-        bytesWrites.inc(16 * r->data_size);
+        profWrites.inc(r->srcId);
+        bytesWrites.inc(r->srcId, 16 * r->data_size);
 		//if (tBL == 4)
         //	bytesWrites.inc(64 * r->data_size);
 		//else if (tBL == 1)
@@ -675,8 +678,8 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
 		//else 
 		//	assert(false);
 
-        profTotalWrLat.inc(scDelay);
-        if (rowHit) profWriteHits.inc();
+        profTotalWrLat.inc(r->srcId, scDelay);
+        if (rowHit) profWriteHits.inc(r->srcId);
     }
 
     DEBUG("Served 0x%lx lat %ld clocks", r->addr, minRespCycle-curCycle);
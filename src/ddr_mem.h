@@ -148,6 +148,7 @@ class DDRMemory : public MemObject {
             AddrLoc loc;
             bool write;
 			uint32_t data_size; // access data size. 1 for cacheline, 64 for page
+            uint32_t srcId;
 
             uint64_t rowHitSeq; // sequence number used to throttle max # row hits
 
@@ -235,11 +236,12 @@ class DDRMemory : public MemObject {
 
         // R/W stats
         PAD();
-        Counter profReads, profWrites;
-		Counter bytesReads, bytesWrites;
-        Counter profTotalRdLat, profTotalWrLat;
-        Counter profReadHits, profWriteHits;  // row buffer hits
-        VectorCounter latencyHist;
+        // Sharded by the srcId of the request
+        ShardedCounter profReads, profWrites;
+		ShardedCounter bytesReads, bytesWrites;
+        ShardedCounter profTotalRdLat, profTotalWrLat;
+        ShardedCounter profReadHits, profWriteHits;  // row buffer hits
+        ShardedVectorCounter latencyHist;
         static const uint32_t BINSIZE = 10, NUMBINS = 100;
         PAD();
 
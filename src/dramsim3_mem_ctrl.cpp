@@ -28,8 +28,9 @@
 #include <map>
 #include <string>
 
+#include "bithacks.h"
+#include "contention_sim.h"
 #include "event_recorder.h"
-#include "tick_event.h"
 #include "timing_event.h"
 #include "zsim.h"
 
@@ -43,16 +44,25 @@
 
 using namespace std;
 
+// One event covers a whole data_size transfer (e.g., a page fill or writeback):
+// its 64B DRAMSim3 transactions are issued back to back, each once the previous
+// one returns, and the event completes when the last one does.
 class DRAMSim3AccEvent : public TimingEvent {
    private:
     DRAMSim3Memory *dram;
     bool write;
-    Address addr;
+    Address addr;        // address of the current transaction
+    uint32_t remLines;   // transactions left, including the current one
 
    public:
-    uint64_t sCycle;
+    uint64_t sCycle;     // start cycle of the current transaction; it is not issued before
+    DRAMSim3ReqNode node;
 
-    DRAMSim3AccEvent(DRAMSim3Memory *_dram, bool _write, Address _addr, int32_t domain) : TimingEvent(0, 0, domain), dram(_dram), write(_write), addr(_addr) {}
+    DRAMSim3AccEvent(DRAMSim3Memory *_dram, bool _write, Address _addr, uint32_t _lines, int32_t domain)
+        : TimingEvent(0, 0, domain), dram(_dram), write(_write), addr(_addr), remLines(_lines) {
+        assert(remLines > 0);
+        node.ev = this;
+    }
 
     bool isWrite() const {
         return write;
@@ -62,12 +72,82 @@ class DRAMSim3AccEvent : public TimingEvent {
         return addr;
     }
 
+    // Moves on to the next transaction; returns false if the transfer is complete
+    bool nextLine() {
+        if (--remLines == 0) return false;
+        addr += 64;
+        return true;
+    }
+
     void simulate(uint64_t startCycle) {
         sCycle = startCycle;
         dram->enqueue(this, startCycle);
     }
 };
 
+/* Globally allocated event that ticks DRAMSim3Memory, rescheduled to the next
+ * cycle with work (same scheme as DDRMemory's SchedEvent). The initial event is
+ * queued synchronously at construction; the ones allocated later in the weave
+ * phase start out held. */
+class DRAMSim3SchedEvent : public TimingEvent, public GlobAlloc {
+   private:
+    DRAMSim3Memory *const dram;
+    enum State { IDLE, QUEUED, RUNNING, ANNULLED };
+    State state;
+
+   public:
+    DRAMSim3SchedEvent *next;  // for event freelist
+
+    DRAMSim3SchedEvent(DRAMSim3Memory *_dram, int32_t domain, bool initial) : TimingEvent(0, 0, domain), dram(_dram) {
+        setMinStartCycle(0);
+        next = nullptr;
+        if (initial) {
+            state = QUEUED;
+            zinfo->contentionSim->enqueueSynced(this, 0);
+        } else {
+            setRunning();
+            hold();
+            state = IDLE;
+        }
+    }
+
+    void parentDone(uint64_t startCycle) {
+        panic("This is queued directly");
+    }
+
+    void simulate(uint64_t startCycle) {
+        if (state == QUEUED) {
+            state = RUNNING;
+            requeue(dram->tick(startCycle));
+            state = QUEUED;
+        } else {
+            assert(state == ANNULLED);
+            state = IDLE;
+            hold();
+            dram->recycleEvent(this);
+        }
+    }
+
+    void enqueue(uint64_t cycle) {
+        assert(state == IDLE);
+        state = QUEUED;
+        requeue(cycle);
+    }
+
+    void annul() {
+        assert_msg(state == QUEUED, "sched state %d", state);
+        state = ANNULLED;
+    }
+
+    // Use glob mem
+    using GlobAlloc::operator new;
+    using GlobAlloc::operator delete;
+};
+
+// While idle, one tick event every this many cycles clocks DRAMSim3 (refresh, epoch stats)
+// through all the DRAM cycles since the last one, one ClockTick() each
+static const uint64_t IDLE_TICK_CYCLES = 4096;
+
 DRAMSim3Memory::DRAMSim3Memory(std::string &ConfigName, std::string &OutputDir,
                                int cpuFreqMHz, uint32_t _controllerSysLatency, uint32_t _domain, const g_string &_name) : controllerSysLatency(_controllerSysLatency), domain(_domain), name(_name) {
     curCycle = 0;
@@ -117,8 +197,18 @@ DRAMSim3Memory::DRAMSim3Memory(std::string &ConfigName, std::string &OutputDir,
     dramPsPerClk = static_cast<uint64_t>(tCK * 1000);
     cpuPsPerClk = static_cast<uint64_t>(1000000. / cpuFreqMHz);
     assert(cpuPsPerClk < dramPsPerClk);
-    TickEvent<DRAMSim3Memory> *tickEv = new TickEvent<DRAMSim3Memory>(this, domain);
-    tickEv->queue(0);  // start the sim at time 0
+    shift_bits = ilog2((uint32_t)(dramCore->GetBusBits() / 8 * dramCore->GetBurstLength()));
+    inflightRequests = gm_malloc<InList<DRAMSim3ReqNode>>(channels * INFLIGHT_BUCKETS);
+    for (uint32_t i = 0; i < channels * INFLIGHT_BUCKETS; i++) new (&inflightRequests[i]) InList<DRAMSim3ReqNode>();
+    numInflight = 0;
+    pendingRequests = gm_malloc<DRAMSim3PendingQueue>(channels);
+    for (uint32_t c = 0; c < channels; c++) new (&pendingRequests[c]) DRAMSim3PendingQueue();
+    numPending = 0;
+    pendingSeq = 0;
+
+    eventFreelist = nullptr;
+    nextSchedEvent = new DRAMSim3SchedEvent(this, domain, true);  // start the sim at time 0
+    nextSchedCycle = 0;
 
     info("DRAMSim3Memory[%s]: domain %d, boundLat %d rd / %d wr", name.c_str(), domain, minRdLatency, minWrLatency);
 }
@@ -215,7 +305,7 @@ uint64_t DRAMSim3Memory::access(MemReq &req) {
         //     requestQueues.emplace(dramReq.channel, chanQueue);
         // }
         bool isWrite = (req.type == PUTX);
-        DRAMSim3AccEvent *memEv = new (zinfo->eventRecorders[req.srcId]) DRAMSim3AccEvent(this, isWrite, addr, domain);
+        DRAMSim3AccEvent *memEv = new (zinfo->eventRecorders[req.srcId]) DRAMSim3AccEvent(this, isWrite, addr, 1, domain);
         memEv->setMinStartCycle(req.cycle);
         TimingRecord tr = {addr, req.cycle, respCycle, req.type, memEv, memEv};
         zinfo->eventRecorders[req.srcId]->pushRecord(tr);
@@ -251,6 +341,7 @@ uint64_t DRAMSim3Memory::access(MemReq &req, int type, uint32_t data_size) {
         respCycle = req.cycle + max(isWrite ? minWrLatency : minRdLatency, minLatency > data_size ? minLatency - data_size : 0) + data_size;
         Address addr = req.lineAddr << lineBits;
         uint64_t hexAddr = (uint64_t)addr;
+        uint32_t lines = MAX(1u, (data_size + 3) / 4);  // 64B transactions, 4 data_size units each
         /*
         bool isWrite = (req.type == PUTX);
         DRAMSim3AccEvent *memEv = new (zinfo->eventRecorders[req.srcId]) DRAMSim3AccEvent(this, isWrite, addr, domain);
@@ -259,7 +350,7 @@ uint64_t DRAMSim3Memory::access(MemReq &req, int type, uint32_t data_size) {
         zinfo->eventRecorders[req.srcId]->pushRecord(tr);
         */
 
-        DRAMSim3AccEvent *memEv = new (zinfo->eventRecorders[req.srcId]) DRAMSim3AccEvent(this, isWrite, addr, domain);
+        DRAMSim3AccEvent *memEv = new (zinfo->eventRecorders[req.srcId]) DRAMSim3AccEvent(this, isWrite, addr, lines, domain);
         if (type == 0) {  // default. The only record.
             TimingRecord tr;
             if (zinfo->eventRecorders[req.srcId]->hasRecord()) {
@@ -273,11 +364,6 @@ uint64_t DRAMSim3Memory::access(MemReq &req, int type, uint32_t data_size) {
                 memEv->setMinStartCycle(req.cycle);
                 tr = {addr, req.cycle, respCycle, req.type, memEv, memEv};
             }
-            for (uint32_t i = 1; data_size > i * 4; i++) {
-                DRAMSim3AccEvent *ev = new (zinfo->eventRecorders[req.srcId]) DRAMSim3AccEvent(this, isWrite, addr + 64 * i, domain);
-                tr.endEvent->addChild(ev, zinfo->eventRecorders[req.srcId]);
-                tr.endEvent = ev;
-            }
             assert(!zinfo->eventRecorders[req.srcId]->hasRecord());
             zinfo->eventRecorders[req.srcId]->pushRecord(tr);
         } else if (type == 1) {  // append the current event to the end of the previous one
@@ -289,11 +375,6 @@ uint64_t DRAMSim3Memory::access(MemReq &req, int type, uint32_t data_size) {
             // tr.respCycle = respCycle;
             tr.type = req.type;
             tr.endEvent = memEv;
-            for (uint32_t i = 1; data_size > i * 4; i++) {
-                DRAMSim3AccEvent *ev = new (zinfo->eventRecorders[req.srcId]) DRAMSim3AccEvent(this, isWrite, addr + 64 * i, domain);
-                tr.endEvent->addChild(ev, zinfo->eventRecorders[req.srcId]);
-                tr.endEvent = ev;
-            }
             zinfo->eventRecorders[req.srcId]->pushRecord(tr);
         } else if (type == 2) {
             // append the current event to the end of the previous one
@@ -302,12 +383,6 @@ uint64_t DRAMSim3Memory::access(MemReq &req, int type, uint32_t data_size) {
             memEv->setMinStartCycle(tr.reqCycle);
             assert(tr.endEvent);
             tr.endEvent->addChild(memEv, zinfo->eventRecorders[req.srcId]);
-            DRAMSim3AccEvent *last_ev = memEv;
-            for (uint32_t i = 1; data_size > i * 4; i++) {
-                DRAMSim3AccEvent *ev = new (zinfo->eventRecorders[req.srcId]) DRAMSim3AccEvent(this, isWrite, addr + 64 * i, domain);
-                last_ev->addChild(ev, zinfo->eventRecorders[req.srcId]);
-                last_ev = ev;
-            }
             // tr.respCycle = respCycle;
             tr.type = req.type;
             zinfo->eventRecorders[req.srcId]->pushRecord(tr);
@@ -319,22 +394,51 @@ uint64_t DRAMSim3Memory::access(MemReq &req, int type, uint32_t data_size) {
 
 void DRAMSim3Memory::printStats() { dramCore->PrintStats(); }
 
-uint32_t DRAMSim3Memory::tick(uint64_t cycle) {
-    // Try to add any pending requests
-    if (!pendingRequests.empty()) {
-        auto it = pendingRequests.begin();
-        while (it != pendingRequests.end()) {
-            DRAMSim3AccEvent *ev = it->first;
-            if (dramCore->WillAcceptTransaction(ev->getAddr(), ev->isWrite())) {
-                dramCore->AddTransaction(ev->getAddr(), ev->isWrite());
-                inflightRequests.insert(std::pair<Address, DRAMSim3AccEvent *>(ev->getAddr(), ev));
-                ev->hold();
-                it = pendingRequests.erase(it);
+InList<DRAMSim3ReqNode> &DRAMSim3Memory::inflightBucket(Address addr) {
+    uint32_t bucket = ((addr >> lineBits) * 0x9e3779b97f4a7c15ul) >> 58;  // top 6 bits
+    return inflightRequests[getChannel(addr) * INFLIGHT_BUCKETS + bucket];
+}
+
+void DRAMSim3Memory::issue(DRAMSim3AccEvent *ev) {
+    dramCore->AddTransaction(ev->getAddr(), ev->isWrite());
+    inflightBucket(ev->getAddr()).push_back(&ev->node);
+    numInflight++;
+    ev->hold();
+}
+
+void DRAMSim3Memory::addPending(DRAMSim3AccEvent *ev) {
+    ev->node.seq = pendingSeq++;
+    pendingRequests[getChannel(ev->getAddr())].reqs[ev->isWrite()].push_back(&ev->node);
+    numPending++;
+}
+
+// DRAMSim3 accepts a transaction based only on its channel and whether it is a
+// write, so once one is refused, later ones of the same kind in that channel
+// would be too. Each channel keeps reads and writes apart, and merges them
+// back in arrival order while trying those that can still be accepted.
+void DRAMSim3Memory::issuePending() {
+    for (uint32_t c = 0; c < channels && numPending; c++) {
+        DRAMSim3PendingQueue &q = pendingRequests[c];
+        DRAMSim3ReqNode *n[2] = {q.reqs[0].front(), q.reqs[1].front()};
+        while (n[0] || n[1]) {
+            uint32_t w = !n[0] || (n[1] && n[1]->seq < n[0]->seq);
+            DRAMSim3ReqNode *cur = n[w];
+            n[w] = cur->next;
+            DRAMSim3AccEvent *ev = cur->ev;
+            if (ev->sCycle > curCycle) continue;  // the rest of a bulk transfer waits for its start cycle
+            if (dramCore->WillAcceptTransaction(ev->getAddr(), w)) {
+                q.reqs[w].remove(cur);
+                numPending--;
+                issue(ev);
             } else {
-                ++it;
+                n[w] = nullptr;
             }
         }
     }
+}
+
+void DRAMSim3Memory::tickCycle() {
+    if (numPending) issuePending();
 
     // Original tick code
     cpuPs += cpuPsPerClk;
@@ -349,26 +453,74 @@ uint32_t DRAMSim3Memory::tick(uint64_t cycle) {
         cpuPs = 0;
         dramPs = 0;
     }
-    return 1;
+}
+
+void DRAMSim3Memory::advance(uint64_t cycle) {
+    while (curCycle < cycle) tickCycle();
+}
+
+uint64_t DRAMSim3Memory::nextClockCycle() const {
+    uint64_t cycle = curCycle;
+    uint64_t ps = cpuPs;
+    uint64_t dPs = dramPs;
+    while (true) {
+        ps += cpuPsPerClk;
+        if (ps > dPs) return cycle;
+        if (ps == dPs) ps = dPs = 0;
+        cycle++;
+    }
+}
+
+uint64_t DRAMSim3Memory::tick(uint64_t cycle) {
+    advance(cycle + 1);
+    // Completions only happen on DRAM clock edges, and pending requests can only
+    // be accepted after one, so the next tick event can wait until then; the
+    // cycles in between are simulated by the next advance()
+    bool busy = numInflight || numPending;
+    nextSchedCycle = busy? nextClockCycle() : curCycle + IDLE_TICK_CYCLES;
+    return nextSchedCycle;
 }
 
 void DRAMSim3Memory::enqueue(DRAMSim3AccEvent *ev, uint64_t cycle) {
-    /* dramCore->AddTransaction(ev->getAddr(), ev->isWrite());
-    inflightRequests.insert(std::pair<Address, DRAMSim3AccEvent *>(ev->getAddr(), ev));
-    ev->hold(); */
+    // As if this cycle's tick ran before this request (the usual order, as ticks are queued a cycle ahead)
+    advance(cycle + 1);
     if (dramCore->WillAcceptTransaction(ev->getAddr(), ev->isWrite())) {
-        dramCore->AddTransaction(ev->getAddr(), ev->isWrite());
-        inflightRequests.insert(std::pair<Address, DRAMSim3AccEvent *>(ev->getAddr(), ev));
-        ev->hold();
+        issue(ev);
     } else {
-        pendingRequests.push_back(std::make_pair(ev, cycle));
+        addPending(ev);
+    }
+
+    // Wake up from an idle period
+    uint64_t clockCycle = nextClockCycle();
+    if (nextSchedCycle > clockCycle) {
+        nextSchedEvent->annul();
+        if (eventFreelist) {
+            nextSchedEvent = eventFreelist;
+            eventFreelist = eventFreelist->next;
+            nextSchedEvent->next = nullptr;
+        } else {
+            nextSchedEvent = new DRAMSim3SchedEvent(this, domain, false);
+        }
+        nextSchedEvent->enqueue(clockCycle);
+        nextSchedCycle = clockCycle;
     }
 }
 
+void DRAMSim3Memory::recycleEvent(DRAMSim3SchedEvent *ev) {
+    assert(ev != nextSchedEvent);
+    assert(ev->next == nullptr);
+    ev->next = eventFreelist;
+    eventFreelist = ev;
+}
+
 void DRAMSim3Memory::DRAM_read_return_cb(uint64_t addr) {
-    std::multimap<uint64_t, DRAMSim3AccEvent *>::iterator it = inflightRequests.find(addr);
-    assert((it != inflightRequests.end()));
-    DRAMSim3AccEvent *ev = it->second;
+    InList<DRAMSim3ReqNode> &bucket = inflightBucket(addr);
+    DRAMSim3ReqNode *n = bucket.front();
+    while (n && n->ev->getAddr() != addr) n = n->next;
+    assert(n);
+    DRAMSim3AccEvent *ev = n->ev;
+    bucket.remove(n);
+    numInflight--;
 
     uint32_t lat = curCycle + 1 - ev->sCycle;
     minLatency = lat;
@@ -382,9 +534,14 @@ void DRAMSim3Memory::DRAM_read_return_cb(uint64_t addr) {
     }
 
     ev->release();
-    ev->done(curCycle + 1);
-    inflightRequests.erase(it);
-    // info("[%s] %s access to %lx DONE at %ld (%ld cycles), %ld inflight reqs", getName(), it->second->isWrite()? "Write" : "Read", it->second->getAddr(), curCycle, curCycle-it->second->sCycle, inflightRequests.size());
+    if (ev->nextLine()) {
+        // Issue the next transaction of the transfer when a chained event would have started
+        ev->sCycle = curCycle + 1;
+        addPending(ev);
+    } else {
+        ev->done(curCycle + 1);
+    }
+    // info("[%s] %s access to %lx DONE at %ld (%ld cycles), %ld inflight reqs", getName(), ev->isWrite()? "Write" : "Read", ev->getAddr(), curCycle, curCycle-ev->sCycle, numInflight);
 }
 
 void DRAMSim3Memory::DRAM_write_return_cb(uint64_t addr) {
@@ -411,11 +568,12 @@ uint64_t DRAMSim3Memory::access(MemReq &req, int type, uint32_t data_size) {
     return 0;
 }
 void DRAMSim3Memory::printStats() { panic("???"); }
-uint32_t DRAMSim3Memory::tick(uint64_t cycle) {
+uint64_t DRAMSim3Memory::tick(uint64_t cycle) {
     panic("???");
     return 0;
 }
 void DRAMSim3Memory::enqueue(DRAMSim3AccEvent *ev, uint64_t cycle) { panic("???"); }
+void DRAMSim3Memory::recycleEvent(DRAMSim3SchedEvent *ev) { panic("???"); }
 void DRAMSim3Memory::DRAM_read_return_cb(uint64_t addr) { panic("???"); }
 void DRAMSim3Memory::DRAM_write_return_cb(uint64_t addr) { panic("???"); }
 
@@ -33,6 +33,7 @@
 #include "config.h"
 #include "g_std/g_string.h"
 #include "g_std/g_unordered_map.h"
+#include "intrusive_list.h"
 #include "memory_hierarchy.h"
 #include "pad.h"
 #include "stats.h"
@@ -43,6 +44,18 @@ struct Address;
 };  // namespace dramsim3
 
 class DRAMSim3AccEvent;
+class DRAMSim3SchedEvent;
+
+// Links a DRAMSim3AccEvent into a pending queue or an inflight bucket (it is in at most one)
+struct DRAMSim3ReqNode : InListNode<DRAMSim3ReqNode> {
+    DRAMSim3AccEvent *ev;
+    uint64_t seq;  // arrival order while pending
+};
+
+// Requests to one channel that DRAMSim3 has not accepted yet, in arrival order
+struct DRAMSim3PendingQueue {
+    InList<DRAMSim3ReqNode> reqs[2];  // reads, writes
+};
 
 struct DS3Request {
     DS3Request(uint64_t addr, uint64_t cycle) : addr(addr), channel(0), rank(0), bank(0), row(0), added_cycle(cycle) {}
@@ -65,11 +78,23 @@ class DRAMSim3Memory : public MemObject {  // one DRAMSim3 controller
 
     dramsim3::MemorySystem *dramCore;
 
-    std::multimap<uint64_t, DRAMSim3AccEvent *> inflightRequests;
+    // Inflight transactions, hashed by channel and address. Buckets are FIFO, so
+    // completions to the same address match requests in issue order.
+    static const uint32_t INFLIGHT_BUCKETS = 64;  // per channel
+    InList<DRAMSim3ReqNode> *inflightRequests;
+    uint64_t numInflight;
 
     uint64_t curCycle;  // processor cycle, used in callbacks
     uint64_t dramCycle;
 
+    // Tick events are only scheduled on cycles where DRAMSim3 may have work (and
+    // every IDLE_TICK_CYCLES while idle). They do not skip DRAMSim3 cycles:
+    // advance() still calls ClockTick() on every DRAM clock edge in between,
+    // since DRAMSim3 has no way to advance its clock in bulk
+    DRAMSim3SchedEvent* nextSchedEvent;
+    uint64_t nextSchedCycle;
+    DRAMSim3SchedEvent* eventFreelist;
+
     // R/W stats
     PAD();
     Counter profReads;
@@ -78,7 +103,9 @@ class DRAMSim3Memory : public MemObject {  // one DRAMSim3 controller
     Counter profTotalWrLat;
     PAD();
 
-    std::vector<std::pair<DRAMSim3AccEvent*, uint64_t>> pendingRequests;
+    DRAMSim3PendingQueue *pendingRequests;  // per channel
+    uint64_t numPending;
+    uint64_t pendingSeq;
 
    public:
     DRAMSim3Memory(std::string &ConfigName, std::string &OutputDir,
@@ -94,8 +121,9 @@ class DRAMSim3Memory : public MemObject {  // one DRAMSim3 controller
     void setDRAMsimConfiguration(uint32_t delayQueue);  // Enable sim config in DRAMSim3 side.
     void printStats() override;
     // Event-driven simulation (phase 2)
-    uint32_t tick(uint64_t cycle);
+    uint64_t tick(uint64_t cycle);  // returns the cycle of the next tick
     void enqueue(DRAMSim3AccEvent *ev, uint64_t cycle);
+    void recycleEvent(DRAMSim3SchedEvent *ev);
 
    private:
     // if you want to use any data structure at all you in access()
@@ -108,6 +136,15 @@ class DRAMSim3Memory : public MemObject {  // one DRAMSim3 controller
     uint32_t channels, ranks, banks, bankgroups, rows, columns;
     uint32_t ch_pos, ra_pos, bg_pos, ba_pos, ro_pos, co_pos;
     uint32_t ch_mask, ra_mask, bg_mask, ba_mask, ro_mask, co_mask;
+    uint32_t shift_bits;  // log2 of DRAMSim3's transaction size
+    inline uint32_t getChannel(Address addr) const { return ((addr >> shift_bits) >> ch_pos) & ch_mask; }
+    InList<DRAMSim3ReqNode> &inflightBucket(Address addr);
+    void issue(DRAMSim3AccEvent *ev);
+    void addPending(DRAMSim3AccEvent *ev);
+    void issuePending();
+    void tickCycle();                       // simulates processor cycle curCycle
+    void advance(uint64_t cycle);           // simulates all cycles before cycle
+    uint64_t nextClockCycle() const;        // first cycle >= curCycle that clocks DRAMSim3
     void DRAM_read_return_cb(uint64_t addr);
     void DRAM_write_return_cb(uint64_t addr);
     std::function<void(uint64_t)> callBackFn;
@@ -0,0 +1,195 @@
+/* Standalone weave loop around one DRAMSim3Memory controller: issues a stream
+ * of reads (or multi-line transfers) at a fixed gap in cycles, runs the weave
+ * phase on a single-domain event queue until every request has completed,
+ * and reports the number of event dispatches, wall time and average latencies.
+ * Fewer tick events show up in low-MPKI runs (large gaps), where the time left
+ * is DRAMSim3's own per-cycle ClockTick(), and the cost of matching completions
+ * and retrying refused requests in saturated ones.
+ *
+ * With -m, the same requests go to an MD1Memory of that bandwidth instead, the
+ * analytic model that DRAM cache schemes can use for ext_dram or mcdram. It has
+ * no weave phase, so the bound-phase time is all it costs.
+ *
+ * Usage: dramsim3bench [-f cpuMHz] [-l lines] [-w writePct] [-o outputDir] [-m MBps [-z latency]] <ini> <requests> <gap>
+ *   lines: 64B lines per request (e.g., 64 for a page transfer), default 1
+ *   writePct: percentage of requests that are writes, default 0
+ *   MBps, latency: bandwidth and zero-load latency (cycles, default 100) of the
+ *     MD1Memory to use instead of DRAMSim3; <ini> is then not read */
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <time.h>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "contention_sim.h"
+#include "dramsim3_mem_ctrl.h"
+#include "event_recorder.h"
+#include "galloc.h"
+#include "log.h"
+#include "mem_ctrls.h"
+#include "stats.h"
+#include "timing_event.h"
+#include "zsim.h"
+
+GlobSimInfo* zinfo;
+uint32_t lineBits;
+
+/* The weave phase of a single domain, in cycle order (FIFO within a cycle).
+ * dramsim3bench does not link contention_sim.cpp; these are the members that
+ * events reach, backed by this queue. */
+struct QueuedEvent {
+    uint64_t cycle;
+    uint64_t seq;
+    TimingEvent* ev;
+    bool operator<(const QueuedEvent& other) const {
+        return (cycle != other.cycle)? cycle > other.cycle : seq > other.seq;
+    }
+};
+
+static std::priority_queue<QueuedEvent> eventQueue;
+static uint64_t queueSeq;
+
+ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _balance, bool _stealing)
+    : lastCrossing(nullptr), domains(nullptr), simThreads(nullptr), numDomains(0), numSimThreads(0),
+      skipContention(false), balance(false), stealing(false), limit(0), lastLimit(0), terminate(false),
+      threadsDone(0), threadTicket(0), inCSim(false) {}
+void ContentionSim::enqueue(TimingEvent* ev, uint64_t cycle) {
+    eventQueue.push({cycle, queueSeq++, ev});
+}
+void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle) {
+    eventQueue.push({cycle, queueSeq++, ev});
+}
+void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec) {
+    panic("dramsim3bench has a single domain");
+}
+
+void SpawnInternalThread(void (*fn)(void*), void* arg, uint32_t stackSize) {
+    panic("dramsim3bench writes no traces");
+}
+
+static Counter* getCounter(AggregateStat* stats, const char* name) {
+    for (uint32_t i = 0; i < stats->size(); i++) {
+        if (strcmp(stats->get(i)->name(), name) == 0) return (Counter*)stats->get(i);
+    }
+    panic("No stat %s", name);
+}
+
+static double getTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char* prog) {
+    info("Usage: %s [-f cpuMHz] [-l lines] [-w writePct] [-o outputDir] [-m MBps [-z latency]] <ini> <requests> <gap>", prog);
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    InitLog("[B] ");
+    uint32_t cpuMHz = 3200;
+    uint32_t lines = 1;
+    uint32_t writePct = 0;
+    std::string outputDir = ".";
+    uint32_t md1MBps = 0;
+    uint32_t md1Latency = 100;
+    int c;
+    while ((c = getopt(argc, argv, "f:l:w:o:m:z:")) != -1) {
+        switch (c) {
+            case 'f': cpuMHz = strtoul(optarg, nullptr, 0); break;
+            case 'l': lines = strtoul(optarg, nullptr, 0); break;
+            case 'w': writePct = strtoul(optarg, nullptr, 0); break;
+            case 'o': outputDir = optarg; break;
+            case 'm': md1MBps = strtoul(optarg, nullptr, 0); break;
+            case 'z': md1Latency = strtoul(optarg, nullptr, 0); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (argc - optind != 3 || lines == 0 || writePct > 100) usage(argv[0]);
+    std::string ini = argv[optind];
+    uint64_t requests = strtoul(argv[optind + 1], nullptr, 0);
+    uint64_t gap = strtoul(argv[optind + 2], nullptr, 0);
+
+    gm_init(1ul << 30);
+    zinfo = gm_calloc<GlobSimInfo>();
+    zinfo->lineSize = 64;
+    zinfo->warmup_done = true;
+    zinfo->phaseLength = 10000;  // MD1Memory updates its load once per phase
+    lineBits = 6;
+    zinfo->contentionSim = new ContentionSim(0, 0);
+    zinfo->eventRecorders = gm_calloc<EventRecorder*>(1);
+    zinfo->eventRecorders[0] = new EventRecorder();
+    EventRecorder* evRec = zinfo->eventRecorders[0];
+
+    MemObject* mem;
+    if (md1MBps) {
+        g_string name("mem-0");
+        mem = new MD1Memory(64, cpuMHz, md1MBps, md1Latency, name);
+    } else {
+        mem = new DRAMSim3Memory(ini, outputDir, cpuMHz, 0, 0, "mem-0");
+    }
+    AggregateStat* rootStat = new AggregateStat();
+    rootStat->init("bench", "DRAMSim3 weave benchmark stats");
+    mem->initStats(rootStat);
+    rootStat->makeImmutable();
+    AggregateStat* memStats = (AggregateStat*)rootStat->get(0);
+    Counter* rdStat = getCounter(memStats, "rd");
+    Counter* wrStat = getCounter(memStats, "wr");
+
+    // Record every request up front, but queue each one only once the weave
+    // reaches its cycle, so it runs after the ticks queued for that cycle, as
+    // requests from the cores would
+    std::vector<TimingEvent*> reqEvents(requests);
+    uint64_t x = 0x9e3779b97f4a7c15ul;
+    double boundStart = getTime();
+    for (uint64_t i = 0; i < requests; i++) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        bool write = (x >> 32) % 100 < writePct;
+        MESIState state = I;
+        Address lineAddr = (x % (1ul << 24)) & ~(uint64_t)(lines - 1);  // 1GB
+        MemReq req = {lineAddr, write? PUTX : GETS, 0, &state, i * gap, nullptr, I, 0, 0};
+        mem->access(req, 0, lines * 4);
+        if (!md1MBps) reqEvents[i] = evRec->popRecord().startEvent;
+    }
+    double boundElapsed = getTime() - boundStart;
+
+    if (md1MBps) {
+        uint64_t rd = rdStat->get();
+        uint64_t wr = wrStat->get();
+        info("MD1 %d MB/s, %ld requests x %d lines, gap %ld cycles, %d%% writes: %.3f s bound (%.1f ns/request), "
+             "avg latency %.1f rd / %.1f wr cycles per request",
+             md1MBps, requests, lines, gap, writePct, boundElapsed, 1e9 * boundElapsed / requests,
+             rd? 1.0 * getCounter(memStats, "rdlat")->get() / rd : 0.0, wr? 1.0 * getCounter(memStats, "wrlat")->get() / wr : 0.0);
+        return 0;
+    }
+
+    uint64_t transactions = requests * lines;
+    uint64_t dispatches = 0;
+    uint64_t lastCycle = 0;
+    uint64_t nextReq = 0;
+    double start = getTime();
+    while (rdStat->get() + wrStat->get() < transactions) {
+        assert(!eventQueue.empty());
+        if (nextReq < requests && nextReq * gap <= eventQueue.top().cycle) {
+            reqEvents[nextReq]->queue(nextReq * gap);
+            nextReq++;
+            continue;
+        }
+        QueuedEvent qe = eventQueue.top();
+        eventQueue.pop();
+        lastCycle = qe.cycle;
+        qe.ev->run(qe.cycle);
+        dispatches++;
+    }
+    double elapsed = getTime() - start;
+
+    uint64_t rd = rdStat->get();
+    uint64_t wr = wrStat->get();
+    info("%ld requests x %d lines, gap %ld cycles, %d%% writes: %ld cycles, %ld dispatches, %.3f s bound + %.3f s weave (%.1f ns/request), "
+         "avg latency %.1f rd / %.1f wr cycles per line",
+         requests, lines, gap, writePct, lastCycle, dispatches, boundElapsed, elapsed, 1e9 * (boundElapsed + elapsed) / requests,
+         rd? 1.0 * getCounter(memStats, "rdlat")->get() / rd : 0.0, wr? 1.0 * getCounter(memStats, "wrlat")->get() / wr : 0.0);
+    return 0;
+}
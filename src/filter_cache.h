@@ -31,9 +31,8 @@
 #include "assert.h"
 #include "galloc.h"
 #include "zsim.h"
-#include "g_std/g_unordered_map.h"
-#include "g_std/g_unordered_set.h"
 #include "config.h"
+#include "frame_alloc.h"
 /* Extends Cache with an L0 direct-mapped cache, optimized to hell for hits
  *
  * L1 lookups are dominated by several kinds of overhead (grab the cache locks,
@@ -66,11 +65,8 @@ class FilterCache : public Cache {
 		// this is not an accurate tlb. It just randomize the page nums   
 		bool _enable_tlb;
         bool _enable_johnny;
-        uint64_t _johnny_ptr;
         uint64_t _mem_size;
-		drand48_data _buffer;
-		g_unordered_map <Address, Address> _tlb;
-		g_unordered_set <Address> _exist_pgnum; 
+		FrameAllocator* _frame_alloc;  // 4KB pages; nullptr if the TLB is disabled
     public:
         FilterCache(uint32_t _numSets, uint32_t _numLines, CC* _cc, CacheArray* _array,
                 ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, g_string& _name, Config &config)
@@ -86,13 +82,13 @@ class FilterCache : public Cache {
             reqFlags = 0;
 			_enable_tlb = config.get<bool>("sim.enableTLB", false);
             _enable_johnny = config.get<bool>("sim.enableJohnny", false);
-            _johnny_ptr = 0;
             _mem_size = (uint64_t)config.get<uint32_t>("sim.memSize", 0) << 20;
             if (_mem_size == 0) {
                 _mem_size = 0x0000ffffffffffff; // 48bit address space, 281474976710656(256TB)
             }
             info("FilterCache: tlb enabled = %d, johnny enabled = %d, memSize = %ld Bytes", _enable_tlb, _enable_johnny, _mem_size);
-			srand48_r((uint64_t)this, &_buffer);
+            _frame_alloc = _enable_tlb? new FrameAllocator(_enable_johnny? FrameAllocator::Johnny : FrameAllocator::Random,
+                                                           _mem_size >> 12, 0, (uint64_t)this) : nullptr;
         }
 
         // Configure No man's land delay (Rommel Sanchez et al)
@@ -160,29 +156,8 @@ class FilterCache : public Cache {
 			// page num = vLineAddr shifted by 6 bits. So it is shifted by 12 bits in total (4KB page size)
 			if (_enable_tlb) {
 				Address vpgnum = vLineAddr >> 6; // Virtual page number
-				uint64_t pgnum;
 				futex_lock(&filterLock);
-				if (_tlb.find(vpgnum) == _tlb.end()) {
-					if (_enable_johnny) {
-						pgnum = _johnny_ptr;
-						_johnny_ptr++;
-						if (_johnny_ptr >= _mem_size >> 6) {
-							_johnny_ptr = 0;
-							info("FilterCache: johnny_ptr reached max memory size, reset to 0");
-						}
-                        assert(_exist_pgnum.find(pgnum) == _exist_pgnum.end());
-					} else {
-						do {
-							int64_t rand;
-							lrand48_r(&_buffer, &rand);
-							pgnum = rand & 0x000fffffffffffff;
-						} while (_exist_pgnum.find(pgnum) != _exist_pgnum.end());
-					}
-					_tlb[vpgnum] = pgnum;
-					_exist_pgnum.insert(pgnum);
-				} else {
-					pgnum = _tlb[vpgnum];
-				}
+				uint64_t pgnum = _frame_alloc->translate(vpgnum);
 
 				pLineAddr = procMask | (pgnum << 6) | (vLineAddr & 0x3f);
 			} else {
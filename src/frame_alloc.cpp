@@ -0,0 +1,41 @@
+#include "frame_alloc.h"
+
+#include "bithacks.h"
+
+FrameAllocator::FrameAllocator(Policy policy, uint64_t numFrames, uint64_t blockFrames, uint64_t seed)
+    : _policy(policy), _num_frames(numFrames), _block_frames(policy == JohnnyRandom ? blockFrames : numFrames), _allocated(0) {
+    assert(_num_frames > 0 && _block_frames > 0);
+    assert_msg(_policy != Identical || isPow2(_num_frames), "Identical page mapping needs a power-of-2 number of frames, got %ld", _num_frames);
+    srand48_r(seed, &_buffer);
+}
+
+FrameAllocator::Policy FrameAllocator::parsePolicy(const g_string& name) {
+    if (name == "Identical") return Identical;
+    else if (name == "Johnny") return Johnny;
+    else if (name == "Random") return Random;
+    else if (name == "JohnnyRandom") return JohnnyRandom;
+    panic("Invalid page mapping scheme %s (Identical, Johnny, Random or JohnnyRandom)", name.c_str());
+}
+
+uint64_t FrameAllocator::allocFrame() {
+    if (unlikely(_allocated == _num_frames)) panic("FrameAllocator: all %ld frames are allocated", _num_frames);
+    uint64_t pos = _allocated++;
+    if (_policy == Johnny) return pos;
+
+    // Draw uniformly from the undrawn positions [pos, blockEnd) of the current block
+    uint64_t blockEnd = MIN((pos / _block_frames + 1) * _block_frames, _num_frames);
+    int64_t hi, lo;
+    lrand48_r(&_buffer, &hi);
+    lrand48_r(&_buffer, &lo);
+    uint64_t pick = pos + ((((uint64_t)hi) << 31) | (uint64_t)lo) % (blockEnd - pos);
+
+    // Position p holds frame p until something is swapped into it
+    uint64_t* pickSlot = _swapped.find(pick);
+    uint64_t frame = pickSlot ? *pickSlot - 1 : pick;
+    if (pick != pos) {
+        uint64_t* posSlot = _swapped.find(pos);
+        uint64_t posFrame = posSlot ? *posSlot - 1 : pos;
+        _swapped[pick] = posFrame + 1;
+    }
+    return frame;
+}
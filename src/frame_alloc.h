@@ -0,0 +1,159 @@
+#ifndef FRAME_ALLOC_H_
+#define FRAME_ALLOC_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "g_std/g_string.h"
+#include "galloc.h"
+#include "log.h"
+
+/* Open-addressing (linear probing) map from 64-bit keys to values, stored in a
+ * single flat gm array. Keys are stored as key + 1 so that a zeroed slot is
+ * empty, which means key ~0 cannot be stored. The table doubles once it is
+ * half full, and erase() shifts later entries of the probe chain back, so
+ * erasing moves entries: it invalidates pointers to values, as inserting does. */
+template <typename V>
+class FlatAddrMap : public GlobAlloc {
+   private:
+    struct Slot {
+        uint64_t key;  // key + 1, 0 if empty
+        V value;
+    };
+
+    Slot* _slots;
+    uint64_t _mask;   // capacity - 1
+    uint32_t _shift;  // 64 - log2(capacity)
+    uint64_t _size;
+
+    // Home slot of key
+    inline uint64_t hash(uint64_t key) const {
+        // Fibonacci hashing; the high bits of the product mix best
+        return (key * 0x9e3779b97f4a7c15ul) >> _shift;
+    }
+
+    void grow() {
+        Slot* old = _slots;
+        uint64_t oldCap = _mask + 1;
+        _mask = 2 * oldCap - 1;
+        _shift--;
+        _slots = gm_calloc<Slot>(_mask + 1);
+        for (uint64_t i = 0; i < oldCap; i++) {
+            if (!old[i].key) continue;
+            uint64_t s = hash(old[i].key - 1);
+            while (_slots[s].key) s = (s + 1) & _mask;
+            _slots[s] = old[i];
+        }
+        gm_free(old);
+    }
+
+   public:
+    explicit FlatAddrMap(uint64_t initialCapacity = 1024) : _size(0) {
+        uint64_t cap = 16;
+        _shift = 60;
+        while (cap < initialCapacity) {
+            cap *= 2;
+            _shift--;
+        }
+        _mask = cap - 1;
+        _slots = gm_calloc<Slot>(cap);
+    }
+
+    ~FlatAddrMap() { gm_free(_slots); }
+
+    // Returns the value of key, or nullptr if absent
+    inline V* find(uint64_t key) {
+        for (uint64_t s = hash(key); _slots[s].key; s = (s + 1) & _mask) {
+            if (_slots[s].key == key + 1) return &_slots[s].value;
+        }
+        return nullptr;
+    }
+
+    // Returns the value of key, inserting a zero-initialized one if absent
+    inline V& operator[](uint64_t key) {
+        uint64_t s = hash(key);
+        for (; _slots[s].key; s = (s + 1) & _mask) {
+            if (_slots[s].key == key + 1) return _slots[s].value;
+        }
+        if (2 * (_size + 1) > _mask + 1) {
+            grow();
+            s = hash(key);
+            while (_slots[s].key) s = (s + 1) & _mask;
+        }
+        _size++;
+        _slots[s].key = key + 1;
+        _slots[s].value = V();
+        return _slots[s].value;
+    }
+
+    // Removes key, if present
+    void erase(uint64_t key) {
+        uint64_t s = hash(key);
+        for (; _slots[s].key; s = (s + 1) & _mask) {
+            if (_slots[s].key == key + 1) break;
+        }
+        if (!_slots[s].key) return;
+        // Move back every later entry of the chain whose home slot is not in (s, j]
+        for (uint64_t j = (s + 1) & _mask; _slots[j].key; j = (j + 1) & _mask) {
+            uint64_t home = hash(_slots[j].key - 1);
+            if (((j - home) & _mask) >= ((j - s) & _mask)) {
+                _slots[s] = _slots[j];
+                s = j;
+            }
+        }
+        _slots[s].key = 0;
+        _size--;
+    }
+
+    uint64_t size() const { return _size; }
+};
+
+/* Physical frame allocator and VPN->PFN page table, shared by the page mapping
+ * of MemoryController (sys.mem.pagemap_scheme) and the FilterCache TLB.
+ *
+ * Policies:
+ *   Identical    - PFN = VPN modulo the (power-of-2) number of frames, no state
+ *   Johnny       - frames handed out sequentially in first-touch order
+ *   Random       - frames drawn uniformly from all free frames
+ *   JohnnyRandom - frames are handed out one block (of blockFrames) at a time,
+ *                  drawn uniformly from the free frames of the current block
+ *
+ * Random draws are a lazy Fisher-Yates shuffle over the frame numbers: the
+ * k-th allocation swaps a uniformly chosen not-yet-drawn position into
+ * position k. Only displaced positions are stored, so each allocation is O(1)
+ * no matter how full memory is, and there is no retry loop on used frames.
+ * Allocating more frames than exist panics.
+ *
+ * Not thread-safe; callers hold their own lock.
+ */
+class FrameAllocator : public GlobAlloc {
+   public:
+    enum Policy { Identical, Johnny, Random, JohnnyRandom };
+
+   private:
+    const Policy _policy;
+    const uint64_t _num_frames;
+    const uint64_t _block_frames;
+    uint64_t _allocated;                // frames handed out so far
+    FlatAddrMap<uint64_t> _page_table;  // VPN -> PFN + 1
+    FlatAddrMap<uint64_t> _swapped;     // shuffle position -> frame + 1, if displaced
+    drand48_data _buffer;
+
+    uint64_t allocFrame();
+
+   public:
+    // blockFrames is only used by JohnnyRandom
+    FrameAllocator(Policy policy, uint64_t numFrames, uint64_t blockFrames, uint64_t seed);
+
+    static Policy parsePolicy(const g_string& name);
+
+    inline uint64_t translate(uint64_t vpn) {
+        if (_policy == Identical) return vpn & (_num_frames - 1);
+        uint64_t& pfn = _page_table[vpn];
+        if (!pfn) pfn = allocFrame() + 1;
+        return pfn - 1;
+    }
+
+    uint64_t getAllocatedFrames() const { return _allocated; }
+};
+
+#endif  // FRAME_ALLOC_H_
@@ -35,6 +35,7 @@
 #include "g_heap/dlmalloc.h.c"
 #include "locks.h"
 #include "pad.h"
+#include "bithacks.h"
 
 /* Base heap address. Has to be available cross-process. With 64-bit virtual
  * addresses, the address space is so sparse that it's quite easy to find
@@ -50,13 +51,49 @@
  */
 #define GM_BASE_ADDR ((const void*)0x00ABBA000000)
 
+/* Arenas: the central mspace is protected by a single lock, which all threads
+ * of all processes would otherwise contend on for every allocation. Small
+ * blocks (up to GM_MAX_CLASS_SIZE bytes) are instead served from per-arena
+ * free lists of 16-byte size classes, each arena with its own lock. Threads
+ * pick an arena by hashing their stack address (there is no usable TLS under
+ * Pin), so most arena locks are uncontended. Arenas refill a class from the
+ * central mspace in batches, and return a batch when a class list grows too
+ * long.
+ *
+ * Cached blocks are still allocated chunks to dlmalloc, so they can be freed
+ * by any thread: a block goes to the free list of the freeing thread's arena,
+ * under the largest class its dlmalloc usable size can serve. Medium and
+ * large blocks, and memalign requests, go straight to the central mspace.
+ */
+#define GM_ARENA_BITS 6
+#define GM_NUM_ARENAS (1 << GM_ARENA_BITS)
+#define GM_CLASS_BITS 4  // 16-byte size classes
+#define GM_NUM_CLASSES 64
+#define GM_MAX_CLASS_SIZE (GM_NUM_CLASSES << GM_CLASS_BITS)
+#define GM_BATCH_BYTES 4096  // bytes moved per refill or flush of a class
+
+struct gm_arena {
+    lock_t lock;
+    uint32_t count[GM_NUM_CLASSES];
+    void* free[GM_NUM_CLASSES];  // singly-linked through the first word of each block
+    uint64_t allocs;     // small allocations served
+    uint64_t refills;    // ...that had to refill from the central mspace
+    uint64_t frees;      // small frees
+    uint64_t flushes;    // ...that returned a batch to the central mspace
+    uint64_t contended;  // lock acquisitions that found the arena taken
+    PAD();
+};
+
 struct gm_segment {
     volatile void* base_regp; //common data structure, accessible with glob_ptr; threads poll on gm_isready to determine when everything has been initialized
     volatile void* secondary_regp; //secondary data structure, used to exchange information between harness and initializing process
     mspace mspace_ptr;
+    gm_arena* arenas;
 
     PAD();
-    lock_t lock;
+    lock_t lock;  // protects the central mspace
+    uint64_t central_ops;        // central lock acquisitions
+    uint64_t central_contended;  // ...that found it taken
     PAD();
 };
 
@@ -105,6 +142,12 @@ int gm_init(size_t segmentSize) {
     GM->mspace_ptr = create_mspace_with_base(alloc_start, alloc_size, 1 /*locked*/);
     futex_init(&GM->lock);
     assert(GM->mspace_ptr);
+    GM->central_ops = 0;
+    GM->central_contended = 0;
+
+    GM->arenas = static_cast<gm_arena*>(mspace_calloc(GM->mspace_ptr, GM_NUM_ARENAS, sizeof(gm_arena)));
+    assert(GM->arenas);
+    for (uint32_t i = 0; i < GM_NUM_ARENAS; i++) futex_init(&GM->arenas[i].lock);
 
     return gm_shmid;
 }
@@ -121,43 +164,164 @@ void gm_attach(int shmid) {
 }
 
 
+// Takes lock, counting the acquisitions that had to wait (the count is protected by the lock)
+static inline void gm_lock(lock_t* lock, uint64_t* contended) {
+    if (*lock == 0 && __sync_bool_compare_and_swap(lock, 0, 1)) return;
+    futex_lock(lock);
+    (*contended)++;
+}
+
+static inline void gm_lock_central() {
+    gm_lock(&GM->lock, &GM->central_contended);
+    GM->central_ops++;
+}
+
+static inline gm_arena* gm_my_arena() {
+    // Threads have disjoint stacks, so this is a cheap per-thread hash
+    uint64_t sp = reinterpret_cast<uint64_t>(__builtin_frame_address(0));
+    return &GM->arenas[((sp >> 16) * 0x9e3779b97f4a7c15ul) >> (64 - GM_ARENA_BITS)];
+}
+
+// Class c serves requests of up to (c+1)*16 bytes
+static inline uint32_t gm_alloc_class(size_t size) {
+    return (size > 0)? (size - 1) >> GM_CLASS_BITS : 0;
+}
+
+static inline size_t gm_class_size(uint32_t c) {
+    return (c + 1) << GM_CLASS_BITS;
+}
+
+static inline uint32_t gm_class_batch(uint32_t c) {
+    return MAX(1ul, GM_BATCH_BYTES / gm_class_size(c));
+}
+
+// Returns the blocks of every arena to the central mspace; caller must hold no gm locks
+static void gm_drain_arenas() {
+    for (uint32_t i = 0; i < GM_NUM_ARENAS; i++) {
+        gm_arena* a = &GM->arenas[i];
+        gm_lock(&a->lock, &a->contended);
+        gm_lock_central();
+        for (uint32_t c = 0; c < GM_NUM_CLASSES; c++) {
+            while (a->free[c]) {
+                void* block = a->free[c];
+                a->free[c] = *static_cast<void**>(block);
+                mspace_free(GM->mspace_ptr, block);
+            }
+            a->count[c] = 0;
+        }
+        futex_unlock(&GM->lock);
+        futex_unlock(&a->lock);
+    }
+}
+
+// Allocates from the central mspace; on exhaustion, reclaims the arenas' cached blocks and retries
+template <typename F>
+static inline void* gm_central_alloc(F alloc, const char* caller) {
+    gm_lock_central();
+    void* ptr = alloc();
+    futex_unlock(&GM->lock);
+    if (unlikely(!ptr)) {
+        gm_drain_arenas();
+        gm_lock_central();
+        ptr = alloc();
+        futex_unlock(&GM->lock);
+        if (!ptr) panic("%s: Out of global heap memory, use a larger GM segment", caller);
+    }
+    return ptr;
+}
+
+static void* gm_small_alloc(size_t size) {
+    uint32_t c = gm_alloc_class(size);
+    gm_arena* a = gm_my_arena();
+    gm_lock(&a->lock, &a->contended);
+    a->allocs++;
+    void* ptr = a->free[c];
+    if (ptr) {
+        a->free[c] = *static_cast<void**>(ptr);
+        a->count[c]--;
+        futex_unlock(&a->lock);
+        return ptr;
+    }
+
+    a->refills++;
+    uint32_t batch = gm_class_batch(c);
+    gm_lock_central();
+    ptr = mspace_malloc(GM->mspace_ptr, gm_class_size(c));
+    for (uint32_t i = 1; ptr && i < batch; i++) {
+        void* block = mspace_malloc(GM->mspace_ptr, gm_class_size(c));
+        if (!block) break;
+        *static_cast<void**>(block) = a->free[c];
+        a->free[c] = block;
+        a->count[c]++;
+    }
+    futex_unlock(&GM->lock);
+    futex_unlock(&a->lock);
+
+    if (unlikely(!ptr)) {
+        ptr = gm_central_alloc([&]() { return mspace_malloc(GM->mspace_ptr, gm_class_size(c)); }, "gm_malloc()");
+    }
+    return ptr;
+}
+
 void* gm_malloc(size_t size) {
     assert(GM);
     assert(GM->mspace_ptr);
-    futex_lock(&GM->lock);
-    void* ptr = mspace_malloc(GM->mspace_ptr, size);
-    futex_unlock(&GM->lock);
-    if (!ptr) panic("gm_malloc(): Out of global heap memory, use a larger GM segment");
-    return ptr;
+    if (size <= GM_MAX_CLASS_SIZE) return gm_small_alloc(size);
+    return gm_central_alloc([&]() { return mspace_malloc(GM->mspace_ptr, size); }, "gm_malloc()");
 }
 
 void* __gm_calloc(size_t num, size_t size) {
     assert(GM);
     assert(GM->mspace_ptr);
-    futex_lock(&GM->lock);
-    void* ptr = mspace_calloc(GM->mspace_ptr, num, size);
-    futex_unlock(&GM->lock);
-    if (!ptr) panic("gm_calloc(): Out of global heap memory, use a larger GM segment");
-    return ptr;
+    size_t bytes = num * size;
+    if (num && bytes / num != size) panic("gm_calloc(): %ld x %ld bytes overflows", num, size);
+    if (bytes <= GM_MAX_CLASS_SIZE) {
+        void* ptr = gm_small_alloc(bytes);
+        memset(ptr, 0, bytes);
+        return ptr;
+    }
+    return gm_central_alloc([&]() { return mspace_calloc(GM->mspace_ptr, num, size); }, "gm_calloc()");
 }
 
 void* __gm_memalign(size_t blocksize, size_t bytes) {
     assert(GM);
     assert(GM->mspace_ptr);
-    futex_lock(&GM->lock);
-    void* ptr = mspace_memalign(GM->mspace_ptr, blocksize, bytes);
-    futex_unlock(&GM->lock);
-    if (!ptr) panic("gm_memalign(): Out of global heap memory, use a larger GM segment");
-    return ptr;
+    return gm_central_alloc([&]() { return mspace_memalign(GM->mspace_ptr, blocksize, bytes); }, "gm_memalign()");
 }
 
 
 void gm_free(void* ptr) {
     assert(GM);
     assert(GM->mspace_ptr);
-    futex_lock(&GM->lock);
-    mspace_free(GM->mspace_ptr, ptr);
-    futex_unlock(&GM->lock);
+    if (!ptr) return;
+    // Largest class this block can serve; the usable size comes from the chunk header, which we own
+    size_t c = (mspace_usable_size(ptr) >> GM_CLASS_BITS) - 1;  // wraps around if smaller than class 0
+    if (c >= GM_NUM_CLASSES) {
+        gm_lock_central();
+        mspace_free(GM->mspace_ptr, ptr);
+        futex_unlock(&GM->lock);
+        return;
+    }
+
+    gm_arena* a = gm_my_arena();
+    gm_lock(&a->lock, &a->contended);
+    a->frees++;
+    *static_cast<void**>(ptr) = a->free[c];
+    a->free[c] = ptr;
+    a->count[c]++;
+    uint32_t batch = gm_class_batch(c);
+    if (unlikely(a->count[c] > 2 * batch)) {
+        a->flushes++;
+        gm_lock_central();
+        for (uint32_t i = 0; i < batch; i++) {
+            void* block = a->free[c];
+            a->free[c] = *static_cast<void**>(block);
+            mspace_free(GM->mspace_ptr, block);
+        }
+        futex_unlock(&GM->lock);
+        a->count[c] -= batch;
+    }
+    futex_unlock(&a->lock);
 }
 
 
@@ -196,6 +360,22 @@ void* gm_get_secondary_ptr() {
 void gm_stats() {
     assert(GM);
     mspace_malloc_stats(GM->mspace_ptr);
+
+    // Racy reads, but these are only indicative
+    uint64_t allocs = 0, refills = 0, frees = 0, flushes = 0, contended = 0, cachedBytes = 0;
+    for (uint32_t i = 0; i < GM_NUM_ARENAS; i++) {
+        gm_arena* a = &GM->arenas[i];
+        allocs += a->allocs;
+        refills += a->refills;
+        frees += a->frees;
+        flushes += a->flushes;
+        contended += a->contended;
+        for (uint32_t c = 0; c < GM_NUM_CLASSES; c++) cachedBytes += a->count[c] * gm_class_size(c);
+    }
+    info("gm arenas: %ld small allocs (%ld refills), %ld small frees (%ld flushes), %ld KB cached, %ld contended arena locks",
+         allocs, refills, frees, flushes, cachedBytes / 1024, contended);
+    info("gm central heap: %ld lock acquisitions, %ld contended (%.2f%%)",
+         GM->central_ops, GM->central_contended, 100.0 * GM->central_contended / MAX(1ul, GM->central_ops));
 }
 
 bool gm_isready() {
@@ -0,0 +1,149 @@
+/* Multithreaded stress test and benchmark of the global heap (gm_malloc,
+ * gm_calloc and gm_free). Each thread keeps a window of live blocks, mostly
+ * small (8-520 bytes, served by the per-thread arenas) with 1 in 16 of 1-9KB
+ * (served by the central heap), and replaces them one at a time. Every block
+ * is tagged at both ends with its owner and size, and checked when it is
+ * freed, so overlapping blocks are caught, and calloc blocks are checked to
+ * be zeroed. 1 in 8 blocks is passed to the next thread and freed there, as
+ * simulator objects often are, unless that thread has fallen behind on
+ * freeing them (the report counts actual cross-thread frees).
+ *
+ * Usage: gallocbench [<threads>] [<allocs per thread>] */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bithacks.h"
+#include "galloc.h"
+#include "locks.h"
+#include "log.h"
+#include "pad.h"
+
+static const uint32_t WINDOW = 256;        // live blocks per thread
+static const uint32_t MAILBOX_SIZE = 1024;  // blocks in flight to the next thread
+
+struct BlockHeader {
+    uint32_t owner;
+    uint32_t size;  // bytes requested, including this header
+};  // also copied into the last bytes of the block
+
+// Blocks handed to a thread to free; when full, the sender frees them itself
+struct Mailbox {
+    lock_t lock;
+    uint32_t count;
+    BlockHeader* blocks[MAILBOX_SIZE];
+} ATTR_LINE_ALIGNED;
+
+static uint32_t numThreads;
+static uint64_t allocsPerThread;
+static Mailbox* mailboxes;
+static volatile uint64_t crossFrees;
+
+struct Rng {
+    uint64_t x;
+    explicit Rng(uint64_t seed) : x(seed * 0x9e3779b97f4a7c15ul + 1) {}
+    uint64_t next() {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        return x;
+    }
+};
+
+static BlockHeader* allocBlock(uint32_t tid, Rng& rng) {
+    uint64_t r = rng.next();
+    uint32_t size = (r % 16 == 0)? 1024 + (r >> 8) % 8192 : 8 + (r >> 8) % 513;
+    size = MAX(size, (uint32_t)(2 * sizeof(BlockHeader)));
+    bool zeroed = (r >> 40) % 4 == 0;
+    uint8_t* p = static_cast<uint8_t*>(zeroed? __gm_calloc(1, size) : gm_malloc(size));
+    if (!p) panic("Out of global heap memory");
+    if (zeroed) {
+        for (uint32_t i = 0; i < size; i++) {
+            if (p[i]) panic("Thread %d: calloc'd block of %d bytes is not zeroed at byte %d", tid, size, i);
+        }
+    }
+    BlockHeader* b = reinterpret_cast<BlockHeader*>(p);
+    b->owner = tid;
+    b->size = size;
+    memcpy(p + size - sizeof(BlockHeader), b, sizeof(BlockHeader));
+    return b;
+}
+
+static void freeBlock(BlockHeader* b) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(b);
+    if (b->owner >= numThreads || memcmp(p + b->size - sizeof(BlockHeader), b, sizeof(BlockHeader)) != 0) {
+        panic("Block of %d bytes from thread %d corrupted", b->size, b->owner);
+    }
+    gm_free(b);
+}
+
+static void drainMailbox(Mailbox& mb) {
+    futex_lock(&mb.lock);
+    for (uint32_t i = 0; i < mb.count; i++) freeBlock(mb.blocks[i]);
+    __sync_fetch_and_add(&crossFrees, mb.count);
+    mb.count = 0;
+    futex_unlock(&mb.lock);
+}
+
+static void* stress(void* arg) {
+    uint32_t tid = (uint32_t)(uintptr_t)arg;
+    Rng rng(tid + 1);
+    BlockHeader* window[WINDOW];
+    for (uint32_t i = 0; i < WINDOW; i++) window[i] = allocBlock(tid, rng);
+
+    Mailbox& next = mailboxes[(tid + 1) % numThreads];
+    for (uint64_t i = WINDOW; i < allocsPerThread; i++) {
+        uint32_t slot = rng.next() % WINDOW;
+        BlockHeader* b = window[slot];
+        bool sent = false;
+        if (rng.next() % 8 == 0) {
+            futex_lock(&next.lock);
+            if (next.count < MAILBOX_SIZE) {
+                next.blocks[next.count++] = b;
+                sent = true;
+            }
+            futex_unlock(&next.lock);
+        }
+        if (!sent) freeBlock(b);
+        window[slot] = allocBlock(tid, rng);
+        if (i % 64 == 0) drainMailbox(mailboxes[tid]);
+    }
+
+    for (uint32_t i = 0; i < WINDOW; i++) freeBlock(window[i]);
+    return nullptr;
+}
+
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+int main(int argc, char* argv[]) {
+    InitLog("[B] ");
+    numThreads = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 64;
+    allocsPerThread = (argc > 2) ? strtoul(argv[2], nullptr, 0) : 200000;
+    if (numThreads == 0 || allocsPerThread < WINDOW) panic("Need at least 1 thread and %d allocs per thread", WINDOW);
+
+    gm_init(1ul << 30);
+    mailboxes = gm_memalign<Mailbox>(CACHE_LINE_BYTES, numThreads);
+    for (uint32_t t = 0; t < numThreads; t++) {
+        futex_init(&mailboxes[t].lock);
+        mailboxes[t].count = 0;
+    }
+
+    info("%d threads, %ld allocs per thread, 8-520B blocks and 1 in 16 of 1-9KB, 1 in 8 freed by another thread",
+         numThreads, allocsPerThread);
+    pthread_t* threads = new pthread_t[numThreads];
+    uint64_t start = nowNs();
+    for (uint32_t t = 0; t < numThreads; t++) pthread_create(&threads[t], nullptr, stress, (void*)(uintptr_t)t);
+    for (uint32_t t = 0; t < numThreads; t++) pthread_join(threads[t], nullptr);
+    for (uint32_t t = 0; t < numThreads; t++) drainMailbox(mailboxes[t]);
+    uint64_t ns = nowNs() - start;
+
+    uint64_t allocs = numThreads * allocsPerThread;
+    info("%ld allocs and frees (%ld cross-thread) in %.3f s, %.1f Mops/s, all blocks intact",
+         allocs, crossFrees, ns * 1e-9, 2.0 * allocs * 1e3 / ns);
+    gm_stats();
+    delete[] threads;
+    return 0;
+}
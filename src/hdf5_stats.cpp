@@ -44,19 +44,26 @@
 #include "galloc.h"
 #include "log.h"
 #include "stats.h"
+#include "stats_snapshot.h"
+#include "stats_writer.h"
 #include "zsim.h"
 
+// Serializes HDF5 library calls, which may come from the writer thread and from backends being built
+static lock_t h5Lock = 0;
+
 /** Implements the HDF5 backend. Creates one big table in the file, and writes one row per dump.
- * NOTE: Because dump may be called from multiple processes, we close and open the HDF5 file every dump.
- * This is inefficient, but dumps are not that common anyhow, and we get the ability to read hdf5 files mid-simulation.
- * (alternatively, we could have an extra thread exclusively dedicated to writing stats).
+ * NOTE: Because dump may be called from multiple processes, without a StatsWriter we close and open the HDF5 file
+ * every write. This is inefficient, but we get the ability to read hdf5 files mid-simulation. With a writer, full
+ * buffers are handed off to its thread, which keeps the file open and flushes it periodically; dumps keep filling
+ * the other buffer meanwhile.
  */
-class HDF5BackendImpl : public GlobAlloc {
+class HDF5BackendImpl : public GlobAlloc, public StatsWriter::Sink {
     private:
         const char* filename;
         AggregateStat* rootStat;
         bool skipVectors;
         bool sumRegularAggregates;
+        StatsSnapshot* snapshot; //compiled reads of the whole record
 
         uint64_t* dataBuf; //buffered record data
         uint64_t* curPtr; //points to next element to write in dump
@@ -65,46 +72,16 @@ class HDF5BackendImpl : public GlobAlloc {
 
         uint32_t bufferedRecords; //number of records buffered (dumped w/o being written), <= recordsPerWrite
 
+        StatsWriter* writer; //nullptr to write from dump()
+        uint64_t* bufs[2]; //dataBuf is one of them
+        lock_t freeSem; //held while a buffer is with the writer
+        hid_t fileID; //open file, only kept open with a writer
+
         // Always have a single function to determine when to skip a stat to avoid inconsistencies in the code
         bool skipStat(Stat* s) {
             return skipVectors && dynamic_cast<VectorStat*>(s);
         }
 
-        // Dump the stats, inorder walk
-        void dumpWalk(Stat* s) {
-            if (skipStat(s)) return;
-            if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
-                if (as->isRegular() && sumRegularAggregates) {
-                    //Dump first record
-                    uint64_t* startPtr = curPtr;
-                    dumpWalk(as->get(0));
-                    uint64_t* tmpPtr = curPtr;
-                    uint32_t sz = tmpPtr - startPtr;
-                    //Dump others below, and add them up
-                    for (uint32_t i = 1; i < as->size(); i++) {
-                        dumpWalk(as->get(i));
-                        //Add record with previous ones
-                        assert(curPtr == tmpPtr + sz);
-                        for (uint32_t j = 0; j < sz; j++) startPtr[j] += tmpPtr[j];
-                        //Rewind
-                        curPtr = tmpPtr;
-                    }
-                } else {
-                    for (uint32_t i = 0; i < as->size(); i++) {
-                        dumpWalk(as->get(i));
-                    }
-                }
-            } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
-                *(curPtr++) = ss->get();
-            } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
-                for (uint32_t i = 0; i < vs->size(); i++) {
-                    *(curPtr++) = vs->count(i);
-                }
-            } else {
-                panic("Unrecognized stat type");
-            }
-        }
-
         //Note this is a local vector, b/c it's only used at initialization.
         std::vector<hid_t> uniqueTypes;
 
@@ -201,12 +178,13 @@ class HDF5BackendImpl : public GlobAlloc {
         }
 
     public:
-        HDF5BackendImpl(const char* _filename, AggregateStat* _rootStat, size_t _bytesPerWrite, bool _skipVectors, bool _sumRegularAggregates) :
-            filename(_filename), rootStat(_rootStat), skipVectors(_skipVectors), sumRegularAggregates(_sumRegularAggregates)
+        HDF5BackendImpl(const char* _filename, AggregateStat* _rootStat, size_t _bytesPerWrite, bool _skipVectors, bool _sumRegularAggregates, StatsWriter* _writer) :
+            filename(_filename), rootStat(_rootStat), skipVectors(_skipVectors), sumRegularAggregates(_sumRegularAggregates), writer(_writer)
         {
+            futex_lock(&h5Lock);
             // Create stats file
             info("HDF5 backend: Opening %s", filename);
-            hid_t fileID = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+            fileID = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
 
             hid_t rootType = getH5Type(rootStat);
 
@@ -225,45 +203,83 @@ class HDF5BackendImpl : public GlobAlloc {
                     nullptr, 9 /*compression*/, nullptr);
             assert(hErrVal == 0);
 
+            snapshot = new StatsSnapshot(rootStat, skipVectors, sumRegularAggregates);
+            assert_msg(snapshot->size()*sizeof(uint64_t) == recordSize, "HDF5 (%s): snapshot has %d counters, record is %ld bytes", filename, snapshot->size(), recordSize);
+
             size_t bufSize = recordsPerWrite*recordSize;
-            if (sumRegularAggregates) bufSize += recordSize; //conservatively add space for a record. See dumpWalk(), we bleed into the buffer a bit when dumping a regular aggregate.
-            dataBuf = static_cast<uint64_t*>(gm_malloc(bufSize));
+            bufs[0] = static_cast<uint64_t*>(gm_malloc(bufSize));
+            bufs[1] = writer? static_cast<uint64_t*>(gm_malloc(bufSize)) : nullptr;
+            dataBuf = bufs[0];
             curPtr = dataBuf;
+            futex_init(&freeSem);
 
             bufferedRecords = 0;
 
-            info("HDF5 backend: Created table, %ld bytes/record, %d records/write", recordSize, recordsPerWrite);
+            info("HDF5 backend: Created table, %ld bytes/record, %d records/write%s", recordSize, recordsPerWrite, writer? ", async" : "");
             H5Fclose(fileID);
+            fileID = -1;
+            futex_unlock(&h5Lock);
         }
 
         ~HDF5BackendImpl() {}
 
         void dump(bool buffered) {
             // Copy stats to data buffer
-            dumpWalk(rootStat);
+            snapshot->read(curPtr);
+            curPtr += snapshot->size();
             bufferedRecords++;
 
             assert_msg(dataBuf + bufferedRecords*recordSize/sizeof(uint64_t) == curPtr, "HDF5 (%s): %p + %d * %ld / %ld != %p", filename, dataBuf, bufferedRecords, recordSize, sizeof(uint64_t), curPtr);
 
             // Write to table if needed
             if (bufferedRecords == recordsPerWrite || !buffered) {
-                hid_t fileID = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT);
-
-                size_t fieldOffsets[] = {0};
-                size_t fieldSizes[] = {recordSize};
-                H5TBappend_records(fileID, "stats", bufferedRecords, recordSize, fieldOffsets, fieldSizes, dataBuf);
-                H5Fclose(fileID);
+                if (writer) {
+                    futex_lock(&freeSem); //the writer is done with the other buffer
+                    uint64_t ticket = writer->enqueue(this, dataBuf, bufferedRecords, &freeSem);
+                    dataBuf = (dataBuf == bufs[0])? bufs[1] : bufs[0];
+                    if (!buffered) writer->wait(ticket);
+                } else {
+                    write(dataBuf, bufferedRecords);
+                }
 
                 //Rewind
                 bufferedRecords = 0;
                 curPtr = dataBuf;
             }
         }
+
+        // StatsWriter::Sink; also called by dump() without a writer
+        void write(const uint64_t* records, uint32_t numRecords) {
+            futex_lock(&h5Lock);
+            if (fileID < 0) fileID = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT);
+
+            size_t fieldOffsets[] = {0};
+            size_t fieldSizes[] = {recordSize};
+            H5TBappend_records(fileID, "stats", numRecords, recordSize, fieldOffsets, fieldSizes, records);
+            if (!writer) {
+                H5Fclose(fileID);
+                fileID = -1;
+            }
+            futex_unlock(&h5Lock);
+        }
+
+        void flush() {
+            futex_lock(&h5Lock);
+            if (fileID >= 0) H5Fflush(fileID, H5F_SCOPE_LOCAL);
+            futex_unlock(&h5Lock);
+        }
+
+        void close() {
+            futex_lock(&h5Lock);
+            if (fileID >= 0) H5Fclose(fileID);
+            fileID = -1;
+            futex_unlock(&h5Lock);
+        }
 };
 
 
-HDF5Backend::HDF5Backend(const char* filename, AggregateStat* rootStat, size_t bytesPerWrite, bool skipVectors, bool sumRegularAggregates) {
-    backend = new HDF5BackendImpl(filename, rootStat, bytesPerWrite, skipVectors, sumRegularAggregates);
+HDF5Backend::HDF5Backend(const char* filename, AggregateStat* rootStat, size_t bytesPerWrite, bool skipVectors, bool sumRegularAggregates, StatsWriter* writer) {
+    backend = new HDF5BackendImpl(filename, rootStat, bytesPerWrite, skipVectors, sumRegularAggregates, writer);
 }
 
 void HDF5Backend::dump(bool buffered) {
@@ -53,6 +53,7 @@
 #include "log.h"
 #include "mem_ctrls.h"
 #include "network.h"
+#include "nvmain_mem_ctrl.h"
 #include "null_core.h"
 #include "ooo_core.h"
 #include "part_repl_policies.h"
@@ -67,6 +68,7 @@
 #include "simple_core.h"
 #include "stats.h"
 #include "stats_filter.h"
+#include "stats_writer.h"
 #include "str.h"
 #include "timing_cache.h"
 #include "timing_core.h"
@@ -79,8 +81,6 @@
 #include "zsim.h"
 #include <iostream>
 
-extern void EndOfPhaseActions(); //in zsim.cpp
-
 /* zsim should be initialized in a deterministic and logical order, to avoid re-reading config vars
  * all over the place and give a predictable global state to constructors. Ideally, this should just
  * follow the layout of zinfo, top-down.
@@ -378,6 +378,12 @@ MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t fre
         string outputDir = config.get<const char*>("sys.mem.outputDir");
         outputDir = outputDir + "/" + suffix_str;
         mem = new DRAMSim3Memory(dramIni, outputDir, cpuFreqMHz, latency, domain, name);
+    } else if (type == "NVMain") {
+        int cpuFreqMHz = frequency;
+        string nvmainConfig = config.get<const char*>("sys.mem.configFile");
+        string outputDir = config.get<const char*>("sys.mem.outputDir");
+        outputDir = outputDir + "/" + suffix_str;
+        mem = new NVMainMemory(nvmainConfig, outputDir, cpuFreqMHz, latency, domain, name);
     } else if (type == "Detailed") {
         // FIXME(dsm): Don't use a separate config file... see DDRMemory
         g_string mcfg = config.get<const char*>("sys.mem.paramFile", "");
@@ -919,6 +925,12 @@ void mkdirIfNotExist(string path)
 		}
 		return gm_strdup((pathStr + "/" + "zsim-pout.out" ).c_str());
 	break;
+	case ZSIM_PCOL:
+		if (suffix) {
+            return gm_strdup((pathStr + "/" + suffix_str + "/" + "zsim-pout.zcs" ).c_str());
+		}
+		return gm_strdup((pathStr + "/" + "zsim-pout.zcs" ).c_str());
+	break;
 	case OUT_CFG:
 		if (suffix) {
 			// return gm_strdup((pathStr + "/" + "out_" + suffix_str + ".cfg" ).c_str());
@@ -952,12 +964,21 @@ static void PostInitStats(bool perProcessDir, Config& config, string suffix_str=
     const char* cmpStatsFile =  ZsimFileNameForStats(ZSIM_CMP, zinfo->outputDir, true, suffix_str);
     const char* statsFile    =  ZsimFileNameForStats(ZSIM_OUT, zinfo->outputDir, true, suffix_str);
     const char* poStatsFile  =  ZsimFileNameForStats(ZSIM_POUT, zinfo->outputDir, true, suffix_str);
+    const char* pcolStatsFile = ZsimFileNameForStats(ZSIM_PCOL, zinfo->outputDir, true, suffix_str);
+
+    // Backends hand their records off to a writer thread instead of writing them at the end of the phase
+    if (config.get<bool>("sim.asyncStats", true)) {
+        zinfo->statsWriter = new StatsWriter(config.get<uint32_t>("sim.statsFlushMs", 1000));
+    } else {
+        zinfo->statsWriter = nullptr;
+    }
+    StatsWriter* writer = zinfo->statsWriter;
 
     if (zinfo->statsPhaseInterval) {
         const char* periodicStatsFilter = config.get<const char*>("sim.periodicStatsFilter", "");
         AggregateStat* prStat = (!strlen(periodicStatsFilter))? zinfo->rootStat : FilterStats(zinfo->rootStat, periodicStatsFilter);
         if (!prStat) panic("No stats match sim.periodicStatsFilter regex (%s)! Set interval to 0 to avoid periodic stats", periodicStatsFilter);
-        zinfo->periodicStatsBackend = new HDF5Backend(pStatsFile, prStat, (1 << 20) /* 1MB chunks */, zinfo->skipStatsVectors, zinfo->compactPeriodicStats);
+        zinfo->periodicStatsBackend = new HDF5Backend(pStatsFile, prStat, (1 << 20) /* 1MB chunks */, zinfo->skipStatsVectors, zinfo->compactPeriodicStats, writer);
         zinfo->periodicStatsBackend->dump(true); //must have a first sample
 
         class PeriodicStatsDumpEvent : public Event {
@@ -978,7 +999,22 @@ static void PostInitStats(bool perProcessDir, Config& config, string suffix_str=
     }
 
     if (zinfo->outputPhaseInterval) {
-        zinfo->periodicOutputStatsBackend = new TextBackend(poStatsFile, zinfo->rootStat);;
+        // Columnar binary output by default; zcsread extracts series from it, or prints it as text
+        string poFormat = config.get<const char*>("sim.periodicOutputFormat", "columnar");
+        if (poFormat == "columnar") {
+            uint32_t blockRows = config.get<uint32_t>("sim.periodicOutputBlockRows", 64);
+            if (!blockRows) panic("sim.periodicOutputBlockRows must be > 0");
+#ifdef _WITH_ZSTD_
+            bool compress = config.get<bool>("sim.periodicOutputCompress", true);
+#else
+            bool compress = config.get<bool>("sim.periodicOutputCompress", false);  // setting it warns, see ColumnarBackend
+#endif
+            zinfo->periodicOutputStatsBackend = new ColumnarBackend(pcolStatsFile, zinfo->rootStat, blockRows, compress, writer);
+        } else if (poFormat == "text") {
+            zinfo->periodicOutputStatsBackend = new TextBackend(poStatsFile, zinfo->rootStat, writer);
+        } else {
+            panic("Invalid sim.periodicOutputFormat %s, must be columnar or text", poFormat.c_str());
+        }
         zinfo->periodicOutputStatsBackend->dump(true); //must have a first sample
 
         class PeriodicOutputDumpEvent : public Event {
@@ -998,7 +1034,7 @@ static void PostInitStats(bool perProcessDir, Config& config, string suffix_str=
         zinfo->periodicOutputStatsBackend = nullptr;
     }
 
-    zinfo->eventualStatsBackend = new HDF5Backend(evStatsFile, zinfo->rootStat, (1 << 17) /* 128KB chunks */, zinfo->skipStatsVectors, false /* don't sum regular aggregates*/);
+    zinfo->eventualStatsBackend = new HDF5Backend(evStatsFile, zinfo->rootStat, (1 << 17) /* 128KB chunks */, zinfo->skipStatsVectors, false /* don't sum regular aggregates*/, writer);
     zinfo->eventualStatsBackend->dump(true); //must have a first sample
     zinfo->statsBackends->push_back(zinfo->eventualStatsBackend);
 
@@ -1016,8 +1052,8 @@ static void PostInitStats(bool perProcessDir, Config& config, string suffix_str=
     }
 
     // Convenience stats
-    StatsBackend* compactStats = new HDF5Backend(cmpStatsFile, zinfo->rootStat, 0 /* no aggregation, this is just 1 record */, zinfo->skipStatsVectors, true); //don't dump a first sample.
-    StatsBackend* textStats = new TextBackend(statsFile, zinfo->rootStat);
+    StatsBackend* compactStats = new HDF5Backend(cmpStatsFile, zinfo->rootStat, 0 /* no aggregation, this is just 1 record */, zinfo->skipStatsVectors, true, writer); //don't dump a first sample.
+    StatsBackend* textStats = new TextBackend(statsFile, zinfo->rootStat, writer);
     zinfo->statsBackends->push_back(compactStats);
     zinfo->statsBackends->push_back(textStats);
 }
@@ -1102,11 +1138,18 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid, cons
 
     zinfo->numDomains = config.get<uint32_t>("sim.domains", 1);
     uint32_t numSimThreads = config.get<uint32_t>("sim.contentionThreads", MAX((uint32_t)1, zinfo->numDomains/2)); //gives a bit of parallelism, TODO tune
-    zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads);
+    // Optionally reassign domains to weave threads by their recent cost every phase, and let
+    // threads that run out of domains within a phase take them from busier threads. Both are
+    // off by default, keeping the fixed domain ranges, since balancing only pays off when
+    // domain costs are skewed (see tests/bench/weave_scaling.sh)
+    bool balanceDomains = config.get<bool>("sim.contentionBalance", false);
+    bool stealDomains = config.get<bool>("sim.contentionStealing", false);
+    zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads, balanceDomains, stealDomains);
     zinfo->contentionSim->initStats(zinfo->rootStat);
     zinfo->eventRecorders = gm_calloc<EventRecorder*>(zinfo->numCores);
 
     zinfo->traceWriters = new g_vector<AccessTraceWriter*>();
+    zinfo->memTraceWriters = new g_vector<MemTraceWriter*>();
 
     // Global simulation values
     zinfo->numPhases = 0;
@@ -0,0 +1,257 @@
+#include "instr_trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef _WITH_ZSTD_
+#include <zstd.h>
+#endif
+#include "decoder.h"
+#include "galloc.h"
+#include "zsim.h"
+
+/* InstrTraceWriter */
+
+InstrTraceWriter::InstrTraceWriter(const char* outputDir, uint32_t procIdx, uint32_t tid)
+    : lastAddr(0), lastBblAddr(0), records(0), closeRequested(false)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/instrtrace-p%d-t%d.bin", procIdx, tid);
+    fname = std::string(outputDir) + name;
+    fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) panic("Could not open instruction trace %s: %s", fname.c_str(), strerror(errno));
+
+    buf = new uint8_t[BUF_BYTES];
+    cur = buf;
+#ifdef _WITH_ZSTD_
+    zCap = ZSTD_compressBound(BUF_BYTES);
+    zBuf = new uint8_t[zCap];
+#else
+    zCap = 0;
+    zBuf = nullptr;
+#endif
+
+    InstrTraceHeader header;
+    memset(&header, 0, sizeof(header));
+    strncpy(header.magic, INSTRTRACE_MAGIC, sizeof(header.magic));
+    header.version = INSTRTRACE_VERSION;
+    header.procIdx = procIdx;
+    header.tid = tid;
+    header.lineSize = zinfo->lineSize;
+    header.dynUopBytes = sizeof(DynUop);
+    header.maxRegisters = MAX_REGISTERS;
+    write(&header, sizeof(header));
+}
+
+InstrTraceWriter::~InstrTraceWriter() {
+    close();
+    delete[] buf;
+    delete[] zBuf;
+}
+
+void InstrTraceWriter::bblDef(uint64_t bblAddr, BblInfo* bblInfo, uint32_t id) {
+    if (id >= defined.size()) defined.resize(2*id + 1024);
+    defined[id] = true;
+
+    // Capture forces OOO decoding (see SimInit), so every BblInfo carries its DynBbl
+    assert(zinfo->oooDecode);
+    uint32_t bytes = offsetof(BblInfo, oooBbl) + DynBbl::bytes(bblInfo->oooBbl[0].uops);
+    if (bytes + 1 + 3*10 > BUF_BYTES) panic("Instruction trace %s: basic block at 0x%lx is too large (%d bytes)", fname.c_str(), bblAddr, bytes);
+    reserve(1 + 3*10 + bytes);
+    *(cur++) = ITR_BBL_DEF;
+    cur = zcsPutVarint(cur, id);
+    cur = zcsPutVarint(cur, bblAddr);
+    cur = zcsPutVarint(cur, bytes);
+    memcpy(cur, bblInfo, bytes);
+    cur += bytes;
+    lastBblAddr = bblAddr;
+    records++;
+}
+
+void InstrTraceWriter::write(const void* data, uint64_t bytes) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (bytes) {
+        ssize_t res = ::write(fd, p, bytes);
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            panic("Could not write instruction trace %s: %s", fname.c_str(), strerror(errno));
+        }
+        p += res;
+        bytes -= res;
+    }
+}
+
+void InstrTraceWriter::join(uint64_t phase) {
+    if (closeRequested) close();
+    reserve(MAX_RECORD_BYTES);
+    *(cur++) = ITR_JOIN;
+    cur = zcsPutVarint(cur, phase);
+}
+
+void InstrTraceWriter::leave(uint64_t phase) {
+    reserve(MAX_RECORD_BYTES);
+    *(cur++) = ITR_LEAVE;
+    cur = zcsPutVarint(cur, phase);
+    flush();
+    if (closeRequested) close();
+}
+
+void InstrTraceWriter::syscallLeave(uint64_t phase, uint64_t pc, uint64_t syscallNumber, uint64_t arg0, uint64_t arg1) {
+    reserve(MAX_RECORD_BYTES);
+    *(cur++) = ITR_SYSCALL_LEAVE;
+    cur = zcsPutVarint(cur, phase);
+    cur = zcsPutVarint(cur, pc);
+    cur = zcsPutVarint(cur, syscallNumber);
+    cur = zcsPutVarint(cur, arg0);
+    cur = zcsPutVarint(cur, arg1);
+    flush();
+    if (closeRequested) close();
+}
+
+void InstrTraceWriter::flush() {
+    if (fd < 0) cur = buf;  // closed at the end of the simulation; drop stragglers
+    if (cur == buf) return;
+    InstrTraceBlockHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = INSTRTRACE_BLOCK_MAGIC;
+    header.codec = ZCS_RAW;
+    header.rawBytes = cur - buf;
+    header.storedBytes = header.rawBytes;
+    const uint8_t* stored = buf;
+#ifdef _WITH_ZSTD_
+    size_t res = ZSTD_compress(zBuf, zCap, buf, header.rawBytes, 1 /*level, favor speed*/);
+    if (!ZSTD_isError(res) && res < header.rawBytes) {
+        header.codec = ZCS_ZSTD;
+        header.storedBytes = res;
+        stored = zBuf;
+    }
+#endif
+    write(&header, sizeof(header));
+    write(stored, header.storedBytes);
+    cur = buf;
+}
+
+void InstrTraceWriter::close() {
+    if (fd < 0) return;
+    flush();
+    ::close(fd);
+    fd = -1;
+    info("Instruction trace %s: %ld records", fname.c_str(), records);
+}
+
+/* InstrTraceReader */
+
+InstrTraceReader::InstrTraceReader(const char* _fname) : fname(_fname), cur(nullptr), end(nullptr), lastAddr(0), lastBblAddr(0) {
+    file = fopen(_fname, "rb");
+    if (!file) panic("Could not open instruction trace %s: %s", _fname, strerror(errno));
+    if (fread(&header, sizeof(header), 1, file) != 1 || strncmp(header.magic, INSTRTRACE_MAGIC, sizeof(header.magic)) != 0) {
+        panic("%s is not an instruction trace", _fname);
+    }
+    if (header.version != INSTRTRACE_VERSION) panic("%s: unsupported instruction trace version %d", _fname, header.version);
+    if (header.dynUopBytes != sizeof(DynUop) || header.maxRegisters != MAX_REGISTERS) {
+        panic("%s: captured with an incompatible decoder (DynUop %d bytes, %d registers; this build has %ld, %d)",
+              _fname, header.dynUopBytes, header.maxRegisters, sizeof(DynUop), MAX_REGISTERS);
+    }
+}
+
+InstrTraceReader::~InstrTraceReader() {
+    fclose(file);
+}
+
+bool InstrTraceReader::readBlock() {
+    InstrTraceBlockHeader bh;
+    size_t n = fread(&bh, sizeof(bh), 1, file);
+    if (n != 1) return false;  // a block cut short (e.g., by a crash) ends the stream too
+    if (bh.magic != INSTRTRACE_BLOCK_MAGIC) panic("%s: corrupt block header", fname.c_str());
+    raw.resize(bh.rawBytes);
+    if (bh.codec == ZCS_RAW) {
+        if (fread(raw.data(), bh.rawBytes, 1, file) != 1) return false;
+    } else {
+        stored.resize(bh.storedBytes);
+        if (fread(stored.data(), bh.storedBytes, 1, file) != 1) return false;
+#ifdef _WITH_ZSTD_
+        size_t res = ZSTD_decompress(raw.data(), bh.rawBytes, stored.data(), bh.storedBytes);
+        if (ZSTD_isError(res) || res != bh.rawBytes) panic("%s: corrupt compressed block", fname.c_str());
+#else
+        panic("%s is zstd-compressed, but zsim was built without zstd", fname.c_str());
+#endif
+    }
+    cur = raw.data();
+    end = cur + bh.rawBytes;
+    return true;
+}
+
+uint64_t InstrTraceReader::getVarint() {
+    uint64_t v;
+    cur = zcsGetVarint(cur, end, &v);
+    if (!cur) panic("%s: truncated record", fname.c_str());
+    return v;
+}
+
+bool InstrTraceReader::next(InstrTraceRecord& rec) {
+    while (cur == end) {
+        if (!readBlock()) return false;
+    }
+
+    uint8_t op = *(cur++);
+    rec.op = op & ~ITR_FLAG;
+    rec.flag = op & ITR_FLAG;
+    switch (rec.op) {
+        case ITR_BBL_DEF:
+            {
+                uint64_t id = getVarint();
+                uint64_t addr = getVarint();
+                uint64_t bytes = getVarint();
+                if ((uint64_t)(end - cur) < bytes || bytes < offsetof(BblInfo, oooBbl) + DynBbl::bytes(0)) {
+                    panic("%s: corrupt basic block definition", fname.c_str());
+                }
+                if (id >= bbls.size()) {
+                    bbls.resize(2*id + 1024, nullptr);
+                    bblAddrs.resize(2*id + 1024, 0);
+                }
+                BblInfo* bblInfo = static_cast<BblInfo*>(gm_malloc(bytes));  // can't use type-safe interface
+                memcpy(bblInfo, cur, bytes);
+                cur += bytes;
+                bbls[id] = bblInfo;
+                bblAddrs[id] = addr;
+                rec.op = ITR_BBL;
+                rec.bblInfo = bblInfo;
+                rec.addr = lastBblAddr = addr;
+            }
+            break;
+        case ITR_BBL:
+            {
+                uint64_t id = getVarint();
+                if (id >= bbls.size() || !bbls[id]) panic("%s: basic block %ld used before its definition", fname.c_str(), id);
+                rec.bblInfo = bbls[id];
+                rec.addr = lastBblAddr = bblAddrs[id];
+            }
+            break;
+        case ITR_LOAD:
+        case ITR_STORE:
+        case ITR_PRED_LOAD:
+        case ITR_PRED_STORE:
+            rec.addr = lastAddr = lastAddr + zcsUnzigzag(getVarint());
+            break;
+        case ITR_BRANCH:
+            rec.addr = lastBblAddr + zcsUnzigzag(getVarint());
+            rec.arg[0] = rec.addr + zcsUnzigzag(getVarint());
+            rec.arg[1] = rec.addr + zcsUnzigzag(getVarint());
+            break;
+        case ITR_JOIN:
+        case ITR_LEAVE:
+            rec.arg[0] = getVarint();
+            break;
+        case ITR_SYSCALL_LEAVE:
+            rec.arg[0] = getVarint();
+            rec.addr = getVarint();
+            rec.arg[1] = getVarint();
+            rec.arg[2] = getVarint();
+            rec.arg[3] = getVarint();
+            break;
+        default:
+            panic("%s: unknown record type %d", fname.c_str(), rec.op);
+    }
+    return true;
+}
@@ -0,0 +1,203 @@
+#ifndef INSTR_TRACE_H_
+#define INSTR_TRACE_H_
+
+/* Per-thread instruction traces, replayable by zreplay without Pin or the
+ * original program.
+ *
+ * A trace holds every call a thread makes into the core analysis functions
+ * (basic blocks, loads, stores, branches), plus the points where the thread
+ * joins and leaves the scheduler. Each (process, thread) has its own file,
+ * <outputDir>/instrtrace-p<procIdx>-t<tid>.bin. zsim does not record traces
+ * yet (capture has not been validated under Pin); itracetest -g writes
+ * synthetic ones. Layout:
+ *
+ *   InstrTraceHeader, then blocks: InstrTraceBlockHeader and storedBytes of
+ *   payload, compressed with zstd if codec == ZCS_ZSTD. Records never span
+ *   blocks. Each record is a 1-byte opcode (ITR_* kind, ITR_FLAG for the
+ *   taken/predicate bit) followed by varints:
+ *     ITR_BBL_DEF  id, bblAddr, bytes, then the decoded BblInfo (bytes long);
+ *                  defines id, and runs it
+ *     ITR_BBL      id
+ *     ITR_LOAD/STORE (and PRED_ variants)  zigzag delta from the previous
+ *                  load/store address of the thread
+ *     ITR_BRANCH   zigzag pc - bblAddr, taken - pc, notTaken - pc
+ *     ITR_JOIN     phase
+ *     ITR_LEAVE    phase
+ *     ITR_SYSCALL_LEAVE  phase, pc, syscall number, arg0, arg1
+ *
+ * Basic block ids are assigned at instrumentation time, and each thread
+ * defines an id the first time it runs it, so streams decode independently.
+ * BblInfos are copied verbatim, so replay requires a zsim build with the same
+ * DynUop layout and register count; the header records both.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "columnar_stats.h"  // for varints and ZcsCodec
+#include "core.h"
+#include "log.h"
+
+#define INSTRTRACE_MAGIC "ZSINSTR"
+#define INSTRTRACE_VERSION 1
+
+enum InstrTraceOp : uint8_t {
+    ITR_BBL_DEF = 0,
+    ITR_BBL,
+    ITR_LOAD,
+    ITR_STORE,
+    ITR_PRED_LOAD,
+    ITR_PRED_STORE,
+    ITR_BRANCH,
+    ITR_JOIN,
+    ITR_LEAVE,
+    ITR_SYSCALL_LEAVE,
+    ITR_FLAG = 0x80,  // branch taken, or predicated op executed
+};
+
+struct InstrTraceHeader {
+    char magic[8];  // INSTRTRACE_MAGIC, NUL-terminated
+    uint32_t version;
+    uint32_t procIdx;
+    uint32_t tid;
+    uint32_t lineSize;
+    uint32_t dynUopBytes;   // sizeof(DynUop)
+    uint32_t maxRegisters;  // MAX_REGISTERS, depends on the Pin kit
+};
+
+static const uint32_t INSTRTRACE_BLOCK_MAGIC = 0x4b425449;  // "ITBK"
+
+struct InstrTraceBlockHeader {
+    uint32_t magic;  // INSTRTRACE_BLOCK_MAGIC
+    uint32_t rawBytes;
+    uint32_t storedBytes;
+    uint8_t codec;  // ZcsCodec
+    uint8_t pad[3];
+};
+
+/* Capture side: one per simulated thread, owned by that thread (so no
+ * locking), and process-local. Records go into a raw buffer, which is
+ * compressed and appended to the file when full.
+ */
+class InstrTraceWriter {
+    private:
+        static const uint32_t BUF_BYTES = 1 << 20;
+        static const uint32_t MAX_RECORD_BYTES = 1 + 5*10;  // all but BBL defs
+
+        std::string fname;
+        int fd;
+        uint8_t* buf;
+        uint8_t* cur;
+        uint8_t* zBuf;
+        size_t zCap;
+        std::vector<bool> defined;  // bbl ids this thread has defined
+        uint64_t lastAddr;
+        uint64_t lastBblAddr;
+        uint64_t records;
+        volatile bool closeRequested;
+
+        void reserve(uint32_t bytes) {
+            if (unlikely(cur + bytes > buf + BUF_BYTES)) {
+                flush();
+                if (closeRequested) close();
+            }
+        }
+
+        void write(const void* data, uint64_t bytes);
+
+        // Out of line, so that definitions do not bloat the inlined fast path
+        void bblDef(uint64_t bblAddr, BblInfo* bblInfo, uint32_t id);
+
+    public:
+        InstrTraceWriter(const char* outputDir, uint32_t procIdx, uint32_t tid);
+        ~InstrTraceWriter();
+
+        // id is the one assigned to bblInfo at instrumentation time
+        inline void bbl(uint64_t bblAddr, BblInfo* bblInfo, uint32_t id);
+
+        inline void memOp(InstrTraceOp op, uint64_t addr) {
+            reserve(MAX_RECORD_BYTES);
+            *(cur++) = op;
+            cur = zcsPutVarint(cur, zcsZigzag(addr - lastAddr));
+            lastAddr = addr;
+            records++;
+        }
+
+        inline void predMemOp(InstrTraceOp op, uint64_t addr, bool pred) {
+            memOp((InstrTraceOp)(op | (pred? ITR_FLAG : 0)), addr);
+        }
+
+        inline void branch(uint64_t pc, bool taken, uint64_t takenNpc, uint64_t notTakenNpc) {
+            reserve(MAX_RECORD_BYTES);
+            *(cur++) = ITR_BRANCH | (taken? ITR_FLAG : 0);
+            cur = zcsPutVarint(cur, zcsZigzag(pc - lastBblAddr));
+            cur = zcsPutVarint(cur, zcsZigzag(takenNpc - pc));
+            cur = zcsPutVarint(cur, zcsZigzag(notTakenNpc - pc));
+            records++;
+        }
+
+        void join(uint64_t phase);
+        // Leaves flush the buffer, so threads outside the simulation have nothing buffered
+        void leave(uint64_t phase);
+        void syscallLeave(uint64_t phase, uint64_t pc, uint64_t syscallNumber, uint64_t arg0, uint64_t arg1);
+
+        // Compresses and writes out buffered records
+        void flush();
+        // Flushes and closes the file; records appended afterwards are dropped.
+        // Only the owning thread may call this, as it may be appending.
+        void close();
+        // Called from other threads at the end of the simulation: the owner
+        // closes the file at its next join, leave, or full buffer
+        void requestClose() { closeRequested = true; }
+};
+
+/* Replay side. Decoded records; addresses are absolute. */
+struct InstrTraceRecord {
+    uint8_t op;  // InstrTraceOp without ITR_FLAG; BBL_DEF is returned as BBL
+    bool flag;
+    BblInfo* bblInfo;
+    uint64_t addr;  // bbl, load/store, or branch pc
+    uint64_t arg[4];  // branch: takenNpc, notTakenNpc; join/leave: phase; syscall leave: phase, number, arg0, arg1
+};
+
+class InstrTraceReader {
+    private:
+        std::string fname;
+        FILE* file;
+        InstrTraceHeader header;
+        std::vector<uint8_t> raw;
+        std::vector<uint8_t> stored;
+        const uint8_t* cur;
+        const uint8_t* end;
+        std::vector<BblInfo*> bbls;  // by id, gm-allocated and never freed (cores keep pointers to them)
+        std::vector<uint64_t> bblAddrs;
+        uint64_t lastAddr;
+        uint64_t lastBblAddr;
+
+        bool readBlock();
+        uint64_t getVarint();
+
+    public:
+        explicit InstrTraceReader(const char* fname);
+        ~InstrTraceReader();
+
+        const InstrTraceHeader& getHeader() const {return header;}
+
+        // Returns false at the end of the stream
+        bool next(InstrTraceRecord& rec);
+};
+
+inline void InstrTraceWriter::bbl(uint64_t bblAddr, BblInfo* bblInfo, uint32_t id) {
+    if (likely(id < defined.size() && defined[id])) {
+        reserve(MAX_RECORD_BYTES);
+        *(cur++) = ITR_BBL;
+        cur = zcsPutVarint(cur, id);
+        lastBblAddr = bblAddr;
+        records++;
+    } else {
+        bblDef(bblAddr, bblInfo, id);
+    }
+}
+
+#endif  // INSTR_TRACE_H_
@@ -0,0 +1,300 @@
+/* Round-trip test of instruction traces (see instr_trace.h):
+ * writes random streams of every record kind through InstrTraceWriter, reads
+ * them back with InstrTraceReader, checks every record and basic block, and
+ * measures write and read throughput. One writer is closed through
+ * requestClose(), as at the end of the simulation.
+ *
+ * With -g, writes synthetic traces that zreplay can replay instead: each
+ * thread runs basic blocks of general uops and one load or (one in four) one
+ * store, to addresses spread over its own footprint. It prints the
+ * instruction, uop and block counts the cores of a replay must report.
+ *
+ * Usage: itracetest [<records per thread>]
+ *        itracetest -g <outputDir> <threads> <bbls per thread> [<footprint MB per thread>] */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "core.h"
+#include "decoder.h"
+#include "galloc.h"
+#include "instr_trace.h"
+#include "log.h"
+#include "zsim.h"
+
+GlobSimInfo* zinfo;
+
+static const uint32_t NUM_THREADS = 4;
+static const uint32_t NUM_BBLS = 256;  // distinct basic blocks per thread
+
+struct TestBbl {
+    BblInfo* info;
+    uint32_t bytes;  // BblInfo and its DynBbl
+    uint64_t addr;
+};
+
+struct Rng {
+    uint64_t x;
+    explicit Rng(uint64_t seed) : x(seed * 0x9e3779b97f4a7c15ul + 1) {}
+    uint64_t next() {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        return x;
+    }
+};
+
+// A basic block of instrs instructions, as the decoder would build it with OOO
+// decoding on. Its last loads uops are loads, or stores if store is set
+static TestBbl makeBbl(uint64_t addr, uint32_t instrs, uint32_t uops, uint32_t loads, Rng& rng, bool randomUops, bool store = false) {
+    TestBbl bbl;
+    bbl.bytes = offsetof(BblInfo, oooBbl) + DynBbl::bytes(uops);
+    bbl.info = static_cast<BblInfo*>(gm_malloc(bbl.bytes));  // can't use type-safe interface
+    memset(bbl.info, 0, bbl.bytes);
+    bbl.info->instrs = instrs;
+    bbl.info->bytes = instrs * 4;
+    bbl.addr = addr;
+    DynBbl& dbbl = bbl.info->oooBbl[0];
+    dbbl.addr = addr;
+    dbbl.init(addr, uops, instrs);
+    for (uint32_t u = 0; u < uops; u++) {
+        DynUop& uop = dbbl.uop[u];
+        if (randomUops) {
+            uint64_t r = rng.next();
+            memcpy(&uop, &r, MIN(sizeof(uop), sizeof(r)));
+            r = rng.next();
+            memcpy(reinterpret_cast<uint8_t*>(&uop) + sizeof(r), &r, sizeof(uop) - sizeof(r));
+        } else {
+            memset(&uop, 0, sizeof(uop));
+            bool load = u >= uops - loads;
+            uop.type = load? UOP_LOAD : UOP_GENERAL;
+            uop.portMask = load? PORTS_23 : PORTS_015;
+            uop.lat = 1;
+            if (load && store) {
+                uop.type = UOP_STORE;
+                uop.portMask = PORT_4;
+            }
+        }
+    }
+    return bbl;
+}
+
+// Expected contents of a record; bbl is the index into the thread's TestBbls
+struct TestRecord {
+    uint8_t op;
+    bool flag;
+    uint32_t bbl;
+    uint64_t addr;
+    uint64_t arg[4];
+};
+
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+static uint64_t fileBytes(const std::string& fname) {
+    struct stat st;
+    if (stat(fname.c_str(), &st) != 0) panic("Could not stat %s", fname.c_str());
+    return st.st_size;
+}
+
+static std::string traceName(const char* dir, uint32_t tid) {
+    return std::string(dir) + "/instrtrace-p0-t" + std::to_string(tid) + ".bin";
+}
+
+static void roundTrip(uint64_t records) {
+    char dir[] = "/tmp/itracetestXXXXXX";
+    if (!mkdtemp(dir)) panic("Could not create a temporary directory");
+
+    std::vector<std::vector<TestBbl>> bbls(NUM_THREADS);
+    std::vector<std::vector<TestRecord>> expected(NUM_THREADS);
+    for (uint32_t t = 0; t < NUM_THREADS; t++) {
+        Rng rng(t + 1);
+        for (uint32_t b = 0; b < NUM_BBLS; b++) {
+            uint32_t uops = 1 + rng.next() % 40;
+            bbls[t].push_back(makeBbl(0x400000 + rng.next() % (1ul << 30), 1 + rng.next() % 20, uops, 0, rng, true));
+        }
+
+        // Mostly blocks and memory accesses, with the occasional leave/join pair
+        std::vector<TestRecord>& recs = expected[t];
+        uint64_t phase = 0;
+        uint64_t lastAddr = 0x7fff00000000ul;
+        uint32_t lastBbl = 0;
+        recs.push_back({ITR_JOIN, false, 0, 0, {phase, 0, 0, 0}});
+        while (recs.size() < records) {
+            uint64_t r = rng.next();
+            TestRecord rec = {ITR_BBL, false, 0, 0, {0, 0, 0, 0}};
+            switch (r % 16) {
+                case 0 ... 5:
+                    lastBbl = rec.bbl = (r >> 8) % NUM_BBLS;
+                    rec.addr = bbls[t][rec.bbl].addr;
+                    break;
+                case 6 ... 12:
+                    rec.op = ITR_LOAD + (r >> 8) % 4;
+                    rec.flag = (rec.op == ITR_PRED_LOAD || rec.op == ITR_PRED_STORE) && ((r >> 16) & 1);
+                    // Mostly nearby addresses (small deltas), sometimes far ones
+                    lastAddr = ((r >> 20) % 8)? lastAddr + (int64_t)((r >> 24) % 4096) - 2048 : rng.next() >> 16;
+                    rec.addr = lastAddr;
+                    break;
+                case 13 ... 14:
+                    rec.op = ITR_BRANCH;
+                    rec.flag = (r >> 8) & 1;
+                    rec.addr = bbls[t][lastBbl].addr + (r >> 16) % 64;
+                    rec.arg[0] = rec.addr - 4096 + (r >> 24) % 8192;
+                    rec.arg[1] = rec.addr + 4;
+                    break;
+                default:
+                    if ((r >> 8) & 1) {
+                        rec.op = ITR_LEAVE;
+                        rec.arg[0] = phase;
+                    } else {
+                        rec.op = ITR_SYSCALL_LEAVE;
+                        rec.arg[0] = phase;
+                        rec.addr = bbls[t][lastBbl].addr;
+                        rec.arg[1] = (r >> 16) % 330;
+                        rec.arg[2] = rng.next();
+                        rec.arg[3] = rng.next() >> 32;
+                    }
+                    recs.push_back(rec);
+                    phase += 1 + (r >> 32) % 100;
+                    rec = {ITR_JOIN, false, 0, 0, {phase, 0, 0, 0}};
+                    break;
+            }
+            recs.push_back(rec);
+        }
+    }
+
+    uint64_t totalRecords = 0;
+    uint64_t totalBytes = 0;
+    uint64_t start = nowNs();
+    for (uint32_t t = 0; t < NUM_THREADS; t++) {
+        InstrTraceWriter* w = new InstrTraceWriter(dir, 0, t);
+        for (const TestRecord& rec : expected[t]) {
+            switch (rec.op) {
+                case ITR_BBL: w->bbl(rec.addr, bbls[t][rec.bbl].info, rec.bbl); break;
+                case ITR_LOAD: case ITR_STORE: w->memOp((InstrTraceOp)rec.op, rec.addr); break;
+                case ITR_PRED_LOAD: case ITR_PRED_STORE: w->predMemOp((InstrTraceOp)rec.op, rec.addr, rec.flag); break;
+                case ITR_BRANCH: w->branch(rec.addr, rec.flag, rec.arg[0], rec.arg[1]); break;
+                case ITR_JOIN: w->join(rec.arg[0]); break;
+                case ITR_LEAVE: w->leave(rec.arg[0]); break;
+                case ITR_SYSCALL_LEAVE: w->syscallLeave(rec.arg[0], rec.addr, rec.arg[1], rec.arg[2], rec.arg[3]); break;
+                default: panic("Unexpected record %d", rec.op);
+            }
+        }
+        if (t == NUM_THREADS - 1) {
+            // As at the end of the simulation: the owner closes the file at its next join, and drops what follows
+            w->requestClose();
+            w->join(UINT64_MAX);
+            w->memOp(ITR_LOAD, 0);
+        }
+        delete w;  // closes the file
+        totalRecords += expected[t].size();
+        totalBytes += fileBytes(traceName(dir, t));
+    }
+    uint64_t writeNs = nowNs() - start;
+
+    start = nowNs();
+    for (uint32_t t = 0; t < NUM_THREADS; t++) {
+        std::string fname = traceName(dir, t);
+        InstrTraceReader r(fname.c_str());
+        if (r.getHeader().procIdx != 0 || r.getHeader().tid != t || r.getHeader().lineSize != zinfo->lineSize) {
+            panic("%s: wrong header", fname.c_str());
+        }
+        InstrTraceRecord rec;
+        uint64_t i = 0;
+        while (r.next(rec)) {
+            if (i >= expected[t].size()) panic("%s: more records than written", fname.c_str());
+            const TestRecord& exp = expected[t][i];
+            // Only the fields each kind of record carries
+            bool match = rec.op == exp.op && rec.flag == exp.flag;
+            switch (exp.op) {
+                case ITR_BBL:
+                    match = match && rec.addr == exp.addr && memcmp(rec.bblInfo, bbls[t][exp.bbl].info, bbls[t][exp.bbl].bytes) == 0;
+                    break;
+                case ITR_BRANCH:
+                    match = match && rec.addr == exp.addr && rec.arg[0] == exp.arg[0] && rec.arg[1] == exp.arg[1];
+                    break;
+                case ITR_JOIN:
+                case ITR_LEAVE:
+                    match = match && rec.arg[0] == exp.arg[0];
+                    break;
+                case ITR_SYSCALL_LEAVE:
+                    match = match && rec.addr == exp.addr && memcmp(rec.arg, exp.arg, sizeof(exp.arg)) == 0;
+                    break;
+                default:
+                    match = match && rec.addr == exp.addr;
+            }
+            if (!match) panic("%s: record %ld (op %d) differs from what was written (op %d)", fname.c_str(), i, rec.op, exp.op);
+            i++;
+        }
+        if (i != expected[t].size()) panic("%s: %ld records read, %ld written", fname.c_str(), i, expected[t].size());
+        unlink(fname.c_str());
+    }
+    uint64_t readNs = nowNs() - start;
+    rmdir(dir);
+
+    info("%d threads, %ld records, %.2f bytes/record: all records match", NUM_THREADS, totalRecords, 1.0 * totalBytes / totalRecords);
+    info("write %.1f Mrec/s, read %.1f Mrec/s", totalRecords * 1e3 / writeNs, totalRecords * 1e3 / readNs);
+}
+
+// Replayable traces: each block has BBL_INSTRS instructions, one of them a load or a store
+static void generate(const char* dir, uint32_t threads, uint64_t bblsPerThread, uint64_t footprintMB) {
+    const uint32_t BBL_INSTRS = 8;
+    uint64_t totalInstrs = 0;
+    uint64_t totalUops = 0;
+    uint64_t lastInstrs = 0;  // in the last block of each thread
+    uint64_t lastUops = 0;
+    for (uint32_t t = 0; t < threads; t++) {
+        Rng rng(t + 1);
+        std::vector<TestBbl> bbls;
+        for (uint32_t b = 0; b < 16; b++) bbls.push_back(makeBbl(0x400000 + b * 0x100, BBL_INSTRS, BBL_INSTRS, 1, rng, false, b % 4 == 3));
+
+        uint64_t base = (1ul << 40) + t * (footprintMB << 20);
+        uint64_t instrs = 0;
+        uint64_t uops = 0;
+        uint64_t stores = 0;
+        uint32_t b = 0;
+        InstrTraceWriter* w = new InstrTraceWriter(dir, 0, t);
+        w->join(0);
+        for (uint64_t i = 0; i < bblsPerThread; i++) {
+            b = rng.next() % bbls.size();
+            w->bbl(bbls[b].addr, bbls[b].info, b);
+            bool store = b % 4 == 3;
+            w->memOp(store? ITR_STORE : ITR_LOAD, base + ((rng.next() % (footprintMB << 20)) & ~7ul));
+            stores += store;
+            instrs += bbls[b].info->instrs;
+            uops += bbls[b].info->oooBbl[0].uops;
+        }
+        w->leave(0);
+        delete w;
+        info("Thread %d: %ld instrs, %ld uops, %ld loads, %ld stores", t, instrs, uops, bblsPerThread - stores, stores);
+        totalInstrs += instrs;
+        totalUops += uops;
+        lastInstrs += bbls[b].info->instrs;
+        lastUops += bbls[b].info->oooBbl[0].uops;
+    }
+    info("Total: %ld instrs, %ld uops", totalInstrs, totalUops);
+    // Cores simulate each block when the next one starts, so the last one of each thread is never counted
+    info("A replay must report %ld instrs, %ld uops, %ld bbls", totalInstrs - lastInstrs, totalUops - lastUops,
+         threads * (bblsPerThread - 1));
+}
+
+int main(int argc, char* argv[]) {
+    InitLog("[T] ");
+    gm_init(1ul << 30);
+    zinfo = gm_calloc<GlobSimInfo>();
+    zinfo->lineSize = 64;
+    zinfo->oooDecode = true;
+
+    if (argc > 1 && strcmp(argv[1], "-g") == 0) {
+        if (argc < 5) panic("Usage: %s -g <outputDir> <threads> <bbls per thread> [<footprint MB per thread>]", argv[0]);
+        generate(argv[2], strtoul(argv[3], nullptr, 0), strtoul(argv[4], nullptr, 0), (argc > 5)? strtoul(argv[5], nullptr, 0) : 64);
+    } else {
+        roundTrip((argc > 1)? strtoul(argv[1], nullptr, 0) : 2000000);
+    }
+    return 0;
+}
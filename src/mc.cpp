@@ -7,6 +7,7 @@
 #include <unistd.h>
 #include <cmath>
 
+#include "bithacks.h"
 #include "cache/alloy.h"
 #include "cache/banshee.h"
 #include "cache/cacheonly.h"
@@ -22,6 +23,8 @@
 #include "dramsim3_mem_ctrl.h"
 #include "dramsim_mem_ctrl.h"
 #include "mem_ctrls.h"
+#include "nvmain_mem_ctrl.h"
+#include "str.h"
 #include "zsim.h"
 
 // Helper function to check if a directory exists
@@ -31,17 +34,8 @@ inline bool file_exists(const std::string& path) {
 }
 
 MemoryController::MemoryController(g_string& name, uint32_t freqMHz, uint32_t domain, Config& config, std::string suffix_str)
-    : _name(name), _cur_trace_len(0), _max_trace_len(10000) {
-    // Initialize tracing
-    _collect_trace = config.get<bool>("sys.mem.enableTrace", false);
-    if (_collect_trace && _name == "mem-0") {
-        _trace_dir = config.get<const char*>("sys.mem.traceDir", "./");
-        FILE* f = fopen((_trace_dir + g_string("/") + _name + g_string("trace.bin")).c_str(), "wb");
-        uint32_t num = 0;
-        fwrite(&num, sizeof(uint32_t), 1, f);
-        fclose(f);
-        futex_init(&_lock);
-    }
+    : _name(name), _mcdram(nullptr), _mcdram_per_mc(0) {
+    futex_init(&_map_lock);
 
     g_string scheme = config.get<const char*>("sys.mem.cache_scheme", "NoCache");
 
@@ -92,11 +86,24 @@ MemoryController::MemoryController(g_string& name, uint32_t freqMHz, uint32_t do
              dramIni.c_str(), outputDir.c_str(), cpuFreqMHz);
         _ext_dram = (DRAMSim3Memory*)gm_malloc(sizeof(DRAMSim3Memory));
         new (_ext_dram) DRAMSim3Memory(dramIni, outputDir, cpuFreqMHz, latency, domain, ext_dram_name);
+    } else if (_ext_type == "NVMain") {
+        int cpuFreqMHz = freqMHz;
+        string nvmainConfig = config.get<const char*>("sys.mem.ext_dram.configFile");
+        string outputDir = config.get<const char*>("sys.mem.ext_dram.outputDir");
+        outputDir = outputDir + "/" + suffix_str;
+        if (!file_exists(outputDir)) {
+            if (mkdir(outputDir.c_str(), 0777) != 0) {
+                panic("Could not create directory %s: %s", outputDir.c_str(), strerror(errno));
+            }
+        }
+        uint32_t latency = config.get<uint32_t>("sys.mem.ext_dram.latency", 100);
+        _ext_dram = (NVMainMemory*)gm_malloc(sizeof(NVMainMemory));
+        new (_ext_dram) NVMainMemory(nvmainConfig, outputDir, cpuFreqMHz, latency, domain, ext_dram_name);
     } else
         panic("Invalid memory controller type %s", _ext_type.c_str());
 
     // Configure MCDRAM if applicable
-    if (_scheme != NoCache) {
+    if (scheme != "NoCache") {
         // Configure the MC-Dram (Timing Model)
         _mcdram_per_mc = config.get<uint32_t>("sys.mem.mcdram.mcdramPerMC", 4);
         // _mcdram = new MemObject * [_mcdram_per_mc];
@@ -151,6 +158,19 @@ MemoryController::MemoryController(g_string& name, uint32_t freqMHz, uint32_t do
                 info("Initializing DRAMSim3 with config %s, output dir %s, freq %d MHz",
                      dramIni.c_str(), outputDir.c_str(), cpuFreqMHz);
                 new (_mcdram[i]) DRAMSim3Memory(dramIni, outputDir, cpuFreqMHz, latency, domain, mcdram_name);
+            } else if (_mcdram_type == "NVMain") {
+                int cpuFreqMHz = freqMHz;
+                string nvmainConfig = config.get<const char*>("sys.mem.mcdram.configFile");
+                string outputDir = config.get<const char*>("sys.mem.mcdram.outputDir");
+                outputDir = outputDir + "/" + suffix_str;
+                if (!file_exists(outputDir)) {
+                    if (mkdir(outputDir.c_str(), 0777) != 0) {
+                        panic("Could not create directory %s: %s", outputDir.c_str(), strerror(errno));
+                    }
+                }
+                uint32_t latency = config.get<uint32_t>("sys.mem.mcdram.latency", 0);
+                _mcdram[i] = (NVMainMemory*)gm_malloc(sizeof(NVMainMemory));
+                new (_mcdram[i]) NVMainMemory(nvmainConfig, outputDir, cpuFreqMHz, latency, domain, mcdram_name);
             } else
                 panic("Invalid memory controller type %s", _mcdram_type.c_str());
         }
@@ -158,45 +178,48 @@ MemoryController::MemoryController(g_string& name, uint32_t freqMHz, uint32_t do
 
     g_string placement_scheme = config.get<const char*>("sys.mem.mcdram.placementPolicy", "LRU");
 
-    // Instantiate CacheScheme based on scheme type
-    if (scheme == "AlloyCache") {
-        _scheme = AlloyCache;
-        _cache_scheme = new (gm_malloc(sizeof(AlloyCacheScheme))) AlloyCacheScheme(config, this);
-    } else if (scheme == "UnisonCache") {
-        _scheme = UnisonCache;
-        _cache_scheme = new (gm_malloc(sizeof(UnisonCacheScheme))) UnisonCacheScheme(config, this);
-    } else if (scheme == "BansheeCache") {
-        _scheme = BansheeCache;
-        _cache_scheme = new (gm_malloc(sizeof(BansheeCacheScheme))) BansheeCacheScheme(config, this);
-    } else if (scheme == "NoCache") {
-        _scheme = NoCache;
-        _cache_scheme = new (gm_malloc(sizeof(NoCacheScheme))) NoCacheScheme(config, this);
-    } else if (scheme == "CacheOnly") {
-        _scheme = CacheOnly;
-        _cache_scheme = new (gm_malloc(sizeof(CacheOnlyScheme))) CacheOnlyScheme(config, this);
-    } else if (scheme == "CopyCache") {
-        _scheme = CopyCache;
-        _cache_scheme = new (gm_malloc(sizeof(CopyCacheScheme))) CopyCacheScheme(config, this);
-    } else if (scheme == "NDC") {
-        _scheme = NDC;
-        _cache_scheme = new (gm_malloc(sizeof(NDCScheme))) NDCScheme(config, this);
-    } else if (scheme == "IdealBalanced") {
-        _scheme = IdealBalanced;
-        _cache_scheme = new (gm_malloc(sizeof(IdealBalancedScheme))) IdealBalancedScheme(config, this);
-    } else if (scheme == "IdealAssociative") {
-        _scheme = IdealAssociative;
-        _cache_scheme = new (gm_malloc(sizeof(IdealAssociativeScheme))) IdealAssociativeScheme(config, this);
-    } else if (scheme == "IdealFully") {
-        _scheme = IdealFully;
-        _cache_scheme = new (gm_malloc(sizeof(IdealFullyScheme))) IdealFullyScheme(config, this);
-    } else if (scheme == "CHAMO") {
-        _scheme = CHAMO;
-        _cache_scheme = new (gm_malloc(sizeof(CHAMOScheme))) CHAMOScheme(config, this);
-    } else {
-        panic("Invalid cache scheme %s", scheme.c_str());
+    // Instantiate one CacheScheme per front-end shard. Shard i owns the granules
+    // g with g % numShards == i, i.e., a fixed slice of the sets, so each shard's
+    // scheme state and lock are fully independent. Granules are at least a page,
+    // so each page lives whole in one shard and per-page state (e.g., footprints)
+    // stays exact in the compacted shard addresses.
+    uint32_t page_size = config.get<uint32_t>("sys.mem.page_size", 4096);
+    _num_shards = config.get<uint32_t>("sys.mem.shards", 1);
+    // NDC's explicit index masks select bits of the full cache's line address, but
+    // each shard's scheme indexes 1/N of the sets with the shard bits removed
+    if (_num_shards > 1 && scheme == "NDC" && (config.get<uint32_t>("sys.mem.mcdram.index_mask_upper", 0x0) ||
+                                               config.get<uint32_t>("sys.mem.mcdram.index_mask_lower", 0x0))) {
+        panic("%s: sys.mem.mcdram.index_mask_upper/lower cannot be used with sys.mem.shards = %d; "
+              "remove the masks or set sys.mem.shards = 1", _name.c_str(), _num_shards);
+    }
+    _trace = BuildMemTraceWriter(config, _name, _num_shards);
+    _shards = gm_memalign<MemShard>(CACHE_LINE_BYTES, _num_shards);
+    _port_locks = nullptr;
+    if (_num_shards > 1) {
+        _port_locks = gm_memalign<MemPortLock>(CACHE_LINE_BYTES, 1 + _mcdram_per_mc);
+        for (uint32_t j = 0; j < 1 + _mcdram_per_mc; j++) futex_init(&_port_locks[j].lock);
     }
+    for (uint32_t i = 0; i < _num_shards; i++) {
+        MemShard& shard = _shards[i];
+        futex_init(&shard.lock);
+        shard.scheme = buildCacheScheme(scheme, config);
+        _granule_lines = MAX(shard.scheme->getGranularity(), (uint64_t)page_size) / 64;
+        if (_num_shards == 1) {
+            shard.ext_dram = _ext_dram;
+            shard.mcdram = _mcdram;
+        } else {
+            if (i == 0) checkShardSplit(shard.scheme, scheme);
+            shard.ext_dram = new MemShardPort(_ext_dram, &_port_locks[0].lock, i, _num_shards, _granule_lines);
+            shard.mcdram = gm_calloc<MemObject*>(_mcdram_per_mc);
+            for (uint32_t j = 0; j < _mcdram_per_mc; j++) {
+                shard.mcdram[j] = new MemShardPort(_mcdram[j], &_port_locks[1 + j].lock, i, _num_shards, _granule_lines);
+            }
+        }
+        shard.scheme->setMemories(shard.ext_dram, shard.mcdram, _mcdram_per_mc);
+    }
+    _cache_scheme = _shards[0].scheme;
 
-    uint32_t _page_size = config.get<uint32_t>("sys.mem.page_size", 4096); // 4096, 2097152
+    uint32_t _page_size = page_size; // 4096, 2097152
     _page_bits = log2(_page_size);
     if (_page_bits < 12) {
         panic("Page size %d is too small, must be at least 64 bytes", _page_size);
@@ -217,80 +240,83 @@ MemoryController::MemoryController(g_string& name, uint32_t freqMHz, uint32_t do
     }
     _ext_bits = log2(ext_size);
     _page_map_scheme = config.get<const char*>("sys.mem.pagemap_scheme", "Identical"); // Identical, Random, Johnny, JohnnyRandom
-    if (_page_map_scheme == "Johnny") {
-        _johnny_ptr = 0;
-    } else if (_page_map_scheme == "JohnnyRandom") {
-        _johnny_ptr = 0;
-        srand48_r((uint64_t)this, &_buffer);
-    } else if (_page_map_scheme == "Random") {
-        srand48_r((uint64_t)this, &_buffer);
-    } else if (_page_map_scheme == "Identical") { 
-        // Do nothing
-    } else {
-        panic("Invalid page mapping scheme %s", _page_map_scheme.c_str());
-    }
+    // JohnnyRandom fills external memory one cache-sized block of frames at a time
+    _frame_alloc = new FrameAllocator(FrameAllocator::parsePolicy(_page_map_scheme), 1UL << (_ext_bits - _page_bits),
+                                      1UL << (_cache_bits - _page_bits), (uint64_t)this);
+
+    _identical_map = (_page_map_scheme == "Identical");
+
+    _profiler = BuildMemProfiler(config, _page_bits);
 
     info("MemoryController %s initialized with page size %d, page mapping scheme %s", _name.c_str(), _page_size, _page_map_scheme.c_str());
     info("MemoryController %s initialized with cache size %lu, ext size %lu", _name.c_str(), cache_size, ext_size);
+    if (_num_shards > 1) info("MemoryController %s front end split into %d shards", _name.c_str(), _num_shards);
 
 }
 
-Address MemoryController::mapPage(MemReq& req) {
-    Address vLineAddr = req.lineAddr;
-    ReqType type = (req.type == GETS || req.type == GETX) ? LOAD : STORE;
-    Address pLineAddr;
-    if (_page_map_scheme == "Identical") {
-        pLineAddr = vLineAddr & ((1UL << (_ext_bits - 6)) - 1);
-        return pLineAddr;
+// Sharding splits the cache, its sets and external memory into numShards equal
+// slices of whole sharding granules; CacheScheme checks that sizes split evenly.
+// Each shard's sets must also hold whole sharding granules, so that its set
+// index matches the unsharded cache's. Otherwise shards would map conflicts
+// differently, so refuse such splits.
+void MemoryController::checkShardSplit(CacheScheme* cs, const g_string& scheme) {
+    if (cs->getNumSets() == 1) {
+        panic("%s: cache scheme %s is fully associative and cannot be split across %d shards",
+              _name.c_str(), scheme.c_str(), _num_shards);
+    }
+    uint64_t granules_per_granule = _granule_lines * 64 / cs->getGranularity();
+    if (cs->getNumSets() % granules_per_granule != 0) {
+        panic("%s: %ld sets per shard are not a multiple of the %ld-byte sharding granule (%ld cache granules); "
+              "use fewer shards or a larger cache", _name.c_str(), cs->getNumSets(), _granule_lines * 64, granules_per_granule);
     }
+}
 
-    Address vpgnum = vLineAddr >> (_page_bits - 6); 
-    // uint64_t cache_line_mask = (1UL << (_cache_bits - 6)) - 1;
-    uint64_t cache_page_mask = (1UL << (_cache_bits - _page_bits)) - 1;
-    // uint64_t ext_line_mask = (1UL << (_ext_bits - 6)) - 1;
-    uint64_t ext_page_mask = (1UL << (_ext_bits - _page_bits)) - 1;
-    uint64_t pgnum;
-    // info("Johnny page mapping: vLineAddr = %lx, vpgnum = %lx", vLineAddr, vpgnum);
-    if (_tlb.find(vpgnum) == _tlb.end()) {
-        if (_page_map_scheme == "Johnny") {
-            pgnum = _johnny_ptr;
-            _johnny_ptr++;
-            _johnny_ptr &= ext_page_mask;
-            assert(_johnny_ptr != 0);
-            // info("Johnny page mapping: _johnny_ptr = %lx", _johnny_ptr);
-        } else if (_page_map_scheme == "JohnnyRandom") {
-            uint32_t current_block = _johnny_ptr / (cache_page_mask + 1);
-            do {
-                int64_t rand;
-                lrand48_r(&_buffer, &rand);
-                pgnum = current_block * (cache_page_mask + 1) + (rand & cache_page_mask);
-            } while (_exist_pgnum.find(pgnum) != _exist_pgnum.end());
-            _johnny_ptr++;
-            assert(_johnny_ptr <= ext_page_mask + 1);
-            assert(pgnum <= ext_page_mask + 1);
-            _johnny_ptr &= ext_page_mask;
-            assert(_johnny_ptr != 0);
-        } else if (_page_map_scheme == "Random") {
-            do {
-                int64_t rand;
-                lrand48_r(&_buffer, &rand);
-                // pgnum = rand & 0x000fffffffffffff;
-                // info("Random page mapping: pgnum = %lx => %lx", rand, rand & ((1UL << (_ext_bits - 6)) - 1));
-                // N.B. TAKE CARE OF '<<'
-                pgnum = rand & ext_page_mask;
-            } while (_exist_pgnum.find(pgnum) != _exist_pgnum.end());
-        } else {
-            panic("Invalid page mapping scheme %s", _page_map_scheme.c_str());
-        }
-        _tlb[vpgnum] = pgnum;
-        _exist_pgnum.insert(pgnum);
-    } else 
-        pgnum = _tlb[vpgnum];
-    pLineAddr = (pgnum << (_page_bits - 6)) | (vLineAddr & ((1UL << (_page_bits - 6)) - 1));
-    // if (type == LOAD) {
-    //     info("rwttpe = %d, vLineAddr = %lx, vpgnum = %lx, pgnum = %lx, pLineAddr = %lx", req.type , vLineAddr, vpgnum, pgnum, pLineAddr);
-    // }
-    return pLineAddr;
+CacheScheme* MemoryController::buildCacheScheme(const g_string& scheme, Config& config) {
+    CacheScheme* cs;
+    if (scheme == "AlloyCache") {
+        _scheme = AlloyCache;
+        cs = new (gm_malloc(sizeof(AlloyCacheScheme))) AlloyCacheScheme(config, this);
+    } else if (scheme == "UnisonCache") {
+        _scheme = UnisonCache;
+        cs = new (gm_malloc(sizeof(UnisonCacheScheme))) UnisonCacheScheme(config, this);
+    } else if (scheme == "BansheeCache") {
+        _scheme = BansheeCache;
+        cs = new (gm_malloc(sizeof(BansheeCacheScheme))) BansheeCacheScheme(config, this);
+    } else if (scheme == "NoCache") {
+        _scheme = NoCache;
+        cs = new (gm_malloc(sizeof(NoCacheScheme))) NoCacheScheme(config, this);
+    } else if (scheme == "CacheOnly") {
+        _scheme = CacheOnly;
+        cs = new (gm_malloc(sizeof(CacheOnlyScheme))) CacheOnlyScheme(config, this);
+    } else if (scheme == "CopyCache") {
+        _scheme = CopyCache;
+        cs = new (gm_malloc(sizeof(CopyCacheScheme))) CopyCacheScheme(config, this);
+    } else if (scheme == "NDC") {
+        _scheme = NDC;
+        cs = new (gm_malloc(sizeof(NDCScheme))) NDCScheme(config, this);
+    } else if (scheme == "IdealBalanced") {
+        _scheme = IdealBalanced;
+        cs = new (gm_malloc(sizeof(IdealBalancedScheme))) IdealBalancedScheme(config, this);
+    } else if (scheme == "IdealAssociative") {
+        _scheme = IdealAssociative;
+        cs = new (gm_malloc(sizeof(IdealAssociativeScheme))) IdealAssociativeScheme(config, this);
+    } else if (scheme == "IdealFully") {
+        _scheme = IdealFully;
+        cs = new (gm_malloc(sizeof(IdealFullyScheme))) IdealFullyScheme(config, this);
+    } else if (scheme == "CHAMO") {
+        _scheme = CHAMO;
+        cs = new (gm_malloc(sizeof(CHAMOScheme))) CHAMOScheme(config, this);
+    } else {
+        panic("Invalid cache scheme %s", scheme.c_str());
+    }
+    return cs;
+}
+
+Address MemoryController::mapPage(MemReq& req) {
+    Address vLineAddr = req.lineAddr;
+    uint32_t pageLineBits = _page_bits - 6;
+    Address pgnum = _frame_alloc->translate(vLineAddr >> pageLineBits);
+    return (pgnum << pageLineBits) | (vLineAddr & ((1UL << pageLineBits) - 1));
 }
 
 uint64_t MemoryController::access(MemReq& req) {
@@ -311,44 +337,135 @@ uint64_t MemoryController::access(MemReq& req) {
     }
     if (req.type == PUTS) return req.cycle;
 
-    futex_lock(&_lock);
+    updateWarmupDone();
 
-    // Handle tracing if enabled
-    if (_collect_trace && _name == "mem-0") {
-        handleTraceCollection(req);
+    // Page mapping is controller-wide; everything after is per shard
+    Address vLineAddr = req.lineAddr;
+    uint64_t reqCycle = req.cycle;
+    if (!_identical_map) {
+        futex_lock(&_map_lock);
+        req.lineAddr = mapPage(req);
+        futex_unlock(&_map_lock);
+    } else {
+        req.lineAddr = mapPage(req);
     }
 
-    updateWarmupDone();
-    _cache_scheme->incNumRequests();
+    if (_profiler) _profiler->access(req.lineAddr, reqCycle);
 
-    // Delegate access to CacheScheme
-    Address vLineAddr = req.lineAddr;
-    req.lineAddr = mapPage(req);
-    uint64_t result = _cache_scheme->access(req);
-    req.lineAddr = vLineAddr;
-    _cache_scheme->period(req);
+    uint32_t shardIdx = getShard(req.lineAddr);
+    MemShard& shard = _shards[shardIdx];
+    req.lineAddr = toShardAddr(req.lineAddr);
 
-    futex_unlock(&_lock);
+    // Delegate access to this shard's CacheScheme
+    futex_lock(&shard.lock);
+    shard.scheme->incNumRequests();
+    uint64_t hits = shard.scheme->getStepHits(req.srcId);
+    uint64_t misses = shard.scheme->getStepMisses(req.srcId);
+    Address shardLineAddr = req.lineAddr;
+    uint64_t result = shard.scheme->access(req);
+    shard.scheme->accessShadows(shardLineAddr, req.type == PUTX);
+    req.lineAddr = vLineAddr;
+    if (_trace) {
+        // Schemes count each access as at most one step hit or miss
+        MemTraceOutcome outcome = (shard.scheme->getStepHits(req.srcId) != hits)? MEMTRACE_HIT :
+                                  (shard.scheme->getStepMisses(req.srcId) != misses)? MEMTRACE_MISS : MEMTRACE_NONE;
+        _trace->append(shardIdx, vLineAddr, reqCycle, req.srcId, req.type == PUTX, outcome);
+    }
+    shard.scheme->period(req);
+    futex_unlock(&shard.lock);
     return result;
 }
 
-void MemoryController::handleTraceCollection(MemReq& req) {
-    _address_trace[_cur_trace_len] = req.lineAddr;
-    _type_trace[_cur_trace_len] = (req.type == PUTX) ? 1 : 0;
-    _cur_trace_len++;
-    if (_cur_trace_len == _max_trace_len) {
-        FILE* f = fopen((_trace_dir + g_string("/") + _name + g_string("trace.bin")).c_str(), "ab");
-        fwrite(_address_trace, sizeof(Address), _max_trace_len, f);
-        fwrite(_type_trace, sizeof(uint32_t), _max_trace_len, f);
-        fclose(f);
-        _cur_trace_len = 0;
+// Merged view of one stat across the front-end shards, so sharded controllers
+// still report their scheme stats at the unsharded path (e.g., mem-0.<scheme>)
+class ShardSumStat : public ScalarStat {
+   private:
+    ScalarStat** _stats;
+    uint32_t _num;
+
+   public:
+    ShardSumStat(ScalarStat** stats, uint32_t num) : _stats(stats), _num(num) {}
+    uint64_t get() const {
+        uint64_t sum = 0;
+        for (uint32_t i = 0; i < _num; i++) sum += _stats[i]->get();
+        return sum;
+    }
+};
+
+class ShardSumVectorStat : public VectorStat {
+   private:
+    VectorStat** _stats;
+    uint32_t _num;
+
+   public:
+    ShardSumVectorStat(VectorStat** stats, uint32_t num) : _stats(stats), _num(num) {
+        _counterNames = stats[0]->hasCounterNames()? gm_calloc<const char*>(stats[0]->size()) : nullptr;
+        for (uint32_t j = 0; _counterNames && j < stats[0]->size(); j++) _counterNames[j] = stats[0]->counterName(j);
+    }
+    uint32_t size() const { return _stats[0]->size(); }
+    uint64_t count(uint32_t idx) const {
+        uint64_t sum = 0;
+        for (uint32_t i = 0; i < _num; i++) sum += _stats[i]->count(idx);
+        return sum;
     }
+};
+
+// Builds the merged counterpart of stats[0..num), which every shard's scheme
+// initialized identically
+static Stat* mergeShardStats(Stat** stats, uint32_t num) {
+    if (AggregateStat* as = dynamic_cast<AggregateStat*>(stats[0])) {
+        AggregateStat* merged = new AggregateStat(as->isRegular());
+        merged->init(as->name(), as->desc());
+        Stat** children = gm_calloc<Stat*>(num);
+        for (uint32_t c = 0; c < as->curSize(); c++) {
+            for (uint32_t i = 0; i < num; i++) children[i] = static_cast<AggregateStat*>(stats[i])->get(c);
+            merged->append(mergeShardStats(children, num));
+        }
+        gm_free(children);
+        return merged;
+    } else if (dynamic_cast<ScalarStat*>(stats[0])) {
+        ScalarStat** scalars = gm_calloc<ScalarStat*>(num);
+        for (uint32_t i = 0; i < num; i++) scalars[i] = static_cast<ScalarStat*>(stats[i]);
+        ShardSumStat* merged = new ShardSumStat(scalars, num);
+        merged->init(stats[0]->name(), stats[0]->desc());
+        return merged;
+    } else if (dynamic_cast<VectorStat*>(stats[0])) {
+        VectorStat** vectors = gm_calloc<VectorStat*>(num);
+        for (uint32_t i = 0; i < num; i++) vectors[i] = static_cast<VectorStat*>(stats[i]);
+        ShardSumVectorStat* merged = new ShardSumVectorStat(vectors, num);
+        merged->init(stats[0]->name(), stats[0]->desc());
+        return merged;
+    }
+    panic("Unrecognized stat type for %s", stats[0]->name());
 }
 
 void MemoryController::initStats(AggregateStat* parentStat) {
     AggregateStat* memStats = new AggregateStat();
     memStats->init(_name.c_str(), "Memory controller stats");
-    _cache_scheme->initStats(memStats);
+    if (_num_shards == 1) {
+        _cache_scheme->initStats(memStats);
+        _cache_scheme->initShadowStats(memStats);
+    } else {
+        // Regular aggregate, so per-shard counters are summed in compacted dumps
+        AggregateStat* shardsStats = new AggregateStat(true);
+        shardsStats->init("shard", "Cache scheme stats per front-end shard");
+        Stat** shardStats = gm_calloc<Stat*>(_num_shards);
+        for (uint32_t i = 0; i < _num_shards; i++) {
+            AggregateStat* as = new AggregateStat();
+            as->init(gm_strdup(("shard-" + Str(i)).c_str()), "Front-end shard stats");
+            _shards[i].scheme->initStats(as);
+            _shards[i].scheme->initShadowStats(as);
+            shardsStats->append(as);
+            shardStats[i] = as;
+        }
+        // Full dumps also get the shard sums at the unsharded paths
+        AggregateStat* merged = static_cast<AggregateStat*>(mergeShardStats(shardStats, _num_shards));
+        for (uint32_t c = 0; c < merged->curSize(); c++) memStats->append(merged->get(c));
+        delete merged;
+        gm_free(shardStats);
+        memStats->append(shardsStats);
+    }
+    if (_profiler) _profiler->initStats(memStats);
     _ext_dram->initStats(memStats);
     for (uint32_t i = 0; i < _mcdram_per_mc; i++) _mcdram[i]->initStats(memStats);
     parentStat->append(memStats);
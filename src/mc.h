@@ -4,9 +4,12 @@
 #include "cache/cache_scheme.h"
 #include "cache/cache_utils.h"
 #include "config.h"
+#include "frame_alloc.h"
 #include "g_std/g_string.h"
 #include "g_std/g_unordered_map.h"
 #include "g_std/g_unordered_set.h"
+#include "mem_profiler.h"
+#include "mem_trace.h"
 #include <unordered_map>
 #include <unordered_set>
 #include "memory_hierarchy.h"
@@ -14,31 +17,99 @@
 #include "zsim.h"
 #include "galloc.h"
 #include "process_stats.h"  // Add this include
+#include "pad.h"
 
 class DDRMemory;
 
+// Forwards one shard's traffic to a shared memory, translating the shard-local
+// line address back into the controller-wide address space. Shard s owns the
+// granules g with g % numShards == s, and sees them compacted as g / numShards.
+// Memory models are not thread-safe, and shards hold different locks, so all
+// the ports to one memory serialize on a lock shared among them.
+class MemShardPort : public MemObject {
+   private:
+    MemObject* _mem;
+    lock_t* _mem_lock;
+    uint32_t _shard;
+    uint32_t _num_shards;
+    uint64_t _granule_lines;
+
+   public:
+    MemShardPort(MemObject* mem, lock_t* memLock, uint32_t shard, uint32_t numShards, uint64_t granuleLines)
+        : _mem(mem), _mem_lock(memLock), _shard(shard), _num_shards(numShards), _granule_lines(granuleLines) {}
+
+    inline Address toGlobal(Address lineAddr) const {
+        return ((lineAddr / _granule_lines) * _num_shards + _shard) * _granule_lines + lineAddr % _granule_lines;
+    }
+
+    uint64_t access(MemReq& req) override {
+        Address lineAddr = req.lineAddr;
+        req.lineAddr = toGlobal(lineAddr);
+        futex_lock(_mem_lock);
+        uint64_t respCycle = _mem->access(req);
+        futex_unlock(_mem_lock);
+        req.lineAddr = lineAddr;
+        return respCycle;
+    }
+
+    uint64_t access(MemReq& req, int type, uint32_t data_size) override {
+        Address lineAddr = req.lineAddr;
+        req.lineAddr = toGlobal(lineAddr);
+        futex_lock(_mem_lock);
+        uint64_t respCycle = _mem->access(req, type, data_size);
+        futex_unlock(_mem_lock);
+        req.lineAddr = lineAddr;
+        return respCycle;
+    }
+
+    const char* getName() override { return _mem->getName(); }
+};
+
+// An independently locked slice of the DRAM cache front end
+struct MemShard {
+    lock_t lock;
+    CacheScheme* scheme;
+    MemObject* ext_dram;  // _ext_dram itself, or a MemShardPort to it
+    MemObject** mcdram;   // _mcdram itself, or MemShardPorts to it
+    PAD();
+};
+
+// Serializes the shard ports of one shared memory
+struct MemPortLock {
+    lock_t lock;
+    PAD();
+};
+
 class MemoryController : public MemObject {
    private:
     g_string _name;                 // Controller name
-    lock_t _lock;                   // Lock for thread safety
-    bool _collect_trace;            // Enable trace collection
-    g_string _trace_dir;            // Directory for trace output
-    Address _address_trace[10000];  // Address trace buffer
-    uint32_t _type_trace[10000];    // Type trace buffer
-    uint32_t _cur_trace_len;        // Current trace length
-    uint32_t _max_trace_len;        // Maximum trace length
-	
-    g_unordered_map <Address, Address> _tlb;
-    g_unordered_set <Address> _exist_pgnum;
-
-    // std::unordered_map<Address, Address> _tlb;
-    // std::unordered_set<Address> _exist_pgnum;
+    lock_t _map_lock;               // Protects page mapping state
+    MemTraceWriter* _trace;         // Request trace, nullptr unless sys.mem.enableTrace
+    MemProfiler* _profiler;         // Reuse/footprint profile, nullptr unless sys.mem.profiler.enable
+
     g_string _page_map_scheme;
-    uint64_t _johnny_ptr;
-    drand48_data _buffer;
+    FrameAllocator* _frame_alloc;   // VPN -> PFN mapping under _page_map_scheme
     uint32_t _page_bits;
     uint32_t _cache_bits;
     uint32_t _ext_bits;
+    bool _identical_map;
+
+    MemShard* _shards;        // Front-end shards, each with its own lock and scheme state
+    uint32_t _num_shards;
+    uint64_t _granule_lines;  // Lines per sharding granule (the larger of a page and the scheme's granularity)
+    MemPortLock* _port_locks; // One per shared memory (ext, then each mcdram); nullptr unless sharded
+
+    CacheScheme* buildCacheScheme(const g_string& scheme, Config& config);
+    void checkShardSplit(CacheScheme* cs, const g_string& scheme);
+
+    inline uint32_t getShard(Address lineAddr) const {
+        return (_num_shards == 1) ? 0 : (lineAddr / _granule_lines) % _num_shards;
+    }
+
+    inline Address toShardAddr(Address lineAddr) const {
+        if (_num_shards == 1) return lineAddr;
+        return (lineAddr / _granule_lines / _num_shards) * _granule_lines + lineAddr % _granule_lines;
+    }
 
    public:
     MemObject* _ext_dram;     // External DRAM
@@ -48,9 +119,8 @@ class MemoryController : public MemObject {
     g_string _mcdram_type;    // MCDRAM type
 
     Scheme _scheme;              // Cache scheme type
-    CacheScheme* _cache_scheme;  // Pointer to cache scheme implementation
+    CacheScheme* _cache_scheme;  // Scheme of shard 0 (the only one when unsharded)
 
-    void handleTraceCollection(MemReq& req);  // Trace handling logic
     DDRMemory* BuildDDRMemory(Config& config, uint32_t freqMHz, uint32_t domain,
                               g_string name, const std::string& prefix, uint32_t tBL,
                               double timing_scale);  // DDR memory builder
@@ -63,10 +133,11 @@ class MemoryController : public MemObject {
     void initStats(AggregateStat* parentStat) override;
     void printStats() override;
 
+    // Called by every shard without a common lock; the flag only ever goes false -> true
     inline void updateWarmupDone() {
-        if (zinfo->warmup_done) return;
+        if (__atomic_load_n(&zinfo->warmup_done, __ATOMIC_ACQUIRE)) return;
         if (zinfo->processStats->getTotalProcessInstrs() >= zinfo->warmup_instrs) {
-            zinfo->warmup_done = true;
+            __atomic_store_n(&zinfo->warmup_done, true, __ATOMIC_RELEASE);
         }
     }
     // Accessors for CacheScheme and memory components
@@ -33,39 +33,17 @@ SimpleMemory::SimpleMemory(uint32_t _latency, g_string& _name, Config& config)
 	: name(_name)
 	, latency(_latency) 
 {
-	// trace is collected in mc.cpp.  
-	_collect_trace = false;
-	_cur_trace_len = 0;
-	_max_trace_len = 10000;
+	// A DRAM cache controller traces its own requests (mc.cpp), so its internal
+	// SimpleMemories don't; only trace when this is the controller itself
+	g_string type = config.get<const char *>("sys.mem.type", "Simple");
+	_trace = (type == "Simple")? BuildMemTraceWriter(config, name) : nullptr;
 //	temp = new char[200];
 	temp = nullptr;
-	_trace_dir = config.get<const char *>("sys.mem.traceDir", "./");
-	//_address_trace = new Address[_max_trace_len]; 
-	//_type_trace = new uint32_t[_max_trace_len];
-	if (_collect_trace) {
-		FILE * f = fopen((_trace_dir + g_string("/") + name + g_string("trace.bin")).c_str(), "wb");
-		uint32_t num = 0;
-		fwrite(&num, sizeof(uint32_t), 1, f);
-		fclose(f);
-	    futex_init(&_lock);
-	}
 }
 
-uint64_t SimpleMemory::access(MemReq& req) {
-	if (_collect_trace) {
-	    futex_lock(&_lock);
-		_address_trace[_cur_trace_len] = req.lineAddr;
-		_type_trace[_cur_trace_len] = (req.type == PUTS || req.type == PUTX)? 1 : 0;
-		_cur_trace_len ++;
-		assert(_cur_trace_len <= _max_trace_len);
-		if (_cur_trace_len == _max_trace_len) {
-			FILE * f = fopen((_trace_dir + g_string("/") + name + g_string("trace.bin")).c_str(), "ab");
-			fwrite(_address_trace, sizeof(Address), _max_trace_len, f);
-			fwrite(_type_trace, sizeof(uint32_t), _max_trace_len, f);
-			fclose(f);
-			_cur_trace_len = 0;
-		}
-	    futex_unlock(&_lock);
+uint64_t SimpleMemory::access(MemReq& req, int type, uint32_t data_size) {
+	if (_trace) {
+		_trace->append(0, req.lineAddr, req.cycle, req.srcId, req.type == PUTS || req.type == PUTX, MEMTRACE_NONE);
 	}
 /*	if (temp == nullptr) {
 		//temp = std::new char[2000];
@@ -114,6 +92,7 @@ MD1Memory::MD1Memory(uint32_t requestSize, uint32_t megacyclesPerSecond, uint32_
     double bytesPerCycle = ((double)megabytesPerSecond)/((double)megacyclesPerSecond);
     maxRequestsPerCycle = bytesPerCycle/requestSize;
     assert(maxRequestsPerCycle > 0.0);
+    cyclesPerRequest = 1.0/maxRequestsPerCycle;
 
     zeroLoadLatency = _zeroLoadLatency;
 
@@ -124,8 +103,8 @@ MD1Memory::MD1Memory(uint32_t requestSize, uint32_t megacyclesPerSecond, uint32_
     futex_init(&updateLock);
 }
 
-void MD1Memory::updateLatency() {
-    uint32_t phaseCycles = (zinfo->numPhases - lastPhase)*(zinfo->phaseLength);
+void MD1Memory::updateLatency(uint64_t phase) {
+    uint32_t phaseCycles = (phase - lastPhase)*(zinfo->phaseLength);
     if (phaseCycles < 10000) return; //Skip with short phases
 
     smoothedPhaseAccesses =  (curPhaseAccesses*0.5) + (smoothedPhaseAccesses*0.5);
@@ -149,25 +128,32 @@ void MD1Memory::updateLatency() {
 
     curPhaseAccesses = 0;
     __sync_synchronize();
-    lastPhase = zinfo->numPhases;
+    lastPhase = phase;
 }
 
-uint64_t MD1Memory::access(MemReq& req) {
-    if (zinfo->numPhases > lastPhase) {
+uint64_t MD1Memory::access(MemReq& req, int type, uint32_t data_size) {
+    //The phase comes from the request's own cycle, not zinfo->numPhases, so that drivers without
+    //a phase barrier (mcsim's replay threads) need not maintain a global phase count
+    uint64_t phase = req.cycle/zinfo->phaseLength;
+    if (phase > lastPhase) {
         futex_lock(&updateLock);
         //Recheck, someone may have updated already
-        if (zinfo->numPhases > lastPhase) {
-            updateLatency();
+        if (phase > lastPhase) {
+            updateLatency(phase);
         }
         futex_unlock(&updateLock);
     }
 
+    //data_size counts 16-byte quarter-lines, not bytes: round up to whole lines
+    uint32_t lines = (data_size > 4)? (data_size + 3)/4 : 1;
+    uint32_t latency = curLatency + (uint32_t)((lines - 1)*cyclesPerRequest);
+
     switch (req.type) {
         case PUTX:
             //Dirty wback
             profWrites.atomicInc();
-            profTotalWrLat.atomicInc(curLatency);
-            __sync_fetch_and_add(&curPhaseAccesses, 1);
+            profTotalWrLat.atomicInc(latency);
+            __sync_fetch_and_add(&curPhaseAccesses, lines);
             //Note no break
         case PUTS:
             //Not a real access -- memory must treat clean wbacks as if they never happened.
@@ -175,19 +161,19 @@ uint64_t MD1Memory::access(MemReq& req) {
             break;
         case GETS:
             profReads.atomicInc();
-            profTotalRdLat.atomicInc(curLatency);
-            __sync_fetch_and_add(&curPhaseAccesses, 1);
+            profTotalRdLat.atomicInc(latency);
+            __sync_fetch_and_add(&curPhaseAccesses, lines);
             *req.state = req.is(MemReq::NOEXCL)? S : E;
             break;
         case GETX:
             profReads.atomicInc();
-            profTotalRdLat.atomicInc(curLatency);
-            __sync_fetch_and_add(&curPhaseAccesses, 1);
+            profTotalRdLat.atomicInc(latency);
+            __sync_fetch_and_add(&curPhaseAccesses, lines);
             *req.state = M;
             break;
 
         default: panic("!?");
     }
-    return req.cycle + ((req.type == PUTS)? 0 /*PUTS is not a real access*/ : curLatency);
+    return req.cycle + ((req.type == PUTS)? 0 /*PUTS is not a real access*/ : latency);
 }
 
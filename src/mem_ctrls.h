@@ -27,6 +27,7 @@
 #define MEM_CTRLS_H_
 
 #include "g_std/g_string.h"
+#include "mem_trace.h"
 #include "memory_hierarchy.h"
 #include "pad.h"
 #include "stats.h"
@@ -35,31 +36,31 @@
 /* Simple memory (or memory bank), has a fixed latency */
 class SimpleMemory : public MemObject {
     private:
-		bool _collect_trace;
-		g_string _trace_dir;
+		MemTraceWriter* _trace;  // nullptr unless tracing this controller
 
         g_string name;
         uint32_t latency;
-		Address _address_trace[10000];
-		uint32_t _type_trace[10000];
-		uint32_t _cur_trace_len;
-		uint32_t _max_trace_len;
 
 		struct Chunk {
 			char a[2000];
 		};
 	
-		lock_t _lock;
 		Chunk * temp;
     public:
-        uint64_t access(MemReq& req);
+        // data_size is in 16-byte units (4 = one line); the latency is fixed regardless
+        uint64_t access(MemReq& req, int type, uint32_t data_size = 4);
+        uint64_t access(MemReq& req) { return access(req, 0, 4); }
         const char* getName() {return name.c_str();}
         SimpleMemory(uint32_t _latency, g_string& _name, Config& config);
 };
 
 
 /* Implements a memory controller with limited bandwidth, throttling latency
- * using an M/D/1 queueing model.
+ * using an M/D/1 queueing model. Multi-line transfers (e.g., page fills from a
+ * DRAM cache scheme) count each line against the bandwidth, and pay the
+ * serialization of the lines after the first on top of the queueing latency.
+ * Being analytic, it records no weave events, so the chaining type of the
+ * access only matters to the caller.
  */
 class MD1Memory : public MemObject {
     private:
@@ -68,6 +69,7 @@ class MD1Memory : public MemObject {
         double smoothedPhaseAccesses;
         uint32_t zeroLoadLatency;
         uint32_t curLatency;
+        double cyclesPerRequest;  // serialization of each line after the first in a transfer
 
         PAD();
 
@@ -101,12 +103,15 @@ class MD1Memory : public MemObject {
         }
 
         //uint32_t access(Address lineAddr, AccessType type, uint32_t childId, MESIState* state /*both input and output*/, MESIState initialState, lock_t* childLock);
-        uint64_t access(MemReq& req);
+        // data_size is not in bytes: it counts quarter-lines (16-byte units, like DDRMemory's bursts),
+        // so 4 is one 64B line and lines = ceil(data_size/4); partial lines (e.g., tag reads) count as a line
+        uint64_t access(MemReq& req, int type, uint32_t data_size = 4);
+        uint64_t access(MemReq& req) { return access(req, 0, 4); }
 
         const char* getName() {return name.c_str();}
 
     private:
-        void updateLatency();
+        void updateLatency(uint64_t phase);
 };
 
 #endif  // MEM_CTRLS_H_
@@ -0,0 +1,171 @@
+#include "mem_profiler.h"
+
+#include <algorithm>
+#include "bithacks.h"
+#include "config.h"
+#include "log.h"
+#include "str.h"
+
+MemProfiler::MemProfiler(Config& config, uint32_t pageBits) : _page_line_bits(pageBits - 6) {
+    futex_init(&_lock);
+    uint32_t shift = config.get<uint32_t>("sys.mem.profiler.sampleShift", 10);
+    if (shift > HASH_BITS) panic("sys.mem.profiler.sampleShift must be <= %d", HASH_BITS);
+    uint32_t pageShift = config.get<uint32_t>("sys.mem.profiler.pageSampleShift", 10);
+    if (pageShift > HASH_BITS) panic("sys.mem.profiler.pageSampleShift must be <= %d", HASH_BITS);
+    _max_keys = config.get<uint32_t>("sys.mem.profiler.maxKeys", 1 << 18);
+    if (_max_keys == 0) panic("sys.mem.profiler.maxKeys must be > 0");
+    initStream(_lines, shift);
+    initStream(_pages, pageShift);
+
+    _ws_window = config.get<uint64_t>("sys.mem.profiler.wsWindow", 10000000);
+    _ws_slots = config.get<uint32_t>("sys.mem.profiler.wsSlots", 256);
+    if (_ws_window == 0 || _ws_slots < 2) panic("sys.mem.profiler: wsWindow must be > 0 and wsSlots >= 2");
+    _ws_stride = _ws_window;
+    _cur_window = 0;
+    _window_serial = 1;
+    _lines.workingSet = gm_calloc<uint64_t>(_ws_slots);
+    _pages.workingSet = gm_calloc<uint64_t>(_ws_slots);
+
+    _top_k = config.get<uint32_t>("sys.mem.profiler.hotPages", 32);
+    _top_size = 0;
+    _top_min = 0;
+    _top_pages = gm_calloc<uint64_t>(MAX(_top_k, 1u));
+    _top_counts = gm_calloc<uint64_t>(MAX(_top_k, 1u));
+    _top_order = gm_calloc<uint32_t>(MAX(_top_k, 1u));
+    _top_sorted = true;
+
+    info("Memory profiler: sampling 1/%ld lines and 1/%ld pages, up to %ld keys each", 1ul << _lines.shift, 1ul << _pages.shift, _max_keys);
+}
+
+void MemProfiler::initStream(Stream& s, uint32_t shift) {
+    s.shift = shift;
+    s.threshold = 1ul << (HASH_BITS - shift);
+    // Sampled streams hold few keys; a small tree keeps each touch in cache
+    s.stack = new StackDistance(_max_keys, 1 << 10);
+}
+
+void MemProfiler::updateWindow(uint64_t cycle, bool& inWindow) {
+    uint64_t window = cycle / _ws_stride;
+    if (window > _cur_window) {
+        while (window >= _ws_slots) {
+            // Keep the even windows, which are the windows of the doubled stride
+            _ws_stride *= 2;
+            for (uint32_t i = 0; i < _ws_slots; i++) {
+                _lines.workingSet[i] = (2 * i < _ws_slots) ? _lines.workingSet[2 * i] : 0;
+                _pages.workingSet[i] = (2 * i < _ws_slots) ? _pages.workingSet[2 * i] : 0;
+            }
+            window = cycle / _ws_stride;
+        }
+        _cur_window = window;
+        _window_serial++;
+    }
+    // Requests from threads lagging behind the latest window are not counted
+    inWindow = (window == _cur_window) && (cycle % _ws_stride < _ws_window);
+}
+
+void MemProfiler::sample(Stream& s, uint64_t key, bool inWindow) {
+    StackDistance::Entry* e = s.stack->find(key);
+    uint32_t bucket = 0;
+    if (e) {
+        // Distances within the sample are 2^-shift of the real ones
+        uint64_t distance = s.stack->depth(e) << s.shift;
+        bucket = MIN(ilog2(distance) + 1, REUSE_BUCKETS - 1);
+    }
+    s.reuse.inc(bucket, 1ul << s.shift);
+    e = s.stack->touch(key, e);
+    if (inWindow && e->flags != _window_serial) {
+        e->flags = _window_serial;
+        s.workingSet[_cur_window]++;
+    }
+}
+
+void MemProfiler::updateHotness(uint64_t page) {
+    if (_top_k == 0) return;
+    PageCount* pcp = _page_counts.find(page);
+    if (!pcp) {
+        if (_page_counts.size() == _max_keys) return;
+        pcp = &_page_counts[page];
+    }
+    PageCount& pc = *pcp;
+    uint64_t count = ++pc.count;
+    _top_sorted = false;
+    if (pc.topSlot) {
+        uint32_t slot = pc.topSlot - 1;
+        _top_counts[slot] = count;
+        if (slot != _top_min) return;
+    } else if (_top_size < _top_k) {
+        _top_pages[_top_size] = page;
+        _top_counts[_top_size] = count;
+        pc.topSlot = ++_top_size;
+    } else if (count > _top_counts[_top_min]) {
+        _page_counts.find(_top_pages[_top_min])->topSlot = 0;
+        pc.topSlot = _top_min + 1;
+        _top_pages[_top_min] = page;
+        _top_counts[_top_min] = count;
+    } else {
+        return;
+    }
+    _top_min = 0;
+    for (uint32_t i = 1; i < _top_size; i++) {
+        if (_top_counts[i] < _top_counts[_top_min]) _top_min = i;
+    }
+}
+
+// Sorts the top K once per dump: hotPages and hotPageAccesses read every
+// element in turn, and pages are only accessed between dumps
+const uint32_t* MemProfiler::topOrder() {
+    if (!_top_sorted) {
+        for (uint32_t i = 0; i < _top_size; i++) _top_order[i] = i;
+        std::sort(_top_order, _top_order + _top_size, [this](uint32_t a, uint32_t b) {
+            return (_top_counts[a] != _top_counts[b]) ? _top_counts[a] > _top_counts[b] : _top_pages[a] < _top_pages[b];
+        });
+        _top_sorted = true;
+    }
+    return _top_order;
+}
+
+void MemProfiler::initStats(AggregateStat* parentStat) {
+    AggregateStat* profStats = new AggregateStat();
+    profStats->init("profiler", "Reuse distance and footprint profile (sampled)");
+
+    const char** bucketNames = gm_calloc<const char*>(REUSE_BUCKETS);
+    bucketNames[0] = "cold";
+    for (uint32_t i = 1; i < REUSE_BUCKETS; i++) bucketNames[i] = gm_strdup(("<2^" + Str(i)).c_str());
+    _lines.reuse.init("lineReuse", "Accesses by line reuse distance (log2 buckets; 0 = cold)", REUSE_BUCKETS, bucketNames);
+    _pages.reuse.init("pageReuse", "Accesses by page reuse distance (log2 buckets; 0 = cold)", REUSE_BUCKETS, bucketNames);
+    profStats->append(&_lines.reuse);
+    profStats->append(&_pages.reuse);
+
+    if (_top_k) {
+        auto hotPages = makeLambdaVectorStat([this](uint32_t idx) -> uint64_t {
+            return (idx < _top_size) ? _top_pages[topOrder()[idx]] : 0;
+        }, _top_k);
+        hotPages->init("hotPages", "Most accessed physical pages, hottest first");
+        auto hotAccesses = makeLambdaVectorStat([this](uint32_t idx) -> uint64_t {
+            return (idx < _top_size) ? _top_counts[topOrder()[idx]] << _pages.shift : 0;
+        }, _top_k);
+        hotAccesses->init("hotPageAccesses", "Accesses to each of hotPages");
+        profStats->append(hotPages);
+        profStats->append(hotAccesses);
+    }
+
+    auto lineWs = makeLambdaVectorStat([this](uint32_t idx) -> uint64_t { return _lines.workingSet[idx] << _lines.shift; }, _ws_slots);
+    lineWs->init("lineWorkingSet", "Distinct lines touched per working-set window");
+    auto pageWs = makeLambdaVectorStat([this](uint32_t idx) -> uint64_t { return _pages.workingSet[idx] << _pages.shift; }, _ws_slots);
+    pageWs->init("pageWorkingSet", "Distinct pages touched per working-set window");
+    ProxyStat* wsWindow = new ProxyStat();
+    wsWindow->init("wsWindow", "Working-set window length (cycles)", &_ws_window);
+    ProxyStat* wsStride = new ProxyStat();
+    wsStride->init("wsStride", "Cycles between working-set window starts", &_ws_stride);
+    profStats->append(lineWs);
+    profStats->append(pageWs);
+    profStats->append(wsWindow);
+    profStats->append(wsStride);
+
+    parentStat->append(profStats);
+}
+
+MemProfiler* BuildMemProfiler(Config& config, uint32_t pageBits) {
+    if (!config.get<bool>("sys.mem.profiler.enable", false)) return nullptr;
+    return new MemProfiler(config, pageBits);
+}
@@ -0,0 +1,122 @@
+#ifndef MEM_PROFILER_H_
+#define MEM_PROFILER_H_
+
+#include <stdint.h>
+#include "frame_alloc.h"  // FlatAddrMap
+#include "galloc.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "stack_distance.h"
+#include "stats.h"
+
+class Config;
+
+/* Reuse-distance and footprint profile of the requests reaching a memory
+ * controller (sys.mem.profiler), on physical line addresses after page
+ * mapping, to size the DRAM cache without sweeping it:
+ *   lineReuse/pageReuse  LRU stack distance histograms: bucket 0 counts cold
+ *                        accesses, bucket i >= 1 distances in [2^(i-1), 2^i)
+ *                        lines or pages. An LRU cache of C lines hits on the
+ *                        accesses with distance <= C.
+ *   hotPages, hotPageAccesses
+ *                        the K most accessed sampled pages, hottest first
+ *   lineWorkingSet/pageWorkingSet
+ *                        distinct lines/pages touched in windows of wsWindow
+ *                        cycles, one every wsStride cycles
+ *
+ * Addresses are spatially sampled as in SHARDS (Waldspurger et al., FAST'15):
+ * a key is tracked iff its hash falls below a threshold, and every distance
+ * and count measured on the sample is scaled by the inverse of the rate. Lines
+ * are sampled at 2^-sampleShift and pages at 2^-pageSampleShift, both 1/1024
+ * by default. Unsampled requests only pay for two hashes; sampled ones take
+ * the profiler lock and update an LRU stack, so the sampling rates set the
+ * cost: at the defaults, the profiler adds about 5% to a NoCache mcsim replay
+ * (tests/bench/profiler_overhead.sh). Lower pageSampleShift finds hot pages
+ * among more pages, at about 6 ns per request at 1/16.
+ *
+ * Each stack tracks at most maxKeys sampled keys (default 256K, up to about
+ * 40MB of gm memory per stack); keys that fall deeper are forgotten and count
+ * as cold when they return, so distances are exact up to maxKeys << shift
+ * (16GB of lines at the defaults). Page access counts for hotPages are kept
+ * for the first maxKeys sampled pages.
+ *
+ * All histogram and working-set values are estimates scaled to the full
+ * stream; with both shifts at 0 (and enough maxKeys) they are exact.
+ */
+class MemProfiler : public GlobAlloc {
+   private:
+    static const uint32_t REUSE_BUCKETS = 48;
+    static const uint32_t HASH_BITS = 24;
+
+    struct Stream {  // line or page level
+        uint32_t shift;          // keys sampled with probability 2^-shift
+        uint64_t threshold;      // sampled iff hash < threshold
+        StackDistance* stack;    // entry flags: last working-set window touched
+        VectorCounter reuse;
+        uint64_t* workingSet;    // per window, in sampled keys
+    };
+
+    lock_t _lock;
+    uint32_t _page_line_bits;
+    uint64_t _max_keys;
+    Stream _lines;
+    Stream _pages;
+
+    // Working-set windows: window i covers cycles [i * stride, i * stride + _ws_window)
+    uint64_t _ws_window;
+    uint64_t _ws_stride;        // doubles, dropping every other window, when windows run out
+    uint32_t _ws_slots;
+    uint64_t _cur_window;       // index of the latest window seen
+    uint32_t _window_serial;    // distinct per window, so keys need no clearing between them
+
+    // Page hotness: exact access counts of sampled pages, and the top K of them
+    struct PageCount {
+        uint64_t count;
+        uint32_t topSlot;  // slot in the top K + 1, 0 if not in it
+    };
+    FlatAddrMap<PageCount> _page_counts;
+    uint32_t _top_k;
+    uint32_t _top_size;
+    uint32_t _top_min;     // slot with the fewest accesses
+    uint64_t* _top_pages;
+    uint64_t* _top_counts;
+    uint32_t* _top_order;  // slots hottest first, sorted when the stats are read
+    bool _top_sorted;      // _top_order is up to date
+
+    static inline uint64_t hash(uint64_t key) {
+        return (key * 0x9e3779b97f4a7c15ul) >> (64 - HASH_BITS);
+    }
+
+    void initStream(Stream& s, uint32_t shift);
+    void sample(Stream& s, uint64_t key, bool inWindow);
+    void updateHotness(uint64_t page);
+    void updateWindow(uint64_t cycle, bool& inWindow);
+    const uint32_t* topOrder();
+
+   public:
+    MemProfiler(Config& config, uint32_t pageBits);
+
+    inline void access(Address lineAddr, uint64_t cycle) {
+        uint64_t page = lineAddr >> _page_line_bits;
+        bool lineSampled = hash(lineAddr) < _lines.threshold;
+        bool pageSampled = hash(page) < _pages.threshold;
+        if (likely(!lineSampled && !pageSampled)) return;
+
+        futex_lock(&_lock);
+        bool inWindow;
+        updateWindow(cycle, inWindow);
+        if (lineSampled) sample(_lines, lineAddr, inWindow);
+        if (pageSampled) {
+            sample(_pages, page, inWindow);
+            updateHotness(page);
+        }
+        futex_unlock(&_lock);
+    }
+
+    void initStats(AggregateStat* parentStat);
+};
+
+// Builds the profiler of a controller if sys.mem.profiler.enable is set; nullptr otherwise
+MemProfiler* BuildMemProfiler(Config& config, uint32_t pageBits);
+
+#endif  // MEM_PROFILER_H_
@@ -0,0 +1,169 @@
+#include "mem_trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include "bithacks.h"
+#include "config.h"
+#include "log.h"
+#include "zsim.h"
+
+MemTraceWriter::MemTraceWriter(const g_string& fname, uint32_t bufRecords, uint32_t numShards)
+    : _fname(fname), _num_shards(numShards), _buf_records(bufRecords), _cur(0), _closed(false),
+      _flush_buf(0), _map(nullptr), _map_offset(0), _map_pos(0) {
+    assert(_buf_records > 0 && _num_shards > 0);
+    _shards = gm_memalign<Shard>(CACHE_LINE_BYTES, _num_shards);
+    for (uint32_t i = 0; i < _num_shards; i++) {
+        Shard& s = _shards[i];
+        futex_init(&s.lock);
+        s.len = 0;
+        s.flushLen = 0;
+        for (uint32_t b = 0; b < 2; b++) s.bufs[b] = gm_calloc<MemTraceRecord>(_buf_records);
+    }
+    _merge_pos = gm_calloc<uint32_t>(_num_shards);
+    futex_init(&_handoff_lock);
+    futex_init(&_free_sem);
+    futex_init(&_full_sem);
+    futex_lock(&_full_sem);  // nothing to write yet
+
+    _fd = open(_fname.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (_fd < 0) panic("Could not open memory trace %s: %s", _fname.c_str(), strerror(errno));
+    nextWindow();
+    MemTraceHeader header;
+    memset(&header, 0, sizeof(header));
+    strncpy(header.magic, MEMTRACE_MAGIC, sizeof(header.magic));
+    header.version = MEMTRACE_VERSION;
+    header.recordSize = sizeof(MemTraceRecord);
+    write(&header, sizeof(header));
+
+    SpawnInternalThread(flushThread, this);
+}
+
+void MemTraceWriter::lockShards() {
+    for (uint32_t i = 0; i < _num_shards; i++) futex_lock(&_shards[i].lock);
+}
+
+void MemTraceWriter::unlockShards() {
+    for (uint32_t i = 0; i < _num_shards; i++) futex_unlock(&_shards[i].lock);
+}
+
+void MemTraceWriter::handOff() {
+    futex_lock(&_handoff_lock);
+    lockShards();
+    // Whoever got here first may have handed off the full buffer already
+    bool full = false;
+    for (uint32_t i = 0; i < _num_shards; i++) full |= _shards[i].len == _buf_records;
+    if (full && !_closed) swapBuffers();
+    unlockShards();
+    futex_unlock(&_handoff_lock);
+}
+
+void MemTraceWriter::swapBuffers() {
+    futex_lock(&_free_sem);  // the previous buffers, i.e. the other ones, have been written
+    _flush_buf = _cur;
+    for (uint32_t i = 0; i < _num_shards; i++) {
+        _shards[i].flushLen = _shards[i].len;
+        _shards[i].len = 0;
+    }
+    _cur ^= 1;
+    futex_unlock(&_full_sem);
+}
+
+void MemTraceWriter::nextWindow() {
+    if (_map) {
+        munmap(_map, MAP_WINDOW);
+        _map_offset += MAP_WINDOW;
+    }
+    // The file is grown a window at a time, and trimmed to its real size by close()
+    if (ftruncate(_fd, _map_offset + MAP_WINDOW) != 0) {
+        panic("Could not grow memory trace %s: %s", _fname.c_str(), strerror(errno));
+    }
+    void* map = mmap(nullptr, MAP_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, _map_offset);
+    if (map == MAP_FAILED) panic("Could not map memory trace %s: %s", _fname.c_str(), strerror(errno));
+    _map = (uint8_t*)map;
+    _map_pos = 0;
+}
+
+void MemTraceWriter::write(const void* data, uint64_t bytes) {
+    const uint8_t* src = (const uint8_t*)data;
+    while (bytes) {
+        if (_map_pos == MAP_WINDOW) nextWindow();
+        uint64_t n = MIN(bytes, MAP_WINDOW - _map_pos);
+        memcpy(_map + _map_pos, src, n);
+        _map_pos += n;
+        src += n;
+        bytes -= n;
+    }
+}
+
+// Sorts each shard's handed-off records by cycle and writes them out merged
+void MemTraceWriter::writeMerged() {
+    auto byCycle = [](const MemTraceRecord& a, const MemTraceRecord& b) { return a.cycle < b.cycle; };
+    for (uint32_t i = 0; i < _num_shards; i++) {
+        MemTraceRecord* buf = _shards[i].bufs[_flush_buf];
+        std::stable_sort(buf, buf + _shards[i].flushLen, byCycle);
+        _merge_pos[i] = 0;
+    }
+    if (_num_shards == 1) {
+        write(_shards[0].bufs[_flush_buf], _shards[0].flushLen * sizeof(MemTraceRecord));
+        return;
+    }
+
+    // Shards are few, so a linear scan for the earliest head is enough
+    while (true) {
+        uint32_t next = _num_shards;
+        uint64_t nextCycle = 0;
+        for (uint32_t i = 0; i < _num_shards; i++) {
+            if (_merge_pos[i] == _shards[i].flushLen) continue;
+            uint64_t cycle = _shards[i].bufs[_flush_buf][_merge_pos[i]].cycle;
+            if (next == _num_shards || cycle < nextCycle) {
+                next = i;
+                nextCycle = cycle;
+            }
+        }
+        if (next == _num_shards) break;
+        write(&_shards[next].bufs[_flush_buf][_merge_pos[next]++], sizeof(MemTraceRecord));
+    }
+}
+
+void MemTraceWriter::flushThread(void* arg) {
+    MemTraceWriter* w = static_cast<MemTraceWriter*>(arg);
+    while (true) {
+        futex_lock(&w->_full_sem);
+        w->writeMerged();
+        futex_unlock(&w->_free_sem);
+    }
+}
+
+void MemTraceWriter::close() {
+    futex_lock(&_handoff_lock);
+    lockShards();
+    if (!_closed) {
+        bool pending = false;
+        for (uint32_t i = 0; i < _num_shards; i++) pending |= _shards[i].len != 0;
+        if (pending) swapBuffers();
+        futex_lock(&_free_sem);  // wait for the flush thread to go idle; it stays blocked from now on
+        _closed = true;
+
+        uint64_t size = _map_offset + _map_pos;
+        munmap(_map, MAP_WINDOW);
+        _map = nullptr;
+        if (ftruncate(_fd, size) != 0) warn("Could not trim memory trace %s: %s", _fname.c_str(), strerror(errno));
+        ::close(_fd);
+        info("Wrote %ld memory trace records to %s", (size - sizeof(MemTraceHeader)) / sizeof(MemTraceRecord), _fname.c_str());
+    }
+    unlockShards();
+    futex_unlock(&_handoff_lock);
+}
+
+MemTraceWriter* BuildMemTraceWriter(Config& config, const g_string& name, uint32_t numShards) {
+    if (!config.get<bool>("sys.mem.enableTrace", false)) return nullptr;
+    g_string traceDir = config.get<const char*>("sys.mem.traceDir", "./");
+    uint32_t bufRecords = config.get<uint32_t>("sys.mem.traceBufferRecords", 1 << 18);  // per shard
+    MemTraceWriter* writer = new MemTraceWriter(traceDir + "/" + name + "trace.bin", bufRecords, numShards);
+    zinfo->memTraceWriters->push_back(writer);  // register it so that it gets closed when the simulation ends
+    return writer;
+}
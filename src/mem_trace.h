@@ -0,0 +1,144 @@
+#ifndef MEM_TRACE_H_
+#define MEM_TRACE_H_
+
+#include <stdint.h>
+#include "g_std/g_string.h"
+#include "galloc.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "pad.h"
+
+class Config;
+
+/* Raw per-request traces of memory controllers (sys.mem.enableTrace), one file
+ * per controller at <sys.mem.traceDir>/<name>trace.bin, replayable by mcsim.
+ * A file is a MemTraceHeader followed by packed MemTraceRecords. Files written
+ * before this format start with a 32-bit 0 instead, followed by 10000-entry
+ * chunks of addresses then types; mcsim still reads those. */
+
+enum MemTraceOutcome {
+    MEMTRACE_NONE = 0,  // no DRAM cache in front, or the scheme does not report hits
+    MEMTRACE_HIT = 1,
+    MEMTRACE_MISS = 2,
+};
+
+#define MEMTRACE_MAGIC "ZSMEMTR"
+#define MEMTRACE_VERSION 1
+
+struct MemTraceHeader {
+    char magic[8];  // MEMTRACE_MAGIC, NUL-terminated
+    uint32_t version;
+    uint32_t recordSize;
+};
+
+struct MemTraceRecord {
+    uint64_t lineAddr;  // as received by the controller, before page mapping
+    uint64_t cycle;     // request cycle
+    uint32_t srcId;
+    uint8_t isWrite;
+    uint8_t outcome;  // MemTraceOutcome
+    uint16_t pad;
+};  // 24 bytes, no packing needed
+
+/* Each shard of a controller (sys.mem.shards) appends records to its own pair
+ * of gm buffers, under its own lock, so shards never contend on tracing. When
+ * a shard's buffer fills up, the buffers of all shards are handed to a
+ * background thread together, and appends continue on the other buffers. The
+ * background thread sorts each shard's records by cycle, merges them, and
+ * copies the result into a memory-mapped output file, which grows in
+ * fixed-size windows. Appenders only block if a buffer fills up before the
+ * previous ones have been written out.
+ *
+ * So records are in cycle order within each hand-off, with ties in arrival
+ * order. Across hand-offs they are not strictly: in the bound phase, cores run
+ * up to a phase ahead of each other, so a request can reach the controller
+ * after requests with later cycles have already been written out. Consumers
+ * that need a strict order (mcsim does not) must sort by cycle.
+ *
+ * Buffers live in shared memory, so any process can append, but the file is
+ * only mapped by the process that built the writer (the one running SimInit),
+ * which is also where close() is called from at the end of the simulation.
+ */
+class MemTraceWriter : public GlobAlloc {
+    private:
+        static const uint64_t MAP_WINDOW = 64ul << 20;  // bytes mapped at a time
+
+        struct Shard {
+            lock_t lock;             // serializes this shard's appenders and hand-offs
+            uint32_t len;            // records in bufs[_cur]
+            uint32_t flushLen;       // records in bufs[_flush_buf], once handed off
+            MemTraceRecord* bufs[2];
+        } ATTR_LINE_ALIGNED;
+
+        g_string _fname;
+        Shard* _shards;
+        uint32_t _num_shards;
+        uint32_t _buf_records;  // capacity of each buffer
+        volatile uint32_t _cur; // buffers being filled, the same in all shards
+        volatile bool _closed;
+        lock_t _handoff_lock;   // serializes hand-offs and close()
+
+        // Hand-off to the flush thread; both locks are used as binary semaphores
+        lock_t _full_sem;       // released when the _flush_buf buffers are ready to be written
+        lock_t _free_sem;       // released when the flush thread is done with them
+        volatile uint32_t _flush_buf;
+        uint32_t* _merge_pos;   // flush thread's position in each shard's buffer
+
+        // Output file, only touched by the flush thread, or by close() once it is idle
+        int _fd;
+        uint8_t* _map;          // current window of the file
+        uint64_t _map_offset;   // file offset of the window
+        uint64_t _map_pos;      // bytes written into the window
+
+        void handOff();
+        void swapBuffers();  // called with _handoff_lock and every shard lock held
+        void lockShards();
+        void unlockShards();
+        void write(const void* data, uint64_t bytes);
+        void writeMerged();
+        void nextWindow();
+        static void flushThread(void* arg);
+
+    public:
+        MemTraceWriter(const g_string& fname, uint32_t bufRecords, uint32_t numShards = 1);
+
+        // Callers may run concurrently, but each shard's appends must come from
+        // one thread at a time (e.g., under the shard's controller lock) for its
+        // records to keep their order
+        inline void append(uint32_t shard, Address lineAddr, uint64_t cycle, uint32_t srcId, bool isWrite, MemTraceOutcome outcome) {
+            assert(shard < _num_shards);
+            Shard& s = _shards[shard];
+            while (true) {
+                futex_lock(&s.lock);
+                if (unlikely(_closed)) {
+                    futex_unlock(&s.lock);
+                    return;
+                }
+                if (likely(s.len < _buf_records)) {
+                    MemTraceRecord& rec = s.bufs[_cur][s.len++];
+                    rec.lineAddr = lineAddr;
+                    rec.cycle = cycle;
+                    rec.srcId = srcId;
+                    rec.isWrite = isWrite;
+                    rec.outcome = outcome;
+                    rec.pad = 0;
+                    bool full = s.len == _buf_records;
+                    futex_unlock(&s.lock);
+                    if (unlikely(full)) handOff();
+                    return;
+                }
+                futex_unlock(&s.lock);
+                handOff();  // another appender filled it and is handing it off
+            }
+        }
+
+        // Writes out buffered records and finalizes the file; later appends are dropped
+        void close();
+};
+
+// Builds the trace writer of memory name, with numShards shards, if
+// sys.mem.enableTrace is set, and registers it to be closed when the
+// simulation ends; returns nullptr otherwise
+MemTraceWriter* BuildMemTraceWriter(Config& config, const g_string& name, uint32_t numShards = 1);
+
+#endif  // MEM_TRACE_H_
@@ -0,0 +1,196 @@
+/* Checks the NDC address translation (NDCAddrMap) bit for bit against the
+ * bit-by-bit loops NDCScheme used before, on random masks and addresses, and
+ * measures translation throughput. Build with march=native (or -mbmi2) for
+ * PEXT/PDEP, or define BIT_GATHER_LUT to check the table fallback.
+ *
+ * Usage: ndcbench [<translations per config>] */
+
+#include <stdlib.h>
+#include <time.h>
+#include "cache/ndc_addr_map.h"
+#include "galloc.h"
+#include "log.h"
+
+// The former NDCScheme::phyAddr2cacheAddr and getSetNum
+struct LoopMap {
+    uint64_t _index_mask, _cache_tag_mask, _pred_tag_mask;
+    uint32_t _index_bits, _cache_tag_bits, _cache_lines_bits, _co_pos;
+
+    Address phyAddr2cacheAddr(Address phy_addr) const {
+        uint64_t hex_addr = phy_addr;
+        uint64_t cache_addr = 0;
+        uint64_t tag_value = 0;
+        uint64_t bit_pos = 0;
+        int first_tag_bit = 0;
+        while (first_tag_bit < 64 && !(_cache_tag_mask & (1ULL << first_tag_bit))) first_tag_bit++;
+        for (int i = first_tag_bit; i < (int)_cache_lines_bits && bit_pos < _cache_tag_bits; i++) {
+            if (_cache_tag_mask & (1ULL << i)) {
+                tag_value |= ((hex_addr >> i) & 1) << bit_pos;
+                bit_pos++;
+            }
+        }
+        cache_addr |= (tag_value << _co_pos);
+
+        uint64_t index_value = 0;
+        bit_pos = 0;
+        int first_index_bit = 0;
+        while (first_index_bit < 64 && !(_index_mask & (1ULL << first_index_bit))) first_index_bit++;
+        for (int i = first_index_bit; i < (int)_cache_lines_bits && bit_pos < _index_bits; i++) {
+            if (_index_mask & (1ULL << i)) {
+                index_value |= ((hex_addr >> i) & 1) << bit_pos;
+                bit_pos++;
+            }
+        }
+        bit_pos = 0;
+        for (int i = 0; i < (int)_cache_lines_bits && bit_pos < _index_bits; i++) {
+            if (i >= (int)_co_pos && i < (int)(_co_pos + _cache_tag_bits)) continue;
+            cache_addr |= ((index_value >> bit_pos) & 1) << i;
+            bit_pos++;
+        }
+        return cache_addr | (phy_addr & _pred_tag_mask);
+    }
+
+    uint64_t getSetNum(Address cache_addr) const {
+        uint64_t index = 0;
+        uint64_t bit_pos = 0;
+        for (int i = 0; i < (int)_cache_lines_bits && bit_pos < _index_bits; i++) {
+            if (i >= (int)_co_pos && i < (int)(_co_pos + _cache_tag_bits)) continue;
+            index |= ((cache_addr >> i) & 1) << bit_pos;
+            bit_pos++;
+        }
+        return index;
+    }
+};
+
+static uint64_t rand64() {
+    return ((uint64_t)rand() << 62) ^ ((uint64_t)rand() << 31) ^ rand();
+}
+
+// NDCScheme's masks: lines = tag + index bits, as many predicted tag bits above
+static LoopMap makeConfig(uint32_t tagBits, uint32_t indexBits, uint32_t predBits, uint32_t coPos, uint64_t indexMask) {
+    LoopMap m;
+    m._cache_tag_bits = tagBits;
+    m._index_bits = indexBits;
+    m._cache_lines_bits = tagBits + indexBits;
+    m._co_pos = coPos;
+    m._index_mask = indexMask ? indexMask : ((1ULL << indexBits) - 1) << tagBits;
+    m._cache_tag_mask = ~m._index_mask & ((1ULL << m._cache_lines_bits) - 1);
+    m._pred_tag_mask = ((1ULL << predBits) - 1) << m._cache_lines_bits;
+    return m;
+}
+
+static NDCAddrMap compile(const LoopMap& m) {
+    NDCAddrMap map;
+    map.init(m._index_mask, m._cache_tag_mask, m._index_bits, m._cache_tag_bits, m._cache_lines_bits, m._co_pos, m._pred_tag_mask);
+    return map;
+}
+
+static void check(const LoopMap& m, uint32_t samples) {
+    NDCAddrMap map = compile(m);
+    for (uint32_t i = 0; i < samples; i++) {
+        Address addr = rand64() >> (rand() % 64);
+        Address a = m.phyAddr2cacheAddr(addr);
+        Address b = map.phyAddr2cacheAddr(addr);
+        if (a != b) {
+            panic("phyAddr2cacheAddr mismatch: index mask 0x%lx, tag bits %d, index bits %d, co_pos %d, addr 0x%lx: loops 0x%lx, map 0x%lx",
+                  m._index_mask, m._cache_tag_bits, m._index_bits, m._co_pos, addr, a, b);
+        }
+        if (m.getSetNum(addr) != map.getSetNum(addr) || m.getSetNum(a) != map.getSetNum(b)) {
+            panic("getSetNum mismatch: index mask 0x%lx, tag bits %d, index bits %d, co_pos %d, addr 0x%lx",
+                  m._index_mask, m._cache_tag_bits, m._index_bits, m._co_pos, addr);
+        }
+    }
+}
+
+static void checkBitGather(uint32_t samples) {
+    for (uint32_t i = 0; i < samples; i++) {
+        uint64_t mask = rand64() & rand64() & (rand64() >> (rand() % 64));
+        BitGather g(mask);
+        uint64_t x = rand64();
+        uint64_t ext = 0, dep = 0;
+        uint32_t pos = 0;
+        for (uint32_t bit = 0; bit < 64; bit++) {
+            if (!(mask & (1ULL << bit))) continue;
+            ext |= ((x >> bit) & 1) << pos;
+            dep |= ((x >> pos) & 1) << bit;
+            pos++;
+        }
+        if (g.extract(x) != ext || g.extractLUT(x) != ext || g.deposit(x) != dep || g.depositLUT(x) != dep) {
+            panic("BitGather mismatch: mask 0x%lx, x 0x%lx", mask, x);
+        }
+    }
+}
+
+static volatile uint64_t sink;  // keeps the timed loops from being optimized away
+
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+template <typename M>
+static double timeTranslations(const M& m, const Address* addrs, uint32_t numAddrs, uint64_t translations) {
+    uint64_t sum = 0;
+    uint64_t start = nowNs();
+    for (uint64_t i = 0; i < translations; i++) {
+        Address a = m.phyAddr2cacheAddr(addrs[i % numAddrs]);
+        sum += a + m.getSetNum(a);
+    }
+    uint64_t ns = nowNs() - start;
+    sink = sum;
+    return 1.0 * ns / translations;
+}
+
+int main(int argc, char* argv[]) {
+    InitLog("[B] ");
+    uint64_t translations = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 20000000;
+#if defined(__BMI2__) && !defined(BIT_GATHER_LUT)
+    info("BitGather: BMI2 PEXT/PDEP");
+#else
+    info("BitGather: lookup tables");
+#endif
+
+    // Random configs: default and scattered index masks, some with bits above the line bits
+    srand(42);
+    checkBitGather(1000000);
+    const uint32_t CONFIGS = 20000;
+    for (uint32_t c = 0; c < CONFIGS; c++) {
+        uint32_t tagBits = rand() % 8;
+        uint32_t indexBits = 1 + rand() % 30;
+        uint32_t linesBits = tagBits + indexBits;
+        uint32_t predBits = rand() % (58 - linesBits);
+        uint32_t coPos = rand() % (linesBits + 1);
+        uint64_t indexMask = 0;
+        if (c % 2) {
+            // indexBits random bits out of the line bits, or occasionally out of the whole word
+            uint32_t range = (c % 10 == 1) ? 64 : linesBits;
+            while ((uint32_t)__builtin_popcountl(indexMask) < indexBits) indexMask |= 1ULL << (rand() % range);
+        }
+        check(makeConfig(tagBits, indexBits, predBits, coPos, indexMask), 200);
+    }
+    info("%d random configs and 1M random BitGather masks match the loops", CONFIGS);
+
+    const uint32_t NUM_ADDRS = 4096;
+    Address* addrs = (Address*)calloc(NUM_ADDRS, sizeof(Address));
+    for (uint32_t i = 0; i < NUM_ADDRS; i++) addrs[i] = rand64() & ((1ULL << 34) - 1);  // 1TB of lines
+
+    struct { const char* name; LoopMap m; } benchConfigs[] = {
+        {"direct-mapped (1 way)", makeConfig(0, 20, 4, 0, 0)},
+        {"4 ways", makeConfig(2, 18, 4, 0, 0)},
+        {"16 ways, co_pos 3", makeConfig(4, 16, 4, 3, 0)},
+        {"4 ways, scattered index", makeConfig(2, 18, 4, 0, 0xff7f7ul)},
+    };
+    info("%ld translations (phyAddr2cacheAddr + getSetNum) per config, ns each", translations);
+    info("config                        loops      map   speedup");
+    for (auto& bc : benchConfigs) {
+        if (__builtin_popcountl(bc.m._index_mask) != bc.m._index_bits) panic("Bad bench config %s", bc.name);
+        NDCAddrMap map = compile(bc.m);
+        check(bc.m, 100000);
+        double loopNs = timeTranslations(bc.m, addrs, NUM_ADDRS, translations);
+        double mapNs = timeTranslations(map, addrs, NUM_ADDRS, translations);
+        info("%-26s %8.2f %8.2f   %5.2fx", bc.name, loopNs, mapNs, loopNs / mapNs);
+    }
+    free(addrs);
+    return 0;
+}
@@ -0,0 +1,474 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nvmain_mem_ctrl.h"
+
+#include <fstream>
+#include <limits>
+#include <string>
+
+#include "bithacks.h"
+#include "contention_sim.h"
+#include "event_recorder.h"
+#include "str.h"
+#include "timing_event.h"
+#include "zsim.h"
+
+#ifdef _WITH_NVMAIN_  // was compiled with nvmain
+#include "NVM/NVMainFactory.h"
+#include "NVM/nvmain.h"
+#include "SimInterface/NullInterface/NullInterface.h"
+#include "include/NVMainRequest.h"
+#include "src/AddressTranslator.h"
+#include "src/Config.h"
+#include "src/EventQueue.h"
+#include "src/Stats.h"
+#include "src/TagGenerator.h"
+
+using namespace std;
+
+// One event covers a whole data_size transfer, issued to NVMain as 64B
+// requests back to back, as in DRAMSim3AccEvent
+class NVMainAccEvent : public TimingEvent {
+   private:
+    NVMainMemory *nvm;
+    bool write;
+    Address addr;        // address of the current request
+    uint32_t remLines;   // requests left, including the current one
+
+   public:
+    uint64_t sCycle;     // start cycle of the current request; it is not issued before
+    NVMainReqNode node;
+
+    NVMainAccEvent(NVMainMemory *_nvm, bool _write, Address _addr, uint32_t _lines, int32_t domain)
+        : TimingEvent(0, 0, domain), nvm(_nvm), write(_write), addr(_addr), remLines(_lines) {
+        assert(remLines > 0);
+        node.ev = this;
+    }
+
+    bool isWrite() const {
+        return write;
+    }
+
+    Address getAddr() const {
+        return addr;
+    }
+
+    // Moves on to the next request; returns false if the transfer is complete
+    bool nextLine() {
+        if (--remLines == 0) return false;
+        addr += 64;
+        return true;
+    }
+
+    void simulate(uint64_t startCycle) {
+        sCycle = startCycle;
+        nvm->enqueue(this, startCycle);
+    }
+};
+
+// Same as DRAMSim3SchedEvent
+class NVMainSchedEvent : public TimingEvent, public GlobAlloc {
+   private:
+    NVMainMemory *const nvm;
+    enum State { IDLE, QUEUED, RUNNING, ANNULLED };
+    State state;
+
+   public:
+    NVMainSchedEvent *next;  // for event freelist
+
+    NVMainSchedEvent(NVMainMemory *_nvm, int32_t domain, bool initial) : TimingEvent(0, 0, domain), nvm(_nvm) {
+        setMinStartCycle(0);
+        next = nullptr;
+        if (initial) {
+            state = QUEUED;
+            zinfo->contentionSim->enqueueSynced(this, 0);
+        } else {
+            setRunning();
+            hold();
+            state = IDLE;
+        }
+    }
+
+    void parentDone(uint64_t startCycle) {
+        panic("This is queued directly");
+    }
+
+    void simulate(uint64_t startCycle) {
+        if (state == QUEUED) {
+            state = RUNNING;
+            requeue(nvm->tick(startCycle));
+            state = QUEUED;
+        } else {
+            assert(state == ANNULLED);
+            state = IDLE;
+            hold();
+            nvm->recycleEvent(this);
+        }
+    }
+
+    void enqueue(uint64_t cycle) {
+        assert(state == IDLE);
+        state = QUEUED;
+        requeue(cycle);
+    }
+
+    void annul() {
+        assert_msg(state == QUEUED, "sched state %d", state);
+        state = ANNULLED;
+    }
+
+    // Use glob mem
+    using GlobAlloc::operator new;
+    using GlobAlloc::operator delete;
+};
+
+// The NVMObject above NVMain: it owns the requests we issue, so NVMain returns them here
+class NVMainFrontend : public NVM::NVMObject {
+   private:
+    NVMainMemory *const nvm;
+
+   public:
+    explicit NVMainFrontend(NVMainMemory *_nvm) : nvm(_nvm) {}
+
+    bool RequestComplete(NVM::NVMainRequest *req) {
+        nvm->requestComplete(req);
+        return true;
+    }
+
+    void Cycle(NVM::ncycle_t steps) {}
+};
+
+// While NVMain has no events, it is still ticked once every this many cycles
+static const uint64_t IDLE_TICK_CYCLES = 4096;
+
+NVMainMemory::NVMainMemory(std::string &ConfigName, std::string &OutputDir,
+                           int cpuFreqMHz, uint32_t _controllerSysLatency, uint32_t _domain, const g_string &_name)
+    : name(_name), controllerSysLatency(_controllerSysLatency), domain(_domain) {
+    curCycle = 0;
+    numInflight = 0;
+    tickEveryCycle = false;
+
+    // NOTE: like DRAMSim3, NVMain allocates on the heap and not the glob_heap, make sure only one process ever handles this
+    nvmainConfig = new NVM::Config();
+    nvmainConfig->Read(ConfigName);
+    // NVMain runs in processor cycles and event-driven; in cycle-driven mode it would need a tick per cycle
+    double memFreqMHz = nvmainConfig->GetEnergy("CLK");
+    if (memFreqMHz > cpuFreqMHz) panic("NVMainMemory[%s]: memory clock (%g MHz) is faster than the processor (%d MHz)", name.c_str(), memFreqMHz, cpuFreqMHz);
+    nvmainConfig->SetValue("CPUFreq", Str(cpuFreqMHz));
+    if (!nvmainConfig->GetBool("EventDriven")) {
+        info("NVMainMemory[%s]: %s is not event-driven, running it event-driven", name.c_str(), ConfigName.c_str());
+        nvmainConfig->SetBool("EventDriven", true);
+    }
+    simInterface = new NVM::NullInterface();
+    nvmainConfig->SetSimInterface(simInterface);
+
+    frontend = new NVMainFrontend(this);
+    eventQueue = new NVM::EventQueue();
+    globalEventQueue = new NVM::GlobalEventQueue();
+    frontend->SetEventQueue(eventQueue);
+    frontend->SetGlobalEventQueue(globalEventQueue);
+    frontend->SetStats(new NVM::Stats());
+    frontend->SetTagGenerator(new NVM::TagGenerator(1000));
+
+    string memType = nvmainConfig->KeyExists("CMemType") ? nvmainConfig->GetString("CMemType") : "NVMain";
+    nvmainPtr = NVM::NVMainFactory::CreateNewNVMain(memType);
+    frontend->AddChild(nvmainPtr);
+    nvmainPtr->SetParent(frontend);
+
+    globalEventQueue->SetFrequency(cpuFreqMHz * 1000000.0);
+    globalEventQueue->AddSystem(nvmainPtr, nvmainConfig);
+    simInterface->SetConfig(nvmainConfig, true);
+    nvmainPtr->SetConfig(nvmainConfig, "defaultMemory", true);
+    cpuClksPerMemClk = cpuFreqMHz / memFreqMHz;
+    statsFile = OutputDir + "/" + name.c_str() + ".nvmain.txt";
+
+    channels = nvmainConfig->GetValue("CHANNELS");
+    pendingRequests = gm_malloc<InList<NVMainReqNode>>(channels);
+    for (uint32_t c = 0; c < channels; c++) new (&pendingRequests[c]) InList<NVMainReqNode>();
+    numPending = 0;
+
+    minRdLatency = controllerSysLatency + (uint32_t)(nvmainConfig->GetValue("tCAS") * cpuClksPerMemClk);
+    minWrLatency = controllerSysLatency;
+    minLatency = minRdLatency;
+
+    eventFreelist = nullptr;
+    nextSchedEvent = new NVMainSchedEvent(this, domain, true);  // start the sim at time 0
+    nextSchedCycle = 0;
+
+    info("NVMainMemory[%s]: %s (%s), %d channels, %g MHz, domain %d, boundLat %d rd / %d wr", name.c_str(),
+         ConfigName.c_str(), memType.c_str(), channels, memFreqMHz, domain, minRdLatency, minWrLatency);
+}
+
+void NVMainMemory::initStats(AggregateStat *parentStat) {
+    AggregateStat *memStats = new AggregateStat();
+    memStats->init(name.c_str(), "Memory controller stats");
+    profReads.init("rd", "Read requests");
+    memStats->append(&profReads);
+    profWrites.init("wr", "Write requests");
+    memStats->append(&profWrites);
+    profTotalRdLat.init("rdlat", "Total latency experienced by read requests");
+    memStats->append(&profTotalRdLat);
+    profTotalWrLat.init("wrlat", "Total latency experienced by write requests");
+    memStats->append(&profTotalWrLat);
+    parentStat->append(memStats);
+}
+
+uint64_t NVMainMemory::access(MemReq &req) {
+    return access(req, 0, 1);
+}
+
+// Same recording as DRAMSim3Memory::access(req, type, data_size)
+uint64_t NVMainMemory::access(MemReq &req, int type, uint32_t data_size) {
+    switch (req.type) {
+        case PUTS:
+        case PUTX:
+            *req.state = I;
+            break;
+        case GETS:
+            *req.state = req.is(MemReq::NOEXCL) ? S : E;
+            break;
+        case GETX:
+            *req.state = M;
+            break;
+
+        default:
+            panic("!?");
+    }
+
+    if (!zinfo->warmup_done)
+        return req.cycle;
+
+    uint64_t respCycle = req.cycle;
+    if ((req.type != PUTS /*discard clean writebacks*/) && zinfo->eventRecorders[req.srcId]) {
+        bool isWrite = (req.type == PUTX);
+        respCycle = req.cycle + max(isWrite ? minWrLatency : minRdLatency, minLatency > data_size ? minLatency - data_size : 0) + data_size;
+        Address addr = req.lineAddr << lineBits;
+        uint32_t lines = MAX(1u, (data_size + 3) / 4);  // 64B requests, 4 data_size units each
+
+        NVMainAccEvent *memEv = new (zinfo->eventRecorders[req.srcId]) NVMainAccEvent(this, isWrite, addr, lines, domain);
+        if (type == 0) {  // default. The only record.
+            TimingRecord tr;
+            if (zinfo->eventRecorders[req.srcId]->hasRecord()) {
+                tr = zinfo->eventRecorders[req.srcId]->popRecord();
+                assert(tr.endEvent);
+                memEv->setMinStartCycle(tr.reqCycle);
+                tr.endEvent->addChild(memEv, zinfo->eventRecorders[req.srcId]);
+                tr.type = req.type;
+                tr.endEvent = memEv;
+            } else {
+                memEv->setMinStartCycle(req.cycle);
+                tr = {addr, req.cycle, respCycle, req.type, memEv, memEv};
+            }
+            assert(!zinfo->eventRecorders[req.srcId]->hasRecord());
+            zinfo->eventRecorders[req.srcId]->pushRecord(tr);
+        } else if (type == 1) {  // append the current event to the end of the previous one
+            TimingRecord tr = zinfo->eventRecorders[req.srcId]->popRecord();
+            memEv->setMinStartCycle(tr.reqCycle);
+            assert(tr.endEvent);
+            tr.endEvent->addChild(memEv, zinfo->eventRecorders[req.srcId]);
+            tr.type = req.type;
+            tr.endEvent = memEv;
+            zinfo->eventRecorders[req.srcId]->pushRecord(tr);
+        } else if (type == 2) {
+            // append the current event to the end of the previous one
+            // but the current event is not on the critical path
+            TimingRecord tr = zinfo->eventRecorders[req.srcId]->popRecord();
+            memEv->setMinStartCycle(tr.reqCycle);
+            assert(tr.endEvent);
+            tr.endEvent->addChild(memEv, zinfo->eventRecorders[req.srcId]);
+            tr.type = req.type;
+            zinfo->eventRecorders[req.srcId]->pushRecord(tr);
+        }
+    }
+
+    return respCycle;
+}
+
+void NVMainMemory::printStats() {
+    nvmainPtr->CalculateStats();
+    std::ofstream out(statsFile.c_str(), std::ofstream::out | std::ofstream::app);
+    frontend->GetStats()->PrintAll(out);
+}
+
+uint32_t NVMainMemory::getChannel(Address addr) const {
+    uint64_t row, col, bank, rank, channel, subarray;
+    nvmainPtr->GetDecoder()->Translate(addr, &row, &col, &bank, &rank, &channel, &subarray);
+    return channel;
+}
+
+bool NVMainMemory::issue(NVMainAccEvent *ev) {
+    NVM::NVMainRequest *nvmReq = new NVM::NVMainRequest();
+    nvmReq->address.SetPhysicalAddress(ev->getAddr());
+    nvmReq->type = ev->isWrite() ? NVM::WRITE : NVM::READ;
+    nvmReq->bulkCmd = NVM::CMD_NOP;
+    nvmReq->status = NVM::MEM_REQUEST_INCOMPLETE;
+    nvmReq->owner = frontend;
+    nvmReq->reqInfo = ev;
+    if (!nvmainPtr->IsIssuable(nvmReq, nullptr)) {
+        delete nvmReq;
+        return false;
+    }
+    nvmainPtr->IssueCommand(nvmReq);
+    numInflight++;
+    ev->hold();
+    return true;
+}
+
+// NVMain's controllers accept requests per channel, in order, so a refused
+// request holds back the later ones of its channel
+void NVMainMemory::issuePending() {
+    for (uint32_t c = 0; c < channels && numPending; c++) {
+        InList<NVMainReqNode> &q = pendingRequests[c];
+        NVMainReqNode *n = q.front();
+        while (n) {
+            NVMainReqNode *next = n->next;
+            if (n->ev->sCycle <= curCycle) {  // the rest of a bulk transfer waits for its start cycle
+                if (!issue(n->ev)) break;
+                q.remove(n);
+                numPending--;
+            }
+            n = next;
+        }
+    }
+}
+
+void NVMainMemory::advance(uint64_t cycle) {
+    // Also runs the events NVMain queued for curCycle after it was simulated (e.g., on issue)
+    if (cycle > curCycle) {
+        globalEventQueue->Cycle(cycle - curCycle);
+        curCycle = cycle;
+    }
+}
+
+uint64_t NVMainMemory::nextEventCycle() const {
+    uint64_t next = globalEventQueue->GetNextEvent();
+    if (next == std::numeric_limits<NVM::ncycle_t>::max()) return next;
+    return MAX(next, curCycle + 1);  // events due now run on the next advance
+}
+
+uint64_t NVMainMemory::tick(uint64_t cycle) {
+    advance(cycle);
+    if (numPending) issuePending();
+
+    // Completions and freed queue slots only happen on NVMain events, so those
+    // are the only cycles to tick, plus the start of bulk transfer requests
+    uint64_t next = MIN(nextEventCycle(), curCycle + IDLE_TICK_CYCLES);
+    for (uint32_t c = 0; c < channels && numPending; c++) {
+        for (NVMainReqNode *n = pendingRequests[c].front(); n; n = n->next) {
+            if (n->ev->sCycle > curCycle) next = MIN(next, n->ev->sCycle);
+        }
+    }
+    nextSchedCycle = tickEveryCycle? curCycle + 1 : next;
+    return nextSchedCycle;
+}
+
+void NVMainMemory::enqueue(NVMainAccEvent *ev, uint64_t cycle) {
+    advance(cycle);
+    InList<NVMainReqNode> &q = pendingRequests[getChannel(ev->getAddr())];
+    if (!q.empty() || !issue(ev)) {
+        q.push_back(&ev->node);
+        numPending++;
+    }
+
+    // Wake up from an idle period
+    uint64_t wakeCycle = MIN(nextEventCycle(), curCycle + 1);
+    if (nextSchedCycle > wakeCycle) {
+        nextSchedEvent->annul();
+        if (eventFreelist) {
+            nextSchedEvent = eventFreelist;
+            eventFreelist = eventFreelist->next;
+            nextSchedEvent->next = nullptr;
+        } else {
+            nextSchedEvent = new NVMainSchedEvent(this, domain, false);
+        }
+        nextSchedEvent->enqueue(wakeCycle);
+        nextSchedCycle = wakeCycle;
+    }
+}
+
+void NVMainMemory::recycleEvent(NVMainSchedEvent *ev) {
+    assert(ev != nextSchedEvent);
+    assert(ev->next == nullptr);
+    ev->next = eventFreelist;
+    eventFreelist = ev;
+}
+
+void NVMainMemory::requestComplete(NVM::NVMainRequest *nvmReq) {
+    NVMainAccEvent *ev = (NVMainAccEvent *)nvmReq->reqInfo;
+    delete nvmReq;
+    numInflight--;
+
+    // NVMain's clock is at the completing event, convert it as its global queue does
+    uint64_t doneCycle = MAX((uint64_t)(eventQueue->GetCurrentCycle() * cpuClksPerMemClk), ev->sCycle);
+    uint32_t lat = doneCycle + 1 - ev->sCycle;
+    minLatency = lat;
+
+    if (ev->isWrite()) {
+        profWrites.inc();
+        profTotalWrLat.inc(lat);
+    } else {
+        profReads.inc();
+        profTotalRdLat.inc(lat);
+    }
+
+    ev->release();
+    if (ev->nextLine()) {
+        // Issue the next request of the transfer when a chained event would have started
+        ev->sCycle = doneCycle + 1;
+        pendingRequests[getChannel(ev->getAddr())].push_back(&ev->node);
+        numPending++;
+    } else {
+        ev->done(doneCycle + 1);
+    }
+}
+
+#else  // no nvmain, have the class fail when constructed
+
+NVMainMemory::NVMainMemory(std::string &ConfigName, std::string &OutputDir,
+                           int cpuFreqMHz, uint32_t _controllerSysLatency, uint32_t _domain, const g_string &_name)
+    : controllerSysLatency(_controllerSysLatency) {
+    panic("Cannot use NVMainMemory, zsim was not compiled with NVMain");
+}
+
+void NVMainMemory::initStats(AggregateStat *parentStat) { panic("???"); }
+uint64_t NVMainMemory::access(MemReq &req) {
+    panic("???");
+    return 0;
+}
+uint64_t NVMainMemory::access(MemReq &req, int type, uint32_t data_size) {
+    panic("???");
+    return 0;
+}
+void NVMainMemory::printStats() { panic("???"); }
+uint64_t NVMainMemory::tick(uint64_t cycle) {
+    panic("???");
+    return 0;
+}
+void NVMainMemory::enqueue(NVMainAccEvent *ev, uint64_t cycle) { panic("???"); }
+void NVMainMemory::recycleEvent(NVMainSchedEvent *ev) { panic("???"); }
+void NVMainMemory::requestComplete(NVM::NVMainRequest *nvmReq) { panic("???"); }
+
+#endif
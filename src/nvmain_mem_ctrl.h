@@ -0,0 +1,129 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NVMAIN_MEM_CTRL_H_
+#define NVMAIN_MEM_CTRL_H_
+
+#include <string>
+
+#include "g_std/g_string.h"
+#include "intrusive_list.h"
+#include "memory_hierarchy.h"
+#include "pad.h"
+#include "stats.h"
+
+namespace NVM {
+class NVMain;
+class NVMainRequest;
+class Config;
+class EventQueue;
+class GlobalEventQueue;
+class SimInterface;
+};  // namespace NVM
+
+class NVMainAccEvent;
+class NVMainSchedEvent;
+class NVMainFrontend;
+
+// Links an NVMainAccEvent into the pending queue of its channel while NVMain does not accept it
+struct NVMainReqNode : InListNode<NVMainReqNode> {
+    NVMainAccEvent *ev;
+};
+
+/* One NVMain memory system (e.g., a PCM or CXL-attached tier), driven from the
+ * weave phase like DRAMSim3Memory. NVMain always runs event-driven, in its own
+ * global event queue clocked at the processor frequency, and is only ticked on
+ * cycles where it has an event (or a request arrives), so idle periods cost
+ * nothing. */
+class NVMainMemory : public MemObject {
+   private:
+    g_string name;
+    const uint32_t controllerSysLatency;
+    uint32_t minLatency;
+    uint32_t minRdLatency;
+    uint32_t minWrLatency;
+    uint32_t domain;
+
+    NVM::Config *nvmainConfig;
+    NVM::SimInterface *simInterface;
+    NVM::NVMain *nvmainPtr;
+    NVMainFrontend *frontend;                 // owns our requests in NVMain and gets their completions
+    NVM::EventQueue *eventQueue;              // NVMain's, in memory cycles
+    NVM::GlobalEventQueue *globalEventQueue;  // in processor cycles
+    double cpuClksPerMemClk;
+    std::string statsFile;
+
+    uint64_t curCycle;  // NVMain has processed all its events up to this processor cycle
+    uint64_t numInflight;
+    bool tickEveryCycle;  // reference mode for nvmainbench, see setTickEveryCycle()
+
+    // NVMain is only ticked on cycles with events; the next tick moves up when a
+    // request arrives before it
+    NVMainSchedEvent *nextSchedEvent;
+    uint64_t nextSchedCycle;
+    NVMainSchedEvent *eventFreelist;
+
+    // R/W stats
+    PAD();
+    Counter profReads;
+    Counter profWrites;
+    Counter profTotalRdLat;
+    Counter profTotalWrLat;
+    PAD();
+
+    // Requests NVMain has not accepted yet, per channel, in arrival order
+    uint32_t channels;
+    InList<NVMainReqNode> *pendingRequests;
+    uint64_t numPending;
+
+   public:
+    NVMainMemory(std::string &ConfigName, std::string &OutputDir,
+                 int cpuFreqMHz, uint32_t _controllerSysLatency, uint32_t _domain, const g_string &_name);
+
+    const char *getName() { return name.c_str(); }
+
+    void initStats(AggregateStat *parentStat);
+
+    // Record accesses
+    uint64_t access(MemReq &req, int type, uint32_t data_size = 4);
+    uint64_t access(MemReq &req);
+    void printStats() override;
+    // Ticks NVMain on every cycle instead of only on its events; completions must not change
+    void setTickEveryCycle(bool every) { tickEveryCycle = every; }
+    // Event-driven simulation (phase 2)
+    uint64_t tick(uint64_t cycle);  // returns the cycle of the next tick
+    void enqueue(NVMainAccEvent *ev, uint64_t cycle);
+    void recycleEvent(NVMainSchedEvent *ev);
+    void requestComplete(NVM::NVMainRequest *nvmReq);  // called by NVMain through frontend
+
+   private:
+    uint32_t getChannel(Address addr) const;
+    bool issue(NVMainAccEvent *ev);  // false if NVMain does not accept it now
+    void issuePending();
+    void advance(uint64_t cycle);    // runs NVMain's events up to cycle
+    uint64_t nextEventCycle() const;  // processor cycle of NVMain's next event
+};
+
+#endif  // NVMAIN_MEM_CTRL_H_
@@ -10,9 +10,9 @@ LinePlacementPolicy::initialize(Config & config)
 }
 
 bool 
-LinePlacementPolicy::handleCacheMiss(Way * current_tad)
+LinePlacementPolicy::handleCacheMiss(bool current_valid)
 {
-	if (!current_tad->valid)
+	if (!current_valid)
 		return true;
 	if (!_enable_replace)
 		return false;
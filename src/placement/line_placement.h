@@ -7,14 +7,13 @@
 using namespace std;
 
 class MemoryController;
-class Way;
 
 class LinePlacementPolicy
 {
 public:
    LinePlacementPolicy() {}; 
    void initialize(Config & config);
-   bool handleCacheMiss(Way * current_tad);
+   bool handleCacheMiss(bool current_valid);
    
 private:
    drand48_data _buffer;
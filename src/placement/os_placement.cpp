@@ -42,9 +42,7 @@ OSPlacementPolicy::remapPages()
       queue.pop();
 
       Set * cache = _cache_scheme->getSets();
-      cache[0].ways[cur_way].valid = true;
-      cache[0].ways[cur_way].tag = top->tag;
-      cache[0].ways[cur_way].dirty = false; 
+      cache[0].fill(cur_way, top->tag, false);
       cur_way ++;
    }
    // Clear all the counters in TLB
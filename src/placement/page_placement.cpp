@@ -1,6 +1,10 @@
 #include "placement/page_placement.h"
 #include <stdlib.h>
 #include <iostream>
+#include "bithacks.h"
+
+// Define DEBUG_PAGE_PLACEMENT to check the FBR chunks against the cache sets
+// on every access (walks every way and the victim heap of the chunk)
 
 void
 PagePlacementPolicy::initialize(Config & config)
@@ -18,9 +22,11 @@ PagePlacementPolicy::initialize(Config & config)
 	} else 
 		_max_count_size = 255;
 
-	_num_entries_per_chunk = 9; //g_num_entries_per_chunk;
+	_num_ways = _cache_scheme->getNumWays();
+	// one candidate entry beyond the ways at 8+ ways
+	_num_entries_per_chunk = MAX(9u, _num_ways + 1); //g_num_entries_per_chunk;
 	//_num_stable_entries = _num_entries_per_chunk / 2;
-	assert(_num_entries_per_chunk > _cache_scheme->getNumWays());
+	assert(_num_entries_per_chunk > _num_ways);
 	for (uint64_t i = 0; i < _num_chunks; i++)
 	{
 		_chunks[i].num_hits = 0;
@@ -32,6 +38,9 @@ PagePlacementPolicy::initialize(Config & config)
 			_chunks[i].entries[j].tag = 0;
 			_chunks[i].entries[j].count = 0;
 		}
+		_chunks[i].victim_heap = (uint32_t *) gm_malloc(sizeof(uint32_t) * _num_ways);
+		_chunks[i].heap_pos = (uint32_t *) gm_malloc(sizeof(uint32_t) * _num_ways);
+		rebuildVictimHeap(&_chunks[i]);
 	}
 	_histogram = (uint64_t *) gm_malloc(sizeof(uint64_t) * _num_entries_per_chunk);
 	for (uint32_t i = 0; i < _num_entries_per_chunk; i++)
@@ -40,11 +49,18 @@ PagePlacementPolicy::initialize(Config & config)
 	clearStats();
 
 	g_string scheme = config.get<const char *>("sys.mem.mcdram.placementPolicy", "LRU");
-	_lru_bits = (uint32_t **) gm_malloc(sizeof(uint32_t *) * _cache_scheme->getNumSets());
-	for (uint64_t i = 0; i < _cache_scheme->getNumSets(); i++) {
-		_lru_bits[i] = (uint32_t *) gm_malloc(sizeof(uint32_t) * _cache_scheme->getNumWays()); 
-		for (uint32_t j = 0; j < _cache_scheme->getNumWays(); j++)
-			_lru_bits[i][j] = j;
+	_lru_links = (LRULink *) gm_malloc(sizeof(LRULink) * _num_chunks * _num_ways);
+	_lru_head = (uint32_t *) gm_malloc(sizeof(uint32_t) * _num_chunks);
+	_lru_tail = (uint32_t *) gm_malloc(sizeof(uint32_t) * _num_chunks);
+	for (uint64_t i = 0; i < _num_chunks; i++) {
+		// way 0 is MRU, way _num_ways - 1 LRU
+		LRULink * links = &_lru_links[i * _num_ways];
+		for (uint32_t j = 0; j < _num_ways; j++) {
+			links[j].prev = (j == 0)? _num_ways : j - 1;
+			links[j].next = j + 1;
+		}
+		_lru_head[i] = 0;
+		_lru_tail[i] = _num_ways - 1;
 	}
 	// hyrbid
 	if (scheme == "LRU")
@@ -76,20 +92,12 @@ PagePlacementPolicy::handleCacheMiss(Address tag, ReqType type, uint64_t set_num
 	  	lrand48_r(&_buffer, &way);
 		if (f < _sample_rate) {
 			//if (_scheme == UnisonCache) {
-				for (uint32_t i = 0; i < _cache_scheme->getNumWays(); i++)
-					if (_lru_bits[set_num][i] == _cache_scheme->getNumWays() - 1) {
-						Address victim_tag = set->ways[i].tag;
-						if (_scheme == BansheeCache) {
-							if (_cache_scheme->getTagBuffer()->canInsert(tag, victim_tag)) {
-								updateLRU(set_num, i);
-								return i;
-							} else 
-								return _cache_scheme->getNumWays();
-						} else { 
-							updateLRU(set_num, i);
-							return i;
-						}
-					}
+				uint32_t victim_way = _lru_tail[set_num];
+				Address victim_tag = set->getTag(victim_way);
+				if (_scheme == BansheeCache && !_cache_scheme->getTagBuffer()->canInsert(tag, victim_tag))
+					return _num_ways;
+				updateLRU(set_num, victim_way);
+				return victim_way;
 			//} else 
 			//	return way % _cache_scheme->getNumWays();
 		} else 
@@ -98,20 +106,8 @@ PagePlacementPolicy::handleCacheMiss(Address tag, ReqType type, uint64_t set_num
 	assert(_placement_policy == FBR);
 	assert(_enable_replace);
 
-#if 1
-	ChunkInfo * chunk = &_chunks[chunk_num];
-	for (uint32_t way = 0; way < _cache_scheme->getNumWays(); way++)
-		if (set->ways[way].valid) {
-			if (set->ways[way].tag != _chunks[chunk_num].entries[way].tag)
-			{
-				for (uint32_t i = 0; i < _num_entries_per_chunk; i++)
-					printf("ID=%d, tag=%ld, valid=%d, count=%d\n", 
-						i, chunk->entries[i].tag, chunk->entries[i].valid, chunk->entries[i].count);
-				for (uint32_t i = 0; i < _cache_scheme->getNumWays(); i++)
-					printf("ID=%d, tag=%ld\n", i, set->ways[i].tag);
-			}
-			assert(set->ways[way].tag == _chunks[chunk_num].entries[way].tag);
-		}
+#ifdef DEBUG_PAGE_PLACEMENT
+	checkChunk(chunk_num, set);
 #endif 
 
 	// for BansheeCache, never replace for store (LLC dirty evict) 
@@ -140,6 +136,8 @@ PagePlacementPolicy::handleCacheMiss(Address tag, ReqType type, uint64_t set_num
 		chunk_entry->count ++;
 		if (chunk_entry->count >= _max_count_size) 
 			handleCounterOverflow(&_chunks[chunk_num], chunk_entry);
+		else if (idx < _num_ways)
+			updateVictimHeap(&_chunks[chunk_num], idx);
 		
 		//idx = adjustEntryOrder(&_chunks[chunk_num], idx);
 		//chunk_entry = &_chunks[chunk_num].entries[idx];
@@ -171,6 +169,7 @@ PagePlacementPolicy::handleCacheMiss(Address tag, ReqType type, uint64_t set_num
 				ChunkEntry tmp = _chunks[chunk_num].entries[idx];
 				_chunks[chunk_num].entries[idx] = _chunks[chunk_num].entries[victim_way];
 				_chunks[chunk_num].entries[victim_way] = tmp;
+				updateVictimHeap(&_chunks[chunk_num], victim_way);
 				//assert(idx >= _cache_scheme->getNumWays() && idx < _num_stable_entries);
 				return victim_way;
 			} 
@@ -185,31 +184,19 @@ PagePlacementPolicy::handleCacheMiss(Address tag, ReqType type, uint64_t set_num
 void 
 PagePlacementPolicy::handleCacheHit(Address tag, ReqType type, uint64_t set_num, Set * set, bool &counter_access, uint32_t hit_way)
 {
-	assert(tag == set->ways[hit_way].tag);
+	assert(tag == set->getTag(hit_way));
 	if (_placement_policy == LRU) {
 		//if (_scheme == UnisonCache)
 			updateLRU(set_num, hit_way);
 		return;
 	}
 	uint64_t chunk_num = set_num;
-	ChunkInfo * chunk = &_chunks[chunk_num];
-#if 1
-	// for DEBUG
+#ifdef DEBUG_PAGE_PLACEMENT
 	// the first few entries in chunk->entries must be in dram cache
-	for (uint32_t way = 0; way < _cache_scheme->getNumWays(); way++)
-		if (set->ways[way].valid) {
-			if (set->ways[way].tag != _chunks[chunk_num].entries[way].tag)
-			{
-				for (uint32_t i = 0; i < _num_entries_per_chunk; i++)
-					printf("ID=%d, tag=%ld, valid=%d, count=%d\n", 
-						i, chunk->entries[i].tag, chunk->entries[i].valid, chunk->entries[i].count);
-				for (uint32_t i = 0; i < _cache_scheme->getNumWays(); i++)
-					printf("ID=%dm tag=%ld\n", i, set->ways[i].tag);
-			}
-			assert(set->ways[way].tag == _chunks[chunk_num].entries[way].tag);
-		}
+	checkChunk(chunk_num, set);
 	// chunk->entries are properly ordered.
-	/*uint32_t min_count = 10000;
+	/*ChunkInfo * chunk = &_chunks[chunk_num];
+	uint32_t min_count = 10000;
 	for (uint32_t way = 0; way < _num_stable_entries; way++)
 		if (chunk->entries[way].valid && chunk->entries[way].count < min_count)
 			min_count = chunk->entries[way].count;
@@ -242,6 +229,8 @@ PagePlacementPolicy::handleCacheHit(Address tag, ReqType type, uint64_t set_num,
 		//assert( idx == adjustEntryOrder(&_chunks[chunk_num], idx ));
 		if (chunk_entry->count >= _max_count_size) 
 			handleCounterOverflow(&_chunks[chunk_num], chunk_entry);
+		else
+			updateVictimHeap(&_chunks[chunk_num], idx);
 	}
 }
 
@@ -339,18 +328,91 @@ PagePlacementPolicy::adjustEntryOrder(ChunkInfo * chunk_info, uint32_t idx)
 uint32_t 
 PagePlacementPolicy::pickVictimWay(ChunkInfo * chunk_info)
 {
-	uint32_t min_count = 10000;
-	uint32_t min_idx = _cache_scheme->getNumWays();
-	for (uint32_t i = 0; i < _cache_scheme->getNumWays(); i++)
-	{
-		assert(chunk_info->entries[i].valid);
-		if (chunk_info->entries[i].count < min_count)
-		{
-			min_count = chunk_info->entries[i].count;
-			min_idx = i;
-		}
+	// the way with the smallest count, the lowest numbered one on ties
+	return chunk_info->victim_heap[0];
+}
+
+bool
+PagePlacementPolicy::heapLess(ChunkInfo * chunk_info, uint32_t way1, uint32_t way2)
+{
+	uint32_t count1 = chunk_info->entries[way1].count;
+	uint32_t count2 = chunk_info->entries[way2].count;
+	return count1 < count2 || (count1 == count2 && way1 < way2);
+}
+
+void
+PagePlacementPolicy::heapSwap(ChunkInfo * chunk_info, uint32_t pos1, uint32_t pos2)
+{
+	uint32_t * heap = chunk_info->victim_heap;
+	uint32_t tmp = heap[pos1];
+	heap[pos1] = heap[pos2];
+	heap[pos2] = tmp;
+	chunk_info->heap_pos[heap[pos1]] = pos1;
+	chunk_info->heap_pos[heap[pos2]] = pos2;
+}
+
+// restores the heap after the count of way changed
+void
+PagePlacementPolicy::updateVictimHeap(ChunkInfo * chunk_info, uint32_t way)
+{
+	uint32_t * heap = chunk_info->victim_heap;
+	uint32_t pos = chunk_info->heap_pos[way];
+	while (pos > 0 && heapLess(chunk_info, way, heap[(pos - 1) / 2])) {
+		heapSwap(chunk_info, pos, (pos - 1) / 2);
+		pos = (pos - 1) / 2;
 	}
-	return min_idx;
+	heapSiftDown(chunk_info, pos);
+}
+
+void
+PagePlacementPolicy::heapSiftDown(ChunkInfo * chunk_info, uint32_t pos)
+{
+	uint32_t * heap = chunk_info->victim_heap;
+	while (true) {
+		uint32_t min_pos = pos;
+		uint32_t child = 2 * pos + 1;
+		if (child < _num_ways && heapLess(chunk_info, heap[child], heap[min_pos]))
+			min_pos = child;
+		if (child + 1 < _num_ways && heapLess(chunk_info, heap[child + 1], heap[min_pos]))
+			min_pos = child + 1;
+		if (min_pos == pos)
+			break;
+		heapSwap(chunk_info, pos, min_pos);
+		pos = min_pos;
+	}
+}
+
+void
+PagePlacementPolicy::rebuildVictimHeap(ChunkInfo * chunk_info)
+{
+	for (uint32_t i = 0; i < _num_ways; i++) {
+		chunk_info->victim_heap[i] = i;
+		chunk_info->heap_pos[i] = i;
+	}
+	for (uint32_t i = _num_ways / 2; i-- > 0; )
+		heapSiftDown(chunk_info, i);
+}
+
+void
+PagePlacementPolicy::checkChunk(uint64_t chunk_num, Set * set)
+{
+	ChunkInfo * chunk = &_chunks[chunk_num];
+	for (uint32_t way = 0; way < _num_ways; way++)
+		if (set->isValid(way)) {
+			if (set->getTag(way) != chunk->entries[way].tag)
+			{
+				for (uint32_t i = 0; i < _num_entries_per_chunk; i++)
+					printf("ID=%d, tag=%ld, valid=%d, count=%d\n", 
+						i, chunk->entries[i].tag, chunk->entries[i].valid, chunk->entries[i].count);
+				for (uint32_t i = 0; i < _num_ways; i++)
+					printf("ID=%d, tag=%ld\n", i, set->getTag(i));
+			}
+			assert(set->getTag(way) == chunk->entries[way].tag);
+		}
+	for (uint32_t pos = 1; pos < _num_ways; pos++)
+		assert(heapLess(chunk, chunk->victim_heap[(pos - 1) / 2], chunk->victim_heap[pos]));
+	for (uint32_t way = 0; way < _num_ways; way++)
+		assert(chunk->victim_heap[chunk->heap_pos[way]] == way);
 }
 
 void 
@@ -363,6 +425,8 @@ PagePlacementPolicy::handleCounterOverflow(ChunkInfo * chunk_info, ChunkEntry *
 		else 
 			chunk_info->entries[i].count /= 2;
 	}
+	// halving can tie counts that were ordered
+	rebuildVictimHeap(chunk_info);
 }
 
 void 
@@ -415,10 +479,19 @@ PagePlacementPolicy::computeFreqDistr()
 void 
 PagePlacementPolicy::updateLRU(uint64_t set_num, uint32_t way_num)
 {
-	for (uint32_t i = 0; i < _cache_scheme->getNumWays(); i++)
-		if (_lru_bits[set_num][i] < _lru_bits[set_num][way_num])
-			_lru_bits[set_num][i] ++;
-	_lru_bits[set_num][way_num] = 0;
+	// move way_num to the head of the list
+	LRULink * links = &_lru_links[set_num * _num_ways];
+	if (_lru_head[set_num] == way_num)
+		return;
+	links[links[way_num].prev].next = links[way_num].next;
+	if (_lru_tail[set_num] == way_num)
+		_lru_tail[set_num] = links[way_num].prev;
+	else
+		links[links[way_num].next].prev = links[way_num].prev;
+	links[way_num].prev = _num_ways;
+	links[way_num].next = _lru_head[set_num];
+	links[_lru_head[set_num]].prev = way_num;
+	_lru_head[set_num] = way_num;
 }
 
 void 
@@ -429,5 +502,6 @@ PagePlacementPolicy::flushChunk(uint32_t set)
 		_chunks[set].entries[i].tag = 0; 
 		_chunks[set].entries[i].count = 0; 
 	}	
+	rebuildVictimHeap(&_chunks[set]);
 }
 
@@ -4,7 +4,6 @@
 #include "cache/cache_utils.h"
 #include "cache/cache_scheme.h"
 
-class Way;
 class Set; 
 class DramCache;
 
@@ -40,6 +39,15 @@ private:
 		ChunkEntry * entries;
 		uint64_t num_hits;
 		uint64_t num_misses;
+		// min-heap of the ways (entries[0, num_ways)) by (count, way), so
+		// victim_heap[0] is the way pickVictimWay would find scanning them
+		uint32_t * victim_heap;
+		uint32_t * heap_pos; // position of each way in victim_heap
+	};
+	struct LRULink
+	{
+		uint32_t prev;
+		uint32_t next;
 	};
 
 	uint32_t getChunkEntry(Address tag, ChunkInfo * chunk_info, bool allocate=true);
@@ -47,6 +55,12 @@ private:
 	bool compareCounter(ChunkEntry * entry1, ChunkEntry * entry2);
 	uint32_t adjustEntryOrder(ChunkInfo * chunk_info, uint32_t idx);
 	uint32_t pickVictimWay(ChunkInfo * chunk_info);
+	bool heapLess(ChunkInfo * chunk_info, uint32_t way1, uint32_t way2);
+	void heapSwap(ChunkInfo * chunk_info, uint32_t pos1, uint32_t pos2);
+	void heapSiftDown(ChunkInfo * chunk_info, uint32_t pos);
+	void updateVictimHeap(ChunkInfo * chunk_info, uint32_t way);
+	void rebuildVictimHeap(ChunkInfo * chunk_info);
+	void checkChunk(uint64_t chunk_num, Set * set);
 	void handleCounterOverflow(ChunkInfo * chunk_info, ChunkEntry * overflow_entry);
 	void computeFreqDistr();
 	void updateLRU(uint64_t set_num, uint32_t way_num);
@@ -55,7 +69,12 @@ private:
 	RepScheme _placement_policy;
 	drand48_data _buffer;
 	Scheme _scheme;	
-	uint32_t ** _lru_bits; // on per set
+	// LRU order of each set as a doubly linked list of its ways, MRU first;
+	// _num_ways terminates the lists
+	LRULink * _lru_links; // _num_ways per set
+	uint32_t * _lru_head;
+	uint32_t * _lru_tail;
+	uint32_t _num_ways;
 
 	uint32_t _granularity;
 	// Frequency Base Replacement
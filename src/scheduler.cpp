@@ -266,7 +266,7 @@ void Scheduler::threadTrampoline(void* arg) {
 }
 
 void Scheduler::startWatchdogThread() {
-    PIN_SpawnInternalThread(threadTrampoline, this, 64*1024, nullptr);
+    SpawnInternalThread(threadTrampoline, this);
 }
 
 
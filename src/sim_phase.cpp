@@ -0,0 +1,140 @@
+/** $glic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ * Copyright (C) 2011 Google Inc.
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* End-of-phase actions, termination checks, and final stats dumps. These only touch global
+ * simulator state, so they are shared by zsim and zreplay.
+ */
+
+#include <unistd.h>
+#include "access_tracing.h"
+#include "contention_sim.h"
+#include "core.h"
+#include "event_queue.h"
+#include "g_std/g_vector.h"
+#include "log.h"
+#include "mem_trace.h"
+#include "profile_stats.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "stats_writer.h"
+#include "zsim.h"
+
+static void CheckForTermination() {
+    assert(zinfo->terminationConditionMet == false);
+    if (zinfo->maxPhases && zinfo->numPhases >= zinfo->maxPhases) {
+        zinfo->terminationConditionMet = true;
+        info("Max phases reached (%ld)", zinfo->numPhases);
+        return;
+    }
+
+    if (zinfo->maxMinInstrs) {
+        uint64_t minInstrs = zinfo->cores[0]->getInstrs();
+        for (uint32_t i = 1; i < zinfo->numCores; i++) {
+            uint64_t coreInstrs = zinfo->cores[i]->getInstrs();
+            if (coreInstrs < minInstrs && coreInstrs > 0) {
+                minInstrs = coreInstrs;
+            }
+        }
+
+        if (minInstrs >= zinfo->maxMinInstrs) {
+            zinfo->terminationConditionMet = true;
+            info("Max min instructions reached (%ld)", minInstrs);
+            return;
+        }
+    }
+
+    if (zinfo->maxTotalInstrs) {
+        uint64_t totalInstrs = 0;
+        for (uint32_t i = 0; i < zinfo->numCores; i++) {
+            totalInstrs += zinfo->cores[i]->getInstrs();
+        }
+
+        if (totalInstrs >= zinfo->maxTotalInstrs) {
+            zinfo->terminationConditionMet = true;
+            info("Max total (aggregate) instructions reached (%ld)", totalInstrs);
+            return;
+        }
+    }
+
+    if (zinfo->maxSimTimeNs) {
+        uint64_t simNs = zinfo->profSimTime->count(PROF_BOUND) + zinfo->profSimTime->count(PROF_WEAVE);
+        if (simNs >= zinfo->maxSimTimeNs) {
+            zinfo->terminationConditionMet = true;
+            info("Max simulation time reached (%ld ns)", simNs);
+            return;
+        }
+    }
+
+    if (zinfo->externalTermPending) {
+        zinfo->terminationConditionMet = true;
+        info("Terminating due to external notification");
+        return;
+    }
+}
+
+/* This is called by the scheduler at the end of a phase. At that point, zinfo->numPhases
+ * has not incremented, so it denotes the END of the current phase
+ */
+void EndOfPhaseActions() {
+    zinfo->profSimTime->transition(PROF_WEAVE);
+    if (zinfo->globalPauseFlag) {
+        info("Simulation entering global pause");
+        zinfo->profSimTime->transition(PROF_FF);
+        while (zinfo->globalPauseFlag) usleep(20*1000);
+        zinfo->profSimTime->transition(PROF_WEAVE);
+        info("Global pause DONE");
+    }
+
+    // Done before tick() to avoid deadlock in most cases when entering synced ffwd (can we still deadlock with sleeping threads?)
+    if (unlikely(zinfo->globalSyncedFFProcs)) {
+        info("Simulation paused due to synced fast-forwarding");
+        zinfo->profSimTime->transition(PROF_FF);
+        while (zinfo->globalSyncedFFProcs) usleep(20*1000);
+        zinfo->profSimTime->transition(PROF_WEAVE);
+        info("Synced fast-forwarding done, resuming simulation");
+    }
+
+    CheckForTermination();
+    zinfo->contentionSim->simulatePhase(zinfo->globPhaseCycles + zinfo->phaseLength);
+    zinfo->eventQueue->tick();
+    zinfo->profSimTime->transition(PROF_BOUND);
+}
+
+void DumpTerminationStats() {
+    info("Dumping termination stats");
+    zinfo->trigger = 20000;
+    for (StatsBackend* backend : *(zinfo->statsBackends)) backend->dump(false /*unbuffered, write out*/);
+    if (zinfo->statsWriter) zinfo->statsWriter->close();  // closes all stats files
+    for (AccessTraceWriter* t : *(zinfo->traceWriters)) t->dump(false);  // flushes trace writer
+    for (MemTraceWriter* t : *(zinfo->memTraceWriters)) t->close();
+
+    // Print DRAMSim3 stats
+    for (MemObject* mem : zinfo->memControllers) {
+        mem->printStats();
+    }
+
+    if (zinfo->sched) zinfo->sched->notifyTermination();
+}
@@ -0,0 +1,89 @@
+#include "stack_distance.h"
+
+#include <string.h>
+#include "bithacks.h"
+#include "log.h"
+
+StackDistance::StackDistance(uint64_t maxKeys, uint64_t initialKeys)
+    : _entries(MIN(initialKeys, maxKeys)), _window(1024), _now(0), _live(0), _max_keys(maxKeys) {
+    assert(_max_keys > 0);
+    // Start with room for twice the expected keys; renumber() grows the window as needed
+    while (_window < 2 * MIN(initialKeys, maxKeys)) _window *= 2;
+    _fenwick = gm_calloc<uint64_t>(_window + 1);
+    _owners = gm_calloc<uint64_t>(_window);
+}
+
+StackDistance::~StackDistance() {
+    gm_free(_fenwick);
+    gm_free(_owners);
+}
+
+uint64_t StackDistance::timeAtDepth(uint64_t d) const {
+    assert(d >= 1 && d <= _live);
+    // Binary search on the tree for the (_live - d + 1)-th oldest timestamp
+    uint64_t k = _live - d + 1;
+    uint64_t pos = 0;
+    for (uint64_t step = _window; step; step >>= 1) {
+        if (pos + step <= _window && _fenwick[pos + step] < k) {
+            pos += step;
+            k -= _fenwick[pos];
+        }
+    }
+    return pos;  // tree index pos + 1 is timestamp pos
+}
+
+StackDistance::Entry* StackDistance::atDepth(uint64_t d) {
+    return _entries.find(_owners[timeAtDepth(d)]);
+}
+
+StackDistance::Entry* StackDistance::touch(uint64_t key, Entry* e) {
+    if (_now == _window) renumber();
+    if (e) {
+        mark(e->time, -1);
+    } else {
+        if (_live == _max_keys) {
+            uint64_t bottom = timeAtDepth(_live);
+            mark(bottom, -1);
+            _entries.erase(_owners[bottom]);
+            _live--;
+        }
+        e = &_entries[key];  // after the erase, which moves entries
+        _live++;
+    }
+    e->time = _now;
+    _owners[_now] = key;
+    mark(_now, 1);
+    _now++;
+    return e;
+}
+
+void StackDistance::renumber() {
+    if (2 * _live > _window) {
+        _window *= 2;
+        uint64_t* owners = gm_calloc<uint64_t>(_window);
+        memcpy(owners, _owners, _now * sizeof(uint64_t));
+        gm_free(_owners);
+        _owners = owners;
+        gm_free(_fenwick);
+        _fenwick = gm_calloc<uint64_t>(_window + 1);
+    }
+
+    // Give live timestamps consecutive numbers, keeping their order
+    uint64_t next = 0;
+    for (uint64_t t = 0; t < _now; t++) {
+        Entry* e = _entries.find(_owners[t]);
+        if (!e || e->time != t) continue;  // evicted, or superseded by a later touch
+        e->time = next;
+        _owners[next++] = _owners[t];
+    }
+    assert(next == _live);
+    _now = _live;
+
+    // Rebuild the tree with timestamps [0, _live) marked, in linear time
+    memset(_fenwick, 0, (_window + 1) * sizeof(uint64_t));
+    for (uint64_t i = 1; i <= _window; i++) {
+        if (i <= _live) _fenwick[i]++;
+        uint64_t parent = i + (i & -i);
+        if (parent <= _window) _fenwick[parent] += _fenwick[i];
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef STACK_DISTANCE_H_
+#define STACK_DISTANCE_H_
+
+#include <stdint.h>
+#include "frame_alloc.h"  // FlatAddrMap
+#include "galloc.h"
+
+/* LRU stack (Mattson et al.) over 64-bit keys, for stack distances and the key
+ * at any depth in O(log n). Each touch gets a timestamp; a Fenwick tree over
+ * timestamps marks the latest one of every key, so the depth of a key is the
+ * number of marks from its timestamp on, and the key at depth d is found by an
+ * order-statistic search. Timestamps are renumbered in place when they run
+ * out, and the window doubles when over half of it is live.
+ *
+ * Each key carries 32 bits of user flags. The stack holds at most maxKeys
+ * keys: inserting one more evicts the least recently used key, whose next
+ * touch then finds no entry, as if it were cold. Stack distances are exact up
+ * to maxKeys, so callers that only care about depths up to some capacity (e.g.,
+ * the largest cache they model) can bound memory by it.
+ * Not thread-safe; callers hold their own lock.
+ */
+class StackDistance : public GlobAlloc {
+   public:
+    struct Entry {
+        uint64_t time;   // latest timestamp, internal
+        uint32_t flags;  // free for the user, 0 on insertion
+    };
+
+   private:
+    FlatAddrMap<Entry> _entries;  // key -> entry
+    uint64_t* _fenwick;  // 1-based Fenwick tree of live timestamps
+    uint64_t* _owners;   // timestamp -> key
+    uint64_t _window;    // timestamps available, a power of 2
+    uint64_t _now;       // next timestamp
+    uint64_t _live;      // keys in the stack, i.e., live timestamps
+    uint64_t _max_keys;
+
+    inline void mark(uint64_t time, int64_t delta) {
+        for (uint64_t i = time + 1; i <= _window; i += i & -i) _fenwick[i] += delta;
+    }
+
+    inline uint64_t countUpTo(uint64_t time) const {  // live timestamps <= time
+        uint64_t sum = 0;
+        for (uint64_t i = time + 1; i > 0; i -= i & -i) sum += _fenwick[i];
+        return sum;
+    }
+
+    uint64_t timeAtDepth(uint64_t d) const;
+    void renumber();
+
+   public:
+    // initialKeys sizes the map and tree, which grow past it up to maxKeys
+    explicit StackDistance(uint64_t maxKeys, uint64_t initialKeys = 1 << 16);
+    ~StackDistance();
+
+    // Entry of key, or nullptr if it was never touched or has been evicted
+    inline Entry* find(uint64_t key) { return _entries.find(key); }
+
+    // Depth of a touched key's entry; 1 is the most recently used
+    inline uint64_t depth(const Entry* e) const { return _live - countUpTo(e->time) + 1; }
+
+    // Entry at depth d, 1 <= d <= size()
+    Entry* atDepth(uint64_t d);
+
+    // Moves key to the top, inserting it if e (its find() result) is nullptr,
+    // and evicting the bottom key if the stack is full. Returns its entry,
+    // valid until the next touch.
+    Entry* touch(uint64_t key, Entry* e);
+
+    uint64_t size() const { return _live; }
+};
+
+#endif  // STACK_DISTANCE_H_
@@ -31,6 +31,8 @@
  * - Counter: A plain single counter.
  * - VectorCounter: A fixed-size vector of logically related counters. Each
  *   vector element may be unnamed or named (useful when enum-indexed vectors).
+ *   ShardedCounter and ShardedVectorCounter keep one padded copy per core,
+ *   for counters that many threads update concurrently.
  * - Histogram: A GEMS-style histogram, intended to profile a distribution.
  *   It has a fixed amount of buckets, and buckets are resized as samples
  *   are added, making profiling increasingly coarser but keeping storage
@@ -78,8 +80,9 @@
 #include <string>
 #include "g_std/g_vector.h"
 #include "log.h"
+#include "pad.h"
 
-enum ZsimStatType :  uint8_t { ZSIM, ZSIM_EV, ZSIM_CMP, ZSIM_OUT, ZSIM_STAT_TYPES, OUT_CFG, ZSIM_POUT};
+enum ZsimStatType :  uint8_t { ZSIM, ZSIM_EV, ZSIM_CMP, ZSIM_OUT, ZSIM_STAT_TYPES, OUT_CFG, ZSIM_POUT, ZSIM_PCOL};
 
 class Stat : public GlobAlloc {
     protected:
@@ -188,6 +191,12 @@ class ScalarStat : public Stat {
         }
 
         virtual uint64_t get() const = 0;
+
+        // Reads the stat without going through get()'s vtable slot when a subclass can (see LambdaStat)
+        typedef uint64_t (*GetThunk)(const ScalarStat*);
+        virtual GetThunk getThunk() const {
+            return [](const ScalarStat* s) { return s->get(); };
+        }
 };
 
 class VectorStat : public Stat {
@@ -200,7 +209,12 @@ class VectorStat : public Stat {
         virtual uint64_t count(uint32_t idx) const = 0;
         virtual uint32_t size() const = 0;
 
-        inline bool hasCounterNames() {
+        typedef uint64_t (*CountThunk)(const VectorStat*, uint32_t);
+        virtual CountThunk countThunk() const {
+            return [](const VectorStat* s, uint32_t idx) { return s->count(idx); };
+        }
+
+        inline bool hasCounterNames() const {
             return (_counterNames != nullptr);
         }
 
@@ -213,6 +227,16 @@ class VectorStat : public Stat {
         }
 };
 
+/* Where the values of a plain counter live, so that compiled snapshots (see
+ * stats_snapshot.h) can copy them directly: value i is the sum over r < reps
+ * of base[r*stride + i]. Only read for objects of exactly the class that
+ * returns it, as subclasses may override get()/count().
+ */
+struct StatLayout {
+    const uint64_t* base;
+    uint32_t stride;  // in counters
+    uint32_t reps;
+};
 
 class Counter : public ScalarStat {
     private:
@@ -249,6 +273,10 @@ class Counter : public ScalarStat {
         inline void set(uint64_t data) {
             _count = data;
         }
+
+        StatLayout layout() const {
+            return {&_count, 0, 1};
+        }
 };
 
 class VectorCounter : public VectorStat {
@@ -298,6 +326,133 @@ class VectorCounter : public VectorStat {
         inline uint32_t size() const {
             return _counters.size();
         }
+
+        StatLayout layout() const {
+            return {&_counters[0], 0, 1};
+        }
+};
+
+/* Sharded counters, for stats updated by many threads concurrently (e.g., the
+ * memory controller's). Each shard (normally one per simulated core, indexed by
+ * the request's srcId) has its own cache line, so increments are plain adds
+ * with no atomics and no false sharing, as long as a shard is only written by
+ * one thread at a time. Reads add up all the shards. Shard ids are masked to
+ * the number of shards, rounded up to a power of 2.
+ */
+class ShardedCounter : public ScalarStat {
+    private:
+        struct Shard {
+            uint64_t count;
+            PAD_SZ(sizeof(uint64_t));
+        };
+        Shard* _shards;
+        uint32_t _mask;
+
+        // A single shard would have every thread update the same line, so
+        // callers must size the counter (see the 3-argument init)
+        void init(const char* name, const char* desc) {
+            panic("ShardedCounter %s initialized without a shard count", name);
+        }
+
+    public:
+        ShardedCounter() : ScalarStat(), _shards(nullptr), _mask(0) {}
+
+        void init(const char* name, const char* desc, uint32_t shards) {
+            initStat(name, desc);
+            assert(shards > 0);
+            uint32_t numShards = 1;
+            while (numShards < shards) numShards <<= 1;
+            _shards = gm_memalign<Shard>(CACHE_LINE_BYTES, numShards);
+            for (uint32_t i = 0; i < numShards; i++) _shards[i].count = 0;
+            _mask = numShards - 1;
+        }
+
+        inline void inc(uint32_t shard, uint64_t delta) {
+            _shards[shard & _mask].count += delta;
+        }
+
+        inline void inc(uint32_t shard) {
+            _shards[shard & _mask].count++;
+        }
+
+        uint64_t get() const {
+            uint64_t res = 0;
+            for (uint32_t i = 0; i <= _mask; i++) res += _shards[i].count;
+            return res;
+        }
+
+        inline uint64_t getShard(uint32_t shard) const {
+            return _shards[shard & _mask].count;
+        }
+
+        // Not atomic with respect to concurrent increments, which may be lost
+        inline void set(uint64_t data) {
+            for (uint32_t i = 1; i <= _mask; i++) _shards[i].count = 0;
+            _shards[0].count = data;
+        }
+
+        StatLayout layout() const {
+            return {&_shards[0].count, sizeof(Shard)/sizeof(uint64_t), _mask + 1};
+        }
+};
+
+class ShardedVectorCounter : public VectorStat {
+    private:
+        uint64_t* _counters;  // one row of _stride counters per shard
+        uint32_t _size;
+        uint32_t _stride;     // _size, rounded up to whole cache lines
+        uint32_t _mask;
+
+        void init(const char* name, const char* desc) {
+            panic("ShardedVectorCounter %s initialized without a size and shard count", name);
+        }
+
+    public:
+        ShardedVectorCounter() : VectorStat(), _counters(nullptr), _size(0), _stride(0), _mask(0) {}
+
+        /* Without counter names */
+        virtual void init(const char* name, const char* desc, uint32_t size, uint32_t shards) {
+            initStat(name, desc);
+            assert(size > 0 && shards > 0);
+            uint32_t numShards = 1;
+            while (numShards < shards) numShards <<= 1;
+            const uint32_t lineCounters = CACHE_LINE_BYTES/sizeof(uint64_t);
+            _size = size;
+            _stride = (size + lineCounters - 1)/lineCounters*lineCounters;
+            _counters = gm_memalign<uint64_t>(CACHE_LINE_BYTES, (size_t)_stride*numShards);
+            for (uint64_t i = 0; i < (uint64_t)_stride*numShards; i++) _counters[i] = 0;
+            _mask = numShards - 1;
+            _counterNames = nullptr;
+        }
+
+        /* With counter names */
+        virtual void init(const char* name, const char* desc, uint32_t size, uint32_t shards, const char** counterNames) {
+            init(name, desc, size, shards);
+            assert(counterNames);
+            _counterNames = gm_dup<const char*>(counterNames, size);
+        }
+
+        inline void inc(uint32_t shard, uint32_t idx, uint64_t value) {
+            _counters[(shard & _mask)*_stride + idx] += value;
+        }
+
+        inline void inc(uint32_t shard, uint32_t idx) {
+            _counters[(shard & _mask)*_stride + idx]++;
+        }
+
+        inline virtual uint64_t count(uint32_t idx) const {
+            uint64_t res = 0;
+            for (uint32_t i = 0; i <= _mask; i++) res += _counters[i*_stride + idx];
+            return res;
+        }
+
+        inline uint32_t size() const {
+            return _size;
+        }
+
+        StatLayout layout() const {
+            return {_counters, _stride, _mask + 1};
+        }
 };
 
 /*
@@ -322,6 +477,11 @@ class ProxyStat : public ScalarStat {
             assert(_statPtr);  // TODO: we may want to make this work only with volatiles...
             return *_statPtr;
         }
+
+        StatLayout layout() const {
+            assert(_statPtr);
+            return {_statPtr, 0, 1};
+        }
 };
 
 
@@ -360,6 +520,9 @@ class LambdaStat : public ScalarStat {
     public:
         explicit LambdaStat(F _f) : f(_f) {} //copy the lambda
         uint64_t get() const {return f();}
+        GetThunk getThunk() const {
+            return [](const ScalarStat* s) { return static_cast<const LambdaStat<F>*>(s)->f(); };
+        }
 };
 
 template<typename F>
@@ -375,6 +538,9 @@ class LambdaVectorStat : public VectorStat {
             assert(idx < s);
             return f(idx);
         }
+        CountThunk countThunk() const {
+            return [](const VectorStat* vs, uint32_t idx) { return static_cast<const LambdaVectorStat<F>*>(vs)->f(idx); };
+        }
 };
 
 // Convenience creation functions
@@ -386,6 +552,8 @@ LambdaVectorStat<F>* makeLambdaVectorStat(F f, uint32_t size) { return new Lambd
 
 //Stat Backends declarations.
 
+class StatsWriter;  // see stats_writer.h
+
 class StatsBackend : public GlobAlloc {
     public:
         StatsBackend() {}
@@ -401,7 +569,8 @@ class TextBackend : public StatsBackend {
         TextBackendImpl* backend;
 
     public:
-        TextBackend(const char* filename, AggregateStat* rootStat);
+        // With a writer, dumps only take a snapshot, and the writer thread formats and writes it
+        TextBackend(const char* filename, AggregateStat* rootStat, StatsWriter* writer = nullptr);
         virtual void dump(bool buffered);
 };
 
@@ -413,7 +582,20 @@ class HDF5Backend : public StatsBackend {
         HDF5BackendImpl* backend;
 
     public:
-        HDF5Backend(const char* filename, AggregateStat* rootStat, size_t bytesPerWrite, bool skipVectors, bool sumRegularAggregates);
+        HDF5Backend(const char* filename, AggregateStat* rootStat, size_t bytesPerWrite, bool skipVectors, bool sumRegularAggregates, StatsWriter* writer = nullptr);
+        virtual void dump(bool buffered);
+};
+
+
+class ColumnarBackendImpl;
+
+class ColumnarBackend : public StatsBackend {
+    private:
+        ColumnarBackendImpl* backend;
+
+    public:
+        // Writes blocks of blockRows dumps, zstd-compressed if compress is set (and zsim is built with zstd); see columnar_stats.h
+        ColumnarBackend(const char* filename, AggregateStat* rootStat, uint32_t blockRows, bool compress, StatsWriter* writer = nullptr);
         virtual void dump(bool buffered);
 };
 
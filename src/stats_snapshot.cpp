@@ -0,0 +1,142 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stats_snapshot.h"
+#include <typeinfo>
+#include "log.h"
+
+StatsSnapshot::StatsSnapshot(AggregateStat* rootStat, bool _skipVectors, bool _sumRegularAggregates)
+    : skipVectors(_skipVectors), sumRegularAggregates(_sumRegularAggregates)
+{
+    recordSize = compile(rootStat, 0, false);
+}
+
+void StatsSnapshot::compileMem(const StatLayout& l, uint32_t len, uint32_t dst, bool add) {
+    assert(l.base && l.reps);
+    Read r;
+    r.kind = Read::MEM;
+    r.add = add;
+    r.dst = dst;
+    r.len = len;
+    r.stride = l.stride;
+    r.reps = l.reps;
+    r.base = l.base;
+    r.get = nullptr;
+    reads.push_back(r);
+}
+
+// Returns the number of counters s takes in the record. Must follow the order of HDF5BackendImpl::getH5Type and TextBackendImpl.
+uint32_t StatsSnapshot::compile(Stat* s, uint32_t dst, bool add) {
+    if (skipVectors && dynamic_cast<VectorStat*>(s)) return 0;
+
+    if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+        uint32_t sz = 0;
+        if (as->isRegular() && sumRegularAggregates && as->size()) {
+            // Every child adds its record over the first one's
+            sz = compile(as->get(0), dst, add);
+            for (uint32_t i = 1; i < as->size(); i++) {
+                uint32_t childSz = compile(as->get(i), dst, true);
+                if (childSz != sz) {
+                    panic("In regular aggregate %s, child %d has %d counters, first child has %d. Doesn't look regular to me!", s->name(), i, childSz, sz);
+                }
+            }
+        } else {
+            for (uint32_t i = 0; i < as->size(); i++) {
+                sz += compile(as->get(i), dst + sz, add);
+            }
+        }
+        return sz;
+    } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
+        const std::type_info& type = typeid(*ss);
+        if (type == typeid(Counter)) {
+            compileMem(static_cast<Counter*>(ss)->layout(), 1, dst, add);
+        } else if (type == typeid(ShardedCounter)) {
+            compileMem(static_cast<ShardedCounter*>(ss)->layout(), 1, dst, add);
+        } else if (type == typeid(ProxyStat)) {
+            compileMem(static_cast<ProxyStat*>(ss)->layout(), 1, dst, add);
+        } else {
+            Read r;
+            r.kind = Read::SCALAR;
+            r.add = add;
+            r.dst = dst;
+            r.len = 1;
+            r.stride = 0;
+            r.reps = 1;
+            r.ss = ss;
+            r.get = ss->getThunk();
+            reads.push_back(r);
+        }
+        return 1;
+    } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+        const std::type_info& type = typeid(*vs);
+        if (type == typeid(VectorCounter)) {
+            compileMem(static_cast<VectorCounter*>(vs)->layout(), vs->size(), dst, add);
+        } else if (type == typeid(ShardedVectorCounter)) {
+            compileMem(static_cast<ShardedVectorCounter*>(vs)->layout(), vs->size(), dst, add);
+        } else {
+            Read r;
+            r.kind = Read::VECTOR;
+            r.add = add;
+            r.dst = dst;
+            r.len = vs->size();
+            r.stride = 0;
+            r.reps = 1;
+            r.vs = vs;
+            r.count = vs->countThunk();
+            reads.push_back(r);
+        }
+        return vs->size();
+    } else {
+        panic("Unrecognized stat type");
+    }
+}
+
+void StatsSnapshot::read(uint64_t* record) const {
+    for (const Read& r : reads) {
+        uint64_t* d = record + r.dst;
+        switch (r.kind) {
+            case Read::MEM:
+                {
+                    const uint64_t* b = r.base;
+                    uint32_t rep = 0;
+                    if (!r.add) {
+                        for (uint32_t i = 0; i < r.len; i++) d[i] = b[i];
+                        b += r.stride;
+                        rep++;
+                    }
+                    for (; rep < r.reps; rep++, b += r.stride) {
+                        for (uint32_t i = 0; i < r.len; i++) d[i] += b[i];
+                    }
+                }
+                break;
+            case Read::SCALAR:
+                d[0] = (r.add? d[0] : 0) + r.get(r.ss);
+                break;
+            case Read::VECTOR:
+                for (uint32_t i = 0; i < r.len; i++) d[i] = (r.add? d[i] : 0) + r.count(r.vs, i);
+                break;
+        }
+    }
+}
@@ -0,0 +1,80 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_SNAPSHOT_H_
+#define STATS_SNAPSHOT_H_
+
+#include "g_std/g_vector.h"
+#include "stats.h"
+
+/* A stats tree compiled into a flat list of reads, so that taking a record
+ * (the inorder values of all scalars and vectors) is a tight copy loop, with
+ * no tree walk and no dynamic_casts. Plain counters are copied straight from
+ * memory (summing their shards); other stats are read through their thunks.
+ * Regular aggregates can be summed into their first child's record, and
+ * vectors skipped, as the HDF5 backend does.
+ *
+ * The tree must be immutable.
+ */
+class StatsSnapshot : public GlobAlloc {
+    private:
+        struct Read {
+            enum Kind : uint8_t {MEM, SCALAR, VECTOR};
+            Kind kind;
+            bool add;  // accumulate into the record (2nd and later children of a summed regular aggregate)
+            uint32_t dst;
+            uint32_t len;
+            uint32_t stride;
+            uint32_t reps;
+            union {
+                const uint64_t* base;
+                const ScalarStat* ss;
+                const VectorStat* vs;
+            };
+            union {
+                ScalarStat::GetThunk get;
+                VectorStat::CountThunk count;
+            };
+        };
+
+        g_vector<Read> reads;
+        uint32_t recordSize;  // in counters
+        bool skipVectors;
+        bool sumRegularAggregates;
+
+        uint32_t compile(Stat* s, uint32_t dst, bool add);
+        void compileMem(const StatLayout& l, uint32_t len, uint32_t dst, bool add);
+
+    public:
+        StatsSnapshot(AggregateStat* rootStat, bool _skipVectors, bool _sumRegularAggregates);
+
+        uint32_t size() const { return recordSize; }
+        uint32_t numReads() const { return reads.size(); }
+
+        // Writes size() counters to record
+        void read(uint64_t* record) const;
+};
+
+#endif  // STATS_SNAPSHOT_H_
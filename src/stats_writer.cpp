@@ -0,0 +1,124 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stats_writer.h"
+#include <algorithm>
+#include <sched.h>
+#include <unistd.h>
+#include "log.h"
+#include "profile_stats.h"
+#include "zsim.h"
+
+StatsWriter::StatsWriter(uint32_t flushMs, uint32_t queueSize) {
+    assert(flushMs > 0);
+    numSlots = 1;
+    while (numSlots < queueSize) numSlots <<= 1;
+    slots = gm_calloc<Slot>(numSlots);
+    for (uint32_t i = 0; i < numSlots; i++) slots[i].seq = i;
+    enqPos = 0;
+    deqPos = 0;
+    written = 0;
+    futex_init(&wakeLock);
+    futex_lock(&wakeLock);  // starts locked, so the writer sleeps until the first job
+    flushNs = flushMs*1000000ul;
+    closed = false;
+    SpawnInternalThread(writerThread, this);
+}
+
+uint64_t StatsWriter::enqueue(Sink* sink, const uint64_t* records, uint32_t numRecords, lock_t* doneSem) {
+    assert(!closed || !sink);
+    uint64_t ticket = __sync_fetch_and_add(&enqPos, 1);
+    Slot& s = slots[ticket & (numSlots - 1)];
+    while (s.seq != ticket) sched_yield();  // queue full; backends have one job in flight each, so this is rare
+    s.sink = sink;
+    s.records = records;
+    s.numRecords = numRecords;
+    s.doneSem = doneSem;
+    __sync_synchronize();
+    s.seq = ticket + 1;
+    futex_unlock(&wakeLock);
+    return ticket;
+}
+
+void StatsWriter::wait(uint64_t ticket) {
+    while (written <= ticket) usleep(100);
+}
+
+void StatsWriter::close() {
+    if (closed) return;
+    closed = true;
+    wait(enqueue(nullptr, nullptr, 0, nullptr));
+}
+
+void StatsWriter::writerThread(void* arg) {
+    static_cast<StatsWriter*>(arg)->writerLoop();
+}
+
+void StatsWriter::flushSinks() {
+    for (Sink* sink : sinks) {
+        if (sink->needsFlush) {
+            sink->flush();
+            sink->needsFlush = false;
+        }
+    }
+}
+
+void StatsWriter::writerLoop() {
+    info("Started stats writer thread");
+    uint64_t lastFlushNs = getNs();
+    while (true) {
+        Slot& s = slots[deqPos & (numSlots - 1)];
+        if (s.seq == deqPos + 1) {
+            Sink* sink = s.sink;
+            if (sink) {
+                sink->write(s.records, s.numRecords);
+                if (!sink->needsFlush) {
+                    sink->needsFlush = true;
+                    if (std::find(sinks.begin(), sinks.end(), sink) == sinks.end()) sinks.push_back(sink);
+                }
+            } else {
+                flushSinks();
+                for (Sink* sk : sinks) sk->close();
+            }
+            lock_t* doneSem = s.doneSem;
+            s.seq = deqPos + numSlots;
+            deqPos++;
+            __sync_synchronize();
+            written = deqPos;
+            if (doneSem) futex_unlock(doneSem);
+            if (!sink) break;
+            continue;
+        }
+
+        // Idle: flush if due, then sleep until a job arrives or the next flush
+        uint64_t curNs = getNs();
+        if (curNs - lastFlushNs >= flushNs) {
+            flushSinks();
+            lastFlushNs = curNs;
+        }
+        futex_trylock_nospin_timeout(&wakeLock, flushNs - (curNs - lastFlushNs));
+    }
+    info("Finished stats writer thread");
+}
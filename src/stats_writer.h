@@ -0,0 +1,103 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_WRITER_H_
+#define STATS_WRITER_H_
+
+#include <stdint.h>
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "locks.h"
+#include "pad.h"
+
+/* Background writer for stats backends. Backends take their snapshot records
+ * into a gm buffer and hand it off through a lock-free queue; the writer
+ * thread formats and writes them out, so the thread that dumps (normally the
+ * one ending the phase) only pays for the snapshot copy. Sinks keep their
+ * files open, and the writer flushes the ones it has written to every
+ * flushMs, so files can still be read mid-run.
+ *
+ * Records live in shared memory, so any process can enqueue, but files are
+ * only written by the process that built the writer (the one running
+ * SimInit, which outlives all others), from its writer thread.
+ */
+class StatsWriter : public GlobAlloc {
+    public:
+        // Output side of a backend. All calls run on the writer thread.
+        class Sink {
+            public:
+                bool needsFlush;
+
+                Sink() : needsFlush(false) {}
+                virtual ~Sink() {}
+                virtual void write(const uint64_t* records, uint32_t numRecords) = 0;
+                virtual void flush() = 0;
+                virtual void close() = 0;
+        };
+
+    private:
+        // Bounded MPSC ring: slot i is free for ticket t when seq == t, and holds job t when seq == t + 1
+        struct Slot {
+            volatile uint64_t seq;
+            Sink* sink;  // nullptr closes the writer
+            const uint64_t* records;
+            uint32_t numRecords;
+            lock_t* doneSem;  // unlocked once written, may be nullptr
+        };
+
+        Slot* slots;
+        uint32_t numSlots;
+        PAD();
+        volatile uint64_t enqPos;
+        PAD();
+        uint64_t deqPos;      // only touched by the writer thread
+        volatile uint64_t written;  // jobs with tickets below this are done
+        PAD();
+
+        lock_t wakeLock;      // released by producers, the writer sleeps on it
+        uint64_t flushNs;
+        g_vector<Sink*> sinks;  // every sink written to, for flushes and close()
+        bool closed;
+
+        static void writerThread(void* arg);
+        void writerLoop();
+        void flushSinks();
+
+    public:
+        explicit StatsWriter(uint32_t flushMs, uint32_t queueSize = 64);
+
+        /* Queues numRecords records for sink, and returns the job's ticket.
+         * records must stay untouched until doneSem is released (if given)
+         * or wait() on the ticket returns. */
+        uint64_t enqueue(Sink* sink, const uint64_t* records, uint32_t numRecords, lock_t* doneSem);
+
+        // Blocks until the job with this ticket has been written
+        void wait(uint64_t ticket);
+
+        // Writes all queued jobs, then flushes and closes every sink; no jobs can be queued afterwards
+        void close();
+};
+
+#endif  // STATS_WRITER_H_
@@ -0,0 +1,474 @@
+/* Checks compiled stats snapshots (StatsSnapshot) against the recursive tree
+ * walks the HDF5 and text backends used before, on a stats tree shaped like a
+ * 64-core system, and measures the cost of a dump with each. Then measures
+ * what dumps cost the dumping thread with and without a StatsWriter, and
+ * checks that both write the same files.
+ *
+ * Usage: statsbench [<dumps per config>] */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "galloc.h"
+#define _STR(x) #x
+#define STR(x) _STR(x)
+#ifdef HDF5INCPREFIX
+#include STR(HDF5INCPREFIX/hdf5.h)
+#else
+#include <hdf5.h>
+#endif
+#undef STR
+#undef _STR
+#include "columnar_stats.h"
+#include "log.h"
+#include "stats.h"
+#include "stats_snapshot.h"
+#include "stats_writer.h"
+
+// The writer thread; as in mcsim, internal threads are pthreads
+void SpawnInternalThread(void (*fn)(void*), void* arg, uint32_t stackSize) {
+    struct Trampoline {
+        static void* run(void* p) {
+            std::pair<void (*)(void*), void*>* t = static_cast<std::pair<void (*)(void*), void*>*>(p);
+            t->first(t->second);
+            delete t;
+            return nullptr;
+        }
+    };
+    pthread_t thread;
+    pthread_create(&thread, nullptr, Trampoline::run, new std::pair<void (*)(void*), void*>(fn, arg));
+    pthread_detach(thread);
+}
+
+// A VectorCounter whose count() differs from its storage, like CycleBreakdownStat
+class OffsetVectorCounter : public VectorCounter {
+    public:
+        uint64_t count(uint32_t idx) const { return VectorCounter::count(idx) + idx; }
+};
+
+// The former HDF5BackendImpl::dumpWalk
+struct WalkDumper {
+    bool skipVectors;
+    bool sumRegularAggregates;
+    uint64_t* curPtr;
+
+    void dumpWalk(Stat* s) {
+        if (skipVectors && dynamic_cast<VectorStat*>(s)) return;
+        if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+            if (as->isRegular() && sumRegularAggregates) {
+                uint64_t* startPtr = curPtr;
+                dumpWalk(as->get(0));
+                uint64_t* tmpPtr = curPtr;
+                uint32_t sz = tmpPtr - startPtr;
+                for (uint32_t i = 1; i < as->size(); i++) {
+                    dumpWalk(as->get(i));
+                    assert(curPtr == tmpPtr + sz);
+                    for (uint32_t j = 0; j < sz; j++) startPtr[j] += tmpPtr[j];
+                    curPtr = tmpPtr;
+                }
+            } else {
+                for (uint32_t i = 0; i < as->size(); i++) dumpWalk(as->get(i));
+            }
+        } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
+            *(curPtr++) = ss->get();
+        } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+            for (uint32_t i = 0; i < vs->size(); i++) *(curPtr++) = vs->count(i);
+        } else {
+            panic("Unrecognized stat type");
+        }
+    }
+};
+
+// The former TextBackendImpl::dumpStat
+static void dumpStat(Stat* s, uint32_t level, std::ostream* out) {
+    for (uint32_t i = 0; i < level; i++) *out << " ";
+    *out << s->name() << ": ";
+    if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+        *out << "# " << as->desc() << std::endl;
+        for (uint32_t i = 0; i < as->size(); i++) dumpStat(as->get(i), level+1, out);
+    } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
+        *out << ss->get() << " # " << ss->desc() << std::endl;
+    } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+        *out << "# " << vs->desc() << std::endl;
+        for (uint32_t i = 0; i < vs->size(); i++) {
+            for (uint32_t j = 0; j < level+1; j++) *out << " ";
+            if (vs->hasCounterNames()) {
+                *out << vs->counterName(i) << ": " << vs->count(i) << std::endl;
+            } else {
+                *out << i << ": " << vs->count(i) << std::endl;
+            }
+        }
+    } else {
+        panic("Unrecognized stat type");
+    }
+}
+
+static const char* name(const char* prefix, uint32_t i) {
+    std::stringstream ss;
+    ss << prefix << "-" << i;
+    return gm_strdup(ss.str().c_str());
+}
+
+static std::vector<Counter*> allCounters;
+
+static Counter* counter(AggregateStat* parent, const char* name) {
+    Counter* c = new Counter();
+    c->init(name, "Counter");
+    c->inc(rand() % 100000);
+    parent->append(c);
+    allCounters.push_back(c);
+    return c;
+}
+
+// Advances the counters as a phase would: most move a little, many not at all
+static void advance() {
+    for (Counter* c : allCounters) {
+        if (rand() % 4) c->inc(rand() % 2000);
+    }
+}
+
+static uint64_t proxyValues[16];
+
+/* Roughly the stats of a 64-core OOO system: cores, private L1s/L2s, a banked
+ * L3, sharded memory controller stats, and weave domain profiling. */
+static AggregateStat* makeTree(uint32_t cores) {
+    AggregateStat* root = new AggregateStat();
+    root->init("root", "Stats");
+
+    AggregateStat* coreStats = new AggregateStat(true);
+    coreStats->init("core", "Core stats");
+    for (uint32_t c = 0; c < cores; c++) {
+        AggregateStat* cs = new AggregateStat();
+        cs->init(name("core", c), "Core stats");
+        Counter* cycles = counter(cs, "cycles");
+        auto cCycles = [cycles]() { return cycles->get() / 3; };
+        LambdaStat<decltype(cCycles)>* cCyclesStat = makeLambdaStat(cCycles);
+        cCyclesStat->init("cCycles", "Cycles due to contention stalls");
+        cs->append(cCyclesStat);
+        const char* names[] = {"instrs", "uops", "bbls", "approxInstrs", "mispredBranches", "condBranches",
+                               "fetchStalls", "decodeStalls", "issueStalls", "robStalls"};
+        for (const char* n : names) counter(cs, n);
+        OffsetVectorCounter* stalls = new OffsetVectorCounter();
+        stalls->init("stallBreakdown", "Stall cycles per cause", 8);
+        for (uint32_t i = 0; i < 8; i++) stalls->inc(i, rand() % 1000);
+        cs->append(stalls);
+        coreStats->append(cs);
+    }
+    root->append(coreStats);
+
+    const char* cacheCounters[] = {"hGETS", "hGETX", "fhGETS", "fhGETX", "mGETS", "mGETXIM", "mGETXSM",
+                                   "PUTS", "PUTX", "INV", "INVX", "FWD", "latGETnl", "latGETnet"};
+    const char* levels[] = {"l1i", "l1d", "l2", "l3"};
+    for (const char* level : levels) {
+        uint32_t banks = (level[1] == '3') ? cores / 4 : cores;
+        AggregateStat* cacheStats = new AggregateStat(true);
+        cacheStats->init(level, "Cache stats");
+        for (uint32_t b = 0; b < banks; b++) {
+            AggregateStat* bs = new AggregateStat();
+            bs->init(name(level, b), "Cache bank stats");
+            for (const char* n : cacheCounters) counter(bs, n);
+            VectorCounter* lat = new VectorCounter();
+            lat->init("latHist", "Latency histogram", 32);
+            for (uint32_t i = 0; i < 32; i++) lat->inc(i, rand() % 1000);
+            bs->append(lat);
+            cacheStats->append(bs);
+        }
+        root->append(cacheStats);
+    }
+
+    AggregateStat* memStats = new AggregateStat(true);
+    memStats->init("mem", "Memory controller stats");
+    for (uint32_t m = 0; m < 4; m++) {
+        AggregateStat* ms = new AggregateStat();
+        ms->init(name("mem", m), "Memory controller stats");
+        const char* names[] = {"rd", "wr", "rdlat", "wrlat", "hits", "misses"};
+        for (const char* n : names) {
+            ShardedCounter* sc = new ShardedCounter();
+            sc->init(n, "Sharded counter", cores);
+            for (uint32_t i = 0; i < cores; i++) sc->inc(i, rand() % 1000);
+            ms->append(sc);
+        }
+        const char* bucketNames[] = {"b0", "b1", "b2", "b3", "b4", "b5", "b6", "b7", "b8", "b9", "b10", "b11"};
+        ShardedVectorCounter* svc = new ShardedVectorCounter();
+        svc->init("latBuckets", "Sharded vector counter", 12, cores, bucketNames);
+        for (uint32_t i = 0; i < cores; i++) svc->inc(i, rand() % 12, rand() % 1000);
+        ms->append(svc);
+        memStats->append(ms);
+    }
+    root->append(memStats);
+
+    AggregateStat* sched = new AggregateStat();
+    sched->init("sched", "Scheduler stats");
+    for (uint32_t i = 0; i < 16; i++) {
+        proxyValues[i] = rand();
+        ProxyStat* ps = new ProxyStat();
+        ps->init(name("proxy", i), "Proxy stat", &proxyValues[i]);
+        sched->append(ps);
+    }
+    auto domTime = [](uint32_t d) { return (uint64_t)d * 1000 + 7; };
+    LambdaVectorStat<decltype(domTime)>* domStat = makeLambdaVectorStat(domTime, 16);
+    domStat->init("domTime", "Time per weave domain");
+    sched->append(domStat);
+    root->append(sched);
+
+    root->makeImmutable();
+    return root;
+}
+
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+static std::string readFile(const char* filename) {
+    std::ifstream in(filename);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+// The records of an HDF5 stats file (the file itself also depends on how often it was reopened)
+static std::string readH5Records(const char* filename) {
+    hid_t fileID = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+    hid_t dset = H5Dopen2(fileID, "stats", H5P_DEFAULT);
+    hid_t type = H5Dget_type(dset);
+    hid_t space = H5Dget_space(dset);
+    std::string res(H5Sget_simple_extent_npoints(space) * H5Tget_size(type), '\0');
+    H5Dread(dset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, &res[0]);
+    H5Sclose(space);
+    H5Tclose(type);
+    H5Dclose(dset);
+    H5Fclose(fileID);
+    return res;
+}
+
+static uint64_t threadCpuNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+// Dumps as the simulator does (buffered periodic dumps, then a final unbuffered one).
+// Returns the average CPU time each dump takes the dumping thread, in us.
+static double timeDumps(StatsBackend* backend, uint32_t dumps) {
+    uint64_t start = threadCpuNs();
+    for (uint32_t d = 0; d < dumps; d++) backend->dump(d != dumps - 1);
+    return 1.0 * (threadCpuNs() - start) / dumps / 1000;
+}
+
+static uint64_t fileSize(const char* filename) {
+    struct stat st;
+    if (stat(filename, &st) != 0) panic("Could not stat %s", filename);
+    return st.st_size;
+}
+
+static uint32_t walkSize(Stat* root, bool skipVectors) {
+    uint64_t* buf = gm_calloc<uint64_t>(1 << 20);
+    WalkDumper w = {skipVectors, false, buf};
+    w.dumpWalk(root);
+    uint32_t sz = w.curPtr - buf;
+    gm_free(buf);
+    return sz;
+}
+
+int main(int argc, char* argv[]) {
+    InitLog("[B] ");
+    gm_init(1ul << 28);
+    uint32_t dumps = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 20000;
+    srand(42);
+    const uint32_t CORES = 64;
+    AggregateStat* root = makeTree(CORES);
+
+    info("config                 counters  reads   walk ns  snapshot ns  speedup");
+    for (uint32_t cfg = 0; cfg < 4; cfg++) {
+        bool skipVectors = cfg & 1;
+        bool sumRegular = cfg & 2;
+        StatsSnapshot snapshot(root, skipVectors, sumRegular);
+        uint32_t fullSize = walkSize(root, skipVectors);  // the walk bleeds past the record when summing
+        uint64_t* walkRec = gm_calloc<uint64_t>(fullSize);
+        uint64_t* snapRec = gm_calloc<uint64_t>(snapshot.size());
+
+        WalkDumper w = {skipVectors, sumRegular, walkRec};
+        w.dumpWalk(root);
+        if ((uint32_t)(w.curPtr - walkRec) != snapshot.size()) panic("Record size mismatch: walk %ld, snapshot %d", w.curPtr - walkRec, snapshot.size());
+        snapshot.read(snapRec);
+        for (uint32_t i = 0; i < snapshot.size(); i++) {
+            if (walkRec[i] != snapRec[i]) panic("Mismatch at counter %d: walk %ld, snapshot %ld", i, walkRec[i], snapRec[i]);
+        }
+
+        uint64_t start = nowNs();
+        for (uint32_t d = 0; d < dumps; d++) {
+            w.curPtr = walkRec;
+            w.dumpWalk(root);
+        }
+        double walkNs = 1.0 * (nowNs() - start) / dumps;
+        start = nowNs();
+        for (uint32_t d = 0; d < dumps; d++) snapshot.read(snapRec);
+        double snapNs = 1.0 * (nowNs() - start) / dumps;
+        info("skipVectors=%d sum=%d %9d %6d %9.0f %12.0f %7.2fx", skipVectors, sumRegular,
+             snapshot.size(), snapshot.numReads(), walkNs, snapNs, walkNs / snapNs);
+        gm_free(walkRec);
+        gm_free(snapRec);
+    }
+
+    // Text: same output as the old walk, and dump cost
+    const char* textFile = "statsbench.txt";
+    TextBackend* text = new TextBackend(textFile, root);
+    text->dump(false);
+    std::stringstream ref;
+    ref << "# zsim stats" << std::endl << "===" << std::endl;
+    dumpStat(root, 0, &ref);
+    ref << "===" << std::endl;
+    std::ifstream in(textFile);
+    std::stringstream got;
+    got << in.rdbuf();
+    if (got.str() != ref.str()) panic("Text backend output differs from the tree walk");
+    remove(textFile);
+
+    uint32_t textDumps = dumps / 100 + 1;
+    TextBackend* nullText = new TextBackend("/dev/null", root);
+    uint64_t start = nowNs();
+    for (uint32_t d = 0; d < textDumps; d++) {
+        std::ofstream out("/dev/null", std::ios_base::app);
+        dumpStat(root, 0, &out);
+        out << "===" << std::endl;
+    }
+    double walkNs = 1.0 * (nowNs() - start) / textDumps;
+    start = nowNs();
+    for (uint32_t d = 0; d < textDumps; d++) nullText->dump(false);
+    double snapNs = 1.0 * (nowNs() - start) / textDumps;
+    info("text backend, us/dump: walk %.1f, snapshot %.1f (%.2fx); output matches", walkNs / 1000, snapNs / 1000, walkNs / snapNs);
+
+    // Sync vs writer thread: cost to the dumping thread, total time until files are closed, and output
+    info("backend, us/dump          sync   async (dumping thread)   async (until closed)");
+    for (uint32_t cfg = 0; cfg < 3; cfg++) {
+        const char* names[] = {"text", "hdf5 eventual", "hdf5 periodic"};
+        const char* files[2][3] = {{"sb-sync.out", "sb-sync-ev.h5", "sb-sync.h5"}, {"sb-async.out", "sb-async-ev.h5", "sb-async.h5"}};
+        uint32_t cfgDumps = (cfg == 0)? textDumps : dumps / 10;
+        double syncUs = 0, asyncUs = 0, totalUs = 0;
+        for (uint32_t async = 0; async < 2; async++) {
+            StatsWriter* writer = async? new StatsWriter(1000) : nullptr;
+            const char* file = files[async][cfg];
+            StatsBackend* backend;
+            if (cfg == 0) backend = new TextBackend(file, root, writer);
+            else if (cfg == 1) backend = new HDF5Backend(file, root, 1 << 17, false, false, writer);
+            else backend = new HDF5Backend(file, root, 1 << 20, false, true, writer);
+            uint64_t start = nowNs();
+            double us = timeDumps(backend, cfgDumps);
+            if (writer) writer->close();
+            double total = 1.0 * (nowNs() - start) / cfgDumps / 1000;
+            if (async) {
+                asyncUs = us;
+                totalUs = total;
+            } else {
+                syncUs = us;
+            }
+        }
+        bool same = (cfg == 0)? readFile(files[0][cfg]) == readFile(files[1][cfg]) :
+                                readH5Records(files[0][cfg]) == readH5Records(files[1][cfg]);
+        if (!same) panic("%s: files written with and without a writer differ", names[cfg]);
+        info("%-20s %8.1f %24.1f %22.1f", names[cfg], syncUs, asyncUs, totalUs);
+        remove(files[0][cfg]);
+        remove(files[1][cfg]);
+    }
+
+    /* Periodic output: text vs columnar, all dumping the same rows. Checks
+     * that the reader returns every row, and times extracting series. Pass
+     * "keep" as the second argument to keep the files (e.g., to compare
+     * zcsread -t on a columnar file with the text one). */
+    bool keep = argc > 2 && strcmp(argv[2], "keep") == 0;
+    uint32_t pDumps = dumps / 40 + 1;
+    const uint32_t NUM_P = 4;
+    const char* pNames[NUM_P] = {"text", "columnar raw", "columnar zstd", "columnar zstd async"};
+    const char* pFiles[NUM_P] = {"sb-pout.out", "sb-pout-raw.zcs", "sb-pout-zstd.zcs", "sb-pout-async.zcs"};
+    StatsWriter* pWriter = new StatsWriter(1);  // flushes between dumps, which must not split blocks
+    StatsBackend* pBackends[NUM_P] = {
+        new TextBackend(pFiles[0], root),
+        new ColumnarBackend(pFiles[1], root, 64, false),
+        new ColumnarBackend(pFiles[2], root, 64, true),
+        new ColumnarBackend(pFiles[3], root, 64, true, pWriter),
+    };
+    double pUs[NUM_P] = {0, 0, 0, 0};
+    StatsSnapshot pSnap(root, false, false);
+    std::vector<uint64_t> pRef((uint64_t)pDumps * pSnap.size());
+    for (uint32_t d = 0; d < pDumps; d++) {
+        advance();
+        pSnap.read(&pRef[(uint64_t)d * pSnap.size()]);
+        for (uint32_t b = 0; b < NUM_P; b++) {
+            uint64_t start = threadCpuNs();
+            pBackends[b]->dump(d != pDumps - 1);
+            pUs[b] += threadCpuNs() - start;
+        }
+    }
+    pWriter->close();
+
+    info("periodic output, %d dumps      bytes  bytes/dump  us/dump (dumping thread)", pDumps);
+    for (uint32_t b = 0; b < NUM_P; b++) {
+        uint64_t bytes = fileSize(pFiles[b]);
+        info("%-24s %12ld %11ld %10.1f", pNames[b], bytes, bytes / pDumps, pUs[b] / pDumps / 1000);
+    }
+
+    std::vector<uint64_t> vals;
+    for (uint32_t b = 1; b < NUM_P; b++) {
+        ColumnarStatsReader r(pFiles[b]);
+        if (r.getNumRows() != pDumps || r.getNumColumns() != pSnap.size() || !r.isIndexed()) {
+            panic("%s: %ld rows, %d columns, indexed %d", pFiles[b], r.getNumRows(), r.getNumColumns(), r.isIndexed());
+        }
+        // Only the last, unbuffered dump ends a partial block, even with the writer's periodic flushes
+        if (r.getNumBlocks() != (pDumps + 63) / 64) panic("%s: %d blocks for %d rows", pFiles[b], r.getNumBlocks(), pDumps);
+        for (uint32_t d = 0; d < pDumps; d++) {
+            r.readRow(d, vals);
+            if (memcmp(vals.data(), &pRef[(uint64_t)d * pSnap.size()], pSnap.size() * sizeof(uint64_t)) != 0) {
+                panic("%s: row %d differs from the snapshot", pFiles[b], d);
+            }
+        }
+    }
+
+    // Decoding whole blocks, as zcsread -t does
+    for (uint32_t b = 1; b < 3; b++) {
+        ColumnarStatsReader r(pFiles[b]);
+        start = nowNs();
+        for (uint32_t blk = 0; blk < r.getNumBlocks(); blk++) r.readBlock(blk, vals);
+        info("%s: decoded %d blocks in %.1f ms", pNames[b], r.getNumBlocks(), (nowNs() - start) / 1e6);
+    }
+
+    // One series out of the compressed file (opened each time, as zcsread would), vs. scanning the text file for it
+    start = nowNs();
+    uint32_t reps = 20;
+    for (uint32_t i = 0; i < reps; i++) {
+        ColumnarStatsReader r(pFiles[2]);
+        int32_t col = r.findColumn("root.core.core-17.cycles");
+        if (col < 0) panic("Column not found");
+        vals.clear();
+        r.readColumn(col, vals);
+        if (vals.size() != pDumps) panic("Series has %ld rows", vals.size());
+    }
+    double zcsUs = 1.0 * (nowNs() - start) / reps / 1000;
+    start = nowNs();
+    for (uint32_t i = 0; i < reps; i++) {
+        std::ifstream in(pFiles[0]);
+        std::string line;
+        bool inCore = false;
+        uint32_t found = 0;
+        while (std::getline(in, line)) {
+            if (line.compare(0, 10, "  core-17:") == 0) inCore = true;
+            else if (line.compare(0, 10, "  core-18:") == 0) inCore = false;
+            else if (inCore && line.compare(0, 10, "   cycles:") == 0) found++;
+        }
+        if (found != pDumps) panic("Text scan found %d rows", found);
+    }
+    double textUs = 1.0 * (nowNs() - start) / reps / 1000;
+    info("extracting one series: text scan %.0f us, columnar %.0f us (%.0fx); all rows match", textUs, zcsUs, textUs / zcsUs);
+    if (!keep) {
+        for (const char* f : pFiles) remove(f);
+    }
+    return 0;
+}
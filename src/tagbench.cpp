@@ -0,0 +1,141 @@
+/* Microbenchmark of DRAM cache tag lookups (Set::lookup and victim selection)
+ * for 1-64 way sets, against the array-of-structs layout sets used to have.
+ * Build with march=native (or -mavx2) to measure the vectorized compares.
+ *
+ * Usage: tagbench [<lookups per way count>] */
+
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include "cache/cache_utils.h"
+#include "galloc.h"
+#include "log.h"
+
+// The former layout: one 16-byte struct per way, scanned in order
+struct AosWay {
+    Address tag;
+    bool valid;
+    bool dirty;
+};
+
+static uint32_t aosLookup(const AosWay* ways, uint32_t numWays, Address tag) {
+    for (uint32_t w = 0; w < numWays; w++) {
+        if (ways[w].valid && ways[w].tag == tag) return w;
+    }
+    return numWays;
+}
+
+// Victim selection as IdealAssociative did it: invalid, else clean, else dirty ways, the n-th of them
+static uint32_t aosVictim(const AosWay* ways, uint32_t numWays, uint64_t n) {
+    std::vector<uint32_t> candidates;
+    for (uint32_t w = 0; w < numWays; w++) {
+        if (!ways[w].valid) candidates.push_back(w);
+    }
+    if (candidates.empty()) {
+        for (uint32_t w = 0; w < numWays; w++) {
+            if (ways[w].valid && !ways[w].dirty) candidates.push_back(w);
+        }
+    }
+    if (candidates.empty()) {
+        for (uint32_t w = 0; w < numWays; w++) {
+            if (ways[w].valid && ways[w].dirty) candidates.push_back(w);
+        }
+    }
+    return candidates[n % candidates.size()];
+}
+
+static volatile uint64_t sink;  // keeps the timed loops from being optimized away
+
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+int main(int argc, char* argv[]) {
+    InitLog("[B] ");
+    uint64_t lookups = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 20000000;
+    const uint32_t NUM_SETS = 4096;  // 4096 x 64 ways x 8 bytes = 2MB of tags, so lookups mostly hit in cache
+    const uint32_t NUM_KEYS = 1024;
+
+    info("%ld lookups per associativity, %d sets, ~50%% hits, 7/8 of ways valid", lookups, NUM_SETS);
+    info("          lookup (ns)                  victim (ns)");
+    info("ways      aos      soa   speedup       aos      soa   speedup");
+    for (uint32_t numWays = 1; numWays <= 64; numWays *= 2) {
+        AosWay* aos = (AosWay*)calloc(NUM_SETS * numWays, sizeof(AosWay));
+        Address* tags = (Address*)calloc(NUM_SETS * numWays, sizeof(Address));
+        uint64_t* valid = (uint64_t*)calloc(NUM_SETS, sizeof(uint64_t));
+        uint64_t* dirty = (uint64_t*)calloc(NUM_SETS, sizeof(uint64_t));
+        Set* sets = (Set*)calloc(NUM_SETS, sizeof(Set));
+
+        // Tags of set s are drawn from 2 * numWays values, so about half of the lookups hit
+        srand(42);
+        for (uint32_t s = 0; s < NUM_SETS; s++) {
+            sets[s].tags = tags + s * numWays;
+            sets[s].valid = valid + s;
+            sets[s].dirty = dirty + s;
+            sets[s].num_ways = numWays;
+            for (uint32_t w = 0; w < numWays; w++) {
+                if (numWays > 1 && rand() % 8 == 0) continue;  // leave some ways empty
+                Address tag = (Address)s * 1024 + (w * 2 + rand() % 2);
+                bool d = rand() % 2;
+                aos[s * numWays + w] = {tag, true, d};
+                sets[s].fill(w, tag, d);
+            }
+        }
+        uint32_t* keySets = (uint32_t*)calloc(NUM_KEYS, sizeof(uint32_t));
+        Address* keys = (Address*)calloc(NUM_KEYS, sizeof(Address));
+        for (uint32_t k = 0; k < NUM_KEYS; k++) {
+            keySets[k] = rand() % NUM_SETS;
+            keys[k] = (Address)keySets[k] * 1024 + rand() % (2 * numWays);
+        }
+
+        for (uint32_t k = 0; k < NUM_KEYS; k++) {
+            uint32_t s = keySets[k];
+            uint32_t a = aosLookup(aos + s * numWays, numWays, keys[k]);
+            uint32_t b = sets[s].lookup(keys[k]);
+            if (a != b) panic("Mismatch: %d ways, set %d, tag %ld: aos way %d, soa way %d", numWays, s, keys[k], a, b);
+        }
+
+        uint64_t sum = 0;
+        uint64_t start = nowNs();
+        for (uint64_t i = 0; i < lookups; i++) {
+            uint32_t k = i % NUM_KEYS;
+            sum += aosLookup(aos + keySets[k] * numWays, numWays, keys[k]);
+        }
+        uint64_t aosNs = nowNs() - start;
+
+        start = nowNs();
+        for (uint64_t i = 0; i < lookups; i++) {
+            uint32_t k = i % NUM_KEYS;
+            sum -= sets[keySets[k]].lookup(keys[k]);
+        }
+        uint64_t soaNs = nowNs() - start;
+        if (sum) panic("Layouts disagree");
+
+        // Victim selection
+        start = nowNs();
+        for (uint64_t i = 0; i < lookups; i++) {
+            uint32_t k = i % NUM_KEYS;
+            sum += aosVictim(aos + keySets[k] * numWays, numWays, i);
+        }
+        uint64_t aosVictimNs = nowNs() - start;
+
+        start = nowNs();
+        for (uint64_t i = 0; i < lookups; i++) {
+            const Set& set = sets[keySets[i % NUM_KEYS]];
+            Set::WayState state = set.countWays(Set::EMPTY) ? Set::EMPTY : set.countWays(Set::CLEAN) ? Set::CLEAN : Set::DIRTY;
+            sum -= set.nthWay(state, i % set.countWays(state));
+        }
+        uint64_t soaVictimNs = nowNs() - start;
+        if (sum) panic("Victim selections disagree");
+        sink = sum;
+
+        info("%4d  %8.2f %8.2f   %5.2fx   %8.2f %8.2f   %5.2fx", numWays,
+             1.0 * aosNs / lookups, 1.0 * soaNs / lookups, 1.0 * aosNs / soaNs,
+             1.0 * aosVictimNs / lookups, 1.0 * soaVictimNs / lookups, 1.0 * aosVictimNs / soaVictimNs);
+
+        free(aos); free(tags); free(valid); free(dirty); free(sets); free(keySets); free(keys);
+    }
+    return 0;
+}
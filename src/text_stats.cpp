@@ -28,58 +28,135 @@
 #include "galloc.h"
 #include "log.h"
 #include "stats.h"
+#include "stats_snapshot.h"
+#include "stats_writer.h"
 #include "zsim.h"
 
 using std::endl;
 
-class TextBackendImpl : public GlobAlloc {
+/* Without a StatsWriter, each dump appends to the file, opening and closing it (dumps may come from any process).
+ * With a writer, dumps take a snapshot into one of two records and hand it off; the writer thread keeps the file
+ * open, formats the record, and flushes the file periodically.
+ */
+class TextBackendImpl : public GlobAlloc, public StatsWriter::Sink {
     private:
         const char* filename;
         AggregateStat* rootStat;
 
-        void dumpStat(Stat* s, uint32_t level, std::ofstream* out) {
-            for (uint32_t i = 0; i < level; i++) *out << " ";
-            *out << s->name() << ": ";
+        // One per stat, inorder; values come from the snapshot record, in the same order
+        struct Line {
+            const Stat* stat;
+            const VectorStat* vs;  // nullptr for aggregates and scalars
+            uint32_t level;
+            bool isAggregate;
+        };
+        g_vector<Line> lines;
+        StatsSnapshot* snapshot;
+        uint64_t* records[2];  // the second one is only used with a writer
+        uint32_t curRecord;
+
+        StatsWriter* writer;
+        lock_t freeSem;  // held while a record is with the writer
+        std::ofstream* out;  // open file, only kept open with a writer
+
+        void compileLines(Stat* s, uint32_t level) {
+            Line l = {s, nullptr, level, false};
             if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
-                *out << "# " << as->desc() << endl;
+                l.isAggregate = true;
+                lines.push_back(l);
                 for (uint32_t i = 0; i < as->size(); i++) {
-                    dumpStat(as->get(i), level+1, out);
+                    compileLines(as->get(i), level+1);
                 }
-            } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
-                *out << ss->get() << " # " << ss->desc() << endl;
+            } else if (dynamic_cast<ScalarStat*>(s)) {
+                lines.push_back(l);
             } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
-                *out << "# " << vs->desc() << endl;
-                for (uint32_t i = 0; i < vs->size(); i++) {
-                    for (uint32_t j = 0; j < level+1; j++) *out << " ";
-                    if (vs->hasCounterNames()) {
-                        *out << vs->counterName(i) << ": " << vs->count(i) << endl;
-                    } else {
-                        *out << i << ": " << vs->count(i) << endl;
-                    }
-                }
+                l.vs = vs;
+                lines.push_back(l);
             } else {
                 panic("Unrecognized stat type");
             }
         }
 
+        static void indent(uint32_t level, std::ofstream* out) {
+            for (uint32_t i = 0; i < level; i++) *out << " ";
+        }
+
+        // Lines end in '\n', not endl, so that the stream is not flushed on every line
+        void dumpLines(const uint64_t* record, std::ofstream* out) {
+            const uint64_t* val = record;
+            for (const Line& l : lines) {
+                indent(l.level, out);
+                *out << l.stat->name() << ": ";
+                if (l.isAggregate) {
+                    *out << "# " << l.stat->desc() << '\n';
+                } else if (!l.vs) {
+                    *out << *(val++) << " # " << l.stat->desc() << '\n';
+                } else {
+                    *out << "# " << l.vs->desc() << '\n';
+                    for (uint32_t i = 0; i < l.vs->size(); i++) {
+                        indent(l.level+1, out);
+                        if (l.vs->hasCounterNames()) {
+                            *out << l.vs->counterName(i) << ": " << *(val++) << '\n';
+                        } else {
+                            *out << i << ": " << *(val++) << '\n';
+                        }
+                    }
+                }
+            }
+            assert(val == record + snapshot->size());
+        }
+
     public:
-        TextBackendImpl(const char* _filename, AggregateStat* _rootStat) :
-            filename(_filename), rootStat(_rootStat)
+        TextBackendImpl(const char* _filename, AggregateStat* _rootStat, StatsWriter* _writer) :
+            filename(_filename), rootStat(_rootStat), writer(_writer), out(nullptr)
         {
+            compileLines(rootStat, 0);
+            snapshot = new StatsSnapshot(rootStat, false /*skipVectors*/, false /*sumRegularAggregates*/);
+            records[0] = gm_calloc<uint64_t>(snapshot->size() + 1);
+            records[1] = writer? gm_calloc<uint64_t>(snapshot->size() + 1) : nullptr;
+            curRecord = 0;
+            futex_init(&freeSem);
+
             std::ofstream out(filename, std::ios_base::out);
             out << "# zsim stats" << endl;
             out << "===" << endl;
         }
 
         void dump(bool buffered) {
-            std::ofstream out(filename, std::ios_base::app);
-            dumpStat(rootStat, 0, &out);
-            out << "===" << endl;
+            // Take all values first, then format them
+            snapshot->read(records[curRecord]);
+            if (writer) {
+                futex_lock(&freeSem);  // the writer is done with the other record
+                uint64_t ticket = writer->enqueue(this, records[curRecord], 1, &freeSem);
+                curRecord ^= 1;
+                if (!buffered) writer->wait(ticket);
+            } else {
+                write(records[curRecord], 1);
+            }
+        }
+
+        // StatsWriter::Sink; also called by dump() without a writer
+        void write(const uint64_t* recs, uint32_t numRecords) {
+            if (!out) out = new std::ofstream(filename, std::ios_base::app);
+            for (uint32_t r = 0; r < numRecords; r++) {
+                dumpLines(recs + r*snapshot->size(), out);
+                *out << "===" << '\n';
+            }
+            if (!writer) close();
+        }
+
+        void flush() {
+            if (out) out->flush();
+        }
+
+        void close() {
+            delete out;
+            out = nullptr;
         }
 };
 
-TextBackend::TextBackend(const char* filename, AggregateStat* rootStat) {
-    backend = new TextBackendImpl(filename, rootStat);
+TextBackend::TextBackend(const char* filename, AggregateStat* rootStat, StatsWriter* writer) {
+    backend = new TextBackendImpl(filename, rootStat, writer);
 }
 
 void TextBackend::dump(bool buffered) {
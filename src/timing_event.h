@@ -253,6 +253,13 @@ class TimingEvent {
             if (numChildren == 1) {
                 f(&child);
             } else {
+                // f may add children: produceCrossings adds each response crossing
+                // to its request's parent, which may be this event. New blocks go
+                // first, so added children are visited only if they land in the
+                // unvisited part of the first block. Skipping them is fine, since
+                // the visit that created a crossing also handles its only child.
+                // weavetest covers this case.
+                uint32_t startChildren = numChildren;
                 TimingEventBlock* curBlock = children;
                 uint32_t visitedChildren = 0;
                 while (curBlock) {
@@ -266,7 +273,7 @@ class TimingEvent {
                     curBlock = curBlock->next;
                 }
                 //info("visit %p multi done", this);
-                assert(visitedChildren == numChildren);
+                assert(visitedChildren >= startChildren && visitedChildren <= numChildren);
             }
         }
 
@@ -352,10 +359,11 @@ class CrossingEvent : public TimingEvent {
                     assert_msg(numParents == 1, "CSE: numParents %d", numParents);
                     numParents = 0;
                     assert(numChildren == 0);
-                    ce->markSrcEventDone(startCycle);
                     assert(state == EV_NONE);
-                    state = EV_RUNNING;
-                    done(startCycle);  // does RUNNING -> DONE and frees event
+                    // Not done(): this event lives inside its CrossingEvent, which frees both, and
+                    // may do so as soon as it sees the source done, so mark it done first
+                    state = EV_DONE;
+                    ce->markSrcEventDone(startCycle);
                 }
 
                 virtual void simulate(uint64_t simCycle) {
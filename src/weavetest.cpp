@@ -0,0 +1,221 @@
+/* Regression test of cross-domain events in the weave phase. It builds event
+ * graphs the way the core recorders do, with a request that crosses from
+ * domain 0 to domain 1 and a response that crosses back, runs
+ * produceCrossings on them, and weaves them with ContentionSim over many
+ * phases, with one and with two weave threads, and with each domain scheduler:
+ * fixed domain ranges, balancing by cost (sim.contentionBalance), and balancing
+ * plus stealing (sim.contentionStealing).
+ *
+ * Each graph is R -> P -> {A, X, B} -> ..., where X is in another domain and
+ * its child Y is back in R's domain. Graphs rotate over the domains, so with
+ * more domains than threads each thread holds several, and can be stolen from.
+ * P has three children, a full TimingEventBlock,
+ * so the response crossing X -> Y that produceCrossings adds to P while it
+ * visits P's children lands in a new block that the visit does not reach.
+ * The test checks that this happens, that every event runs exactly once and
+ * no earlier than its parents allow, and that the crossings' source events
+ * (CrossingSrcEvent), which live inside their CrossingEvents, are not freed
+ * twice: the slab allocator asserts on that.
+ *
+ * It links the whole simulator like zreplay, so it defines the process-wide
+ * state that zsim.cpp defines for the Pin tool.
+ *
+ * Usage: weavetest [<graphs per phase>] [<phases>] */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "contention_sim.h"
+#include "core.h"
+#include "debug_zsim.h"
+#include "event_recorder.h"
+#include "galloc.h"
+#include "log.h"
+#include "stats.h"
+#include "timing_event.h"
+#include "zsim.h"
+
+GlobSimInfo* zinfo;
+uint32_t procIdx;
+uint32_t lineBits;
+Address procMask;
+Core* cores[MAX_THREADS];
+
+uint32_t getCid(uint32_t tid) {
+    panic("weavetest has no cores");
+}
+
+uint32_t TakeBarrier(uint32_t tid, uint32_t cid) {
+    panic("weavetest has no cores");
+}
+
+void SimEnd() {
+    panic("weavetest does not end through SimEnd");
+}
+
+void SpawnInternalThread(void (*fn)(void*), void* arg, uint32_t stackSize) {
+    struct Trampoline {
+        static void* run(void* p) {
+            std::pair<void (*)(void*), void*>* t = static_cast<std::pair<void (*)(void*), void*>*>(p);
+            t->first(t->second);
+            delete t;
+            return nullptr;
+        }
+    };
+    pthread_t thread;
+    pthread_create(&thread, nullptr, Trampoline::run, new std::pair<void (*)(void*), void*>(fn, arg));
+    pthread_detach(thread);
+}
+
+void getLibzsimAddrs(LibInfo* libzsimAddrs) {
+    memset(libzsimAddrs, 0, sizeof(LibInfo));
+}
+
+void notifyHarnessForDebugger(int harnessPid) {
+    panic("weavetest does not support sim.attachDebugger");
+}
+
+enum {EV_R, EV_P, EV_A, EV_X, EV_B, EV_Y, EVS_PER_GRAPH};
+
+struct GraphRecord {
+    uint64_t start[EVS_PER_GRAPH];
+    uint32_t runs[EVS_PER_GRAPH];
+};
+
+class TestEvent : public TimingEvent {
+    private:
+        GraphRecord* rec;
+        uint32_t idx;
+
+    public:
+        TestEvent(GraphRecord* _rec, uint32_t _idx, uint32_t preDelay, uint32_t postDelay, int32_t domain)
+            : TimingEvent(preDelay, postDelay, domain), rec(_rec), idx(_idx) {}
+
+        virtual void simulate(uint64_t startCycle) {
+            rec->start[idx] = startCycle;
+            rec->runs[idx]++;
+            done(startCycle);
+        }
+};
+
+// Delays of each event; the checks below use them as lower bounds
+static const uint32_t preDelays[EVS_PER_GRAPH] = {0, 1, 2, 3, 2, 1};
+static const uint32_t postDelays[EVS_PER_GRAPH] = {1, 2, 0, 5, 0, 0};
+
+static void buildGraph(EventRecorder* evRec, GraphRecord* rec, uint64_t cycle, int32_t dom, int32_t xDom) {
+    TestEvent* evs[EVS_PER_GRAPH];
+    for (uint32_t i = 0; i < EVS_PER_GRAPH; i++) {
+        evs[i] = new (evRec) TestEvent(rec, i, preDelays[i], postDelays[i], (i == EV_X)? xDom : dom);
+        evs[i]->setMinStartCycle(cycle + i);  // bound-phase start; crossings need it on their parents
+    }
+    evs[EV_R]->addChild(evs[EV_P], evRec);
+    evs[EV_P]->addChild(evs[EV_A], evRec);
+    evs[EV_P]->addChild(evs[EV_X], evRec);
+    evs[EV_P]->addChild(evs[EV_B], evRec);
+    evs[EV_X]->addChild(evs[EV_Y], evRec);
+    evs[EV_R]->queue(cycle);
+
+    TimingEvent* p = evs[EV_P];
+    evs[EV_R]->produceCrossings(evRec);
+    evRec->getCrossingStack().clear();
+    // The response crossing was added to P while produceCrossings visited P's full block
+    if (p->getNumChildren() != 4) panic("P has %d children after produceCrossings, expected 4", p->getNumChildren());
+}
+
+static void checkGraph(const GraphRecord& rec, uint64_t cycle, uint32_t g) {
+    for (uint32_t i = 0; i < EVS_PER_GRAPH; i++) {
+        if (rec.runs[i] != 1) panic("Graph %d: event %d ran %d times", g, i, rec.runs[i]);
+    }
+    auto after = [&](uint32_t parent, uint32_t child) {
+        uint64_t minStart = rec.start[parent] + postDelays[parent] + preDelays[child];
+        if (rec.start[child] < minStart) {
+            panic("Graph %d: event %d started at %ld, before its parent %d allows (%ld)",
+                  g, child, rec.start[child], parent, minStart);
+        }
+    };
+    if (rec.start[EV_R] < cycle) panic("Graph %d: R started at %ld, queued at %ld", g, rec.start[EV_R], cycle);
+    after(EV_R, EV_P);
+    after(EV_P, EV_A);
+    after(EV_P, EV_X);
+    after(EV_P, EV_B);
+    after(EV_X, EV_Y);
+    after(EV_P, EV_Y);  // through the response crossing
+}
+
+static ScalarStat* getStat(AggregateStat* stats, const char* name) {
+    for (uint32_t i = 0; i < stats->size(); i++) {
+        if (strcmp(stats->get(i)->name(), name) == 0) return (ScalarStat*)stats->get(i);
+    }
+    panic("No stat %s", name);
+}
+
+static void run(uint32_t weaveThreads, uint32_t numDomains, bool balance, bool stealing, uint32_t graphsPerPhase, uint32_t phases) {
+    const uint32_t phaseLength = 1000;
+    zinfo->phaseLength = phaseLength;
+    // gm_calloc, not new: with no cores, postInit() would skip the weave, and it must start cleared
+    ContentionSim* csim = new (gm_calloc<ContentionSim>()) ContentionSim(numDomains, weaveThreads, balance, stealing);
+    zinfo->contentionSim = csim;
+    AggregateStat* rootStat = new AggregateStat();
+    rootStat->init("weavetest", "Weave test stats");
+    csim->initStats(rootStat);
+    rootStat->makeImmutable();
+    AggregateStat* csimStats = (AggregateStat*)rootStat->get(0);
+
+    EventRecorder* evRec = new EventRecorder();
+    evRec->setSourceId(0);
+    evRec->setGapCycles(0);
+    evRec->setStartSlack(0);
+
+    uint32_t numGraphs = graphsPerPhase * phases;
+    std::vector<GraphRecord> recs(numGraphs);
+    memset(recs.data(), 0, numGraphs * sizeof(GraphRecord));
+    std::vector<uint64_t> cycles(numGraphs);
+
+    uint32_t g = 0;
+    uint64_t limit = 0;
+    for (uint32_t ph = 0; ph < phases; ph++) {
+        for (uint32_t i = 0; i < graphsPerPhase; i++, g++) {
+            cycles[g] = limit + (i * phaseLength) / graphsPerPhase;
+            // Skewed over the domains, so that balancing has costs to work with
+            int32_t dom = (g % 3)? 0 : (g / 3) % numDomains;
+            buildGraph(evRec, &recs[g], cycles[g], dom, (dom + 1) % numDomains);
+        }
+        limit += phaseLength;
+        csim->simulatePhase(limit);
+    }
+    // Drain: crossings may be pending until the next phases
+    for (uint32_t ph = 0; ph < 10; ph++) {
+        limit += phaseLength;
+        csim->simulatePhase(limit);
+    }
+
+    for (g = 0; g < numGraphs; g++) checkGraph(recs[g], cycles[g], g);
+    info("%d weave thread(s), %d domains%s%s: %d graphs over %d phases, all events ran once and in order",
+         weaveThreads, numDomains, balance? ", balance" : "", stealing? ", stealing" : "", numGraphs, phases);
+    for (uint32_t t = 0; t < weaveThreads; t++) {
+        std::string name = "thread-" + std::to_string(t);
+        AggregateStat* thStats = (AggregateStat*)getStat(csimStats, name.c_str());
+        info("  thread %d: %.3f s busy, %.3f s idle, %ld steals", t, getStat(thStats, "busy")->get()/1e9,
+             getStat(thStats, "idle")->get()/1e9, getStat(thStats, "steals")->get());
+    }
+    csim->finish();
+}
+
+int main(int argc, char* argv[]) {
+    InitLog("[W] ");
+    gm_init(1ul << 30);
+    zinfo = gm_calloc<GlobSimInfo>();
+    zinfo->numCores = 0;
+
+    uint32_t graphsPerPhase = (argc > 1)? strtoul(argv[1], nullptr, 0) : 50;
+    uint32_t phases = (argc > 2)? strtoul(argv[2], nullptr, 0) : 400;
+    run(1, 2, false, false, graphsPerPhase, phases);
+    run(2, 2, false, false, graphsPerPhase, phases);
+    run(2, 4, false, false, graphsPerPhase, phases);
+    run(2, 4, true, false, graphsPerPhase, phases);
+    run(2, 4, true, true, graphsPerPhase, phases);
+    run(3, 8, false, true, graphsPerPhase, phases);
+    return 0;
+}
@@ -0,0 +1,156 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Reads columnar periodic stats files (zsim-pout.zcs). Only the blocks and
+ * columns asked for are decoded, so extracting a few series from a long run
+ * is cheap. */
+
+#include <regex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "bithacks.h"
+#include "columnar_stats.h"
+#include "log.h"
+
+static void usage(const char* prog) {
+    info("Reads a columnar stats file");
+    info("Usage: %s <file.zcs> [-l] [-s <regex>] [-r <first>:<last>] [-d] [-t]", prog);
+    info("  (no options)  summary");
+    info("  -l            list the columns (matching -s, if given)");
+    info("  -s <regex>    print the series of the columns whose full names match, one row per line");
+    info("  -r <f>:<l>    only rows f..l-1 (either can be omitted)");
+    info("  -d            print per-row differences instead of values");
+    info("  -t            print the rows in the text format of zsim-pout.out");
+    exit(1);
+}
+
+// Same layout as TextBackend's output, so existing parsers keep working
+static void printTextRow(const ColumnarStatsReader& r, const uint64_t* vals) {
+    for (const ColumnarStatsReader::Node& n : r.getNodes()) {
+        printf("%*s%s: ", n.level, "", n.name.c_str());
+        if (n.kind == ZCS_SCALAR) {
+            printf("%lu # %s\n", vals[n.firstColumn], n.desc.c_str());
+        } else {
+            printf("# %s\n", n.desc.c_str());
+            for (uint32_t i = 0; i < n.size; i++) {
+                if (n.counterNames.size()) {
+                    printf("%*s%s: %lu\n", n.level + 1, "", n.counterNames[i].c_str(), vals[n.firstColumn + i]);
+                } else {
+                    printf("%*s%d: %lu\n", n.level + 1, "", i, vals[n.firstColumn + i]);
+                }
+            }
+        }
+    }
+    printf("===\n");
+}
+
+static void printText(const ColumnarStatsReader& r, uint64_t firstRow, uint64_t supRow) {
+    std::vector<uint64_t> vals;
+    printf("# zsim stats\n===\n");
+    // Decode each block once, not once per row
+    for (uint32_t b = 0; b < r.getNumBlocks(); b++) {
+        uint64_t blockFirst = r.getBlockFirstRow(b);
+        uint64_t blockSup = blockFirst + r.getBlockRows(b);
+        if (blockSup <= firstRow || blockFirst >= supRow) continue;
+        r.readBlock(b, vals);
+        for (uint64_t row = MAX(firstRow, blockFirst); row < MIN(supRow, blockSup); row++) {
+            printTextRow(r, &vals[(row - blockFirst)*r.getNumColumns()]);
+        }
+    }
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog("");  // no log header
+    if (argc < 2) usage(argv[0]);
+
+    bool list = false, diff = false, text = false;
+    const char* regexStr = nullptr;
+    uint64_t firstRow = 0, supRow = UINT64_MAX;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-l") == 0) {
+            list = true;
+        } else if (strcmp(argv[i], "-d") == 0) {
+            diff = true;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            text = true;
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            regexStr = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            const char* range = argv[++i];
+            const char* sep = strchr(range, ':');
+            if (!sep) usage(argv[0]);
+            if (sep != range) firstRow = strtoul(range, nullptr, 0);
+            if (sep[1]) supRow = strtoul(sep + 1, nullptr, 0);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    ColumnarStatsReader r(argv[1]);
+    if (supRow > r.getNumRows()) supRow = r.getNumRows();
+    if (firstRow > supRow) firstRow = supRow;
+
+    if (text) {
+        printText(r, firstRow, supRow);
+        return 0;
+    }
+
+    std::vector<uint32_t> cols;
+    std::regex re(regexStr? regexStr : ".*");
+    for (uint32_t c = 0; c < r.getNumColumns(); c++) {
+        if (std::regex_match(r.columnName(c), re)) cols.push_back(c);
+    }
+
+    if (list) {
+        for (uint32_t c : cols) printf("%s\n", r.columnName(c).c_str());
+    } else if (regexStr) {
+        if (cols.empty()) panic("No columns match %s", regexStr);
+        // Differences need the row before the first one
+        uint64_t readFirst = (diff && firstRow > 0)? firstRow - 1 : firstRow;
+        std::vector<std::vector<uint64_t>> series(cols.size());
+        for (uint32_t i = 0; i < cols.size(); i++) r.readColumn(cols[i], series[i], readFirst, supRow - readFirst);
+
+        printf("row");
+        for (uint32_t c : cols) printf("\t%s", r.columnName(c).c_str());
+        printf("\n");
+        for (uint64_t row = firstRow; row < supRow; row++) {
+            printf("%lu", row);
+            for (const std::vector<uint64_t>& s : series) {
+                uint64_t v = s[row - readFirst];
+                if (diff) v -= (row > readFirst)? s[row - readFirst - 1] : 0;
+                printf("\t%lu", v);
+            }
+            printf("\n");
+        }
+    } else {
+        info("%s: %d columns, %d stats, %ld rows in %d blocks (%s)", argv[1], r.getNumColumns(), (uint32_t)r.getNodes().size(),
+                r.getNumRows(), r.getNumBlocks(), r.isIndexed()? "indexed" : "no index, scanned");
+    }
+    return 0;
+}
@@ -0,0 +1,284 @@
+/* Replays per-thread instruction traces (see instr_trace.h) on
+ * the system described by a zsim config, without Pin or the original program.
+ *
+ * zreplay runs the regular initialization (SimInit) in a single process, so
+ * cores, caches, memory controllers, the scheduler and the weave phase are
+ * the same as in zsim, and so are the stats files it writes. Each trace is
+ * replayed by its own thread, which calls the analysis functions of whatever
+ * core the scheduler gives it, as the Pin instrumentation would, and leaves
+ * and joins the scheduler where the captured thread did. Replayed threads
+ * rejoin right after leaving: the time a thread was blocked depended on the
+ * other threads in the captured run, and they are re-timed here.
+ *
+ * Streams hold what each thread executed, so a different system (e.g., another
+ * DRAM cache) changes timing, but not the instructions or addresses of each
+ * thread. Anything that depends on the program rather than on its instruction
+ * stream (magic ops, heartbeats, syscall virtualization, fast-forwarding) is
+ * not replayed; traces only cover the simulated parts of the run.
+ *
+ * All traces must come from the same process, since cores tag line addresses
+ * with the process-wide procMask.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "bithacks.h"
+#include "config.h"
+#include "core.h"
+#include "debug_zsim.h"
+#include "galloc.h"
+#include "init.h"
+#include "instr_trace.h"
+#include "log.h"
+#include "process_tree.h"
+#include "scheduler.h"
+#include "zsim.h"
+
+/* Process-wide state that zsim.cpp defines for the Pin tool. Here, the "tid"
+ * the cores see is the index of the replay thread; the scheduler still gets
+ * the captured (procIdx, tid), so per-process settings apply as in zsim. */
+
+GlobSimInfo* zinfo;
+uint32_t procIdx;
+uint32_t lineBits;
+Address procMask;
+Core* cores[MAX_THREADS];
+
+#define INVALID_CID ((uint32_t)-1)
+
+static uint32_t cids[MAX_THREADS];
+static InstrFuncPtrs fPtrs[MAX_THREADS];
+
+struct ReplayThread {
+    pthread_t thread;
+    InstrTraceReader* reader;
+    uint32_t pid;  // captured procIdx and tid
+    uint32_t tid;
+    uint64_t records;
+};
+
+static ReplayThread* threads;
+static uint32_t numThreads;
+static volatile uint32_t runningThreads;
+static double startTime;
+
+static inline void clearCid(uint32_t tid) {
+    assert(cids[tid] != INVALID_CID);
+    cids[tid] = INVALID_CID;
+    cores[tid] = nullptr;
+}
+
+static inline void setCid(uint32_t tid, uint32_t cid) {
+    assert(cids[tid] == INVALID_CID);
+    assert(cid < zinfo->numCores);
+    cids[tid] = cid;
+    cores[tid] = zinfo->cores[cid];
+}
+
+uint32_t getCid(uint32_t tid) {
+    return cids[tid];
+}
+
+uint32_t TakeBarrier(uint32_t tid, uint32_t cid) {
+    ReplayThread& rt = threads[tid];
+    uint32_t newCid = zinfo->sched->sync(rt.pid, rt.tid, cid);
+    clearCid(tid);
+    setCid(tid, newCid);
+
+    if (zinfo->terminationConditionMet) {
+        info("Termination condition met, exiting");
+        zinfo->sched->leave(rt.pid, rt.tid, newCid);
+        SimEnd();
+    }
+
+    fPtrs[tid] = cores[tid]->GetFuncPtrs();
+    return newCid;
+}
+
+static double getTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void SimEnd() {
+    static volatile uint32_t endFlag = 0;
+    if (__sync_bool_compare_and_swap(&endFlag, 0, 1) == false) {
+        while (true) sleep(1);  // the winner exits for us
+    }
+
+    double elapsed = getTime() - startTime;
+    uint64_t records = 0;
+    for (uint32_t t = 0; t < numThreads; t++) records += threads[t].records;
+    info("Replayed %ld records from %d threads in %.3f s (%.2f Mrec/s), %ld phases",
+         records, numThreads, elapsed, records / elapsed / 1e6, zinfo->numPhases);
+
+    bool lastToFinish = zinfo->procArray[procIdx]->notifyEnd();
+    if (procIdx != 0) lastToFinish = zinfo->procArray[0]->notifyEnd();
+    (void) lastToFinish; //the replay process dumps stats regardless
+    DumpTerminationStats();
+    exit(0);
+}
+
+void SpawnInternalThread(void (*fn)(void*), void* arg, uint32_t stackSize) {
+    struct Trampoline {
+        static void* run(void* p) {
+            std::pair<void (*)(void*), void*>* t = static_cast<std::pair<void (*)(void*), void*>*>(p);
+            t->first(t->second);
+            delete t;
+            return nullptr;
+        }
+    };
+    pthread_t thread;
+    pthread_create(&thread, nullptr, Trampoline::run, new std::pair<void (*)(void*), void*>(fn, arg));
+    pthread_detach(thread);
+}
+
+// There is no libzsim.so to attach a debugger to
+void getLibzsimAddrs(LibInfo* libzsimAddrs) {
+    memset(libzsimAddrs, 0, sizeof(LibInfo));
+}
+
+void notifyHarnessForDebugger(int harnessPid) {
+    panic("zreplay does not support sim.attachDebugger; run it under gdb directly");
+}
+
+static void Join(uint32_t tid) {
+    ReplayThread& rt = threads[tid];
+    uint32_t cid = zinfo->sched->join(rt.pid, rt.tid);  // can block
+    setCid(tid, cid);
+
+    if (unlikely(zinfo->terminationConditionMet)) {
+        info("Caught termination condition on join, exiting");
+        zinfo->sched->leave(rt.pid, rt.tid, cid);
+        SimEnd();
+    }
+
+    fPtrs[tid] = cores[tid]->GetFuncPtrs();
+}
+
+static void* replay(void* arg) {
+    uint32_t tid = (uint32_t)(uintptr_t)arg;
+    ReplayThread& rt = threads[tid];
+    zinfo->sched->start(rt.pid, rt.tid, zinfo->procArray[rt.pid]->getMask());
+    cids[tid] = INVALID_CID;
+
+    InstrTraceRecord rec;
+    while (rt.reader->next(rec)) {
+        rt.records++;
+        if (rec.op == ITR_LEAVE || rec.op == ITR_SYSCALL_LEAVE) {
+            if (cids[tid] == INVALID_CID) continue;  // e.g., back-to-back syscalls
+            uint32_t cid = cids[tid];
+            clearCid(tid);
+            if (rec.op == ITR_LEAVE) zinfo->sched->leave(rt.pid, rt.tid, cid);
+            else zinfo->sched->syscallLeave(rt.pid, rt.tid, cid, rec.addr, rec.arg[1], rec.arg[2], rec.arg[3]);
+            continue;
+        }
+
+        // Forked children's traces start joined, without a JOIN record
+        if (cids[tid] == INVALID_CID) Join(tid);
+        switch (rec.op) {
+            case ITR_JOIN: break;
+            case ITR_BBL: fPtrs[tid].bblPtr(tid, rec.addr, rec.bblInfo); break;
+            case ITR_LOAD: fPtrs[tid].loadPtr(tid, rec.addr); break;
+            case ITR_STORE: fPtrs[tid].storePtr(tid, rec.addr); break;
+            case ITR_PRED_LOAD: fPtrs[tid].predLoadPtr(tid, rec.addr, rec.flag); break;
+            case ITR_PRED_STORE: fPtrs[tid].predStorePtr(tid, rec.addr, rec.flag); break;
+            case ITR_BRANCH: fPtrs[tid].branchPtr(tid, rec.addr, rec.flag, rec.arg[0], rec.arg[1]); break;
+            default: panic("Unexpected record %d", rec.op);
+        }
+    }
+
+    if (cids[tid] != INVALID_CID) {
+        uint32_t cid = cids[tid];
+        clearCid(tid);
+        zinfo->sched->leave(rt.pid, rt.tid, cid);
+    }
+    zinfo->sched->finish(rt.pid, rt.tid);
+    info("Thread %d (captured %d/%d) finished, %ld records", tid, rt.pid, rt.tid, rt.records);
+
+    if (__sync_sub_and_fetch(&runningThreads, 1) == 0) SimEnd();
+    return nullptr;
+}
+
+static void usage(const char* prog) {
+    info("Replays instruction traces (e.g., from itracetest -g) on the system of a zsim config, without Pin");
+    info("Usage: %s [-o outputDir] [-c category] <config> <trace>...", prog);
+    info("  <trace> are instrtrace-p<procIdx>-t<tid>.bin files, all from the same process");
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    InitLog("[R] ");
+
+    char cwd[1024];
+    const char* outputDir = getcwd(cwd, sizeof(cwd));
+    const char* category = "";
+    int c;
+    while ((c = getopt(argc, argv, "o:c:")) != -1) {
+        switch (c) {
+            case 'o': outputDir = optarg; break;
+            case 'c': category = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (argc - optind < 2) usage(argv[0]);
+    const char* configFile = argv[optind];
+
+    numThreads = argc - optind - 1;
+    if (numThreads > MAX_THREADS) panic("Too many traces (%d), at most %d threads are supported", numThreads, MAX_THREADS);
+    threads = new ReplayThread[numThreads];
+    for (uint32_t t = 0; t < numThreads; t++) {
+        ReplayThread& rt = threads[t];
+        rt.reader = new InstrTraceReader(argv[optind + 1 + t]);
+        rt.pid = rt.reader->getHeader().procIdx;
+        rt.tid = rt.reader->getHeader().tid;
+        rt.records = 0;
+        if (rt.pid != threads[0].pid) panic("%s is from process %d, but %s is from process %d; zreplay replays one process at a time",
+                argv[optind + 1 + t], rt.pid, argv[optind + 1], threads[0].pid);
+        for (uint32_t u = 0; u < t; u++) {
+            if (threads[u].tid == rt.tid) panic("%s and %s are traces of the same thread", argv[optind + 1 + u], argv[optind + 1 + t]);
+        }
+    }
+
+    Config conf(configFile);
+    uint32_t gmSize = conf.get<uint32_t>("sim.gmMBytes", (1<<10) /*default 1024MB*/);
+    gm_init(((size_t)gmSize) << 20 /*MB to Bytes*/);
+
+    SimInit(configFile, outputDir, 0 /*no shared segment to pass on*/, category);
+
+    procIdx = threads[0].pid;
+    if (procIdx >= zinfo->numProcs) panic("Traces are from process %d, but the config only has %d processes", procIdx, zinfo->numProcs);
+    for (uint32_t t = 0; t < numThreads; t++) {
+        if (threads[t].reader->getHeader().lineSize != zinfo->lineSize) {
+            panic("Traces were captured with %d-byte lines, but the config has %d", threads[t].reader->getHeader().lineSize, zinfo->lineSize);
+        }
+    }
+    lineBits = ilog2(zinfo->lineSize);
+    procMask = ((uint64_t)procIdx) << (64-lineBits);
+    for (uint32_t i = 0; i < MAX_THREADS; i++) cids[i] = INVALID_CID;
+
+    // SimInit starts process 0; the traced process stands in for the rest of the tree.
+    // Traces only cover simulated execution, so neither waits on the config's fast-forwarding
+    if (procIdx != 0) (void) zinfo->procArray[procIdx]->notifyStart();
+    for (uint32_t p : {0u, procIdx}) {
+        if (zinfo->procArray[p]->isInFastForward()) zinfo->procArray[p]->exitFastForward();
+    }
+
+    info("Replaying %d threads of process %d", numThreads, procIdx);
+    runningThreads = numThreads;
+    startTime = getTime();
+    for (uint32_t t = 0; t < numThreads; t++) {
+        pthread_create(&threads[t].thread, nullptr, replay, (void*)(uintptr_t)t);
+    }
+
+    // The last thread to finish (or whoever meets a termination condition) ends the process through SimEnd()
+    while (true) pause();
+    return 0;
+}
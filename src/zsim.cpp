@@ -53,12 +53,14 @@
 #include "galloc.h"
 #include "init.h"
 #include "log.h"
+#include "mem_trace.h"
 #include "pin.H"
 #include "pin_cmd.h"
 #include "process_tree.h"
 #include "profile_stats.h"
 #include "scheduler.h"
 #include "stats.h"
+#include "stats_writer.h"
 #include "trace_driver.h"
 #include "virt/virt.h"
 #include "mc.h"
@@ -418,88 +420,6 @@ volatile uint32_t perProcessEndFlag;
 
 VOID SimEnd();
 
-VOID CheckForTermination() {
-    assert(zinfo->terminationConditionMet == false);
-    if (zinfo->maxPhases && zinfo->numPhases >= zinfo->maxPhases) {
-        zinfo->terminationConditionMet = true;
-        info("Max phases reached (%ld)", zinfo->numPhases);
-        return;
-    }
-
-    if (zinfo->maxMinInstrs) {
-        uint64_t minInstrs = zinfo->cores[0]->getInstrs();
-        for (uint32_t i = 1; i < zinfo->numCores; i++) {
-            uint64_t coreInstrs = zinfo->cores[i]->getInstrs();
-            if (coreInstrs < minInstrs && coreInstrs > 0) {
-                minInstrs = coreInstrs;
-            }
-        }
-
-        if (minInstrs >= zinfo->maxMinInstrs) {
-            zinfo->terminationConditionMet = true;
-            info("Max min instructions reached (%ld)", minInstrs);
-            return;
-        }
-    }
-
-    if (zinfo->maxTotalInstrs) {
-        uint64_t totalInstrs = 0;
-        for (uint32_t i = 0; i < zinfo->numCores; i++) {
-            totalInstrs += zinfo->cores[i]->getInstrs();
-        }
-
-        if (totalInstrs >= zinfo->maxTotalInstrs) {
-            zinfo->terminationConditionMet = true;
-            info("Max total (aggregate) instructions reached (%ld)", totalInstrs);
-            return;
-        }
-    }
-
-    if (zinfo->maxSimTimeNs) {
-        uint64_t simNs = zinfo->profSimTime->count(PROF_BOUND) + zinfo->profSimTime->count(PROF_WEAVE);
-        if (simNs >= zinfo->maxSimTimeNs) {
-            zinfo->terminationConditionMet = true;
-            info("Max simulation time reached (%ld ns)", simNs);
-            return;
-        }
-    }
-
-    if (zinfo->externalTermPending) {
-        zinfo->terminationConditionMet = true;
-        info("Terminating due to external notification");
-        return;
-    }
-}
-
-/* This is called by the scheduler at the end of a phase. At that point, zinfo->numPhases
- * has not incremented, so it denotes the END of the current phase
- */
-VOID EndOfPhaseActions() {
-    zinfo->profSimTime->transition(PROF_WEAVE);
-    if (zinfo->globalPauseFlag) {
-        info("Simulation entering global pause");
-        zinfo->profSimTime->transition(PROF_FF);
-        while (zinfo->globalPauseFlag) usleep(20*1000);
-        zinfo->profSimTime->transition(PROF_WEAVE);
-        info("Global pause DONE");
-    }
-
-    // Done before tick() to avoid deadlock in most cases when entering synced ffwd (can we still deadlock with sleeping threads?)
-    if (unlikely(zinfo->globalSyncedFFProcs)) {
-        info("Simulation paused due to synced fast-forwarding");
-        zinfo->profSimTime->transition(PROF_FF);
-        while (zinfo->globalSyncedFFProcs) usleep(20*1000);
-        zinfo->profSimTime->transition(PROF_WEAVE);
-        info("Synced fast-forwarding done, resuming simulation");
-    }
-
-    CheckForTermination();
-    zinfo->contentionSim->simulatePhase(zinfo->globPhaseCycles + zinfo->phaseLength);
-    zinfo->eventQueue->tick();
-    zinfo->profSimTime->transition(PROF_BOUND);
-}
-
-
 uint32_t TakeBarrier(uint32_t tid, uint32_t cid) {
     uint32_t newCid = zinfo->sched->sync(procIdx, tid, cid);
     clearCid(tid); //this is after the sync for a hack needed to make EndOfPhase reliable
@@ -1140,17 +1060,7 @@ VOID SimEnd() {
             info("All other processes done, terminating");
         }
 
-        info("Dumping termination stats");
-        zinfo->trigger = 20000;
-        for (StatsBackend* backend : *(zinfo->statsBackends)) backend->dump(false /*unbuffered, write out*/);
-        for (AccessTraceWriter* t : *(zinfo->traceWriters)) t->dump(false);  // flushes trace writer
-
-        // Print DRAMSim3 stats
-        for (MemObject* mem : zinfo->memControllers) {
-            mem->printStats();
-        }
-
-        if (zinfo->sched) zinfo->sched->notifyTermination();
+        DumpTerminationStats();
     }
 
     //Uncomment when debugging termination races, which can be rare because they are triggered by threads of a dying process
@@ -1357,6 +1267,11 @@ class SyncEvent: public Event {
         }
 };
 
+// Used by the memory models (e.g., MemTraceWriter), the scheduler and the contention simulator to launch their threads
+void SpawnInternalThread(void (*fn)(void*), void* arg, uint32_t stackSize) {
+    PIN_SpawnInternalThread(fn, arg, stackSize, nullptr);
+}
+
 VOID FFThread(VOID* arg) {
     futex_lock(&zinfo->ffToggleLocks[procIdx]); //initialize
     info("FF control Thread TID %ld", syscall(SYS_gettid));
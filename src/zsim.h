@@ -39,6 +39,7 @@ class Core;
 class Scheduler;
 class AggregateStat;
 class StatsBackend;
+class StatsWriter;
 class ProcessTreeNode;
 class ProcessStats;
 class ProcStats;
@@ -49,6 +50,7 @@ class PinCmd;
 class PortVirtualizer;
 class VectorCounter;
 class AccessTraceWriter;
+class MemTraceWriter;
 class TraceDriver;
 template <typename T> class g_vector;
 
@@ -150,6 +152,7 @@ struct GlobSimInfo {
     StatsBackend* periodicStatsBackend;
     StatsBackend* periodicOutputStatsBackend;
     StatsBackend* eventualStatsBackend;
+    StatsWriter* statsWriter; // writes stats files in the background (sim.asyncStats), or nullptr
     ProcessStats* processStats;
     ProcStats* procStats;
 
@@ -190,6 +193,7 @@ struct GlobSimInfo {
 
     // Trace writers (stored globally because they need to be deleted when the simulation ends)
     g_vector<AccessTraceWriter*>* traceWriters;
+    g_vector<MemTraceWriter*>* memTraceWriters;  // raw per-controller traces (sys.mem.enableTrace)
 
     // Trace-driven simulation (no cores)
     bool traceDriven;
@@ -200,7 +204,7 @@ struct GlobSimInfo {
 };
 
 
-//Process-wide global variables, defined in zsim.cpp
+//Process-wide global variables, defined in zsim.cpp (or zreplay.cpp, which replays instruction traces without Pin)
 extern Core* cores[MAX_THREADS]; //tid->core array
 extern uint32_t procIdx;
 extern uint32_t lineBits; //process-local for performance, but logically global
@@ -208,9 +212,16 @@ extern uint64_t procMask;
 
 extern GlobSimInfo* zinfo;
 
-//Process-wide functions, defined in zsim.cpp
+//Process-wide functions, defined in zsim.cpp (or zreplay.cpp)
 uint32_t getCid(uint32_t tid);
 uint32_t TakeBarrier(uint32_t tid, uint32_t cid);
 void SimEnd(); //only call point out of zsim.cpp should be watchdog threads
+//Runs fn(arg) on a simulator-internal thread: a Pin internal thread in zsim, a pthread in the
+//standalone tools (mcsim, zreplay, statsbench), whose default stacks exceed any stackSize we ask for
+void SpawnInternalThread(void (*fn)(void*), void* arg, uint32_t stackSize = 64*1024);
+
+//Shared with zreplay, defined in sim_phase.cpp
+void EndOfPhaseActions(); //called by the scheduler at the end of each phase
+void DumpTerminationStats(); //called once, by the process that dumps the final stats
 
 #endif  // ZSIM_H_
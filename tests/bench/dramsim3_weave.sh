@@ -0,0 +1,40 @@
+#!/bin/bash
+# Weave-phase cost of one DRAMSim3Memory controller (DDR4_8Gb_x8_2400 at
+# 3.2 GHz by default), with dramsim3bench. Each case issues <requests> of
+# <lines> 64B lines, one every <gap> cycles, <writes>% of them writes.
+# Large gaps model low-MPKI workloads, where the controller is mostly idle;
+# small ones saturate it, so requests queue up waiting for DRAMSim3 to
+# accept them and many transactions are inflight at once. Each case is then
+# rerun on an MD1Memory with the same peak bandwidth (19200 MB/s), to compare
+# the cost per request of the analytic model.
+#
+# Usage: dramsim3_weave.sh <dramsim3bench binary> [DRAMSim3 ini]
+
+set -e
+BENCH=$1
+DIR=$(cd "$(dirname "$0")" && pwd)
+INI=${2:-$DIR/../../lib/dramsim3/configs/DDR4_8Gb_x8_2400.ini}
+WORK=$(mktemp -d)
+trap 'rm -rf $WORK' EXIT
+
+if [ -z "$BENCH" ]; then echo "Usage: $0 <dramsim3bench binary> [DRAMSim3 ini]"; exit 1; fi
+
+# requests lines gap writes
+CASES="
+2000 1 20000 0
+20000 1 200 0
+500 64 2000 0
+20000 1 4 0
+20000 1 4 30
+100000 1 4 0
+3000 16 100 0
+"
+
+echo "$CASES" | while read requests lines gap writes; do
+    [ -z "$requests" ] && continue
+    (cd $WORK && "$BENCH" -l $lines -w $writes -o $WORK "$INI" $requests $gap 2>&1 | tail -1)
+done
+echo "$CASES" | while read requests lines gap writes; do
+    [ -z "$requests" ] && continue
+    "$BENCH" -l $lines -w $writes -m 19200 "$INI" $requests $gap 2>&1 | tail -1
+done
@@ -0,0 +1,45 @@
+#!/usr/bin/env python3
+# Writes a synthetic memory controller trace (MemTraceHeader + MemTraceRecords,
+# see src/mem_trace.h) for mcsim-based benchmarks: line addresses drawn from a
+# skewed (power-law) distribution over a footprint of 4 KB pages, with sequential runs
+# of lines within each page, and a fraction of writebacks.
+#
+# Usage: gen_memtrace.py <out> [records] [footprintMB] [writeFrac] [seed]
+
+import random
+import struct
+import sys
+
+if len(sys.argv) < 2:
+    sys.exit("usage: gen_memtrace.py <out> [records] [footprintMB] [writeFrac] [seed]")
+out = sys.argv[1]
+records = int(sys.argv[2]) if len(sys.argv) > 2 else 4000000
+footprintMB = int(sys.argv[3]) if len(sys.argv) > 3 else 8192
+writeFrac = float(sys.argv[4]) if len(sys.argv) > 4 else 0.3
+rng = random.Random(int(sys.argv[5]) if len(sys.argv) > 5 else 1)
+
+pages = footprintMB * 256
+# Hot pages are spread over the footprint by a fixed permutation of page ranks
+perm_mult = 2654435761  # odd, so rank -> page is a bijection mod 2^k
+header = struct.pack("<8sII", b"ZSMEMTR\0", 1, 24)
+rec = struct.Struct("<QQIBBH")
+
+with open(out, "wb") as f:
+    f.write(header)
+    buf = bytearray()
+    n = 0
+    cycle = 0
+    while n < records:
+        rank = int(rng.random() ** 4 * pages)
+        page = (rank * perm_mult) % pages
+        line = rng.randrange(64)
+        for _ in range(min(rng.randrange(1, 9), records - n)):
+            isWrite = rng.random() < writeFrac
+            buf += rec.pack(page * 64 + line, cycle, n % 16, 1 if isWrite else 0, 0, 0)
+            line = (line + 1) % 64
+            cycle += 10
+            n += 1
+        if len(buf) > (1 << 20):
+            f.write(buf)
+            buf = bytearray()
+    f.write(buf)
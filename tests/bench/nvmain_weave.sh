@@ -0,0 +1,34 @@
+#!/bin/bash
+# Weave-phase cost of one NVMainMemory controller (PCM_ISSCC_2012_4GB at
+# 3.2 GHz by default), with nvmainbench. Each case issues <requests> of
+# <lines> 64B lines, one every <gap> cycles, <writes>% of them writes, and
+# runs twice: ticking NVMain only on its events (the default) and on every
+# cycle (-e). Both runs must report the same completions hash.
+#
+# Usage: nvmain_weave.sh <nvmainbench binary> [NVMain config]
+
+set -e
+BENCH=$1
+DIR=$(cd "$(dirname "$0")" && pwd)
+CONFIG=${2:-$DIR/../../lib/nvmain/Config/PCM_ISSCC_2012_4GB.config}
+WORK=$(mktemp -d)
+trap 'rm -rf $WORK' EXIT
+
+if [ -z "$BENCH" ]; then echo "Usage: $0 <nvmainbench binary> [NVMain config]"; exit 1; fi
+
+# requests lines gap writes
+CASES="
+200 1 20000 0
+2000 1 2000 0
+100 64 20000 0
+5000 1 4 0
+5000 1 4 30
+500 16 100 0
+"
+
+echo "$CASES" | while read requests lines gap writes; do
+    [ -z "$requests" ] && continue
+    for mode in "" "-e"; do
+        (cd $WORK && "$BENCH" $mode -l $lines -w $writes -o $WORK "$CONFIG" $requests $gap 2>&1 | tail -1)
+    done
+done
@@ -0,0 +1,45 @@
+#!/bin/bash
+# Overhead of the memory profiler (sys.mem.profiler) on the bound phase, with
+# mcsim: replay time of a NoCache system with the profiler off, at its default
+# sampling rates, and at denser rates. Each time is the best of <runs>, and
+# the overhead is relative to the run without the profiler.
+#
+# Usage: profiler_overhead.sh <mcsim binary> [trace] [runs]
+# Without a trace, a 4M-request synthetic one is generated with gen_memtrace.py.
+
+set -e
+MCSIM=$1
+TRACE=$2
+RUNS=${3:-5}
+DIR=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf $WORK' EXIT
+
+if [ -z "$MCSIM" ]; then echo "Usage: $0 <mcsim binary> [trace] [runs]"; exit 1; fi
+if [ -z "$TRACE" ]; then
+    TRACE=$WORK/trace.bin
+    python3 "$DIR/gen_memtrace.py" "$TRACE" 4000000
+fi
+
+# name|profiler settings
+CASES="
+off|enable = false;
+default|enable = true;
+pages-1/16|enable = true; pageSampleShift = 4;
+lines+pages-1/2^24|enable = true; sampleShift = 24; pageSampleShift = 24;
+lines-1/64|enable = true; sampleShift = 6; pageSampleShift = 6;
+"
+
+printf "%-12s %10s %10s\n" "profiler" "time (s)" "overhead"
+base=""
+echo "$CASES" | while IFS='|' read name settings; do
+    [ -z "$name" ] && continue
+    sed "s/@PROFILER@/$settings/" "$DIR/mem_profiler.cfg.in" > $WORK/mem.cfg
+    best=""
+    for r in $(seq $RUNS); do
+        t=$(cd $WORK && "$MCSIM" -o $WORK/mcsim.out $WORK/mem.cfg "$TRACE" 2>&1 | sed -n 's/.* in \([0-9.]*\) s:.*/\1/p')
+        if [ -z "$best" ] || awk "BEGIN { exit !($t < $best) }"; then best=$t; fi
+    done
+    [ -z "$base" ] && base=$best
+    printf "%-12s %10s %9.1f%%\n" "$name" "$best" "$(awk "BEGIN { print 100 * ($best - $base) / $base }")"
+done
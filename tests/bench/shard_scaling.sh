@@ -0,0 +1,54 @@
+#!/bin/bash
+# Bound-phase throughput of the sharded DRAM cache front end (sys.mem.shards)
+# against the number of replay threads, with mcsim, for each cache scheme.
+# Each thread replays interleaved blocks of the same trace, so all threads
+# contend on the controller like cores missing in the LLC would. Schemes that
+# refuse a shard count (e.g., fully associative ones) print "unsupported" and
+# the reason instead of rates.
+#
+# Usage: shard_scaling.sh <mcsim binary> [trace] ["shard counts"] ["thread counts"] ["schemes"]
+# Without a trace, a 4M-request synthetic one is generated with gen_memtrace.py.
+
+set -e
+MCSIM=$1
+TRACE=$2
+SHARDS=${3:-"1 2 4 8 16"}
+THREADS=${4:-"1 2 4 8 16"}
+SCHEMES=${5:-"AlloyCache BansheeCache UnisonCache NDC CHAMO IdealBalanced IdealAssociative IdealFully"}
+DIR=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf $WORK' EXIT
+
+if [ -z "$MCSIM" ]; then echo "Usage: $0 <mcsim binary> [trace] [\"shard counts\"] [\"thread counts\"] [\"schemes\"]"; exit 1; fi
+if [ -z "$TRACE" ]; then
+    TRACE=$WORK/trace.bin
+    python3 "$DIR/gen_memtrace.py" "$TRACE" 4000000
+fi
+
+for scheme in $SCHEMES; do
+    case $scheme in
+        BansheeCache|UnisonCache) geom="4096 4";;  # page-granularity, 4-way
+        IdealAssociative) geom="64 16";;
+        IdealBalanced|IdealFully) geom="64 0";;  # fully associative
+        *) geom="64 1";;
+    esac
+    read gran ways <<< "$geom"
+    printf "%-18s%-8s" "$scheme" "shards"
+    for t in $THREADS; do printf "%12s" "t=$t"; done
+    printf "   (Mreq/s)\n"
+    for s in $SHARDS; do
+        sed -e "s/@SCHEME@/$scheme/" -e "s/@SHARDS@/$s/" -e "s/@GRANULARITY@/$gran/" -e "s/@WAYS@/$ways/" \
+            "$DIR/mem_shards.cfg.in" > $WORK/mem.cfg
+        printf "%-18s%-8s" "" "$s"
+        for t in $THREADS; do
+            if ! (cd $WORK && "$MCSIM" -t $t -o $WORK/mcsim.out $WORK/mem.cfg "$TRACE") > $WORK/log 2>&1; then
+                # A panic does not depend on the thread count, so report it once
+                why=$(grep -m1 -o 'Panic on .*\|Failed assertion.*' $WORK/log | sed 's/^Panic on [^ ]* //')
+                printf "  unsupported: %s" "${why:-mcsim failed}"
+                break
+            fi
+            printf "%12s" "$(sed -n 's/.* s: \([0-9.]*\) Mreq\/s.*/\1/p' $WORK/log)"
+        done
+        printf "\n"
+    done
+done
@@ -0,0 +1,40 @@
+#!/bin/bash
+# Weave phase time against the number of weave threads (sim.contentionThreads)
+# on 16 cores with an AlloyCache (weave_dramcache16.cfg.in), with zreplay,
+# for each domain scheduler: the fixed ranges (the default), balancing by cost
+# (sim.contentionBalance), and balancing plus stealing (sim.contentionStealing).
+# Reports the weave time from zsim.out, in seconds, and the total replay time.
+#
+# Usage: weave_scaling.sh <zreplay binary> <trace dir> ["domain counts"] ["thread counts"]
+# The trace dir holds the instruction traces to replay (instrtrace-*.bin), e.g.
+# from itracetest -g <dir> 16 40000 2. Thread counts above the domain count
+# are skipped.
+
+set -e
+ZREPLAY=$1
+TRACES=$2
+DOMAINS=${3:-"16"}
+THREADS=${4:-"1 2 4 8 16"}
+DIR=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf $WORK' EXIT
+
+if [ -z "$ZREPLAY" ] || [ ! -d "$TRACES" ]; then
+    echo "Usage: $0 <zreplay binary> <trace dir> [\"domain counts\"] [\"thread counts\"]"; exit 1
+fi
+
+printf "%-8s%-8s%-10s%12s%12s\n" "domains" "threads" "sched" "weave (s)" "total (s)"
+for d in $DOMAINS; do
+    for t in $THREADS; do
+        if [ $t -gt $d ]; then continue; fi
+        for sched in fixed balance steal; do
+            b=$([ $sched != fixed ] && echo true || echo false)
+            s=$([ $sched = steal ] && echo true || echo false)
+            sed "s/@DOMAINS@/$d/; s/@THREADS@/$t/; s/@BALANCE@/$b/; s/@STEALING@/$s/" "$DIR/weave_dramcache16.cfg.in" > $WORK/weave.cfg
+            rm -rf $WORK/out && mkdir $WORK/out
+            total=$(cd $WORK && "$ZREPLAY" -o $WORK/out $WORK/weave.cfg "$TRACES"/instrtrace-*.bin 2>&1 | sed -n 's/.*Replayed .* in \([0-9.]*\) s.*/\1/p')
+            weave=$(cat $WORK/out/*/zsim.out | sed -n 's/^ *weave: \([0-9]*\).*/\1/p' | tail -1)
+            printf "%-8s%-8s%-10s%12s%12s\n" $d $t $sched "$(awk "BEGIN {printf \"%.3f\", $weave/1e9}")" "$total"
+        done
+    done
+done
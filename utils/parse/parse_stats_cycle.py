@@ -11,6 +11,8 @@ import h5py
 import numpy as np
 import argparse
 
+from zcs import periodic_output_file, read_periods
+
 # Add imports for plotting and efficient numerical operations
 try:
     import matplotlib.pyplot as plt
@@ -52,6 +54,8 @@ def parse_zsim_output(file_path: str, use_h5: bool = False) -> List[Dict[str, An
                 result = parse_zsim_h5(file_path)
         else:
             result = parse_zsim_h5(file_path)
+    elif file_path.endswith('.zcs'):
+        result = read_periods(file_path)
     else:
         result = parse_zsim_text(file_path)
     
@@ -1143,7 +1147,7 @@ def main():
     if use_h5:
         zsim_file = os.path.join(zsim_dir, "zsim.h5")
     else:
-        zsim_file = os.path.join(zsim_dir, "zsim-pout.out")
+        zsim_file = periodic_output_file(zsim_dir)
     
     # If custom path is provided but stat_type isn't 'custom', warn user
     if custom_path and stat_type != 'custom':
@@ -1158,7 +1162,7 @@ def main():
     if stat_type == 'custom':
         print(f"Calculating CUSTOM stat for {zsim_dir}...")
         if not os.path.exists(zsim_file):
-            print(f"Error: zsim-pout.out not found in directory {zsim_dir}")
+            print(f"Error: {os.path.basename(zsim_file)} not found in directory {zsim_dir}")
             sys.exit(1)
         data = parse_zsim_output(zsim_file, use_h5=use_h5)
         debug_print(f"Looking up values for path: {custom_path}")
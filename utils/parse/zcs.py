@@ -0,0 +1,56 @@
+"""Reads zsim periodic output, shared by the parse_stats_* scripts.
+
+Periodic output is written in columnar form (zsim-pout.zcs) by default, or
+as text (zsim-pout.out) with sim.periodicOutputFormat = "text". Columnar
+files are read through zcsread, taken from $ZCSREAD or build/opt/zcsread,
+which decodes only the columns asked for; nothing is written next to the
+stats file.
+"""
+
+import os
+import subprocess
+from typing import Any, Dict, List
+
+
+def periodic_output_file(zsim_dir: str) -> str:
+    """Path to the periodic output of a run: zsim-pout.zcs if it exists, else zsim-pout.out."""
+    zcs_file = os.path.join(zsim_dir, "zsim-pout.zcs")
+    if os.path.exists(zcs_file):
+        return zcs_file
+    return os.path.join(zsim_dir, "zsim-pout.out")
+
+
+def zcsread_path() -> str:
+    script_dir = os.path.dirname(os.path.abspath(__file__))
+    return os.environ.get("ZCSREAD", os.path.join(script_dir, "..", "..", "build", "opt", "zcsread"))
+
+
+def read_series(zcs_file: str, regex: str = ".*") -> Dict[str, List[int]]:
+    """Values per row of the columns whose dot-separated names (e.g.,
+    root.mem.mem-0.rd) fully match regex."""
+    out = subprocess.run([zcsread_path(), zcs_file, "-s", regex], stdout=subprocess.PIPE,
+                         check=True, universal_newlines=True).stdout
+    lines = out.splitlines()
+    names = lines[0].split("\t")[1:]  # the first column is the row number
+    series = {name: [] for name in names}
+    for line in lines[1:]:
+        vals = line.split("\t")[1:]
+        for name, val in zip(names, vals):
+            series[name].append(int(val))
+    return series
+
+
+def read_periods(zcs_file: str, regex: str = ".*") -> List[Dict[str, Any]]:
+    """The rows of a columnar file as period dictionaries, nested as when
+    parsing zsim-pout.out (vector elements are keyed by counter name or index)."""
+    series = read_series(zcs_file, regex)
+    rows = len(next(iter(series.values()))) if series else 0
+    periods = [{} for _ in range(rows)]
+    for name, vals in series.items():
+        path = name.split(".")
+        for period, val in zip(periods, vals):
+            cur = period
+            for p in path[:-1]:
+                cur = cur.setdefault(p, {})
+            cur[path[-1]] = val
+    return periods